@@ -0,0 +1,63 @@
+/**
+ * @file address.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief A Bluetooth device address independent of the BLE host stack.
+ */
+#include "address.h"
+
+#include <cstdio>
+#include <cstring>
+
+DeviceAddress::DeviceAddress() { memset(bytes, 0, sizeof(bytes)); }
+
+DeviceAddress::DeviceAddress(const uint8_t* pAddress) {
+    memcpy(bytes, pAddress, sizeof(bytes));
+}
+
+DeviceAddress::DeviceAddress(const std::string& address) {
+    memset(bytes, 0, sizeof(bytes));
+    if (address.size() != 3 * kLength - 1) {
+        return;
+    }
+    uint8_t parsed[kLength];
+    for (size_t i = 0; i < kLength; ++i) {
+        uint8_t byte = 0;
+        for (size_t j = 0; j < 2; ++j) {
+            char c = address[3 * i + j];
+            byte <<= 4;
+            if ((c >= '0') && (c <= '9')) {
+                byte |= c - '0';
+            } else if ((c >= 'a') && (c <= 'f')) {
+                byte |= c - 'a' + 10;
+            } else if ((c >= 'A') && (c <= 'F')) {
+                byte |= c - 'A' + 10;
+            } else {
+                return;
+            }
+        }
+        if ((i + 1 < kLength) && (address[3 * i + 2] != ':')) {
+            return;
+        }
+        parsed[i] = byte;
+    }
+    memcpy(bytes, parsed, sizeof(bytes));
+}
+
+const uint8_t* DeviceAddress::GetNative() const { return bytes; }
+
+std::string DeviceAddress::ToString() const {
+    char result[3 * kLength];
+    snprintf(result, sizeof(result), "%02x:%02x:%02x:%02x:%02x:%02x",
+             bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5]);
+    return result;
+}
+
+bool DeviceAddress::IsZero() const { return *this == DeviceAddress(); }
+
+bool DeviceAddress::operator==(const DeviceAddress& other) const {
+    return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+}
+
+bool DeviceAddress::operator!=(const DeviceAddress& other) const {
+    return !(*this == other);
+}
@@ -0,0 +1,43 @@
+/**
+ * @file address.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief A Bluetooth device address independent of the BLE host stack.
+ */
+#ifndef BLUETOOTHGATEWAY_ADDRESS_H_
+#define BLUETOOTHGATEWAY_ADDRESS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+/**
+ * @brief The 6 bytes address, most significant first as printed.
+ * @details The string form is `aa:bb:cc:dd:ee:ff` in lowercase, the same
+ * as the BLEAddress of Bluedroid, so the addresses stored in NVS and the
+ * MQTT names do not change with the host stack.
+ */
+class DeviceAddress {
+   public:
+    static const size_t kLength = 6;
+    /**
+     * @brief The zero address of an empty slot.
+     */
+    DeviceAddress();
+    explicit DeviceAddress(const uint8_t* pAddress);
+    /**
+     * @brief Parse `aa:bb:cc:dd:ee:ff` in either case.
+     * @details An invalid string gives the zero address.
+     */
+    explicit DeviceAddress(const std::string& address);
+    const uint8_t* GetNative() const;
+    std::string ToString() const;
+    bool IsZero() const;
+    bool operator==(const DeviceAddress& other) const;
+    bool operator!=(const DeviceAddress& other) const;
+
+   private:
+    uint8_t bytes[kLength];
+};
+
+#endif
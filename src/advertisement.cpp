@@ -0,0 +1,285 @@
+/**
+ * @file advertisement.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Decoders of the broadcast formats of third-party sensors.
+ */
+#include "advertisement.h"
+
+/**
+ * @brief Append a sample if the raw value is decoded.
+ */
+static size_t AppendSample(const CharacteristicDescriptor& characteristic,
+                           RawDecoder decode, float scale,
+                           const uint8_t* pData, size_t length,
+                           AdvertisementSample* pSamples, size_t num,
+                           size_t max_num) {
+    int32_t raw = 0;
+    if ((num >= max_num) || !decode(pData, length, raw)) {
+        return num;
+    }
+    pSamples[num].pCharacteristic = &characteristic;
+    pSamples[num].value = raw * scale;
+    return num + 1;
+}
+
+static bool DecodeSInt16BE(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 2) {
+        return false;
+    }
+    raw = static_cast<int16_t>((pData[0] << 8) | pData[1]);
+    return true;
+}
+
+static bool DecodeUInt16BE(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 2) {
+        return false;
+    }
+    raw = static_cast<uint16_t>((pData[0] << 8) | pData[1]);
+    return true;
+}
+
+size_t DecodeATC(const uint8_t* pData, size_t length,
+                 AdvertisementSample* pSamples, size_t max_num) {
+    size_t num = 0;
+    if (length == 13) {
+        // MAC(6) + temperature(2, BE, 0.1) + humidity(1) + battery(1)
+        // + battery mV(2, BE) + frame counter(1)
+        num = AppendSample(kTemperatureCharacteristic, DecodeSInt16BE, 0.1F,
+                           pData + 6, 2, pSamples, num, max_num);
+        num = AppendSample(kHumidityCharacteristic, DecodeUInt8, 1.0F,
+                           pData + 8, 1, pSamples, num, max_num);
+        num = AppendSample(kBatteryLevelCharacteristic, DecodeUInt8, 1.0F,
+                           pData + 9, 1, pSamples, num, max_num);
+        num = AppendSample(kVoltageCharacteristic, DecodeUInt16BE, 0.001F,
+                           pData + 10, 2, pSamples, num, max_num);
+    } else if (length == 15) {
+        // MAC(6) + temperature(2, 0.01) + humidity(2, 0.01) + battery mV(2)
+        // + battery(1) + frame counter(1) + flags(1)
+        num = AppendSample(kTemperatureCharacteristic, DecodeSInt16, 0.01F,
+                           pData + 6, 2, pSamples, num, max_num);
+        num = AppendSample(kHumidityCharacteristic, DecodeUInt16, 0.01F,
+                           pData + 8, 2, pSamples, num, max_num);
+        num = AppendSample(kVoltageCharacteristic, DecodeUInt16, 0.001F,
+                           pData + 10, 2, pSamples, num, max_num);
+        num = AppendSample(kBatteryLevelCharacteristic, DecodeUInt8, 1.0F,
+                           pData + 12, 1, pSamples, num, max_num);
+    }
+    return num;
+}
+
+/**
+ * @brief Describe a BTHome v2 object.
+ * @details The size is 0 if the object id is unknown. The object is skipped
+ * if pCharacteristic is nullptr.
+ */
+struct BTHomeObject {
+    uint8_t size;
+    RawDecoder decode;
+    float scale;
+    const CharacteristicDescriptor* pCharacteristic;
+};
+
+/**
+ * @brief The size of text and raw objects is given by their first byte.
+ */
+const uint8_t kLengthPrefixed = 0xFF;
+
+/**
+ * @brief BTHome v2 objects indexed by object id.
+ */
+constexpr BTHomeObject kBTHomeObjects[] = {
+    {1, nullptr, 0.0F, nullptr},  // 0x00
+    {1, DecodeUInt8, 1.0F, &kBatteryLevelCharacteristic},  // 0x01
+    {2, DecodeSInt16, 0.01F, &kTemperatureCharacteristic},  // 0x02
+    {2, DecodeUInt16, 0.01F, &kHumidityCharacteristic},  // 0x03
+    {3, DecodeUInt24, 0.01F, &kPressureCharacteristic},  // 0x04
+    {3, DecodeUInt24, 0.01F, &kIlluminanceCharacteristic},  // 0x05
+    {2, nullptr, 0.0F, nullptr},  // 0x06
+    {2, nullptr, 0.0F, nullptr},  // 0x07
+    {2, DecodeSInt16, 0.01F, &kDewPointCharacteristic},  // 0x08
+    {1, nullptr, 0.0F, nullptr},  // 0x09
+    {3, nullptr, 0.0F, nullptr},  // 0x0A
+    {3, nullptr, 0.0F, nullptr},  // 0x0B
+    {2, DecodeUInt16, 0.001F, &kVoltageCharacteristic},  // 0x0C
+    {2, nullptr, 0.0F, nullptr},  // 0x0D
+    {2, nullptr, 0.0F, nullptr},  // 0x0E
+    {1, nullptr, 0.0F, nullptr},  // 0x0F
+    {1, nullptr, 0.0F, nullptr},  // 0x10
+    {1, nullptr, 0.0F, nullptr},  // 0x11
+    {2, DecodeUInt16, 1.0F, &kCO2ConcentrationCharacteristic},  // 0x12
+    {2, nullptr, 0.0F, nullptr},  // 0x13
+    {2, nullptr, 0.0F, nullptr},  // 0x14
+    {1, nullptr, 0.0F, nullptr},  // 0x15
+    {1, nullptr, 0.0F, nullptr},  // 0x16
+    {1, nullptr, 0.0F, nullptr},  // 0x17
+    {1, nullptr, 0.0F, nullptr},  // 0x18
+    {1, nullptr, 0.0F, nullptr},  // 0x19
+    {1, nullptr, 0.0F, nullptr},  // 0x1A
+    {1, nullptr, 0.0F, nullptr},  // 0x1B
+    {1, nullptr, 0.0F, nullptr},  // 0x1C
+    {1, nullptr, 0.0F, nullptr},  // 0x1D
+    {1, nullptr, 0.0F, nullptr},  // 0x1E
+    {1, nullptr, 0.0F, nullptr},  // 0x1F
+    {1, nullptr, 0.0F, nullptr},  // 0x20
+    {1, nullptr, 0.0F, nullptr},  // 0x21
+    {1, nullptr, 0.0F, nullptr},  // 0x22
+    {1, nullptr, 0.0F, nullptr},  // 0x23
+    {1, nullptr, 0.0F, nullptr},  // 0x24
+    {1, nullptr, 0.0F, nullptr},  // 0x25
+    {1, nullptr, 0.0F, nullptr},  // 0x26
+    {1, nullptr, 0.0F, nullptr},  // 0x27
+    {1, nullptr, 0.0F, nullptr},  // 0x28
+    {1, nullptr, 0.0F, nullptr},  // 0x29
+    {1, nullptr, 0.0F, nullptr},  // 0x2A
+    {1, nullptr, 0.0F, nullptr},  // 0x2B
+    {1, nullptr, 0.0F, nullptr},  // 0x2C
+    {1, nullptr, 0.0F, nullptr},  // 0x2D
+    {1, DecodeUInt8, 1.0F, &kHumidityCharacteristic},  // 0x2E
+    {1, nullptr, 0.0F, nullptr},  // 0x2F
+    {0, nullptr, 0.0F, nullptr},  // 0x30
+    {0, nullptr, 0.0F, nullptr},  // 0x31
+    {0, nullptr, 0.0F, nullptr},  // 0x32
+    {0, nullptr, 0.0F, nullptr},  // 0x33
+    {0, nullptr, 0.0F, nullptr},  // 0x34
+    {0, nullptr, 0.0F, nullptr},  // 0x35
+    {0, nullptr, 0.0F, nullptr},  // 0x36
+    {0, nullptr, 0.0F, nullptr},  // 0x37
+    {0, nullptr, 0.0F, nullptr},  // 0x38
+    {0, nullptr, 0.0F, nullptr},  // 0x39
+    {1, nullptr, 0.0F, nullptr},  // 0x3A
+    {0, nullptr, 0.0F, nullptr},  // 0x3B
+    {2, nullptr, 0.0F, nullptr},  // 0x3C
+    {2, nullptr, 0.0F, nullptr},  // 0x3D
+    {4, nullptr, 0.0F, nullptr},  // 0x3E
+    {2, nullptr, 0.0F, nullptr},  // 0x3F
+    {2, nullptr, 0.0F, nullptr},  // 0x40
+    {2, nullptr, 0.0F, nullptr},  // 0x41
+    {3, nullptr, 0.0F, nullptr},  // 0x42
+    {2, nullptr, 0.0F, nullptr},  // 0x43
+    {2, nullptr, 0.0F, nullptr},  // 0x44
+    {2, DecodeSInt16, 0.1F, &kTemperatureCharacteristic},  // 0x45
+    {1, DecodeUInt8, 0.1F, &kUVIndexCharacteristic},  // 0x46
+    {2, nullptr, 0.0F, nullptr},  // 0x47
+    {2, nullptr, 0.0F, nullptr},  // 0x48
+    {2, nullptr, 0.0F, nullptr},  // 0x49
+    {2, DecodeUInt16, 0.1F, &kVoltageCharacteristic},  // 0x4A
+    {3, nullptr, 0.0F, nullptr},  // 0x4B
+    {4, nullptr, 0.0F, nullptr},  // 0x4C
+    {4, nullptr, 0.0F, nullptr},  // 0x4D
+    {4, nullptr, 0.0F, nullptr},  // 0x4E
+    {4, nullptr, 0.0F, nullptr},  // 0x4F
+    {4, nullptr, 0.0F, nullptr},  // 0x50
+    {2, nullptr, 0.0F, nullptr},  // 0x51
+    {2, nullptr, 0.0F, nullptr},  // 0x52
+    {kLengthPrefixed, nullptr, 0.0F, nullptr},  // 0x53
+    {kLengthPrefixed, nullptr, 0.0F, nullptr},  // 0x54
+    {4, nullptr, 0.0F, nullptr},  // 0x55
+    {2, nullptr, 0.0F, nullptr},  // 0x56
+    {1, DecodeSInt8, 1.0F, &kTemperatureCharacteristic},  // 0x57
+    {1, DecodeSInt8, 0.35F, &kTemperatureCharacteristic},  // 0x58
+    {1, nullptr, 0.0F, nullptr},  // 0x59
+    {2, nullptr, 0.0F, nullptr},  // 0x5A
+    {4, nullptr, 0.0F, nullptr},  // 0x5B
+    {4, nullptr, 0.0F, nullptr},  // 0x5C
+    {2, nullptr, 0.0F, nullptr},  // 0x5D
+    {2, nullptr, 0.0F, nullptr},  // 0x5E
+    {2, DecodeUInt16, 0.1F, &kRainfallCharacteristic},  // 0x5F
+    {1, nullptr, 0.0F, nullptr},  // 0x60
+};
+const size_t kBTHomeObjectNum =
+    sizeof(kBTHomeObjects) / sizeof(kBTHomeObjects[0]);
+
+size_t DecodeBTHome(const uint8_t* pData, size_t length,
+                    AdvertisementSample* pSamples, size_t max_num) {
+    if (length < 1) {
+        return 0;
+    }
+    uint8_t device_info = pData[0];
+    if ((device_info & 0x01) || ((device_info >> 5) != 2)) {
+        return 0;  // Encrypted or not BTHome v2.
+    }
+    size_t num = 0;
+    size_t cursor = 1;
+    while (cursor < length) {
+        uint8_t object_id = pData[cursor];
+        ++cursor;
+        if (object_id >= kBTHomeObjectNum) {
+            break;
+        }
+        const BTHomeObject& object = kBTHomeObjects[object_id];
+        size_t size = object.size;
+        if (size == kLengthPrefixed) {
+            if (cursor >= length) {
+                break;
+            }
+            size = pData[cursor] + 1;
+        }
+        if ((size == 0) || (cursor + size > length)) {
+            break;
+        }
+        if (object.pCharacteristic != nullptr) {
+            num = AppendSample(*object.pCharacteristic, object.decode,
+                               object.scale, pData + cursor, size, pSamples,
+                               num, max_num);
+        }
+        cursor += size;
+    }
+    return num;
+}
+
+/**
+ * @brief Built-in broadcast formats.
+ */
+constexpr AdvertisementFormat kAdvertisementFormats[] = {
+    {AdvertisementDataType::ServiceData, 0x181A, "atc", DecodeATC},
+    {AdvertisementDataType::ServiceData, 0xFCD2, "bthome", DecodeBTHome},
+};
+
+const AdvertisementFormat* FindAdvertisementFormat(
+    AdvertisementDataType data_type, uint16_t id) {
+    for (const AdvertisementFormat& format : kAdvertisementFormats) {
+        if ((format.data_type == data_type) && (format.id == id)) {
+            return &format;
+        }
+    }
+    return nullptr;
+}
+
+size_t DecodeAdvertisingPayload(const uint8_t* pPayload, size_t length,
+                                AdvertisementSample* pSamples,
+                                size_t max_num) {
+    size_t num = 0;
+    size_t cursor = 0;
+    // Each AD structure is length(1) + AD type(1) + data(length - 1).
+    while (cursor + 1 < length) {
+        size_t structure_length = pPayload[cursor];
+        if ((structure_length == 0) ||
+            (cursor + 1 + structure_length > length)) {
+            break;
+        }
+        uint8_t ad_type = pPayload[cursor + 1];
+        const uint8_t* pData = pPayload + cursor + 2;
+        size_t data_length = structure_length - 1;
+        cursor += 1 + structure_length;
+        AdvertisementDataType data_type;
+        if (ad_type == 0x16) {
+            data_type = AdvertisementDataType::ServiceData;
+        } else if (ad_type == 0xFF) {
+            data_type = AdvertisementDataType::ManufacturerData;
+        } else {
+            continue;
+        }
+        if (data_length < 2) {
+            continue;
+        }
+        uint16_t id = pData[0] | (pData[1] << 8);
+        const AdvertisementFormat* pFormat =
+            FindAdvertisementFormat(data_type, id);
+        if (pFormat == nullptr) {
+            continue;
+        }
+        num += pFormat->decode(pData + 2, data_length - 2, pSamples + num,
+                               max_num - num);
+    }
+    return num;
+}
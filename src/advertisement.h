@@ -0,0 +1,95 @@
+/**
+ * @file advertisement.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Decoders of the broadcast formats of third-party sensors.
+ */
+#ifndef BLUETOOTHGATEWAY_ADVERTISEMENT_H_
+#define BLUETOOTHGATEWAY_ADVERTISEMENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "characteristic.h"
+
+/**
+ * @brief A measurement decoded from an advertisement.
+ */
+struct AdvertisementSample {
+    const CharacteristicDescriptor* pCharacteristic;
+    float value;
+};
+
+/**
+ * @brief Decode the samples in the advertisement data.
+ * @param [in] pData The service data or manufacturer data without its UUID
+ * or company ID.
+ * @param [in] length
+ * @param [out] pSamples
+ * @param [in] max_num The capacity of pSamples.
+ * @return size_t The number of decoded samples.
+ */
+typedef size_t (*AdvertisementDecoder)(const uint8_t* pData, size_t length,
+                                       AdvertisementSample* pSamples,
+                                       size_t max_num);
+
+/**
+ * @brief A enum for the AD type which carries the sensor data.
+ */
+enum class AdvertisementDataType : uint8_t {
+    ServiceData,
+    ManufacturerData,
+};
+
+/**
+ * @brief Describe a broadcast format.
+ * @details The id is the 16-bit service UUID of service data
+ * or the company ID of manufacturer data.
+ */
+struct AdvertisementFormat {
+    AdvertisementDataType data_type;
+    uint16_t id;
+    const char* name;
+    AdvertisementDecoder decode;
+};
+
+/**
+ * @brief Decode the custom format of ATC1441 and pvvx firmware.
+ * @details Service data of UUID 0x181A with 13 bytes (ATC1441)
+ * or 15 bytes (pvvx). The encrypted formats are not supported.
+ */
+size_t DecodeATC(const uint8_t* pData, size_t length,
+                 AdvertisementSample* pSamples, size_t max_num);
+
+/**
+ * @brief Decode the BTHome v2 format.
+ * @details Service data of UUID 0xFCD2. The encrypted format is not
+ * supported. Decoding stops at an unknown object id since its length is
+ * unknown.
+ */
+size_t DecodeBTHome(const uint8_t* pData, size_t length,
+                    AdvertisementSample* pSamples, size_t max_num);
+
+/**
+ * @brief Find the built-in format of the advertisement data.
+ * @param [in] data_type
+ * @param [in] id
+ * @return const AdvertisementFormat* nullptr if not supported.
+ */
+const AdvertisementFormat* FindAdvertisementFormat(
+    AdvertisementDataType data_type, uint16_t id);
+
+/**
+ * @brief Decode the supported AD structures in the advertising payload.
+ * @details The service data and manufacturer data are dispatched to the
+ * format found by FindAdvertisementFormat.
+ * @param [in] pPayload The advertising data followed by scan response.
+ * @param [in] length
+ * @param [out] pSamples
+ * @param [in] max_num The capacity of pSamples.
+ * @return size_t The number of decoded samples.
+ */
+size_t DecodeAdvertisingPayload(const uint8_t* pPayload, size_t length,
+                                AdvertisementSample* pSamples,
+                                size_t max_num);
+
+#endif
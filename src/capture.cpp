@@ -0,0 +1,186 @@
+/**
+ * @file capture.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Binary capture format of BLE traffic and its replay.
+ */
+#include "capture.h"
+
+#include <cstring>
+
+#include "advertisement.h"
+#include "characteristic.h"
+
+static const size_t kRecordHeaderLength = 11;  // type, time and address
+static const size_t kMaxSampleNum = 16;
+
+CaptureWriter::CaptureWriter(uint8_t* pBuffer, size_t capacity)
+    : pBuffer(pBuffer), capacity(capacity), length(0) {}
+
+bool CaptureWriter::WriteRecord(const CaptureRecordType& type, uint32_t time,
+                                const uint8_t* pAddress, const uint8_t* pHead,
+                                size_t head_length, const uint8_t* pBody,
+                                size_t body_length) {
+    size_t record_length = kRecordHeaderLength + head_length + body_length;
+    if (record_length > capacity - length) {
+        return false;
+    }
+    uint8_t* pRecord = pBuffer + length;
+    pRecord[0] = static_cast<uint8_t>(type);
+    pRecord[1] = time;
+    pRecord[2] = time >> 8;
+    pRecord[3] = time >> 16;
+    pRecord[4] = time >> 24;
+    memcpy(pRecord + 5, pAddress, 6);
+    memcpy(pRecord + kRecordHeaderLength, pHead, head_length);
+    if (body_length > 0) {
+        memcpy(pRecord + kRecordHeaderLength + head_length, pBody,
+               body_length);
+    }
+    length += record_length;
+    return true;
+}
+
+bool CaptureWriter::WriteAdvertisement(uint32_t time, const uint8_t* pAddress,
+                                       int rssi, const uint8_t* pPayload,
+                                       size_t length) {
+    if (length > 0xFF) {
+        return false;
+    }
+    uint8_t head[2] = {static_cast<uint8_t>(static_cast<int8_t>(rssi)),
+                       static_cast<uint8_t>(length)};
+    return WriteRecord(CaptureRecordType::Advertisement, time, pAddress, head,
+                       sizeof(head), pPayload, length);
+}
+
+bool CaptureWriter::WriteNotification(uint32_t time, const uint8_t* pAddress,
+                                      uint16_t uuid, const uint8_t* pData,
+                                      size_t length) {
+    if (length > 0xFFFF) {
+        return false;
+    }
+    uint8_t head[4] = {static_cast<uint8_t>(uuid),
+                       static_cast<uint8_t>(uuid >> 8),
+                       static_cast<uint8_t>(length),
+                       static_cast<uint8_t>(length >> 8)};
+    return WriteRecord(CaptureRecordType::Notification, time, pAddress, head,
+                       sizeof(head), pData, length);
+}
+
+bool CaptureWriter::WriteConnection(uint32_t time, const uint8_t* pAddress,
+                                    bool is_connected) {
+    return WriteRecord(is_connected ? CaptureRecordType::Connect
+                                    : CaptureRecordType::Disconnect,
+                       time, pAddress, nullptr, 0, nullptr, 0);
+}
+
+size_t CaptureWriter::GetLength() const { return length; }
+
+const uint8_t* CaptureWriter::GetData() const { return pBuffer; }
+
+void CaptureWriter::Clear() { length = 0; }
+
+size_t ReplayCapture(const uint8_t* pData, size_t length,
+                     CaptureReplayCallbacks* pCallbacks) {
+    size_t record_num = 0;
+    size_t offset = 0;
+    while (length - offset >= kRecordHeaderLength) {
+        const uint8_t* pRecord = pData + offset;
+        uint32_t time = static_cast<uint32_t>(pRecord[1]) |
+                        (static_cast<uint32_t>(pRecord[2]) << 8) |
+                        (static_cast<uint32_t>(pRecord[3]) << 16) |
+                        (static_cast<uint32_t>(pRecord[4]) << 24);
+        const uint8_t* pAddress = pRecord + 5;
+        const uint8_t* pBody = pRecord + kRecordHeaderLength;
+        size_t remaining = length - offset - kRecordHeaderLength;
+        size_t body_length = 0;
+        switch (static_cast<CaptureRecordType>(pRecord[0])) {
+            case CaptureRecordType::Advertisement: {
+                if ((remaining < 2) || (remaining - 2 < pBody[1])) {
+                    return record_num;
+                }
+                body_length = 2 + pBody[1];
+                pCallbacks->onAdvertisement(time, pAddress,
+                                            static_cast<int8_t>(pBody[0]),
+                                            pBody + 2, pBody[1]);
+                break;
+            }
+            case CaptureRecordType::Notification: {
+                if (remaining < 4) {
+                    return record_num;
+                }
+                uint16_t uuid = pBody[0] | (pBody[1] << 8);
+                size_t value_length = pBody[2] | (pBody[3] << 8);
+                if (remaining - 4 < value_length) {
+                    return record_num;
+                }
+                body_length = 4 + value_length;
+                pCallbacks->onNotification(time, pAddress, uuid, pBody + 4,
+                                           value_length);
+                break;
+            }
+            case CaptureRecordType::Connect:
+            case CaptureRecordType::Disconnect:
+                pCallbacks->onConnection(
+                    time, pAddress,
+                    pRecord[0] ==
+                        static_cast<uint8_t>(CaptureRecordType::Connect));
+                break;
+            default:
+                return record_num;  // Unknown type, length unknown.
+        }
+        offset += kRecordHeaderLength + body_length;
+        ++record_num;
+    }
+    return record_num;
+}
+
+CapturePipeline::CapturePipeline(const uint8_t (*pAcceptList)[6],
+                                 size_t accept_num)
+    : pAcceptList(pAcceptList),
+      accept_num(accept_num),
+      record_num(0),
+      filtered_num(0),
+      sample_num(0) {}
+
+bool CapturePipeline::IsAccepted(const uint8_t* pAddress) const {
+    if (pAcceptList == nullptr) {
+        return true;
+    }
+    for (size_t i = 0; i < accept_num; ++i) {
+        if (memcmp(pAcceptList[i], pAddress, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CapturePipeline::onAdvertisement(uint32_t time, const uint8_t* pAddress,
+                                      int rssi, const uint8_t* pPayload,
+                                      size_t length) {
+    ++record_num;
+    if (!IsAccepted(pAddress)) {
+        ++filtered_num;
+        return;
+    }
+    AdvertisementSample samples[kMaxSampleNum];
+    sample_num +=
+        DecodeAdvertisingPayload(pPayload, length, samples, kMaxSampleNum);
+}
+
+void CapturePipeline::onNotification(uint32_t time, const uint8_t* pAddress,
+                                     uint16_t uuid, const uint8_t* pData,
+                                     size_t length) {
+    ++record_num;
+    const CharacteristicDescriptor* pDescriptor = FindCharacteristic(uuid);
+    float value = 0;
+    if ((pDescriptor != nullptr) &&
+        DecodeCharacteristic(*pDescriptor, pData, length, value)) {
+        ++sample_num;
+    }
+}
+
+uint32_t CapturePipeline::GetRecordNum() const { return record_num; }
+
+uint32_t CapturePipeline::GetFilteredNum() const { return filtered_num; }
+
+uint32_t CapturePipeline::GetSampleNum() const { return sample_num; }
@@ -0,0 +1,115 @@
+/**
+ * @file capture.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Binary capture format of BLE traffic and its replay.
+ */
+#ifndef BLUETOOTHGATEWAY_CAPTURE_H_
+#define BLUETOOTHGATEWAY_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A enum for the record type of the capture.
+ * @details Every record is `type u8 | time u32 | address 6 bytes | body`
+ * in little-endian, where the time is milliseconds since boot.
+ * - Advertisement body: `rssi s8 | length u8 | payload`.
+ * - Notification body: `uuid u16 | length u16 | value`.
+ * - Connect and Disconnect have no body.
+ */
+enum class CaptureRecordType : uint8_t {
+    Advertisement = 0x01,
+    Notification = 0x02,
+    Connect = 0x03,
+    Disconnect = 0x04,
+};
+
+/**
+ * @brief Append capture records into a caller-provided buffer.
+ * @details A record which does not fit is dropped as a whole.
+ */
+class CaptureWriter {
+   public:
+    CaptureWriter(uint8_t* pBuffer, size_t capacity);
+    bool WriteAdvertisement(uint32_t time, const uint8_t* pAddress, int rssi,
+                            const uint8_t* pPayload, size_t length);
+    bool WriteNotification(uint32_t time, const uint8_t* pAddress,
+                           uint16_t uuid, const uint8_t* pData,
+                           size_t length);
+    bool WriteConnection(uint32_t time, const uint8_t* pAddress,
+                         bool is_connected);
+    size_t GetLength() const;
+    const uint8_t* GetData() const;
+    void Clear();
+
+   private:
+    uint8_t* pBuffer;
+    size_t capacity;
+    size_t length;
+    bool WriteRecord(const CaptureRecordType& type, uint32_t time,
+                     const uint8_t* pAddress, const uint8_t* pHead,
+                     size_t head_length, const uint8_t* pBody,
+                     size_t body_length);
+};
+
+/**
+ * @brief Callbacks of the replayed records.
+ */
+class CaptureReplayCallbacks {
+   public:
+    virtual ~CaptureReplayCallbacks(){};
+    virtual void onAdvertisement(uint32_t time, const uint8_t* pAddress,
+                                 int rssi, const uint8_t* pPayload,
+                                 size_t length){};
+    virtual void onNotification(uint32_t time, const uint8_t* pAddress,
+                                uint16_t uuid, const uint8_t* pData,
+                                size_t length){};
+    virtual void onConnection(uint32_t time, const uint8_t* pAddress,
+                              bool is_connected){};
+};
+
+/**
+ * @brief Feed the records of a capture to the callbacks.
+ * @details The records are replayed at maximum speed. For real time replay,
+ * the callbacks wait until the record time.
+ * @param [in] pData
+ * @param [in] length
+ * @param [in] pCallbacks
+ * @return size_t The number of replayed records. It stops at the first
+ * malformed or truncated record.
+ */
+size_t ReplayCapture(const uint8_t* pData, size_t length,
+                     CaptureReplayCallbacks* pCallbacks);
+
+/**
+ * @brief Decode the replayed records as the gateway does.
+ * @details Advertisements are decoded by DecodeAdvertisingPayload and
+ * notifications by the characteristic table. Optionally only the addresses
+ * of the accept list pass.
+ */
+class CapturePipeline : public CaptureReplayCallbacks {
+   public:
+    /**
+     * @param [in] pAcceptList 6 bytes addresses, nullptr to accept all.
+     * @param [in] accept_num
+     */
+    CapturePipeline(const uint8_t (*pAcceptList)[6], size_t accept_num);
+    void onAdvertisement(uint32_t time, const uint8_t* pAddress, int rssi,
+                         const uint8_t* pPayload, size_t length) override;
+    void onNotification(uint32_t time, const uint8_t* pAddress,
+                        uint16_t uuid, const uint8_t* pData,
+                        size_t length) override;
+    uint32_t GetRecordNum() const;
+    uint32_t GetFilteredNum() const;
+    uint32_t GetSampleNum() const;
+
+   private:
+    const uint8_t (*pAcceptList)[6];
+    size_t accept_num;
+    uint32_t record_num;
+    uint32_t filtered_num;
+    uint32_t sample_num;
+    bool IsAccepted(const uint8_t* pAddress) const;
+};
+
+#endif
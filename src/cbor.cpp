@@ -0,0 +1,112 @@
+/**
+ * @file cbor.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Allocation-free CBOR (RFC 8949) encoder of the state payload.
+ */
+#include "cbor.h"
+
+#include <cmath>
+#include <cstring>
+
+static const uint8_t kMajorUInt = 0;
+static const uint8_t kMajorNegativeInt = 1;
+static const uint8_t kMajorText = 3;
+static const uint8_t kMajorArray = 4;
+static const uint8_t kMajorMap = 5;
+static const uint8_t kSimpleNull = 0xF6;
+static const uint8_t kFloat32 = 0xFA;
+
+CborWriter::CborWriter(uint8_t* pBuffer, size_t capacity)
+    : pBuffer(pBuffer), capacity(capacity), length(0), is_valid(true) {}
+
+void CborWriter::WriteBytes(const uint8_t* pData, size_t num) {
+    if (!is_valid || (num > capacity - length)) {
+        is_valid = false;
+        return;
+    }
+    memcpy(pBuffer + length, pData, num);
+    length += num;
+}
+
+/**
+ * @brief Write the initial byte and the big-endian argument.
+ */
+void CborWriter::WriteHead(uint8_t major_type, uint64_t argument) {
+    uint8_t head[9];
+    size_t num = 1;
+    if (argument < 24) {
+        head[0] = (major_type << 5) | argument;
+    } else if (argument <= 0xFF) {
+        head[0] = (major_type << 5) | 24;
+        head[1] = argument;
+        num = 2;
+    } else if (argument <= 0xFFFF) {
+        head[0] = (major_type << 5) | 25;
+        head[1] = argument >> 8;
+        head[2] = argument;
+        num = 3;
+    } else if (argument <= 0xFFFFFFFFU) {
+        head[0] = (major_type << 5) | 26;
+        head[1] = argument >> 24;
+        head[2] = argument >> 16;
+        head[3] = argument >> 8;
+        head[4] = argument;
+        num = 5;
+    } else {
+        head[0] = (major_type << 5) | 27;
+        for (size_t i = 0; i < 8; ++i) {
+            head[1 + i] = argument >> (56 - 8 * i);
+        }
+        num = 9;
+    }
+    WriteBytes(head, num);
+}
+
+void CborWriter::WriteMap(size_t num) {
+    WriteHead(kMajorMap, static_cast<uint32_t>(num));
+}
+
+void CborWriter::WriteArray(size_t num) {
+    WriteHead(kMajorArray, static_cast<uint32_t>(num));
+}
+
+void CborWriter::WriteText(const char* pText) {
+    size_t num = strlen(pText);
+    WriteHead(kMajorText, static_cast<uint32_t>(num));
+    WriteBytes(reinterpret_cast<const uint8_t*>(pText), num);
+}
+
+void CborWriter::WriteUInt(uint64_t value) { WriteHead(kMajorUInt, value); }
+
+void CborWriter::WriteInt(int32_t value) {
+    if (value >= 0) {
+        WriteHead(kMajorUInt, static_cast<uint32_t>(value));
+    } else {
+        // -1 - n is encoded as n, which avoids overflow of INT32_MIN.
+        WriteHead(kMajorNegativeInt, static_cast<uint32_t>(-(value + 1)));
+    }
+}
+
+void CborWriter::WriteFloat(float value) {
+    if (std::isnan(value)) {
+        WriteNull();
+        return;
+    }
+    if ((value == std::trunc(value)) && (std::fabs(value) < 2147483648.0F)) {
+        WriteInt(static_cast<int32_t>(value));
+        return;
+    }
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t item[5] = {kFloat32, static_cast<uint8_t>(bits >> 24),
+                       static_cast<uint8_t>(bits >> 16),
+                       static_cast<uint8_t>(bits >> 8),
+                       static_cast<uint8_t>(bits)};
+    WriteBytes(item, sizeof(item));
+}
+
+void CborWriter::WriteNull() { WriteBytes(&kSimpleNull, 1); }
+
+size_t CborWriter::GetLength() const { return length; }
+
+bool CborWriter::IsValid() const { return is_valid; }
@@ -0,0 +1,53 @@
+/**
+ * @file cbor.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Allocation-free CBOR (RFC 8949) encoder of the state payload.
+ */
+#ifndef BLUETOOTHGATEWAY_CBOR_H_
+#define BLUETOOTHGATEWAY_CBOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Write CBOR data items into a caller-provided buffer.
+ * @details Only the items used by the state payload are supported. Once the
+ * buffer overflows, the following writes are ignored and IsValid returns
+ * false.
+ */
+class CborWriter {
+   public:
+    CborWriter(uint8_t* pBuffer, size_t capacity);
+    /**
+     * @brief Start a map of definite length.
+     * @param [in] num The number of key-value pairs.
+     */
+    void WriteMap(size_t num);
+    /**
+     * @brief Start an array of definite length.
+     * @param [in] num The number of items.
+     */
+    void WriteArray(size_t num);
+    void WriteText(const char* pText);
+    void WriteUInt(uint64_t value);
+    void WriteInt(int32_t value);
+    /**
+     * @brief Write a float, or null if it is NAN.
+     * @details Integral values are written as integers and the others as
+     * single-precision floats.
+     */
+    void WriteFloat(float value);
+    void WriteNull();
+    size_t GetLength() const;
+    bool IsValid() const;
+
+   private:
+    uint8_t* pBuffer;
+    size_t capacity;
+    size_t length;
+    bool is_valid;
+    void WriteHead(uint8_t major_type, uint64_t argument);
+    void WriteBytes(const uint8_t* pData, size_t num);
+};
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * @file characteristic.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Table-driven descriptors and decoders of GATT characteristics.
+ */
+#include "characteristic.h"
+
+#include <cmath>
+
+bool DecodeUInt8(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 1) {
+        return false;
+    }
+    raw = pData[0];
+    return true;
+}
+
+bool DecodeSInt8(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 1) {
+        return false;
+    }
+    raw = static_cast<int8_t>(pData[0]);
+    return true;
+}
+
+bool DecodeSInt16(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 2) {
+        return false;
+    }
+    raw = static_cast<int16_t>(pData[0] | (pData[1] << 8));
+    return true;
+}
+
+bool DecodeUInt16(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 2) {
+        return false;
+    }
+    raw = static_cast<uint16_t>(pData[0] | (pData[1] << 8));
+    return true;
+}
+
+bool DecodeSInt24(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 3) {
+        return false;
+    }
+    uint32_t value = pData[0] | (pData[1] << 8) | (pData[2] << 16);
+    if (value & 0x800000U) {
+        value |= 0xFF000000U;  // Sign extension.
+    }
+    raw = static_cast<int32_t>(value);
+    return true;
+}
+
+bool DecodeUInt24(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 3) {
+        return false;
+    }
+    raw = static_cast<int32_t>(pData[0] | (pData[1] << 8) | (pData[2] << 16));
+    return true;
+}
+
+bool DecodeUInt32(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 4) {
+        return false;
+    }
+    uint32_t value = static_cast<uint32_t>(pData[0]) |
+                     (static_cast<uint32_t>(pData[1]) << 8) |
+                     (static_cast<uint32_t>(pData[2]) << 16) |
+                     (static_cast<uint32_t>(pData[3]) << 24);
+    if (value > static_cast<uint32_t>(INT32_MAX)) {
+        return false;
+    }
+    raw = static_cast<int32_t>(value);
+    return true;
+}
+
+bool DecodeSInt32(const uint8_t* pData, size_t length, int32_t& raw) {
+    if (length < 4) {
+        return false;
+    }
+    uint32_t value = static_cast<uint32_t>(pData[0]) |
+                     (static_cast<uint32_t>(pData[1]) << 8) |
+                     (static_cast<uint32_t>(pData[2]) << 16) |
+                     (static_cast<uint32_t>(pData[3]) << 24);
+    raw = static_cast<int32_t>(value);
+    return true;
+}
+
+bool DecodeCharacteristic(const CharacteristicDescriptor& descriptor,
+                          const uint8_t* pData, size_t length, float& value) {
+    int32_t raw = 0;
+    if (!descriptor.decode(pData, length, raw) || (raw == descriptor.unknown)) {
+        return false;
+    }
+    value = raw * descriptor.scale;
+    return true;
+}
+
+constexpr CharacteristicDescriptor kElevationCharacteristic = {
+    0x2A6C, "elevation", DecodeSInt24, kUnknownNone, 0.01F, "m", "distance"};
+constexpr CharacteristicDescriptor kPressureCharacteristic = {
+    0x2A6D, "pressure", DecodeUInt32, kUnknownNone, 0.001F, "hPa", "pressure"};
+constexpr CharacteristicDescriptor kTemperatureCharacteristic = {
+    0x2A6E, "temperature", DecodeSInt16, -0x8000, 0.01F, "°C", "temperature"};
+constexpr CharacteristicDescriptor kHumidityCharacteristic = {
+    0x2A6F, "humidity", DecodeUInt16, 0xFFFF, 0.01F, "%", "humidity"};
+constexpr CharacteristicDescriptor kTrueWindSpeedCharacteristic = {
+    0x2A70, "true_wind_speed", DecodeUInt16, kUnknownNone, 0.01F, "m/s",
+    "wind_speed"};
+constexpr CharacteristicDescriptor kTrueWindDirectionCharacteristic = {
+    0x2A71, "true_wind_direction", DecodeUInt16, kUnknownNone, 0.01F, "°",
+    nullptr};
+constexpr CharacteristicDescriptor kApparentWindSpeedCharacteristic = {
+    0x2A72, "apparent_wind_speed", DecodeUInt16, kUnknownNone, 0.01F, "m/s",
+    "wind_speed"};
+constexpr CharacteristicDescriptor kApparentWindDirectionCharacteristic = {
+    0x2A73, "apparent_wind_direction", DecodeUInt16, kUnknownNone, 0.01F, "°",
+    nullptr};
+constexpr CharacteristicDescriptor kGustFactorCharacteristic = {
+    0x2A74, "gust_factor", DecodeUInt8, kUnknownNone, 0.1F, nullptr, nullptr};
+constexpr CharacteristicDescriptor kPollenConcentrationCharacteristic = {
+    0x2A75, "pollen_concentration", DecodeUInt24, kUnknownNone, 1.0F, "/m³",
+    nullptr};
+constexpr CharacteristicDescriptor kUVIndexCharacteristic = {
+    0x2A76, "uv_index", DecodeUInt8, kUnknownNone, 1.0F, nullptr, nullptr};
+constexpr CharacteristicDescriptor kIrradianceCharacteristic = {
+    0x2A77, "irradiance", DecodeUInt16, kUnknownNone, 0.1F, "W/m²",
+    "irradiance"};
+constexpr CharacteristicDescriptor kRainfallCharacteristic = {
+    0x2A78, "rainfall", DecodeUInt16, kUnknownNone, 1.0F, "mm",
+    "precipitation"};
+constexpr CharacteristicDescriptor kWindChillCharacteristic = {
+    0x2A79, "wind_chill", DecodeSInt8, kUnknownNone, 1.0F, "°C",
+    "temperature"};
+constexpr CharacteristicDescriptor kHeatIndexCharacteristic = {
+    0x2A7A, "heat_index", DecodeSInt8, kUnknownNone, 1.0F, "°C",
+    "temperature"};
+constexpr CharacteristicDescriptor kDewPointCharacteristic = {
+    0x2A7B, "dew_point", DecodeSInt8, kUnknownNone, 1.0F, "°C",
+    "temperature"};
+constexpr CharacteristicDescriptor kIlluminanceCharacteristic = {
+    0x2AFB, "illuminance", DecodeUInt24, 0xFFFFFF, 0.01F, "lx", "illuminance"};
+// 0xFFFE means 65534 or greater which is decoded as 65534 ppm.
+constexpr CharacteristicDescriptor kCO2ConcentrationCharacteristic = {
+    0x2B8C, "co2_concentration", DecodeUInt16, 0xFFFF, 1.0F, "ppm",
+    "carbon_dioxide"};
+// 0xFFFE means 65534 or greater which is decoded as 65534 ppb.
+constexpr CharacteristicDescriptor kVOCConcentrationCharacteristic = {
+    0x2BE7, "voc_concentration", DecodeUInt16, 0xFFFF, 1.0F, "ppb",
+    "volatile_organic_compounds_parts"};
+
+constexpr CharacteristicDescriptor kBatteryLevelCharacteristic = {
+    0x2A19, "battery", DecodeUInt8, kUnknownNone, 1.0F, "%", "battery"};
+constexpr CharacteristicDescriptor kVoltageCharacteristic = {
+    0x2B18, "voltage", DecodeUInt16, 0xFFFF, 1.0F / 64, "V", "voltage"};
+
+constexpr const CharacteristicDescriptor* const
+    kEnvironmentalSensingCharacteristics[] = {
+        &kElevationCharacteristic,
+        &kPressureCharacteristic,
+        &kTemperatureCharacteristic,
+        &kHumidityCharacteristic,
+        &kTrueWindSpeedCharacteristic,
+        &kTrueWindDirectionCharacteristic,
+        &kApparentWindSpeedCharacteristic,
+        &kApparentWindDirectionCharacteristic,
+        &kGustFactorCharacteristic,
+        &kPollenConcentrationCharacteristic,
+        &kUVIndexCharacteristic,
+        &kIrradianceCharacteristic,
+        &kRainfallCharacteristic,
+        &kWindChillCharacteristic,
+        &kHeatIndexCharacteristic,
+        &kDewPointCharacteristic,
+        &kIlluminanceCharacteristic,
+        &kCO2ConcentrationCharacteristic,
+        &kVOCConcentrationCharacteristic,
+};
+static_assert(sizeof(kEnvironmentalSensingCharacteristics) /
+                      sizeof(kEnvironmentalSensingCharacteristics[0]) ==
+                  kEnvironmentalSensingCharacteristicNum,
+              "kEnvironmentalSensingCharacteristicNum mismatch.");
+
+const CharacteristicDescriptor* FindCharacteristic(uint16_t uuid) {
+    // Binary search since the table is sorted by UUID.
+    size_t low = 0;
+    size_t high = kEnvironmentalSensingCharacteristicNum;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const CharacteristicDescriptor* pDescriptor =
+            kEnvironmentalSensingCharacteristics[middle];
+        if (pDescriptor->uuid == uuid) {
+            return pDescriptor;
+        }
+        if (pDescriptor->uuid < uuid) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return nullptr;
+}
+
+size_t DecodeCharacteristics(const RawCharacteristicValue* pRawValues,
+                             size_t num, float* pValues) {
+    size_t decoded_num = 0;
+    const CharacteristicDescriptor* pDescriptor = nullptr;
+    for (size_t i = 0; i < num; ++i) {
+        const RawCharacteristicValue& raw_value = pRawValues[i];
+        // Multi-characteristic sensors repeat the same UUID in a batch.
+        if ((pDescriptor == nullptr) || (pDescriptor->uuid != raw_value.uuid)) {
+            pDescriptor = FindCharacteristic(raw_value.uuid);
+        }
+        pValues[i] = NAN;
+        if ((pDescriptor != nullptr) &&
+            DecodeCharacteristic(*pDescriptor, raw_value.pData,
+                                 raw_value.length, pValues[i])) {
+            ++decoded_num;
+        }
+    }
+    return decoded_num;
+}
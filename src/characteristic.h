@@ -0,0 +1,153 @@
+/**
+ * @file characteristic.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Table-driven descriptors and decoders of GATT characteristics.
+ */
+#ifndef BLUETOOTHGATEWAY_CHARACTERISTIC_H_
+#define BLUETOOTHGATEWAY_CHARACTERISTIC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Read the raw integer of a characteristic value.
+ * @param [in] pData The characteristic value.
+ * @param [in] length The length of the characteristic value.
+ * @param [out] raw The raw integer.
+ * @return true If the value is long enough and in range.
+ * @return false
+ */
+typedef bool (*RawDecoder)(const uint8_t* pData, size_t length,
+                           int32_t& raw);
+
+bool DecodeUInt8(const uint8_t* pData, size_t length, int32_t& raw);
+bool DecodeSInt8(const uint8_t* pData, size_t length, int32_t& raw);
+bool DecodeSInt16(const uint8_t* pData, size_t length, int32_t& raw);
+bool DecodeUInt16(const uint8_t* pData, size_t length, int32_t& raw);
+bool DecodeSInt24(const uint8_t* pData, size_t length, int32_t& raw);
+bool DecodeUInt24(const uint8_t* pData, size_t length, int32_t& raw);
+bool DecodeUInt32(const uint8_t* pData, size_t length, int32_t& raw);
+bool DecodeSInt32(const uint8_t* pData, size_t length, int32_t& raw);
+
+/**
+ * @brief The unknown value of the characteristic without "unknown" defined.
+ */
+const int32_t kUnknownNone = INT32_MIN;
+
+/**
+ * @brief Describe how a characteristic is decoded and published.
+ * @details The real value is raw * scale unless raw equals unknown.
+ * The unit and device_class are nullptr if Home Assistant has none.
+ */
+struct CharacteristicDescriptor {
+    uint16_t uuid;
+    const char* name;
+    RawDecoder decode;
+    int32_t unknown;
+    float scale;
+    const char* unit;
+    const char* device_class;
+};
+
+/**
+ * @brief A enum for how the values are acquired after GATT connection.
+ * @details Indication waits for the device to indicate the values, which
+ * may take seconds. DirectRead reads the values at once with a short
+ * connection interval.
+ */
+enum class GattAcquisition : uint8_t {
+    Indication,
+    DirectRead,
+};
+
+/**
+ * @brief Describe a device type.
+ * @details The service_uuid is 0 if the device is not connected by GATT,
+ * in which case the acquisition is ignored.
+ */
+struct DeviceDescriptor {
+    const char* object_id;
+    uint16_t service_uuid;
+    const CharacteristicDescriptor* const* characteristics;
+    size_t characteristic_num;
+    GattAcquisition acquisition;
+};
+
+/**
+ * @brief Decode the characteristic value to real value.
+ * @param [in] descriptor
+ * @param [in] pData
+ * @param [in] length
+ * @param [out] value
+ * @return true If the value is decoded.
+ * @return false If the value is too short, out of range or unknown.
+ */
+bool DecodeCharacteristic(const CharacteristicDescriptor& descriptor,
+                          const uint8_t* pData, size_t length, float& value);
+
+/**
+ * Environmental Sensing Service (0x181A) characteristics.
+ */
+
+extern const CharacteristicDescriptor kElevationCharacteristic;
+extern const CharacteristicDescriptor kPressureCharacteristic;
+extern const CharacteristicDescriptor kTemperatureCharacteristic;
+extern const CharacteristicDescriptor kHumidityCharacteristic;
+extern const CharacteristicDescriptor kTrueWindSpeedCharacteristic;
+extern const CharacteristicDescriptor kTrueWindDirectionCharacteristic;
+extern const CharacteristicDescriptor kApparentWindSpeedCharacteristic;
+extern const CharacteristicDescriptor kApparentWindDirectionCharacteristic;
+extern const CharacteristicDescriptor kGustFactorCharacteristic;
+extern const CharacteristicDescriptor kPollenConcentrationCharacteristic;
+extern const CharacteristicDescriptor kUVIndexCharacteristic;
+extern const CharacteristicDescriptor kIrradianceCharacteristic;
+extern const CharacteristicDescriptor kRainfallCharacteristic;
+extern const CharacteristicDescriptor kWindChillCharacteristic;
+extern const CharacteristicDescriptor kHeatIndexCharacteristic;
+extern const CharacteristicDescriptor kDewPointCharacteristic;
+extern const CharacteristicDescriptor kIlluminanceCharacteristic;
+extern const CharacteristicDescriptor kCO2ConcentrationCharacteristic;
+extern const CharacteristicDescriptor kVOCConcentrationCharacteristic;
+
+/**
+ * Other characteristics.
+ */
+
+extern const CharacteristicDescriptor kBatteryLevelCharacteristic;
+extern const CharacteristicDescriptor kVoltageCharacteristic;
+
+/**
+ * @brief All supported ESS characteristics sorted by UUID.
+ */
+const size_t kEnvironmentalSensingCharacteristicNum = 19;
+extern const CharacteristicDescriptor* const
+    kEnvironmentalSensingCharacteristics[];
+
+/**
+ * @brief Find the descriptor of an ESS characteristic.
+ * @param [in] uuid The 16-bit characteristic UUID.
+ * @return const CharacteristicDescriptor* nullptr if not supported.
+ */
+const CharacteristicDescriptor* FindCharacteristic(uint16_t uuid);
+
+/**
+ * @brief A raw characteristic value waiting for decoding.
+ */
+struct RawCharacteristicValue {
+    uint16_t uuid;
+    const uint8_t* pData;
+    size_t length;
+};
+
+/**
+ * @brief Decode a batch of raw characteristic values in one pass.
+ * @details The value is NAN if it is unknown or not supported.
+ * @param [in] pRawValues
+ * @param [in] num The number of raw values.
+ * @param [out] pValues The decoded values with at least num elements.
+ * @return size_t The number of decoded known values.
+ */
+size_t DecodeCharacteristics(const RawCharacteristicValue* pRawValues,
+                             size_t num, float* pValues);
+
+#endif
@@ -5,10 +5,12 @@
  */
 #include "command.h"
 
+#include "rules.h"
+
 std::unique_ptr<Command> ParseBTCommand(uint8_t* pBuffer,
                                         const int& buffer_size,
                                         Preferences* pPrefs,
-                                        BluetoothSerial* pSerialBT) {
+                                        Stream* pSerialBT) {
     CommandType command_type = static_cast<CommandType>(pBuffer[0]);
     switch (command_type) {
         case CommandType::BTAddDevice: {
@@ -42,6 +44,13 @@ std::unique_ptr<Command> ParseBTCommand(uint8_t* pBuffer,
             return cmd;
             break;
         }
+        case CommandType::BTSetRule: {
+            log_i("Parse to BTSetRuleCommand.");
+            std::unique_ptr<Command> cmd(new BTSetRuleCommand(
+                ParseBTSetRuleCommand(pBuffer, buffer_size, pSerialBT)));
+            return cmd;
+            break;
+        }
         default: {
             log_i("Parse to NullCommand.");
             std::unique_ptr<Command> cmd(new NullCommand);
@@ -53,19 +62,19 @@ std::unique_ptr<Command> ParseBTCommand(uint8_t* pBuffer,
 
 BTAddDeviceCommand::BTAddDeviceCommand(const std::string& name,
                                        const DeviceType& type,
-                                       esp_bd_addr_t address,
+                                       const uint8_t* pAddress,
                                        Preferences* pPrefs,
-                                       BluetoothSerial* pSerialBT)
+                                       Stream* pSerialBT)
     : name(name),
       type(type),
-      mac(address),
+      mac(pAddress),
       pPrefs(pPrefs),
       pSerialBT(pSerialBT) {}
 BTAddDeviceCommand::BTAddDeviceCommand(Preferences* pPrefs,
-                                       BluetoothSerial* pSerialBT)
+                                       Stream* pSerialBT)
     : name(std::string()),
       type(DeviceType::Unknown),
-      mac("00:00:00:00:00:00"),
+      mac(),
       pPrefs(pPrefs),
       pSerialBT(pSerialBT) {}
 
@@ -89,7 +98,7 @@ bool BTAddDeviceCommand::execute() {
         return false;
     }
     key = name + ".mac";
-    success = pPrefs->putString(key.c_str(), mac.toString().c_str());
+    success = pPrefs->putString(key.c_str(), mac.ToString().c_str());
     if (!success) {
         log_i("Add %s devices's mac fail!", name.c_str());
         msg = "Add \'" + name + "\' device's mac fail!\n";
@@ -109,7 +118,7 @@ bool BTAddDeviceCommand::execute() {
 BTAddDeviceCommand ParseBTAddDeviceCommand(uint8_t* pBuffer,
                                            const int& buffer_size,
                                            Preferences* pPrefs,
-                                           BluetoothSerial* pSerialBT) {
+                                           Stream* pSerialBT) {
     if (static_cast<CommandType>(pBuffer[0]) != CommandType::BTAddDevice) {
         log_w("Wrong command type, expect BTAddDeviceCommand.");
         return BTAddDeviceCommand(pPrefs, pSerialBT);
@@ -137,10 +146,10 @@ BTAddDeviceCommand ParseBTAddDeviceCommand(uint8_t* pBuffer,
 
 BTRemoveDeviceCommand::BTRemoveDeviceCommand(const std::string& name,
                                              Preferences* pPrefs,
-                                             BluetoothSerial* pSerialBT)
+                                             Stream* pSerialBT)
     : name(name), pPrefs(pPrefs), pSerialBT(pSerialBT){};
 BTRemoveDeviceCommand::BTRemoveDeviceCommand(Preferences* pPrefs,
-                                             BluetoothSerial* pSerialBT)
+                                             Stream* pSerialBT)
     : name(std::string()), pPrefs(pPrefs), pSerialBT(pSerialBT){};
 
 bool BTRemoveDeviceCommand::execute() {
@@ -182,7 +191,7 @@ bool BTRemoveDeviceCommand::execute() {
 BTRemoveDeviceCommand ParseBTRemoveDeviceCommand(uint8_t* pBuffer,
                                                  const int& buffer_size,
                                                  Preferences* pPrefs,
-                                                 BluetoothSerial* pSerialBT) {
+                                                 Stream* pSerialBT) {
     if (static_cast<CommandType>(pBuffer[0]) != CommandType::BTRemoveDevice) {
         log_w("Wrong command type, expect BTRemoveDeviceCommand");
         return BTRemoveDeviceCommand(pPrefs, pSerialBT);
@@ -200,10 +209,10 @@ BTRemoveDeviceCommand ParseBTRemoveDeviceCommand(uint8_t* pBuffer,
 
 BTGetDeviceCommand::BTGetDeviceCommand(const std::string& name,
                                        Preferences* pPrefs,
-                                       BluetoothSerial* pSerialBT)
+                                       Stream* pSerialBT)
     : name(name), pPrefs(pPrefs), pSerialBT(pSerialBT){};
 BTGetDeviceCommand::BTGetDeviceCommand(Preferences* pPrefs,
-                                       BluetoothSerial* pSerialBT)
+                                       Stream* pSerialBT)
     : name(std::string()), pPrefs(pPrefs), pSerialBT(pSerialBT){};
 
 bool BTGetDeviceCommand::execute() {
@@ -235,7 +244,7 @@ bool BTGetDeviceCommand::execute() {
 BTGetDeviceCommand ParseBTGetDeviceCommand(uint8_t* pBuffer,
                                            const int& buffer_size,
                                            Preferences* pPrefs,
-                                           BluetoothSerial* pSerialBT) {
+                                           Stream* pSerialBT) {
     if (static_cast<CommandType>(pBuffer[0]) != CommandType::BTGetDevice) {
         log_w("Wrong command type, expect BTGetDeviceCommand");
         return BTGetDeviceCommand(pPrefs, pSerialBT);
@@ -251,7 +260,7 @@ BTGetDeviceCommand ParseBTGetDeviceCommand(uint8_t* pBuffer,
     return BTGetDeviceCommand(name, pPrefs, pSerialBT);
 };
 
-BTClearCommand::BTClearCommand(Preferences* pPrefs, BluetoothSerial* pSerialBT)
+BTClearCommand::BTClearCommand(Preferences* pPrefs, Stream* pSerialBT)
     : pPrefs(pPrefs), pSerialBT(pSerialBT) {}
 
 bool BTClearCommand::execute() {
@@ -273,6 +282,42 @@ bool BTClearCommand::execute() {
 
 BTClearCommand ParseBTClearCommand(uint8_t* pBuffer, const int& buffer_size,
                                    Preferences* pPrefs,
-                                   BluetoothSerial* pSerialBT) {
+                                   Stream* pSerialBT) {
     return BTClearCommand(pPrefs, pSerialBT);
-}
\ No newline at end of file
+}
+
+BTSetRuleCommand::BTSetRuleCommand(const std::string& rule,
+                                   Stream* pSerialBT)
+    : rule(rule), pSerialBT(pSerialBT){};
+
+bool BTSetRuleCommand::execute() {
+    std::string msg;
+    if (!SetRule(rule.c_str())) {
+        log_i("Invalid rule %s.", rule.c_str());
+        msg = "Invalid rule \'" + rule + "\'\n";
+        pSerialBT->write(reinterpret_cast<const uint8_t*>(msg.c_str()),
+                         msg.size());
+        return false;
+    }
+    msg = "Set rule \'" + rule + "\' success!\n";
+    pSerialBT->write(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
+    log_i("Set rule %s success!", rule.c_str());
+    return true;
+}
+
+BTSetRuleCommand ParseBTSetRuleCommand(uint8_t* pBuffer,
+                                       const int& buffer_size,
+                                       Stream* pSerialBT) {
+    if (static_cast<CommandType>(pBuffer[0]) != CommandType::BTSetRule) {
+        log_w("Wrong command type, expect BTSetRuleCommand");
+        return BTSetRuleCommand(std::string(), pSerialBT);
+    }
+    int cursor = 1;
+    std::string rule;
+    while ((cursor < buffer_size) && (pBuffer[cursor] != 0x04)) {
+        rule.push_back(pBuffer[cursor]);
+        ++cursor;
+    }
+    log_i("Parsed rule is %s", rule.c_str());
+    return BTSetRuleCommand(rule, pSerialBT);
+}
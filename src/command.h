@@ -6,18 +6,21 @@
 #ifndef BLUETOOTHGATEWAY_COMMAND_H_
 #define BLUETOOTHGATEWAY_COMMAND_H_
 
-#include <BLEAddress.h>
-#include <BluetoothSerial.h>
 #include <Preferences.h>
+#include <Stream.h>
 
 #include <memory>
 
+#include "address.h"
+
 /**
  * @brief A enum for device type.
  * @note The values less than 0x05 is reserved.
  */
 enum class DeviceType : uint8_t {
     BluetoothEnvironmentSensor = 0x05,
+    BluetoothEnvironmentalSensing,
+    BluetoothAdvertisementSensor,
     Unknown = 0xFF,
 };
 
@@ -30,6 +33,7 @@ enum class CommandType : uint8_t {
     BTRemoveDevice,
     BTGetDevice,
     BTClear,
+    BTSetRule,
 };
 
 /**
@@ -49,7 +53,7 @@ class NullCommand : public Command {
 std::unique_ptr<Command> ParseBTCommand(uint8_t* pBuffer,
                                         const int& buffer_size,
                                         Preferences* pPrefs,
-                                        BluetoothSerial* pSerialBT);
+                                        Stream* pSerialBT);
 
 /**
  * @brief Add device's type and MAC address.
@@ -58,16 +62,16 @@ class BTAddDeviceCommand : public Command {
    public:
     std::string name;
     DeviceType type;
-    BLEAddress mac;
+    DeviceAddress mac;
     BTAddDeviceCommand(const std::string& name, const DeviceType& type,
-                       esp_bd_addr_t address, Preferences* pPrefs,
-                       BluetoothSerial* pSerialBT);
-    BTAddDeviceCommand(Preferences* pPrefs, BluetoothSerial* pSerialBT);
+                       const uint8_t* pAddress, Preferences* pPrefs,
+                       Stream* pSerialBT);
+    BTAddDeviceCommand(Preferences* pPrefs, Stream* pSerialBT);
     bool execute() override;
 
    private:
     Preferences* pPrefs;
-    BluetoothSerial* pSerialBT;
+    Stream* pSerialBT;
 };
 
 /**
@@ -84,7 +88,7 @@ class BTAddDeviceCommand : public Command {
 BTAddDeviceCommand ParseBTAddDeviceCommand(uint8_t* pBuffer,
                                            const int& buffer_size,
                                            Preferences* pPrefs,
-                                           BluetoothSerial* pSerialBT);
+                                           Stream* pSerialBT);
 
 /**
  * @brief Remove device's info.
@@ -93,13 +97,13 @@ class BTRemoveDeviceCommand : public Command {
    public:
     std::string name;
     BTRemoveDeviceCommand(const std::string& name, Preferences* pPrefs,
-                          BluetoothSerial* pSerialBT);
-    BTRemoveDeviceCommand(Preferences* pPrefs, BluetoothSerial* pSerialBT);
+                          Stream* pSerialBT);
+    BTRemoveDeviceCommand(Preferences* pPrefs, Stream* pSerialBT);
     bool execute() override;
 
    private:
     Preferences* pPrefs;
-    BluetoothSerial* pSerialBT;
+    Stream* pSerialBT;
 };
 
 /**
@@ -115,7 +119,7 @@ class BTRemoveDeviceCommand : public Command {
 BTRemoveDeviceCommand ParseBTRemoveDeviceCommand(uint8_t* pBuffer,
                                                  const int& buffer_size,
                                                  Preferences* pPrefs,
-                                                 BluetoothSerial* pSeialBT);
+                                                 Stream* pSeialBT);
 
 /**
  * @brief Return the device's info.
@@ -124,13 +128,13 @@ class BTGetDeviceCommand : public Command {
    public:
     std::string name;
     BTGetDeviceCommand(const std::string& name, Preferences* pPrefs,
-                       BluetoothSerial* pSerialBT);
-    BTGetDeviceCommand(Preferences* pPrefs, BluetoothSerial* pSerialBT);
+                       Stream* pSerialBT);
+    BTGetDeviceCommand(Preferences* pPrefs, Stream* pSerialBT);
     bool execute() override;
 
    private:
     Preferences* pPrefs;
-    BluetoothSerial* pSerialBT;
+    Stream* pSerialBT;
 };
 
 /**
@@ -146,7 +150,7 @@ class BTGetDeviceCommand : public Command {
 BTGetDeviceCommand ParseBTGetDeviceCommand(uint8_t* pBuffer,
                                            const int& buffer_size,
                                            Preferences* pPrefs,
-                                           BluetoothSerial* pSerialBT);
+                                           Stream* pSerialBT);
 
 /**
  * @brief Clear all stored devices.
@@ -154,10 +158,10 @@ BTGetDeviceCommand ParseBTGetDeviceCommand(uint8_t* pBuffer,
 class BTClearCommand : public Command {
    private:
     Preferences* pPrefs;
-    BluetoothSerial* pSerialBT;
+    Stream* pSerialBT;
 
    public:
-    BTClearCommand(Preferences* pPrefs, BluetoothSerial* pSerialBT);
+    BTClearCommand(Preferences* pPrefs, Stream* pSerialBT);
     bool execute() override;
 };
 
@@ -173,5 +177,32 @@ class BTClearCommand : public Command {
  */
 BTClearCommand ParseBTClearCommand(uint8_t* pBuffer, const int& buffer_size,
                                    Preferences* pPrefs,
-                                   BluetoothSerial* pSerialBT);
+                                   Stream* pSerialBT);
+
+/**
+ * @brief Add, replace or remove an alert rule.
+ */
+class BTSetRuleCommand : public Command {
+   public:
+    std::string rule;
+    BTSetRuleCommand(const std::string& rule, Stream* pSerialBT);
+    bool execute() override;
+
+   private:
+    Stream* pSerialBT;
+};
+
+/**
+ * @brief Parse command in command buffer
+ * @details A valid command consists of
+ * command type(1 byte)+rule(n bytes)+0x04
+ * where the rule is in the text format of SetRule.
+ * @param [in] pBuffer
+ * @param [in] buffer_size
+ * @param [in] pSerialBT
+ * @return BTSetRuleCommand
+ */
+BTSetRuleCommand ParseBTSetRuleCommand(uint8_t* pBuffer,
+                                       const int& buffer_size,
+                                       Stream* pSerialBT);
 #endif
\ No newline at end of file
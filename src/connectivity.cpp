@@ -0,0 +1,272 @@
+/**
+ * @file connectivity.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Event driven WiFi connection with backoff.
+ */
+#include "connectivity.h"
+
+#include <Arduino.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
+
+#include <sys/time.h>
+
+#include "scheduler.h"
+
+static const uint32_t kWiFiCacheMagic = 0x57494649;
+RTC_NOINIT_ATTR static WiFiConnectionCache wifi_cache;
+
+static uint32_t GetCacheChecksum(const WiFiConnectionCache& cache) {
+    // FNV-1a of all bytes before checksum.
+    const uint8_t* pData = reinterpret_cast<const uint8_t*>(&cache);
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < offsetof(WiFiConnectionCache, checksum); ++i) {
+        hash = (hash ^ pData[i]) * 16777619U;
+    }
+    return hash;
+}
+
+static bool IsCacheValid() {
+    return (wifi_cache.magic == kWiFiCacheMagic) &&
+           (wifi_cache.checksum == GetCacheChecksum(wifi_cache));
+}
+
+static void InvalidateCache() { wifi_cache.magic = 0; }
+
+/**
+ * @brief Get seconds of the system time which keeps counting after reset.
+ */
+static int64_t GetSystemSeconds() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return now.tv_sec;
+}
+
+/**
+ * @brief Get the lease granted to the WiFi station by the DHCP server.
+ * @return uint32_t seconds, 0 if DHCP is not bound.
+ */
+static uint32_t GetDHCPLeaseDuration() {
+    esp_netif_t* pNetif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    if (pNetif == nullptr) {
+        return 0;
+    }
+    struct netif* pLwIPNetif =
+        static_cast<struct netif*>(esp_netif_get_netif_impl(pNetif));
+    struct dhcp* pDHCP =
+        (pLwIPNetif == nullptr) ? nullptr : netif_dhcp_data(pLwIPNetif);
+    if ((pDHCP == nullptr) || (pDHCP->state != DHCP_STATE_BOUND)) {
+        return 0;
+    }
+    return pDHCP->offered_t0_lease;
+}
+
+ConnectivityManager::ConnectivityManager(WiFiClass& wifi)
+    : wifi(wifi),
+      pSSID(nullptr),
+      pPassword(nullptr),
+      state(ConnectivityState::Idle),
+      state_start(0),
+      backoff(kMinBackoff),
+      statistics({0, 0, 0, 0, 0}),
+      is_online(false),
+      is_disconnected(false),
+      is_static_ip(false),
+      is_fast_connecting(false),
+      is_lease_reused(false),
+      is_lease_pending(false),
+      lease_renew_time(0) {}
+
+void ConnectivityManager::SetStaticIP(const IPAddress& ip,
+                                      const IPAddress& gateway,
+                                      const IPAddress& subnet,
+                                      const IPAddress& dns) {
+    is_static_ip = true;
+    static_ip = ip;
+    static_gateway = gateway;
+    static_subnet = subnet;
+    static_dns = dns;
+}
+
+void ConnectivityManager::Begin(const char* pSSID, const char* pPassword) {
+    this->pSSID = pSSID;
+    this->pPassword = pPassword;
+    wifi.onEvent([this](WiFiEvent_t event,
+                        WiFiEventInfo_t info) { OnEvent(event, info); });
+    wifi.setAutoReconnect(false);  // Reconnect with backoff in Loop.
+    Connect();
+}
+
+/**
+ * @brief Start connecting.
+ * @details The cached BSSID and channel skip the channel scan and the
+ * cached lease skips DHCP until it is due for renewal.
+ */
+void ConnectivityManager::Connect() {
+    is_disconnected = false;
+    is_fast_connecting = IsCacheValid();
+    is_lease_reused = false;
+    is_lease_pending = false;
+    if (is_static_ip) {
+        wifi.config(static_ip, static_gateway, static_subnet, static_dns);
+    } else if (is_fast_connecting && (wifi_cache.lease_time > 0)) {
+        int64_t now = GetSystemSeconds();
+        if ((now >= wifi_cache.lease_time) && (now < GetLeaseRenewTime())) {
+            wifi.config(IPAddress(wifi_cache.ip), IPAddress(wifi_cache.gateway),
+                        IPAddress(wifi_cache.subnet),
+                        IPAddress(wifi_cache.dns));
+            is_lease_reused = true;
+        }
+    }
+    if (is_fast_connecting) {
+        log_i("Fast connect to WiFi %s on channel %d.", pSSID,
+              wifi_cache.channel);
+        wifi.begin(pSSID, pPassword, wifi_cache.channel, wifi_cache.bssid);
+    } else {
+        log_i("Connect to WiFi %s.", pSSID);
+        wifi.begin(pSSID, pPassword);
+    }
+    state = ConnectivityState::Connecting;
+    state_start = millis();
+}
+
+/**
+ * @brief Get when the cached lease is renewed by DHCP.
+ * @details It is the renewal time T1 of the server, half of the lease, and
+ * at most kLeaseReuseTime after the lease was granted.
+ */
+int64_t ConnectivityManager::GetLeaseRenewTime() const {
+    int64_t reuse_time = wifi_cache.lease_duration / 2;
+    if (reuse_time > kLeaseReuseTime) {
+        reuse_time = kLeaseReuseTime;
+    }
+    return wifi_cache.lease_time + reuse_time;
+}
+
+void ConnectivityManager::SaveCache() {
+    if (!is_lease_reused) {
+        const uint8_t* pBSSID = wifi.BSSID();
+        if (pBSSID == nullptr) {
+            return;
+        }
+        memcpy(wifi_cache.bssid, pBSSID, sizeof(wifi_cache.bssid));
+        wifi_cache.channel = wifi.channel();
+        wifi_cache.lease_time = 0;
+        wifi_cache.lease_duration = 0;
+        uint32_t lease_duration = GetDHCPLeaseDuration();
+        if (!is_static_ip && (lease_duration > 0)) {
+            wifi_cache.ip = wifi.localIP();
+            wifi_cache.gateway = wifi.gatewayIP();
+            wifi_cache.subnet = wifi.subnetMask();
+            wifi_cache.dns = wifi.dnsIP();
+            wifi_cache.lease_time = GetSystemSeconds();
+            wifi_cache.lease_duration = lease_duration;
+        }
+    }
+    wifi_cache.magic = kWiFiCacheMagic;
+    wifi_cache.checksum = GetCacheChecksum(wifi_cache);
+}
+
+/**
+ * @brief Handle WiFi events in the WiFi event task.
+ * @details Only flags are set here. The state is changed in Loop.
+ */
+void ConnectivityManager::OnEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            is_online = true;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            is_online = false;
+            is_disconnected = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void ConnectivityManager::Loop() {
+    uint32_t now = millis();
+    switch (state) {
+        case ConnectivityState::Idle:
+            break;
+        case ConnectivityState::Connecting:
+            if (is_online) {
+                Serial.printf("WiFi connected in %d ms%s. IP is %s\n",
+                              static_cast<uint32_t>(now - state_start),
+                              is_fast_connecting ? " (fast)" : "",
+                              wifi.localIP().toString().c_str());
+                state = ConnectivityState::Online;
+                state_start = now;
+                backoff = kMinBackoff;
+                ++statistics.connect_num;
+                if (is_fast_connecting) {
+                    ++statistics.fast_connect_num;
+                }
+                if (statistics.first_connect_time == 0) {
+                    statistics.first_connect_time = now;
+                }
+                SaveCache();
+            } else if (is_fast_connecting &&
+                       (static_cast<uint32_t>(now - state_start) >=
+                        kFastConnectTimeout)) {
+                // The cached AP or lease is stale, connect from scratch.
+                log_i("WiFi fast connect timeout, connect without cache.");
+                InvalidateCache();
+                wifi.disconnect();
+                if (!is_static_ip) {
+                    wifi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0),
+                                IPAddress(0, 0, 0, 0));  // Enable DHCP.
+                }
+                Connect();
+            } else if (static_cast<uint32_t>(now - state_start) >=
+                       kConnectTimeout) {
+                log_i("WiFi connect timeout, retry after %d ms.", backoff);
+                ++statistics.connect_timeout_num;
+                RecordRadioFailure(RadioFailure::WiFiReconnect);
+                wifi.disconnect();
+                state = ConnectivityState::Backoff;
+                state_start = now;
+            }
+            break;
+        case ConnectivityState::Online:
+            if (!is_online || is_disconnected) {
+                Serial.println("WiFi disconnected");
+                ++statistics.disconnect_num;
+                state = ConnectivityState::Backoff;
+                state_start = now;
+            } else if (is_lease_reused &&
+                       (GetSystemSeconds() >= GetLeaseRenewTime())) {
+                // The server only extends a lease which DHCP renews.
+                log_i("Reused lease is due, renew it by DHCP.");
+                is_lease_reused = false;
+                is_lease_pending = true;
+                wifi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0),
+                            IPAddress(0, 0, 0, 0));  // Enable DHCP.
+            } else if (is_lease_pending && (GetDHCPLeaseDuration() > 0)) {
+                is_lease_pending = false;
+                SaveCache();
+            }
+            break;
+        case ConnectivityState::Backoff:
+            if (static_cast<uint32_t>(now - state_start) >= backoff) {
+                backoff = (2 * backoff > kMaxBackoff) ? kMaxBackoff
+                                                      : 2 * backoff;
+                Connect();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool ConnectivityManager::IsOnline() const {
+    return (state == ConnectivityState::Online) && is_online;
+}
+
+ConnectivityState ConnectivityManager::GetState() const { return state; }
+
+ConnectivityStatistics ConnectivityManager::GetStatistics() const {
+    return statistics;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file connectivity.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Event driven WiFi connection with backoff.
+ */
+#ifndef BLUETOOTHGATEWAY_CONNECTIVITY_H_
+#define BLUETOOTHGATEWAY_CONNECTIVITY_H_
+
+#include <WiFi.h>
+
+/**
+ * @brief A enum for the state of WiFi connection.
+ */
+enum class ConnectivityState : uint8_t {
+    Idle,
+    Connecting,
+    Online,
+    Backoff,
+};
+
+/**
+ * @brief Counters of WiFi connection.
+ */
+struct ConnectivityStatistics {
+    uint32_t connect_num;
+    uint32_t disconnect_num;
+    uint32_t connect_timeout_num;
+    uint32_t fast_connect_num;
+    uint32_t first_connect_time;  // milliseconds since boot
+};
+
+/**
+ * @brief The last good connection cached in RTC memory.
+ * @details It survives the software and watchdog reset.
+ */
+struct WiFiConnectionCache {
+    uint32_t magic;
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    int64_t lease_time;       // seconds, 0 if no lease cached
+    uint32_t lease_duration;  // seconds granted by the DHCP server
+    uint32_t checksum;
+};
+
+/**
+ * @brief Keep WiFi connected without blocking the loop.
+ * @details The state is driven by WiFi events and Loop. A failed or lost
+ * connection is retried after an exponential backoff. A cached lease is
+ * reused as a static IP until half of it, when a DHCP client would renew
+ * it, and then DHCP takes over.
+ */
+class ConnectivityManager {
+   public:
+    static const uint32_t kConnectTimeout = 15000;  // milliseconds
+    static const uint32_t kMinBackoff = 1000;       // milliseconds
+    static const uint32_t kMaxBackoff = 60000;      // milliseconds
+    static const uint32_t kFastConnectTimeout = 5000;  // milliseconds
+    static const int64_t kLeaseReuseTime = 3600;       // seconds
+    ConnectivityManager(WiFiClass& wifi);
+    /**
+     * @brief Use static IP instead of DHCP. Call it before Begin.
+     * @param [in] ip
+     * @param [in] gateway
+     * @param [in] subnet
+     * @param [in] dns
+     */
+    void SetStaticIP(const IPAddress& ip, const IPAddress& gateway,
+                     const IPAddress& subnet, const IPAddress& dns);
+    /**
+     * @brief Start connecting and return immediately.
+     * @param [in] pSSID
+     * @param [in] pPassword
+     */
+    void Begin(const char* pSSID, const char* pPassword);
+    /**
+     * @brief Drive timeout and backoff. Call it in every loop.
+     */
+    void Loop();
+    /**
+     * @brief Whether WiFi is connected and has an IP.
+     */
+    bool IsOnline() const;
+    ConnectivityState GetState() const;
+    ConnectivityStatistics GetStatistics() const;
+
+   private:
+    WiFiClass& wifi;
+    const char* pSSID;
+    const char* pPassword;
+    ConnectivityState state;
+    uint32_t state_start;
+    uint32_t backoff;
+    ConnectivityStatistics statistics;
+    volatile bool is_online;
+    volatile bool is_disconnected;
+    bool is_static_ip;
+    bool is_fast_connecting;
+    bool is_lease_reused;
+    bool is_lease_pending;
+    int64_t lease_renew_time;
+    IPAddress static_ip;
+    IPAddress static_gateway;
+    IPAddress static_subnet;
+    IPAddress static_dns;
+    void Connect();
+    int64_t GetLeaseRenewTime() const;
+    void SaveCache();
+    void OnEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+};
+
+#endif
@@ -1,324 +1,714 @@
 #include "device.h"
 
 #include <Arduino.h>
-#include <BLEDevice.h>
+#include <freertos/FreeRTOS.h>
 
+#include <sys/time.h>
+
+#include <algorithm>
 #include <cmath>
 
+#include "cbor.h"
+#include "history.h"
+#include "metrics.h"
+#include "publisher.h"
+#include "recorder.h"
+#include "rules.h"
+#include "scheduler.h"
 #include "secrets.h"
+#include "settings.h"
+#include "trace.h"
 
-BLEUUID EnvironmentalSensorServiceUUID = BLEUUID(static_cast<uint16_t>(0x181A));
-BLEUUID TemperatureUUID = BLEUUID(static_cast<uint16_t>(0x2A6E));
-BLEUUID HumidityUUID = BLEUUID(static_cast<uint16_t>(0x2A6F));
-BLEUUID IlluminanceUUID = BLEUUID(static_cast<uint16_t>(0x2AFB));
+static const size_t kMaxCBORPayloadSize = 512;
+static bool is_cbor_state_enabled = false;
+static uint32_t next_sample_sequence = 1;
+// Guards the samples and the sequence shared with the BT host task.
+static portMUX_TYPE sample_mux = portMUX_INITIALIZER_UNLOCKED;
+// Clocks before 2021-01-01 are not synchronized by SNTP yet.
+static const time_t kMinSyncedEpoch = 1609459200;
 
-void DefaultClientCallbacks::onConnect(BLEClient* pClient) {
-    log_i("Connect to %s", pClient->getPeerAddress().toString().c_str());
-}
-void DefaultClientCallbacks::onDisconnect(BLEClient* pClient) {
-    log_i("Disconnect to %s", pClient->getPeerAddress().toString().c_str());
+AddressMatchCallbacks::AddressMatchCallbacks(const DeviceAddress& address,
+                                             bool* pResult)
+    : pTargetAvailable(pResult), rssi(0) {
+    memcpy(target_address, address.GetNative(), sizeof(target_address));
 }
-
-DefaultAdvertisedDeviceCallbacks::DefaultAdvertisedDeviceCallbacks(
-    const BLEAddress& address, BLEScan* pScan, bool* pResult)
-    : target_address(address), pScan(pScan), pTargetAvailable(pResult) {}
-void DefaultAdvertisedDeviceCallbacks::onResult(
-    BLEAdvertisedDevice advertised_device) {
-    if (advertised_device.getAddress() == target_address) {
-        log_i("Found device %s", target_address.toString().c_str());
-        *pTargetAvailable = true;
-        pScan->stop();
+bool AddressMatchCallbacks::onReport(const uint8_t* pAddress, int rssi,
+                                     const uint8_t* pPayload, size_t length) {
+    if (memcmp(pAddress, target_address, sizeof(target_address)) != 0) {
+        return false;
     }
+    log_i("Found device %02x:%02x:%02x:%02x:%02x:%02x", pAddress[0],
+          pAddress[1], pAddress[2], pAddress[3], pAddress[4], pAddress[5]);
+    *pTargetAvailable = true;
+    this->rssi = rssi;
+    return true;
 }
+int AddressMatchCallbacks::GetRSSI() const { return rssi; }
 
-Device::Device(const BLEAddress& address) : address(address) {}
-BLEAddress Device::GetAddress() const { return address; }
+Device::Device(const DeviceAddress& address) : address(address) {}
+DeviceAddress Device::GetAddress() const { return address; }
 
 /**
  * @brief Update data from BLE.
- * @param [in] pClient
- * @param [in] pScan
+ * @param [in] transport
  */
-void Device::Update(BLEClient* pClient, BLEScan* pScan) {}
+void Device::Update(BLETransport& transport) {}
 
 /**
  * @brief Push data through MQTT.
  * @param [in] wifi
  * @param [in] mqtt_client
  * @param [in] pMQTTClientID
+ * @return true If nothing is left to push.
+ * @return false If it should be pushed again when online.
  */
-void Device::Push(WiFiClass& wifi, PubSubClient& mqtt_client,
-                  const char* pMQTTClientID) {}
-
-EnvironmentSensor::EnvironmentSensor(const BLEAddress& address)
-    : Device(address) {}
-
-float EnvironmentSensor::temperature = -1;
-float EnvironmentSensor::humidity = -1;
-float EnvironmentSensor::illuminance = -1;
-bool EnvironmentSensor::is_temperature_updated = false;
-bool EnvironmentSensor::is_humidity_updated = false;
-bool EnvironmentSensor::is_illuminance_updated = false;
-
-void EnvironmentSensor::NotificationCallback(BLERemoteCharacteristic* pRemoteC,
-                                             uint8_t* pData, size_t length,
-                                             bool isNotify) {
-    log_i("Remote characteristic %s notify/indicate.",
-          pRemoteC->getUUID().toString().c_str());
-    if (TemperatureUUID.equals(pRemoteC->getUUID())) {
-        log_i(">>>Update temperature");
-        temperature = GetTemperature(pData);
-        is_temperature_updated = true;
-        log_i("%.2f °C", temperature);
-        log_i("<<<Update temperature");
-    }
-    if (HumidityUUID.equals(pRemoteC->getUUID())) {
-        log_i(">>>Update humidity");
-        humidity = GetHumidity(pData);
-        is_humidity_updated = true;
-        log_i("%.2f%%", humidity);
-        log_i("<<<Update humidity");
-    }
-    if (IlluminanceUUID.equals(pRemoteC->getUUID())) {
-        log_i(">>>Update illuminance");
-        illuminance = GetIlluminance(pData);
-        is_illuminance_updated = true;
-        log_i("%.1f lx", illuminance);
-        log_i("<<<Update illuminance");
+bool Device::Push(WiFiClass& wifi, PubSubClient& mqtt_client,
+                  const char* pMQTTClientID) {
+    return true;
+}
+
+SensorDevice::SensorDevice(const DeviceAddress& address,
+                           const DeviceDescriptor& descriptor)
+    : Device(address), descriptor(descriptor) {
+    for (size_t i = 0; i < kMaxCharacteristicNum; ++i) {
+        values[i] = NAN;
+        is_updated[i] = false;
+        is_provided[i] = false;
+        sample_uptimes[i] = 0;
+        sample_epochs[i] = 0;
+        sample_sequences[i] = 0;
     }
-    return;
+}
+
+void SensorDevice::SetValue(size_t index, float value) {
+    uint32_t uptime = millis();
+    uint64_t epoch = GetEpochMillis();
+    portENTER_CRITICAL(&sample_mux);
+    values[index] = value;
+    is_updated[index] = true;
+    sample_uptimes[index] = uptime;
+    sample_epochs[index] = epoch;
+    sample_sequences[index] = next_sample_sequence++;
+    if (next_sample_sequence == 0) {
+        next_sample_sequence = 1;  // 0 means not sampled.
+    }
+    portEXIT_CRITICAL(&sample_mux);
+    // The metrics, history and rules are synchronized by themselves.
+    IncrementMetric(Metric::Samples);
+    uint16_t uuid = descriptor.characteristics[index]->uuid;
+    if ((epoch != 0) && !std::isnan(value)) {
+        RecordHistory(address.GetNative(), uuid, epoch / 1000, value);
+    }
+    EvaluateRules(address.GetNative(), uuid, value, uptime, epoch / 1000);
+}
+
+void SensorDevice::CopySamples(SampleSnapshot& snapshot) const {
+    portENTER_CRITICAL(&sample_mux);
+    std::copy(values, values + kMaxCharacteristicNum, snapshot.values);
+    std::copy(is_updated, is_updated + kMaxCharacteristicNum,
+              snapshot.is_updated);
+    std::copy(sample_uptimes, sample_uptimes + kMaxCharacteristicNum,
+              snapshot.uptimes);
+    std::copy(sample_epochs, sample_epochs + kMaxCharacteristicNum,
+              snapshot.epochs);
+    std::copy(sample_sequences, sample_sequences + kMaxCharacteristicNum,
+              snapshot.sequences);
+    portEXIT_CRITICAL(&sample_mux);
+}
+
+uint32_t SensorDevice::GetSampleSequence(size_t index) const {
+    portENTER_CRITICAL(&sample_mux);
+    uint32_t sequence = sample_sequences[index];
+    portEXIT_CRITICAL(&sample_mux);
+    return sequence;
+}
+
+size_t SensorDevice::GetNewestSample(const SampleSnapshot& snapshot) const {
+    size_t newest = descriptor.characteristic_num;
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        if ((snapshot.sequences[i] != 0) &&
+            ((newest == descriptor.characteristic_num) ||
+             (static_cast<int32_t>(snapshot.uptimes[i] -
+                                   snapshot.uptimes[newest]) > 0))) {
+            newest = i;
+        }
+    }
+    return newest;
+}
+
+GattSensor::GattSensor(const DeviceAddress& address,
+                       const DeviceDescriptor& descriptor)
+    : SensorDevice(address, descriptor) {}
+
+GattSensor* GattSensor::pActiveSensor = nullptr;
+
+void GattSensor::OnIndication(size_t index, const uint8_t* pData,
+                              size_t length) {
+    GattSensor* pSensor = pActiveSensor;
+    if ((pSensor == nullptr) ||
+        (index >= pSensor->descriptor.characteristic_num)) {
+        return;
+    }
+    const CharacteristicDescriptor& characteristic =
+        *(pSensor->descriptor.characteristics[index]);
+    CaptureNotification(pSensor->address.GetNative(), characteristic.uuid,
+                        pData, length);
+    float value = NAN;
+    DecodeCharacteristic(characteristic, pData, length, value);
+    pSensor->SetValue(index, value);
+    log_i("Update %s: %.2f %s", characteristic.name, value,
+          characteristic.unit);
 }
 
 /**
- * @brief Read the notification data and save to static class member.
+ * @brief Read the values directly or wait for the indications.
  */
-void EnvironmentSensor::Update(BLEClient* pClient, BLEScan* pScan) {
+void GattSensor::Update(BLETransport& transport) {
     bool is_scanned = false;
-    DefaultAdvertisedDeviceCallbacks scan_callback(address, pScan, &is_scanned);
-    pScan->setAdvertisedDeviceCallbacks(&scan_callback);
-    pScan->start(1, false);
-    pScan->setAdvertisedDeviceCallbacks(
-        nullptr);  // Avoid point to local variables after exit.
+    AddressMatchCallbacks scan_callback(address, &is_scanned);
+    ScanDevices(transport, GetSetting(Setting::ScanDuration), &scan_callback);
     if (!is_scanned) {
-        log_i("Environment Sensor %s not found", address.toString().c_str());
+        log_i("%s %s not found", descriptor.object_id,
+              address.ToString().c_str());
         return;
     }
-    log_i("Environment Sensor %s found", address.toString().c_str());
-    if (!(pClient->connect(address))) {
-        log_i("Connect to Environment Sensor %s fail.",
-              address.toString().c_str());
+    log_i("%s %s found", descriptor.object_id, address.ToString().c_str());
+    if (!ClaimSensor(address.GetNative(), scan_callback.GetRSSI())) {
+        return;  // Read and published by another gateway.
+    }
+    uint16_t tag = GetTraceTag(address.GetNative());
+    TraceBegin(TraceStage::Connect, tag);
+    bool is_connected = transport.Connect(address.GetNative());
+    TraceEnd(TraceStage::Connect, tag);
+    if (!is_connected) {
+        log_i("Connect to %s %s fail.", descriptor.object_id,
+              address.ToString().c_str());
+        RecordRadioFailure(RadioFailure::BLEConnect);
         return;
     }
-    log_i("Connect to Environment Sensor %s succuss.",
-          address.toString().c_str());
-    BLERemoteService* pRemoteService =
-        pClient->getService(EnvironmentalSensorServiceUUID);
-    if (pRemoteService == nullptr) {
-        log_i("Environmental sensor service not found.");
-        pClient->disconnect();
+    log_i("Connect to %s %s succuss.", descriptor.object_id,
+          address.ToString().c_str());
+    uint32_t connect_time = millis();
+    bool is_direct_read =
+        descriptor.acquisition == GattAcquisition::DirectRead;
+    if (is_direct_read) {
+        transport.RequestFastConnection();
+    }
+    TraceBegin(TraceStage::Discovery, tag);
+    if (!transport.DiscoverService(descriptor.service_uuid)) {
+        TraceEnd(TraceStage::Discovery, tag);
+        log_i("Service 0x%04x not found.", descriptor.service_uuid);
+        transport.Disconnect();
         return;
     }
-    log_i("Environmental sensor service found.");
-    BLERemoteCharacteristic* pRemoteTemperature =
-        pRemoteService->getCharacteristic(TemperatureUUID);
-    BLERemoteCharacteristic* pRemoteHumidity =
-        pRemoteService->getCharacteristic(HumidityUUID);
-    BLERemoteCharacteristic* pRemoteIlluminance =
-        pRemoteService->getCharacteristic(IlluminanceUUID);
-    if ((pRemoteTemperature != nullptr) &&
-        (pRemoteTemperature->canIndicate())) {
-        log_i("Register callback for temperature.");
-        pRemoteTemperature->registerForNotify(NotificationCallback,
-                                              false);  // Enable indication.
-    }
-    if ((pRemoteHumidity != nullptr) && (pRemoteHumidity->canIndicate())) {
-        log_i("Register callback for humidity.");
-        pRemoteHumidity->registerForNotify(NotificationCallback, false);
-    }
-    if ((pRemoteIlluminance != nullptr) &&
-        (pRemoteIlluminance->canIndicate())) {
-        log_i("Register callback for illuminance.");
-        pRemoteIlluminance->registerForNotify(NotificationCallback, false);
+    log_i("Service 0x%04x found.", descriptor.service_uuid);
+    pActiveSensor = this;
+    size_t registered_num = 0;
+    bool is_readable[kMaxCharacteristicNum] = {false};
+    // The sensor is reused across cycles, so the indications of this update
+    // are told by the sequence instead of is_updated, which is only cleared
+    // by Push.
+    uint32_t last_sequences[kMaxCharacteristicNum];
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        last_sequences[i] = GetSampleSequence(i);
+    }
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        const CharacteristicDescriptor& characteristic =
+            *(descriptor.characteristics[i]);
+        uint8_t properties = transport.GetProperties(characteristic.uuid);
+        if (is_direct_read) {
+            if (properties & kPropertyRead) {
+                is_readable[i] = true;
+                is_provided[i] = true;
+            }
+            continue;
+        }
+        if ((properties & kPropertyIndicate) &&
+            transport.Subscribe(characteristic.uuid, i, OnIndication)) {
+            log_i("Register callback for %s.", characteristic.name);
+            is_provided[i] = true;
+            ++registered_num;
+        }
+    }
+    TraceEnd(TraceStage::Discovery, tag);
+    if (is_direct_read) {
+        TraceBegin(TraceStage::Read, tag);
+        for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+            std::string raw;
+            if (!is_readable[i] ||
+                !transport.Read(descriptor.characteristics[i]->uuid, raw)) {
+                continue;
+            }
+            float value = NAN;
+            DecodeCharacteristic(*(descriptor.characteristics[i]),
+                                 reinterpret_cast<const uint8_t*>(raw.data()),
+                                 raw.size(), value);
+            SetValue(i, value);
+        }
+        TraceEnd(TraceStage::Read, tag);
+        log_i("Read %s in %d ms after connected.", descriptor.object_id,
+              static_cast<uint32_t>(millis() - connect_time));
+        transport.Disconnect();
+        pActiveSensor = nullptr;
+        return;
     }
+    TraceBegin(TraceStage::NotifyWait, tag);
     uint32_t wait = millis();
-    while ((static_cast<uint32_t>(millis() - wait) <= 10000U) &&
-           !(is_temperature_updated && is_humidity_updated &&
-             is_illuminance_updated)) {
-        // Wait all characteristic update.
+    uint32_t notify_timeout = GetSetting(Setting::NotifyTimeout);
+    while (static_cast<uint32_t>(millis() - wait) <= notify_timeout) {
+        // Wait all registered characteristic update.
+        size_t updated_num = 0;
+        for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+            updated_num +=
+                (GetSampleSequence(i) != last_sequences[i]) ? 1 : 0;
+        }
+        if (updated_num >= registered_num) {
+            break;
+        }
+    }
+    TraceEnd(TraceStage::NotifyWait, tag);
+    transport.Disconnect();
+    pActiveSensor = nullptr;
+    return;
+}
+
+AdvertisementSensorCallbacks::AdvertisementSensorCallbacks(
+    AdvertisementSensor* const* pSensors, size_t sensor_num)
+    : pSensors(pSensors),
+      sensor_num(std::min(sensor_num, static_cast<size_t>(kMaxDevNum))),
+      decoded_num(0) {
+    for (size_t i = 0; i < this->sensor_num; ++i) {
+        DeviceAddress address = pSensors[i]->GetAddress();
+        memcpy(addresses[i], address.GetNative(), sizeof(addresses[i]));
+        is_decoded[i] = false;
+    }
+}
+bool AdvertisementSensorCallbacks::onReport(const uint8_t* pAddress, int rssi,
+                                            const uint8_t* pPayload,
+                                            size_t length) {
+    for (size_t i = 0; i < sensor_num; ++i) {
+        if (memcmp(pAddress, addresses[i], sizeof(addresses[i])) != 0) {
+            continue;
+        }
+        if (pSensors[i]->OnReport(rssi, pPayload, length) && !is_decoded[i]) {
+            is_decoded[i] = true;
+            ++decoded_num;
+        }
+        return decoded_num == sensor_num;
+    }
+    return false;
+}
+
+// The advertisement sensors alive, which share a scan.
+static AdvertisementSensor* advertisement_sensors[kMaxDevNum];
+static size_t advertisement_sensor_num = 0;
+
+AdvertisementSensor::AdvertisementSensor(const DeviceAddress& address,
+                                         const DeviceDescriptor& descriptor)
+    : SensorDevice(address, descriptor),
+      is_scanned(false),
+      is_sighted(false),
+      rssi(0) {
+    if (advertisement_sensor_num < kMaxDevNum) {
+        advertisement_sensors[advertisement_sensor_num++] = this;
+    } else {
+        log_w("Too many advertisement sensors to share a scan.");
+    }
+}
+
+AdvertisementSensor::~AdvertisementSensor() {
+    AdvertisementSensor** pEnd =
+        advertisement_sensors + advertisement_sensor_num;
+    if (std::remove(advertisement_sensors, pEnd, this) != pEnd) {
+        --advertisement_sensor_num;
+    }
+}
+
+bool AdvertisementSensor::DecodePayload(const uint8_t* pPayload,
+                                        size_t length) {
+    AdvertisementSample samples[kMaxCharacteristicNum];
+    size_t sample_num = DecodeAdvertisingPayload(pPayload, length, samples,
+                                                 kMaxCharacteristicNum);
+    bool is_any_updated = false;
+    for (size_t i = 0; i < sample_num; ++i) {
+        for (size_t j = 0; j < descriptor.characteristic_num; ++j) {
+            if (descriptor.characteristics[j] == samples[i].pCharacteristic) {
+                SetValue(j, samples[i].value);
+                is_provided[j] = true;
+                is_any_updated = true;
+                break;
+            }
+        }
+    }
+    log_i("Decode %d samples from advertisement.", sample_num);
+    return is_any_updated;
+}
+
+bool AdvertisementSensor::OnReport(int rssi, const uint8_t* pPayload,
+                                   size_t length) {
+    is_sighted = true;
+    this->rssi = rssi;
+    return DecodePayload(pPayload, length);
+}
+
+/**
+ * @brief Save the decoded values of the shared scan.
+ * @details A sensor without reports since its last update runs the scan
+ * for all the sensors, so the scan runs once per cycle over the devices.
+ */
+void AdvertisementSensor::Update(BLETransport& transport) {
+    if (!is_scanned) {
+        AdvertisementSensor* const* pSensors = advertisement_sensors;
+        size_t sensor_num = advertisement_sensor_num;
+        AdvertisementSensor* pSelf = this;
+        if (std::find(pSensors, pSensors + sensor_num, this) ==
+            pSensors + sensor_num) {
+            pSensors = &pSelf;  // Beyond the shared sensors.
+            sensor_num = 1;
+        }
+        for (size_t i = 0; i < sensor_num; ++i) {
+            pSensors[i]->is_scanned = true;
+            pSensors[i]->is_sighted = false;
+        }
+        AdvertisementSensorCallbacks scan_callback(pSensors, sensor_num);
+        ScanDevices(transport, GetSetting(Setting::ScanDuration),
+                    &scan_callback);
+    }
+    is_scanned = false;
+    if (is_sighted && !ClaimSensor(address.GetNative(), rssi)) {
+        // Published by another gateway.
+        portENTER_CRITICAL(&sample_mux);
+        for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+            is_updated[i] = false;
+        }
+        portEXIT_CRITICAL(&sample_mux);
     }
-    pClient->disconnect();
     return;
 }
 
 /**
  * @brief Get a string of mac address without colon.
- * @param [in] address BLEAddress
+ * @param [in] address
  * @return std::string
  */
-std::string GetMACWithoutColon(BLEAddress& address) {
-    std::string result = address.toString();
+std::string GetMACWithoutColon(const DeviceAddress& address) {
+    std::string result = address.ToString();
     result.erase(std::remove(result.begin(), result.end(), ':'), result.end());
     return result;
 }
 
+uint64_t GetEpochMillis() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    if (now.tv_sec < kMinSyncedEpoch) {
+        return 0;
+    }
+    return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+void SetCBORStatePayload(bool is_enabled) {
+    is_cbor_state_enabled = is_enabled;
+}
+
 /**
- * @brief Push BLE data through MQTT.
+ * @brief Publish the state as a CBOR map of the same keys as JSON.
+ * @details The payload is encoded into a stack buffer without allocation.
  */
-void EnvironmentSensor::Push(WiFiClass& wifi, PubSubClient& mqtt_client,
-                             const char* pMQTTClientID) {
-    if (!is_temperature_updated && !is_humidity_updated &&
-        !is_illuminance_updated) {
+void SensorDevice::PushCBORState(PubSubClient& mqtt_client,
+                                 const std::string& topic,
+                                 const SampleSnapshot& snapshot) {
+    uint32_t start = micros();
+    uint8_t payload[kMaxCBORPayloadSize];
+    CborWriter writer(payload, sizeof(payload));
+    size_t provided_num = 0;
+    size_t sampled_num = 0;
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        provided_num += is_provided[i] ? 1 : 0;
+        sampled_num +=
+            (is_provided[i] && (snapshot.sequences[i] != 0)) ? 1 : 0;
+    }
+    size_t newest = GetNewestSample(snapshot);
+    bool is_sampled = newest < descriptor.characteristic_num;
+    writer.WriteMap(provided_num + (is_sampled ? 2 : 0));
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        if (!is_provided[i]) {
+            continue;
+        }
+        writer.WriteText(descriptor.characteristics[i]->name);
+        float value = snapshot.values[i];
+        if (!std::isnan(value)) {
+            value = round(10 * value) / 10.0;  // Same precision as JSON.
+        }
+        writer.WriteFloat(value);
+    }
+    if (is_sampled) {
+        writer.WriteText("sampled_at");
+        writer.WriteArray(2);
+        if (snapshot.epochs[newest] == 0) {
+            writer.WriteNull();
+        } else {
+            writer.WriteUInt(snapshot.epochs[newest]);
+        }
+        writer.WriteUInt(snapshot.uptimes[newest]);
+        writer.WriteText("samples");
+        writer.WriteMap(sampled_num);
+        for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+            if (!is_provided[i] || (snapshot.sequences[i] == 0)) {
+                continue;
+            }
+            writer.WriteText(descriptor.characteristics[i]->name);
+            writer.WriteArray(2);
+            writer.WriteUInt(snapshot.uptimes[newest] - snapshot.uptimes[i]);
+            writer.WriteUInt(snapshot.sequences[i]);
+        }
+    }
+    if (!writer.IsValid()) {
+        log_i("CBOR state exceeds %d bytes.", kMaxCBORPayloadSize);
         return;
     }
-    is_temperature_updated = false;
-    is_humidity_updated = false;
-    is_illuminance_updated = false;
+    log_i("Encode CBOR state %d bytes in %d us.", writer.GetLength(),
+          static_cast<uint32_t>(micros() - start));
+    PublishMessage(mqtt_client, topic.c_str(), payload, writer.GetLength());
+}
+
+/**
+ * @brief Push BLE data through MQTT.
+ * @details The values stay updated until they are queued or published.
+ * The samples are copied first, since indications may still arrive.
+ */
+bool SensorDevice::Push(WiFiClass& wifi, PubSubClient& mqtt_client,
+                        const char* pMQTTClientID) {
+    SampleSnapshot snapshot;
+    CopySamples(snapshot);
+    uint32_t updated_num = 0;
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        updated_num += snapshot.is_updated[i] ? 1 : 0;
+    }
+    if (updated_num == 0) {
+        return true;
+    }
     if (!wifi.isConnected()) {
-        if (!wifi.reconnect()) {
-            log_i("Fail to connect to WiFi.");
-            return;
+        log_i("WiFi is not connected.");
+        return false;
+    }
+    // The queued messages are sent after connecting by the publisher.
+    if (!IsMQTTPublisherActive() && !ConnectMQTT(mqtt_client, pMQTTClientID)) {
+        log_i("Fail to connect to MQTT server.");
+        RecordRadioFailure(RadioFailure::MQTTConnect);
+        return false;
+    }
+    std::string object_id = descriptor.object_id;
+    std::string suffix = GetMACWithoutColon(address);
+    std::string topic_prefix =
+        "homeassistant/sensor/" + object_id + "-" + suffix;
+    std::string state_topic = topic_prefix + "/state";
+    std::string state_payload = "{";
+    log_i(">>>Publish config topics");
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        if (!is_provided[i]) {
+            continue;  // Not provided by the remote device.
+        }
+        const CharacteristicDescriptor& characteristic =
+            *(descriptor.characteristics[i]);
+        std::string name = characteristic.name;
+        std::string config_topic = topic_prefix + "/" + name + "/config";
+        std::string config_payload = "{";
+        if (characteristic.device_class != nullptr) {
+            config_payload += "\"device_class\":\"" +
+                              std::string(characteristic.device_class) + "\",";
         }
+        if (characteristic.unit != nullptr) {
+            config_payload += "\"unit_of_measurement\":\"" +
+                              std::string(characteristic.unit) + "\",";
+        }
+        config_payload +=
+            "\"state_class\":\"measurement\",\"name\":\"" + name + "_" +
+            suffix + "\",\"state_topic\":\"" + state_topic +
+            "\",\"unique_id\":\"" + object_id + "_" + suffix + "_" + name +
+            "\",\"device\":{\"identifiers\":\"" + suffix + "\",\"name\":\"" +
+            object_id + "-" + suffix +
+            "\"},\"value_template\":\"{{value_json." + name + "}}\"}";
+        PublishMessage(mqtt_client, config_topic.c_str(),
+                       reinterpret_cast<const uint8_t*>(config_payload.c_str()),
+                       config_payload.size());
+        std::string value_string =
+            std::isnan(snapshot.values[i])
+                ? "\"unknown\""
+                : std::to_string(round(10 * snapshot.values[i]) / 10.0);
+        state_payload += (state_payload.size() == 1 ? "\"" : ",\"") + name +
+                         "\":" + value_string;
+    }
+    size_t newest = GetNewestSample(snapshot);
+    if (newest < descriptor.characteristic_num) {
+        // Ages are relative to the newest sample.
+        state_payload += ",\"sampled_at\":[" +
+                         (snapshot.epochs[newest] == 0
+                              ? std::string("null")
+                              : std::to_string(snapshot.epochs[newest])) +
+                         "," + std::to_string(snapshot.uptimes[newest]) +
+                         "],\"samples\":{";
+        bool is_first = true;
+        for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+            if (!is_provided[i] || (snapshot.sequences[i] == 0)) {
+                continue;
+            }
+            state_payload +=
+                (is_first ? "\"" : ",\"") +
+                std::string(descriptor.characteristics[i]->name) + "\":[" +
+                std::to_string(snapshot.uptimes[newest] -
+                               snapshot.uptimes[i]) +
+                "," + std::to_string(snapshot.sequences[i]) + "]";
+            is_first = false;
+        }
+        state_payload += "}";
+    }
+    state_payload += "}";
+    log_i("<<<Publish config topics");
+    log_i(">>>Publish state topics");
+    if (!PublishMessage(
+            mqtt_client, state_topic.c_str(),
+            reinterpret_cast<const uint8_t*>(state_payload.c_str()),
+            state_payload.size())) {
+        return false;  // Keep the values for the next push.
     }
-    bool mqtt_connected = false;
+    if (is_cbor_state_enabled) {
+        PushCBORState(mqtt_client, state_topic + "/cbor", snapshot);
+    }
+    log_i("<<<Publish state topics");
+    // The samples stamped during the push stay updated.
+    portENTER_CRITICAL(&sample_mux);
+    for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+        if (sample_sequences[i] == snapshot.sequences[i]) {
+            is_updated[i] = false;
+        }
+    }
+    portEXIT_CRITICAL(&sample_mux);
+    AddDeviceSamples((object_id + "-" + suffix).c_str(), updated_num);
+    return true;
+}
+
+constexpr const CharacteristicDescriptor*
+    kEnvironmentSensorCharacteristics[] = {&kTemperatureCharacteristic,
+                                           &kHumidityCharacteristic,
+                                           &kIlluminanceCharacteristic};
+
+constexpr DeviceDescriptor kEnvironmentSensorDescriptor = {
+    "environment_sensor", 0x181A, kEnvironmentSensorCharacteristics,
+    sizeof(kEnvironmentSensorCharacteristics) /
+        sizeof(kEnvironmentSensorCharacteristics[0]),
+    GattAcquisition::Indication};
+
+constexpr DeviceDescriptor kEnvironmentalSensingDescriptor = {
+    "environmental_sensing", 0x181A, kEnvironmentalSensingCharacteristics,
+    kEnvironmentalSensingCharacteristicNum, GattAcquisition::DirectRead};
+
+constexpr const CharacteristicDescriptor*
+    kAdvertisementSensorCharacteristics[] = {
+        &kTemperatureCharacteristic,
+        &kHumidityCharacteristic,
+        &kPressureCharacteristic,
+        &kIlluminanceCharacteristic,
+        &kDewPointCharacteristic,
+        &kCO2ConcentrationCharacteristic,
+        &kUVIndexCharacteristic,
+        &kRainfallCharacteristic,
+        &kBatteryLevelCharacteristic,
+        &kVoltageCharacteristic,
+};
+
+constexpr DeviceDescriptor kAdvertisementSensorDescriptor = {
+    "advertisement_sensor", 0, kAdvertisementSensorCharacteristics,
+    sizeof(kAdvertisementSensorCharacteristics) /
+        sizeof(kAdvertisementSensorCharacteristics[0]),
+    GattAcquisition::Indication};
+
+static_assert(kEnvironmentSensorDescriptor.characteristic_num <=
+                  SensorDevice::kMaxCharacteristicNum,
+              "Too many characteristics of kEnvironmentSensorDescriptor.");
+static_assert(kEnvironmentalSensingDescriptor.characteristic_num <=
+                  SensorDevice::kMaxCharacteristicNum,
+              "Too many characteristics of kEnvironmentalSensingDescriptor.");
+static_assert(kAdvertisementSensorDescriptor.characteristic_num <=
+                  SensorDevice::kMaxCharacteristicNum,
+              "Too many characteristics of kAdvertisementSensorDescriptor.");
+
+/**
+ * @brief The registry of supported device types.
+ * @details Add a DeviceType with its descriptor here to support a new device.
+ */
+constexpr DeviceRegistration kDeviceRegistry[] = {
+    {DeviceType::BluetoothEnvironmentSensor, &kEnvironmentSensorDescriptor,
+     CreateSensorDevice<GattSensor, kEnvironmentSensorDescriptor>},
+    {DeviceType::BluetoothEnvironmentalSensing,
+     &kEnvironmentalSensingDescriptor,
+     CreateSensorDevice<GattSensor, kEnvironmentalSensingDescriptor>},
+    {DeviceType::BluetoothAdvertisementSensor, &kAdvertisementSensorDescriptor,
+     CreateSensorDevice<AdvertisementSensor, kAdvertisementSensorDescriptor>},
+};
+
+bool ConnectMQTT(PubSubClient& mqtt_client, const char* pMQTTClientID) {
+    if (mqtt_client.connected()) {
+        return true;
+    }
+    ScopedTrace trace(TraceStage::MQTTConnect, 0);
     std::string mqtt_user = MQTT_USER;
     std::string mqtt_password = MQTT_PASSWORD;
     if (mqtt_user.empty() || mqtt_password.empty()) {
-        mqtt_connected = mqtt_client.connect(pMQTTClientID);
-
-    } else {
-        mqtt_connected = mqtt_client.connect(pMQTTClientID, mqtt_user.c_str(),
-                                             mqtt_password.c_str());
-    }
-    if (mqtt_connected) {
-        std::string suffix = GetMACWithoutColon(address);
-        std::string state_topic =
-            "homeassistant/sensor/environment_sensor-" + suffix + "/state";
-        std::string temperature_config_topic =
-            "homeassistant/sensor/environment_sensor-" + suffix +
-            "/temperature/config";
-        std::string temperature_config_payload =
-            "{\"device_class\":\"temperature\",\"unit_of_measurement\":"
-            "\"°C\","
-            "\"state_class\":\"measurement\",\"name\":\"temperature_" +
-            suffix + "\",\"state_topic\":\"" + state_topic +
-            "\",\"unique_id\":\"environment_sensor_" + suffix +
-            "_temperature\",\"device\":{\"identifiers\":\"" + suffix +
-            "\",\"name\":\"environment_sensor-" + suffix +
-            "\"},\"value_template\":\"{{value_json.temperature}}\"}";
-        std::string humidity_config_topic =
-            "homeassistant/sensor/environment_sensor-" + suffix +
-            "/humidity/config";
-        std::string humidity_config_payload =
-            "{\"device_class\":\"humidity\",\"unit_of_measurement\":\"%\","
-            "\"state_class\":\"measurement\",\"name\":\"humidity_" +
-            suffix + "\",\"state_topic\":\"" + state_topic +
-            "\",\"unique_id\":\"environment_sensor_" + suffix +
-            "_humidity\",\"device\":{\"identifiers\":\"" + suffix +
-            "\",\"name\":\"environment_sensor-" + suffix +
-            "\"},\"value_template\":\"{{value_json.humidity}}\"}";
-        std::string illuminance_config_topic =
-            "homeassistant/sensor/environment_sensor-" + suffix +
-            "/illuminance/config";
-        std::string illuminance_config_payload =
-            "{\"device_class\":\"illuminance\",\"unit_of_measurement\":"
-            "\"lx\","
-            "\"state_class\":\"measurement\",\"name\":\"illuminance_" +
-            suffix + "\",\"state_topic\":\"" + state_topic +
-            "\",\"unique_id\":\"environment_sensor_" + suffix +
-            "_illuminance\",\"device\":{\"identifiers\":\"" + suffix +
-            "\",\"name\":\"environment_sensor-" + suffix +
-            "\"},\"value_template\":\"{{value_json.illuminance}}\"}";
-        log_i(">>>Publish config topics");
-        mqtt_client.publish(temperature_config_topic.c_str(),
-                            temperature_config_payload.c_str());
-        mqtt_client.publish(humidity_config_topic.c_str(),
-                            humidity_config_payload.c_str());
-        mqtt_client.publish(illuminance_config_topic.c_str(),
-                            illuminance_config_payload.c_str());
-        log_i("<<<Publish config topics");
-        std::string temperature_string =
-            (temperature == -1)
-                ? "\"unknown\""
-                : std::to_string(round(10 * temperature) / 10.0);
-        std::string humidity_string =
-            (humidity == -1) ? "\"unknown\""
-                             : std::to_string(round(10 * humidity) / 10.0);
-        std::string illuminance_string =
-            (illuminance == -1)
-                ? "\"unknown\""
-                : std::to_string(round(10 * illuminance) / 10.0);
-        std::string state_payload = "{\"temperature\":" + temperature_string +
-                                    ",\"humidity\":" + humidity_string +
-                                    ",\"illuminance\":" + illuminance_string +
-                                    "}";
-        log_i(">>>Publish state topics");
-        mqtt_client.publish(state_topic.c_str(), state_payload.c_str());
-        log_i("<<<Publish state topics");
-    } else {
-        log_i("Fail to connect to MQTT server.");
+        return mqtt_client.connect(pMQTTClientID);
     }
-    return;
+    return mqtt_client.connect(pMQTTClientID, mqtt_user.c_str(),
+                               mqtt_password.c_str());
 }
 
 void GetStoredDeviceTypeAddress(const std::string& name, Preferences* pPrefs,
                                 DeviceType& device_type,
-                                BLEAddress& device_address) {
+                                DeviceAddress& device_address) {
     std::string dev_type_key = name + ".type";
     std::string dev_mac_key = name + ".mac";
     device_type =
         static_cast<DeviceType>(pPrefs->getUChar(dev_type_key.c_str(), 0xFF));
     String mac = pPrefs->getString(dev_mac_key.c_str(), "00:00:00:00:00:00");
     std::string mac_std(mac.c_str());
-    device_address = BLEAddress(mac_std);
+    device_address = DeviceAddress(mac_std);
 }
 
-std::unique_ptr<Device> GetDevice(const DeviceType& device_type,
-                                  const BLEAddress& address) {
-    switch (device_type) {
-        case DeviceType::BluetoothEnvironmentSensor: {
-            log_i("Get an environment sensor.");
-            std::unique_ptr<Device> dev(new EnvironmentSensor(address));
-            return dev;
-            break;
+const DeviceRegistration* FindDeviceRegistration(
+    const DeviceType& device_type) {
+    for (const DeviceRegistration& registration : kDeviceRegistry) {
+        if (registration.type == device_type) {
+            return &registration;
         }
-        default:
-            log_i("DeviceType 0x%02x not found.",
-                  static_cast<uint8_t>(device_type));
-            return nullptr;
-            break;
     }
+    return nullptr;
 }
 
-float GetTemperature(const uint8_t* pData) {
-    if ((pData[0] == 0x00) && (pData[1] == 0x80)) {
-        return -1;
+std::unique_ptr<Device> GetDevice(const DeviceType& device_type,
+                                  const DeviceAddress& address) {
+    const DeviceRegistration* pRegistration =
+        FindDeviceRegistration(device_type);
+    if (pRegistration == nullptr) {
+        log_i("DeviceType 0x%02x not found.",
+              static_cast<uint8_t>(device_type));
+        return nullptr;
     }
-    int16_t value = 0;
-    value |= pData[0];
-    value |= (pData[1] << 8);
-    float result = value * 0.01;
+    log_i("Get a %s.", pRegistration->pDescriptor->object_id);
+    return pRegistration->create(address);
+}
+
+float GetTemperature(const uint8_t* pData) {
+    float result = -1;
+    DecodeCharacteristic(kTemperatureCharacteristic, pData, 2, result);
     return result;
 }
 
 float GetHumidity(const uint8_t* pData) {
-    if ((pData[0] == 0xFF) && (pData[1] == 0xFF)) {
-        return -1;
-    }
-    uint16_t value = 0;
-    value |= pData[0];
-    value |= (pData[1] << 8);
-    float result = value * 0.01;
+    float result = -1;
+    DecodeCharacteristic(kHumidityCharacteristic, pData, 2, result);
     return result;
 }
 
 float GetIlluminance(const uint8_t* pData) {
-    if ((pData[0] == 0xFF) && (pData[1] == 0xFF) && (pData[2] == 0xFF)) {
-        return -1;
-    }
-    uint32_t value = 0;
-    value |= pData[0];
-    value |= (pData[1] << 8);
-    value |= (pData[2] << 16);
-    float result = value * 0.01;
+    float result = -1;
+    DecodeCharacteristic(kIlluminanceCharacteristic, pData, 3, result);
     return result;
 }
\ No newline at end of file
@@ -6,37 +6,34 @@
 #ifndef BLUETOOTHGATEWAY_BLE_CLIENT_H_
 #define BLUETOOTHGATEWAY_BLE_CLIENT_H_
 
-#include <BLEClient.h>
 #include <Preferences.h>
 #include <PubSubClient.h>
 #include <WiFi.h>
 
 #include <memory>
 
+#include "address.h"
+#include "advertisement.h"
+#include "characteristic.h"
 #include "command.h"
+#include "ownership.h"
+#include "scan.h"
+#include "settings.h"
 
 /**
- * @brief Default client callback function.
+ * @brief Scan callback to find the target device.
  */
-class DefaultClientCallbacks : public BLEClientCallbacks {
+class AddressMatchCallbacks : public ScanReportCallbacks {
    public:
-    void onConnect(BLEClient* pClient);
-    void onDisconnect(BLEClient* pClient);
-};
-
-/**
- * @brief Default callback function of BLEScan.
- */
-class DefaultAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
-   public:
-    DefaultAdvertisedDeviceCallbacks(const BLEAddress& address, BLEScan* pScan,
-                                     bool* pResult);
-    void onResult(BLEAdvertisedDevice advertised_device);
+    AddressMatchCallbacks(const DeviceAddress& address, bool* pResult);
+    bool onReport(const uint8_t* pAddress, int rssi, const uint8_t* pPayload,
+                  size_t length) override;
+    int GetRSSI() const;
 
    private:
-    BLEAddress target_address;
-    BLEScan* pScan;
+    uint8_t target_address[6];
     bool* pTargetAvailable;
+    int rssi;
 };
 
 /**
@@ -44,39 +41,211 @@ class DefaultAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
  */
 class Device {
    public:
-    Device(const BLEAddress& address);
-    BLEAddress GetAddress() const;
+    Device(const DeviceAddress& address);
+    DeviceAddress GetAddress() const;
     virtual ~Device(){};
-    virtual void Update(BLEClient* pClient, BLEScan* pScan);
-    virtual void Push(WiFiClass& wifi, PubSubClient& mqtt_client,
+    virtual void Update(BLETransport& transport);
+    virtual bool Push(WiFiClass& wifi, PubSubClient& mqtt_client,
                       const char* pMQTTClientID);
 
    protected:
-    BLEAddress address;
+    DeviceAddress address;
 };
 
 /**
- * @brief The class of self-made environment sensor.
+ * @brief The class of the remote device described by a DeviceDescriptor.
+ * @details The values are published following the order of the
+ * characteristics in the descriptor.
  */
-class EnvironmentSensor : public Device {
+class SensorDevice : public Device {
    public:
-    EnvironmentSensor(const BLEAddress& address);
-    void Update(BLEClient* pClient, BLEScan* pScan) override;
-    void Push(WiFiClass& wifi, PubSubClient& mqtt_client,
+    static const size_t kMaxCharacteristicNum = 24;
+    SensorDevice(const DeviceAddress& address,
+                 const DeviceDescriptor& descriptor);
+    bool Push(WiFiClass& wifi, PubSubClient& mqtt_client,
               const char* pMQTTClientID) override;
-    static void NotificationCallback(BLERemoteCharacteristic* pRemoteC,
-                                     uint8_t* pData, size_t length,
-                                     bool isNotify);
+
+   protected:
+    const DeviceDescriptor& descriptor;
+    float values[kMaxCharacteristicNum];
+    bool is_updated[kMaxCharacteristicNum];
+    bool is_provided[kMaxCharacteristicNum];
+    // Uptime and wall clock in milliseconds when sampled and the sample
+    // sequence number which is 0 if not sampled.
+    uint32_t sample_uptimes[kMaxCharacteristicNum];
+    uint64_t sample_epochs[kMaxCharacteristicNum];
+    uint32_t sample_sequences[kMaxCharacteristicNum];
+    /**
+     * @brief The samples copied at once for the loop task.
+     */
+    struct SampleSnapshot {
+        float values[kMaxCharacteristicNum];
+        bool is_updated[kMaxCharacteristicNum];
+        uint32_t uptimes[kMaxCharacteristicNum];
+        uint64_t epochs[kMaxCharacteristicNum];
+        uint32_t sequences[kMaxCharacteristicNum];
+    };
+    /**
+     * @brief Set an updated value and stamp it with the current time.
+     * @details Called from the BT host task by indications and scan
+     * reports, so the samples are only accessed under the sample lock.
+     * @param [in] index
+     * @param [in] value
+     */
+    void SetValue(size_t index, float value);
+    void CopySamples(SampleSnapshot& snapshot) const;
+    uint32_t GetSampleSequence(size_t index) const;
+    /**
+     * @brief Get the newest stamped sample.
+     * @param [in] snapshot
+     * @return size_t descriptor.characteristic_num if nothing is stamped.
+     */
+    size_t GetNewestSample(const SampleSnapshot& snapshot) const;
+    void PushCBORState(PubSubClient& mqtt_client, const std::string& topic,
+                       const SampleSnapshot& snapshot);
+};
+
+/**
+ * @brief The sensor read by GATT connection.
+ * @details Characteristics are subscribed for indication and the
+ * indication is dispatched by the characteristic index.
+ */
+class GattSensor : public SensorDevice {
+   public:
+    GattSensor(const DeviceAddress& address,
+               const DeviceDescriptor& descriptor);
+    void Update(BLETransport& transport) override;
+    static void OnIndication(size_t index, const uint8_t* pData,
+                             size_t length);
+
+   private:
+    static GattSensor* pActiveSensor;
+};
+
+/**
+ * @brief The sensor which broadcasts its values in advertisements.
+ * @details No connection is made. The advertisement is decoded by the
+ * format found by its service UUID or company ID. The sensors share one
+ * scan, run by the first sensor updated after it, and the reports are
+ * dispatched by address.
+ */
+class AdvertisementSensor : public SensorDevice {
+   public:
+    AdvertisementSensor(const DeviceAddress& address,
+                        const DeviceDescriptor& descriptor);
+    ~AdvertisementSensor() override;
+    void Update(BLETransport& transport) override;
+    /**
+     * @brief Decode the advertising payload and update values.
+     * @param [in] pPayload
+     * @param [in] length
+     * @return true If any value is updated.
+     * @return false
+     */
+    bool DecodePayload(const uint8_t* pPayload, size_t length);
+    /**
+     * @brief Record a sighting in the shared scan and decode its payload.
+     * @param [in] rssi
+     * @param [in] pPayload
+     * @param [in] length
+     * @return true If any value is updated.
+     * @return false
+     */
+    bool OnReport(int rssi, const uint8_t* pPayload, size_t length);
+
+   private:
+    // Reported by a shared scan since the last update.
+    bool is_scanned;
+    bool is_sighted;
+    int rssi;
+};
+
+/**
+ * @brief Scan callback of the AdvertisementSensors sharing a scan.
+ * @details The scan stops when every sensor has decoded a value.
+ */
+class AdvertisementSensorCallbacks : public ScanReportCallbacks {
+   public:
+    /**
+     * @param [in] pSensors At most kMaxDevNum sensors.
+     * @param [in] sensor_num
+     */
+    AdvertisementSensorCallbacks(AdvertisementSensor* const* pSensors,
+                                 size_t sensor_num);
+    bool onReport(const uint8_t* pAddress, int rssi, const uint8_t* pPayload,
+                  size_t length) override;
 
    private:
-    static float temperature;
-    static float humidity;
-    static float illuminance;
-    static bool is_temperature_updated;
-    static bool is_humidity_updated;
-    static bool is_illuminance_updated;
+    AdvertisementSensor* const* pSensors;
+    size_t sensor_num;
+    size_t decoded_num;
+    uint8_t addresses[kMaxDevNum][6];
+    bool is_decoded[kMaxDevNum];
 };
 
+extern const DeviceDescriptor kEnvironmentSensorDescriptor;
+/**
+ * @brief Any device with the Environmental Sensing Service.
+ */
+extern const DeviceDescriptor kEnvironmentalSensingDescriptor;
+/**
+ * @brief Any device broadcasting a built-in advertisement format.
+ */
+extern const DeviceDescriptor kAdvertisementSensorDescriptor;
+
+typedef std::unique_ptr<Device> (*DeviceFactory)(const DeviceAddress& address);
+
+/**
+ * @brief Create a SensorDevice from a compile-time descriptor.
+ * @tparam T The class derived from SensorDevice.
+ * @tparam kDescriptor
+ * @param [in] address
+ * @return std::unique_ptr<Device>
+ */
+template <typename T, const DeviceDescriptor& kDescriptor>
+std::unique_ptr<Device> CreateSensorDevice(const DeviceAddress& address) {
+    return std::unique_ptr<Device>(new T(address, kDescriptor));
+}
+
+/**
+ * @brief An entry of the device type registry.
+ */
+struct DeviceRegistration {
+    DeviceType type;
+    const DeviceDescriptor* pDescriptor;
+    DeviceFactory create;
+};
+
+/**
+ * @brief Find the registration of the device type.
+ * @param [in] device_type
+ * @return const DeviceRegistration* nullptr if not registered.
+ */
+const DeviceRegistration* FindDeviceRegistration(const DeviceType& device_type);
+
+/**
+ * @brief Publish the state in CBOR on `<state topic>/cbor` as well.
+ * @details The JSON state topic for Home Assistant is always published.
+ * @param [in] is_enabled
+ */
+void SetCBORStatePayload(bool is_enabled);
+
+/**
+ * @brief Get the wall clock in milliseconds since epoch.
+ * @return uint64_t 0 if the clock is not synchronized yet.
+ */
+uint64_t GetEpochMillis();
+
+/**
+ * @brief Connect to the MQTT server with the credentials in secrets.h.
+ * @details Nothing is done if already connected.
+ * @param [in] mqtt_client
+ * @param [in] pMQTTClientID
+ * @return true If connected.
+ * @return false
+ */
+bool ConnectMQTT(PubSubClient& mqtt_client, const char* pMQTTClientID);
+
 /**
  * @brief Get the Stored DeviceType and its address.
  * @param [in] name
@@ -86,22 +255,20 @@ class EnvironmentSensor : public Device {
  */
 void GetStoredDeviceTypeAddress(const std::string& name, Preferences* pPrefs,
                                 DeviceType& device_type,
-                                BLEAddress& device_address);
+                                DeviceAddress& device_address);
 
 /**
  * @brief Get the Device object
  * @param [in] device_type
  * @param [in] address
- * @param [in] pClient
- * @param [in] pScan
- * @return std::unique_ptr<Device>
+ * @return std::unique_ptr<Device> nullptr if the type is not registered.
  */
 std::unique_ptr<Device> GetDevice(const DeviceType& device_type,
-                                  const BLEAddress& address);
+                                  const DeviceAddress& address);
 
 /**
  * All the following function convert the raw characteristic value to real
- * value. Please refer to the GATT characteristic.
+ * value and return -1 if unknown. Please refer to the GATT characteristic.
  */
 
 float GetTemperature(const uint8_t* pData);
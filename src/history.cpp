@@ -0,0 +1,549 @@
+/**
+ * @file history.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Keep the sample history in flash and serve it over MQTT.
+ */
+#include "history.h"
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "timeseries.h"
+
+static const size_t kBlockSize = 256;
+static const size_t kSectorSize = 4096;
+static const uint16_t kBlockMagic = 0x5453;
+static const size_t kStagingSize = 32;
+static const size_t kDefaultSeriesNum = 16;
+static const size_t kMaxSeriesNum = 64;
+static const uint32_t kFlushInterval = 3600;    // seconds
+static const size_t kMaxScannedBlockNum = 128;  // per response chunk
+static const size_t kChunkSampleNum = 24;
+static const size_t kMaxTopicLength = 80;
+
+/**
+ * @brief The header of a flash block followed by the encoded samples.
+ * @details An erased block has magic 0xFFFF.
+ */
+struct BlockHeader {
+    uint16_t magic;
+    uint16_t sample_num;
+    uint32_t sequence;
+    uint32_t key;
+    uint32_t start_time;
+    uint32_t end_time;
+};
+static const size_t kBlockDataSize = kBlockSize - sizeof(BlockHeader);
+
+struct StagedSample {
+    uint32_t key;
+    uint32_t time;
+    float value;
+};
+
+/**
+ * @brief The open block of a series in RAM.
+ */
+struct Series {
+    uint32_t key;
+    uint8_t data[kBlockDataSize];
+    TimeSeriesEncoder encoder;
+    Series() : key(0), encoder(data, kBlockDataSize) {}
+};
+
+struct HistoryQuery {
+    bool is_active;
+    char sensor[13];
+    uint16_t uuid;
+    uint32_t key;
+    uint32_t from;
+    uint32_t to;
+    uint32_t sequence;  // Blocks written after the request are skipped.
+    size_t start_block;
+    size_t scanned_num;
+    uint16_t skipped_num;  // Samples of the current block already sent.
+    uint32_t sent_num;
+};
+
+static const esp_partition_t* pPartition = nullptr;
+static size_t block_num = 0;
+static size_t next_block = 0;
+static uint32_t next_sequence = 1;
+static std::unique_ptr<Series[]> series;
+static size_t series_num = 0;
+static size_t requested_series_num = kDefaultSeriesNum;
+static uint32_t latest_time = 0;
+static StagedSample staged_samples[kStagingSize];
+static size_t staged_num = 0;
+static HistoryStatistics statistics = {0, 0, 0, 0};
+static HistoryQuery query;
+static char request_topic[kMaxTopicLength];
+static char response_topic[kMaxTopicLength];
+// The samples are recorded in the Bluetooth task.
+static portMUX_TYPE history_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief FNV-1a hash of the address and the UUID.
+ */
+static uint32_t GetSeriesKey(const uint8_t* pAddress, uint16_t uuid) {
+    uint8_t bytes[8];
+    memcpy(bytes, pAddress, 6);
+    bytes[6] = uuid & 0xFF;
+    bytes[7] = uuid >> 8;
+    uint32_t hash = 2166136261U;
+    for (uint8_t byte : bytes) {
+        hash = (hash ^ byte) * 16777619U;
+    }
+    return hash;
+}
+
+static bool ReadBlockHeader(size_t index, BlockHeader& header) {
+    return (esp_partition_read(pPartition, index * kBlockSize, &header,
+                               sizeof(header)) == ESP_OK) &&
+           (header.magic == kBlockMagic);
+}
+
+bool HistorySetup(size_t size, const char* pGatewayID) {
+    snprintf(request_topic, sizeof(request_topic),
+             "bluetooth-gateway/history/%s/request", pGatewayID);
+    snprintf(response_topic, sizeof(response_topic),
+             "bluetooth-gateway/history/%s/response", pGatewayID);
+    query.is_active = false;
+    staged_num = 0;
+    latest_time = 0;
+    next_block = 0;
+    statistics = {0, 0, 0, 0};
+    series.reset();
+    series_num = 0;
+    pPartition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+    if (pPartition == nullptr) {
+        log_w("No data partition for the history.");
+        return false;
+    }
+    size = std::min(size, static_cast<size_t>(pPartition->size));
+    block_num = size / kSectorSize * (kSectorSize / kBlockSize);
+    if (block_num == 0) {
+        pPartition = nullptr;
+        return false;
+    }
+    // Continue after the newest block.
+    statistics.stored_block_num = 0;
+    uint32_t max_sequence = 0;
+    for (size_t i = 0; i < block_num; ++i) {
+        BlockHeader header;
+        if (!ReadBlockHeader(i, header)) {
+            continue;
+        }
+        ++statistics.stored_block_num;
+        if (header.sequence >= max_sequence) {
+            max_sequence = header.sequence;
+            next_block = (i + 1) % block_num;
+        }
+    }
+    next_sequence = max_sequence + 1;
+    log_i("History of %d blocks, next %d.", block_num, next_block);
+    SetHistorySeriesNum(requested_series_num);
+    return true;
+}
+
+/**
+ * @brief Write the open block of a series and start a new one.
+ */
+static void WriteSeriesBlock(Series& target) {
+    if (target.encoder.GetSampleNum() == 0) {
+        return;
+    }
+    size_t offset = next_block * kBlockSize;
+    if (offset % kSectorSize == 0) {
+        esp_partition_erase_range(pPartition, offset, kSectorSize);
+    }
+    uint8_t block[kBlockSize];
+    BlockHeader header = {kBlockMagic,
+                          target.encoder.GetSampleNum(),
+                          next_sequence,
+                          target.key,
+                          target.encoder.GetStartTime(),
+                          target.encoder.GetEndTime()};
+    memcpy(block, &header, sizeof(header));
+    memcpy(block + sizeof(header), target.data, kBlockDataSize);
+    if (esp_partition_write(pPartition, offset, block, sizeof(block)) ==
+        ESP_OK) {
+        next_block = (next_block + 1) % block_num;
+        ++next_sequence;
+        ++statistics.written_block_num;
+        statistics.stored_block_num =
+            std::min(statistics.stored_block_num + 1,
+                     static_cast<uint32_t>(block_num));
+    }
+    target.encoder.Clear();
+}
+
+void SetHistorySeriesNum(size_t num) {
+    num = std::min(std::max(num, static_cast<size_t>(1)), kMaxSeriesNum);
+    requested_series_num = num;
+    if ((pPartition == nullptr) || (num == series_num)) {
+        return;
+    }
+    std::unique_ptr<Series[]> resized(new (std::nothrow) Series[num]);
+    if (!resized) {
+        log_w("No memory for %d history series.", num);
+        return;
+    }
+    for (size_t i = 0; i < series_num; ++i) {
+        WriteSeriesBlock(series[i]);
+    }
+    series = std::move(resized);
+    series_num = num;
+}
+
+/**
+ * @brief Find the series of the key, or take a free one.
+ * @details If every series is open, the fullest one is written to make
+ * room, but only if it is at least half full. Otherwise the sample is
+ * dropped rather than wearing the flash with nearly empty blocks, and the
+ * series gets a slot once another block is written.
+ * @return Series* nullptr if no series is free.
+ */
+static Series* FindSeries(uint32_t key) {
+    Series* pFree = nullptr;
+    Series* pFullest = nullptr;
+    for (size_t i = 0; i < series_num; ++i) {
+        Series& candidate = series[i];
+        if (candidate.encoder.GetSampleNum() == 0) {
+            pFree = (pFree == nullptr) ? &candidate : pFree;
+        } else if (candidate.key == key) {
+            return &candidate;
+        } else if ((pFullest == nullptr) ||
+                   (candidate.encoder.GetLength() >
+                    pFullest->encoder.GetLength())) {
+            pFullest = &candidate;
+        }
+    }
+    if ((pFree == nullptr) && (pFullest != nullptr) &&
+        (pFullest->encoder.GetLength() >= kBlockDataSize / 2)) {
+        WriteSeriesBlock(*pFullest);
+        pFree = pFullest;
+    }
+    if (pFree != nullptr) {
+        pFree->key = key;
+    }
+    return pFree;
+}
+
+void RecordHistory(const uint8_t* pAddress, uint16_t uuid, uint32_t time,
+                   float value) {
+    if (pPartition == nullptr) {
+        return;
+    }
+    uint32_t key = GetSeriesKey(pAddress, uuid);
+    portENTER_CRITICAL(&history_mux);
+    if (staged_num < kStagingSize) {
+        staged_samples[staged_num++] = {key, time, value};
+    } else {
+        ++statistics.dropped_num;
+    }
+    portEXIT_CRITICAL(&history_mux);
+}
+
+void StoreHistory() {
+    if (pPartition == nullptr) {
+        return;
+    }
+    StagedSample samples[kStagingSize];
+    portENTER_CRITICAL(&history_mux);
+    size_t sample_num = staged_num;
+    memcpy(samples, staged_samples, sample_num * sizeof(StagedSample));
+    staged_num = 0;
+    portEXIT_CRITICAL(&history_mux);
+    for (size_t i = 0; i < sample_num; ++i) {
+        const StagedSample& sample = samples[i];
+        Series* pTarget = FindSeries(sample.key);
+        if (pTarget == nullptr) {
+            ++statistics.dropped_num;
+            continue;
+        }
+        if (!pTarget->encoder.Append(sample.time, sample.value)) {
+            // Full, or earlier than the last sample which starts a new block.
+            WriteSeriesBlock(*pTarget);
+            pTarget->encoder.Append(sample.time, sample.value);
+        }
+        ++statistics.recorded_num;
+        latest_time = std::max(latest_time, sample.time);
+    }
+    for (size_t i = 0; i < series_num; ++i) {
+        Series& target = series[i];
+        if ((target.encoder.GetSampleNum() > 0) &&
+            (latest_time - target.encoder.GetStartTime() >= kFlushInterval)) {
+            WriteSeriesBlock(target);
+        }
+    }
+}
+
+const char* GetHistoryTopicFilter() { return request_topic; }
+
+static const char* SkipSpace(const char* pText) {
+    while ((*pText == ' ') || (*pText == '\t') || (*pText == '\r') ||
+           (*pText == '\n')) {
+        ++pText;
+    }
+    return pText;
+}
+
+/**
+ * @brief Read a JSON string without escapes.
+ * @return const char* After the closing quote, nullptr if invalid.
+ */
+static const char* ParseString(const char* pText, char* pValue, size_t size) {
+    if (*pText++ != '"') {
+        return nullptr;
+    }
+    size_t length = 0;
+    while ((*pText != '"') && (*pText != '\0') && (*pText != '\\')) {
+        if (length + 1 < size) {
+            pValue[length++] = *pText;
+        }
+        ++pText;
+    }
+    pValue[length] = '\0';
+    return (*pText == '"') ? pText + 1 : nullptr;
+}
+
+/**
+ * @brief Read the MAC address with or without separators.
+ */
+static bool ParseSensor(const char* pText, char* pSensor, uint8_t* pAddress) {
+    size_t digit_num = 0;
+    for (; *pText != '\0'; ++pText) {
+        if ((*pText == ':') || (*pText == '-')) {
+            continue;
+        }
+        if (!isxdigit(static_cast<unsigned char>(*pText)) ||
+            (digit_num == 12)) {
+            return false;
+        }
+        pSensor[digit_num++] = toupper(static_cast<unsigned char>(*pText));
+    }
+    pSensor[digit_num] = '\0';
+    if (digit_num != 12) {
+        return false;
+    }
+    for (size_t i = 0; i < 6; ++i) {
+        char byte[3] = {pSensor[2 * i], pSensor[2 * i + 1], '\0'};
+        pAddress[i] = static_cast<uint8_t>(strtoul(byte, nullptr, 16));
+    }
+    return true;
+}
+
+/**
+ * @brief Parse a history request.
+ * @details The keys may come in any order with whitespace around. The
+ * sensor may have colons, the UUID may be a hex string like "0x2A6E",
+ * from and to default to the whole history, and unknown keys of strings
+ * or numbers are ignored.
+ * @param [in] pText
+ * @param [out] request The sensor, UUID and time range.
+ * @param [out] pAddress
+ * @return true If the sensor and the UUID are valid.
+ * @return false
+ */
+static bool ParseHistoryRequest(const char* pText, HistoryQuery& request,
+                                uint8_t* pAddress) {
+    bool is_sensor_parsed = false;
+    bool is_uuid_parsed = false;
+    request.from = 0;
+    request.to = 0xFFFFFFFF;
+    pText = SkipSpace(pText);
+    if (*pText++ != '{') {
+        return false;
+    }
+    pText = SkipSpace(pText);
+    while (*pText != '}') {
+        char key[16];
+        pText = ParseString(pText, key, sizeof(key));
+        if (pText == nullptr) {
+            return false;
+        }
+        pText = SkipSpace(pText);
+        if (*pText++ != ':') {
+            return false;
+        }
+        pText = SkipSpace(pText);
+        char text[24] = {'\0'};
+        unsigned long number = 0;
+        bool is_string = *pText == '"';
+        if (is_string) {
+            pText = ParseString(pText, text, sizeof(text));
+            if (pText == nullptr) {
+                return false;
+            }
+        } else {
+            char* pEnd = nullptr;
+            number = strtoul(pText, &pEnd, 10);
+            if ((pEnd == pText) || (*pText == '-')) {
+                return false;
+            }
+            pText = pEnd;
+        }
+        if (strcmp(key, "sensor") == 0) {
+            is_sensor_parsed =
+                is_string && ParseSensor(text, request.sensor, pAddress);
+        } else if (strcmp(key, "uuid") == 0) {
+            if (is_string) {
+                char* pEnd = nullptr;
+                number = strtoul(text, &pEnd, 16);
+                is_uuid_parsed = (pEnd != text) && (*pEnd == '\0');
+            } else {
+                is_uuid_parsed = true;
+            }
+            is_uuid_parsed = is_uuid_parsed && (number <= 0xFFFF);
+            request.uuid = static_cast<uint16_t>(number);
+        } else if ((strcmp(key, "from") == 0) && !is_string) {
+            request.from = std::min(number, 0xFFFFFFFFUL);
+        } else if ((strcmp(key, "to") == 0) && !is_string) {
+            request.to = std::min(number, 0xFFFFFFFFUL);
+        }
+        pText = SkipSpace(pText);
+        if (*pText == ',') {
+            pText = SkipSpace(pText + 1);
+        } else if (*pText != '}') {
+            return false;
+        }
+    }
+    return is_sensor_parsed && is_uuid_parsed;
+}
+
+void HandleHistoryMessage(const char* pTopic, const uint8_t* pPayload,
+                          size_t length) {
+    if ((pPartition == nullptr) || (strcmp(pTopic, request_topic) != 0)) {
+        return;
+    }
+    char payload[256];
+    if (length >= sizeof(payload)) {
+        return;
+    }
+    memcpy(payload, pPayload, length);
+    payload[length] = '\0';
+    HistoryQuery request;
+    uint8_t address[6];
+    if (!ParseHistoryRequest(payload, request, address)) {
+        log_i("Invalid history request %s.", payload);
+        return;
+    }
+    request.is_active = true;
+    request.key = GetSeriesKey(address, request.uuid);
+    request.sequence = next_sequence;
+    request.start_block = next_block;  // The oldest block.
+    request.scanned_num = 0;
+    request.skipped_num = 0;
+    request.sent_num = 0;
+    query = request;
+}
+
+/**
+ * @brief Append the samples of a block in the range to the chunk.
+ * @return true If the block is exhausted.
+ * @return false If the chunk is full.
+ */
+static bool AppendChunkSamples(const uint8_t* pData, uint16_t sample_num,
+                               char* pPayload, size_t payload_size,
+                               size_t& length, size_t& chunk_num) {
+    TimeSeriesDecoder decoder(pData, kBlockDataSize, sample_num);
+    uint32_t time = 0;
+    float value = 0;
+    for (uint16_t i = 0; decoder.Next(time, value); ++i) {
+        if ((i < query.skipped_num) || (time < query.from) ||
+            (time > query.to)) {
+            continue;
+        }
+        if (chunk_num == kChunkSampleNum) {
+            query.skipped_num = i;
+            return false;
+        }
+        int num = snprintf(pPayload + length, payload_size - length,
+                           "%s[%lu,%.7g]", chunk_num == 0 ? "" : ",",
+                           static_cast<unsigned long>(time), value);
+        if ((num < 0) || (static_cast<size_t>(num) >= payload_size - length)) {
+            query.skipped_num = i;
+            return false;
+        }
+        length += num;
+        ++chunk_num;
+    }
+    query.skipped_num = 0;
+    return true;
+}
+
+bool GetHistoryResponse(char* pTopic, size_t topic_size, char* pPayload,
+                        size_t payload_size) {
+    if (!query.is_active) {
+        return false;
+    }
+    // Leave room for the tail `],"last":0}`.
+    const size_t kTailLength = 12;
+    size_t length = snprintf(
+        pPayload, payload_size,
+        "{\"sensor\":\"%s\",\"uuid\":%u,\"offset\":%lu,\"samples\":[",
+        query.sensor, query.uuid, static_cast<unsigned long>(query.sent_num));
+    if (length + kTailLength >= payload_size) {
+        return false;
+    }
+    size_t samples_size = payload_size - kTailLength;
+    size_t chunk_num = 0;
+    bool is_full = false;
+    size_t scanned_num = 0;
+    while (!is_full && (query.scanned_num < block_num)) {
+        if (scanned_num == kMaxScannedBlockNum) {
+            if (chunk_num == 0) {
+                return false;  // Continue in the next call.
+            }
+            break;
+        }
+        ++scanned_num;
+        size_t index = (query.start_block + query.scanned_num) % block_num;
+        BlockHeader header;
+        if (ReadBlockHeader(index, header) && (header.key == query.key) &&
+            (header.sequence < query.sequence) &&
+            (header.end_time >= query.from) &&
+            (header.start_time <= query.to)) {
+            uint8_t data[kBlockDataSize];
+            esp_partition_read(pPartition, index * kBlockSize + sizeof(header),
+                               data, sizeof(data));
+            is_full = !AppendChunkSamples(data, header.sample_num, pPayload,
+                                          samples_size, length, chunk_num);
+        }
+        if (!is_full) {
+            ++query.scanned_num;
+        }
+    }
+    bool is_last = false;
+    if (!is_full && (query.scanned_num == block_num)) {
+        // The open block in RAM after the flash blocks.
+        is_last = true;
+        for (size_t i = 0; i < series_num; ++i) {
+            Series& target = series[i];
+            if ((target.key == query.key) &&
+                (target.encoder.GetSampleNum() > 0)) {
+                is_last = AppendChunkSamples(
+                    target.data, target.encoder.GetSampleNum(), pPayload,
+                    samples_size, length, chunk_num);
+            }
+        }
+    }
+    snprintf(pPayload + length, payload_size - length, "],\"last\":%d}",
+             is_last ? 1 : 0);
+    query.is_active = !is_last;
+    snprintf(pTopic, topic_size, "%s", response_topic);
+    query.sent_num += chunk_num;
+    return true;
+}
+
+HistoryStatistics GetHistoryStatistics() { return statistics; }
@@ -0,0 +1,96 @@
+/**
+ * @file history.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Keep the sample history in flash and serve it over MQTT.
+ */
+#ifndef BLUETOOTHGATEWAY_HISTORY_H_
+#define BLUETOOTHGATEWAY_HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Counters of the history store.
+ * @details dropped_num counts the samples lost before encoding because the
+ * staging ring was full or no series was free.
+ */
+struct HistoryStatistics {
+    uint32_t recorded_num;
+    uint32_t dropped_num;
+    uint32_t written_block_num;
+    uint32_t stored_block_num;
+};
+
+/**
+ * @brief Open the history in the data partition of SPIFFS subtype.
+ * @details The partition is used as a ring of 256 bytes blocks, each of
+ * which holds the compressed samples of one series. The oldest sector is
+ * erased when the ring is full. The partition must not be mounted as a file
+ * system.
+ * @param [in] size The bytes to use at most.
+ * @param [in] pGatewayID The MQTT client ID which names the topics.
+ * @return true If the history is open.
+ * @return false If no partition is found.
+ */
+bool HistorySetup(size_t size, const char* pGatewayID);
+
+/**
+ * @brief Set the number of series with an open block in RAM.
+ * @details Each series takes about 280 bytes. Size it to the registered
+ * characteristics, so that the blocks are only written when they are full
+ * or span an hour. The open blocks are written before resizing. It is
+ * clamped to 1-64 and kept for HistorySetup.
+ * @param [in] num
+ */
+void SetHistorySeriesNum(size_t num);
+
+/**
+ * @brief Record a sample of a characteristic.
+ * @details It only stages the sample and is safe in the BLE callbacks.
+ * @param [in] pAddress The 6 bytes address.
+ * @param [in] uuid The characteristic UUID.
+ * @param [in] time Seconds since the Unix epoch.
+ * @param [in] value
+ */
+void RecordHistory(const uint8_t* pAddress, uint16_t uuid, uint32_t time,
+                   float value);
+
+/**
+ * @brief Encode the staged samples and write the full blocks to flash.
+ * @details Call it in the loop. A partial block is also written once it
+ * spans an hour, which bounds the samples lost by a reset.
+ */
+void StoreHistory();
+
+/**
+ * @brief The topic of the history requests.
+ * @details A request is
+ * `{"sensor":"<MAC without colon>","uuid":n,"from":t,"to":t}` in seconds
+ * since the Unix epoch. The keys may come in any order. The MAC may have
+ * colons, uuid may be a hex string, and from and to are optional. A new
+ * request cancels the pending one.
+ */
+const char* GetHistoryTopicFilter();
+
+void HandleHistoryMessage(const char* pTopic, const uint8_t* pPayload,
+                          size_t length);
+
+/**
+ * @brief Get the next chunk of the response to the pending request.
+ * @details The chunk is
+ * `{"sensor":"...","uuid":n,"offset":k,"samples":[[t,v],...],"last":0|1}`
+ * where offset is the index of its first sample in the response. The last
+ * chunk has last 1.
+ * @param [out] pTopic
+ * @param [in] topic_size
+ * @param [out] pPayload
+ * @param [in] payload_size
+ * @return true If a chunk is ready.
+ * @return false If no request is pending or the chunk is not ready yet.
+ */
+bool GetHistoryResponse(char* pTopic, size_t topic_size, char* pPayload,
+                        size_t payload_size);
+
+HistoryStatistics GetHistoryStatistics();
+
+#endif
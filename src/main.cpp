@@ -1,42 +1,163 @@
 #include <Arduino.h>
-#include <BLEAddress.h>
-#include <BLEClient.h>
-#include <BLEDevice.h>
-#include <BLEScan.h>
+#if !defined(BLE_NIMBLE)
 #include <BluetoothSerial.h>
+#endif
 #include <Preferences.h>
+#include <WebServer.h>
 #include <WiFi.h>
 #include <WiFiClient.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
 #include <esp_task_wdt.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "command.h"
+#include "connectivity.h"
 #include "device.h"
+#include "history.h"
+#include "metrics.h"
+#include "ownership.h"
+#include "publisher.h"
+#include "recorder.h"
+#include "rules.h"
+#include "scan.h"
+#include "scheduler.h"
 #include "secrets.h"
 #include "serial_command.h"
+#include "settings.h"
+#include "tls.h"
+#include "trace.h"
+#include "transport.h"
 
-#if !defined(CONFIG_BT_ENABLED) || !defined(CONFIG_BLUEDROID_ENABLED)
-#error Bluetooth is not enabled! Please run `make menuconfig` to and enable it
+// Keep the old secrets.h compiling.
+#ifndef STATIC_IP
+#define STATIC_IP ""
+#define STATIC_GATEWAY ""
+#define STATIC_SUBNET ""
+#define STATIC_DNS ""
+#endif
+#ifndef MQTT_CA_CERT
+#define MQTT_CA_CERT ""
 #endif
 
-#define WATCHDOG_TIMEOUT 300        // seconds
 #define WATCHDOG_RESET_INTERVAL 60  // seconds
+#define SCAN_ACCEPT_LIST true       // Filter scan by controller accept list
+#define GATEWAY_COORDINATION false  // Elect sensor owners among gateways
+#define STATE_PAYLOAD_CBOR false    // Publish CBOR state alongside JSON
+#define BLE_CAPTURE false           // Dump BLE traffic on Serial for replay
+#define CYCLE_STATISTICS false      // Print statistics of each cycle on Serial
+#define NTP_SERVER "pool.ntp.org"   // Wall clock of the sample timestamps
+#define METRICS_PORT 9100           // Prometheus metrics, 0 to disable
+#define HISTORY_SIZE 1048576        // bytes of flash for history, 0 to disable
+#define MQTT_TLS false              // Connect MQTT over TLS on port 8883
+#define TLS_SESSION_NVS false       // Store the TLS secret to resume on boot
 
 const std::string kDeviceName = "sensor";
-const int kMaxDevNum = 5;
 const int kCommandBufferSize = 128;
 const char kMQTTClientID[] = MQTT_CLIENT_ID;
 const char kMQTTDomain[] = MQTT_DOMAIN;
-const uint16_t kMQTTPort = 1883;
+const uint16_t kMQTTPort = MQTT_TLS ? 8883 : 1883;
+const char kMQTTCACert[] = MQTT_CA_CERT;
+const size_t kDevicePushReserve = 4096;  // bytes of the configs and states
+#if defined(BLE_NIMBLE)
+// Bluetooth Serial needs Bluedroid, so the commands come from USB serial.
+Stream& SerialBT = Serial;
+#else
 BluetoothSerial SerialBT;
+#endif
 Preferences prefs;
 uint8_t pCommandBuffer[kCommandBufferSize] = {0};
-BLEScan* pScan = nullptr;
-BLEClient* pClient = nullptr;
+std::unique_ptr<BLETransport> pTransport;
 WiFiClient esp_client;
-PubSubClient mqtt_client(esp_client);
+TLSClient tls_client;
+MQTTAckClient ack_client(MQTT_TLS ? static_cast<Client&>(tls_client)
+                                  : static_cast<Client&>(esp_client));
+PubSubClient mqtt_client(ack_client);
+// The settings are applied in setup.
+RadioScheduler radio_scheduler(30000, 80);
+ConnectivityManager connectivity(WiFi);
+OwnershipElection ownership(kMQTTClientID);
+MQTTPublisher publisher(mqtt_client, ack_client, kMQTTClientID);
+WebServer metrics_server(METRICS_PORT);
+// The devices live across cycles and are rebuilt when the registry changes.
+DeviceType stored_device_types[kMaxDevNum];
+std::unique_ptr<Device> stored_devices[kMaxDevNum];
+std::vector<Device*> pending_devices;
+
+void QueuePendingDevice(Device* pDevice) {
+    // A device stays pending once until pushed, with its latest values.
+    if (std::find(pending_devices.begin(), pending_devices.end(), pDevice) ==
+        pending_devices.end()) {
+        pending_devices.push_back(pDevice);
+    }
+}
+
+void StoredDeviceSetup() {
+    pending_devices.reserve(kMaxDevNum);
+    size_t created_num = 0;
+    size_t device_num = 0;
+    size_t series_num = 0;
+    int slot_num = GetSetting(Setting::DeviceNum);
+    for (int i = 1; i <= kMaxDevNum; ++i) {
+        std::string dev_name = kDeviceName + std::to_string(i);
+        DeviceType dev_type = DeviceType::Unknown;
+        DeviceAddress dev_addr;
+        if (i <= slot_num) {
+            GetStoredDeviceTypeAddress(dev_name, &prefs, dev_type, dev_addr);
+        }
+        if ((dev_type == DeviceType::Unknown) || dev_addr.IsZero()) {
+            dev_type = DeviceType::Unknown;
+        }
+        std::unique_ptr<Device>& dev = stored_devices[i - 1];
+        const DeviceRegistration* pRegistration =
+            FindDeviceRegistration(dev_type);
+        if (pRegistration != nullptr) {
+            series_num += pRegistration->pDescriptor->characteristic_num;
+        }
+        if (dev && (stored_device_types[i - 1] == dev_type) &&
+            (dev->GetAddress() == dev_addr)) {
+            ++device_num;
+            continue;  // Unchanged, keep its values.
+        }
+        if (dev) {
+            pending_devices.erase(std::remove(pending_devices.begin(),
+                                              pending_devices.end(),
+                                              dev.get()),
+                                  pending_devices.end());
+            dev.reset();
+        }
+        stored_device_types[i - 1] = dev_type;
+        if (dev_type != DeviceType::Unknown) {
+            dev = GetDevice(dev_type, dev_addr);
+            created_num += dev ? 1 : 0;
+            device_num += dev ? 1 : 0;
+        }
+    }
+    Serial.printf("Device pool with %d devices, %d created\n", device_num,
+                  created_num);
+    // Keep a block open for each characteristic.
+    SetHistorySeriesNum(series_num);
+}
+
+void ScanAcceptListSetup() {
+    if (!SCAN_ACCEPT_LIST) {
+        return;
+    }
+    std::vector<DeviceAddress> addresses;
+    for (const std::unique_ptr<Device>& dev : stored_devices) {
+        if (dev) {
+            addresses.push_back(dev->GetAddress());
+        }
+    }
+    if (SetScanAcceptList(*pTransport, addresses.data(), addresses.size())) {
+        Serial.printf("Scan accept list with %d devices\n", addresses.size());
+    } else {
+        Serial.println("Scan without accept list");
+    }
+}
 
 void BTCommandProcess(const uint32_t& interval) {
     static uint32_t last = 0;
@@ -49,6 +170,8 @@ void BTCommandProcess(const uint32_t& interval) {
                 pCommandBuffer, kCommandBufferSize, &prefs, &SerialBT);
             if (cmd->execute()) {
                 Serial.println("Command execute success!");
+                StoredDeviceSetup();
+                ScanAcceptListSetup();
             } else {
                 Serial.println("Command execute fail!");
             }
@@ -56,29 +179,461 @@ void BTCommandProcess(const uint32_t& interval) {
     }
 }
 
+/**
+ * @brief Print the statistics at the end of a cycle over the devices.
+ */
+void PrintCycleStatistics() {
+    ScanStatistics scan_statistics = GetScanStatistics();
+    Serial.printf("Scan callbacks %d in %d scans, CPU time %d us\n",
+                  scan_statistics.callback_num, scan_statistics.scan_num,
+                  scan_statistics.callback_us);
+    Serial.printf("Free heap %d, largest free block %d\n",
+                  esp_get_free_heap_size(),
+                  heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    HistoryStatistics history_statistics = GetHistoryStatistics();
+    Serial.printf("History samples %d, dropped %d, blocks %d\n",
+                  history_statistics.recorded_num,
+                  history_statistics.dropped_num,
+                  history_statistics.stored_block_num);
+    RuleStatistics rule_statistics = GetRuleStatistics();
+    Serial.printf("Rule evaluations %d, alerts %d, CPU time %d us\n",
+                  rule_statistics.evaluated_num, rule_statistics.alert_num,
+                  rule_statistics.evaluation_us);
+    if (MQTT_TLS) {
+        TLSStatistics tls_statistics = tls_client.GetStatistics();
+        Serial.printf(
+            "TLS handshakes %d, resumed %d, last %d ms, full %d ms, "
+            "heap setup %d, peak %d, min free %d, largest block %d\n",
+            tls_statistics.handshake_num, tls_statistics.resumed_num,
+            tls_statistics.handshake_ms, tls_statistics.full_handshake_ms,
+            tls_statistics.heap_setup, tls_statistics.heap_peak,
+            tls_statistics.heap_min_free, tls_statistics.heap_largest_block);
+    }
+    TraceStatistics trace_statistics = GetTraceStatistics();
+    Serial.printf("Trace events %d, over budget %d, CPU time %d us\n",
+                  trace_statistics.event_num, trace_statistics.over_budget_num,
+                  trace_statistics.cpu_us);
+}
+
 void StoredBLEDeviceProcess(const uint32_t& interval) {
     static uint32_t last = 0;
+    static int next_index = 1;
+    // Only start BLE tasks which can finish the scan in the BLE window.
+    if ((radio_scheduler.GetWindow() != RadioWindow::BLE) ||
+        (radio_scheduler.GetRemainingTime() <
+         1000 * GetSetting(Setting::ScanDuration))) {
+        return;
+    }
+    int slot_num = GetSetting(Setting::DeviceNum);
+    if (next_index > slot_num) {
+        next_index = 1;  // The slots are reduced by the settings.
+    }
     uint32_t now = millis();
-    if (static_cast<uint32_t>(now - last) >= interval) {
+    if (next_index == 1) {
+        if (static_cast<uint32_t>(now - last) < interval) {
+            return;
+        }
         last = now;
-        // Read and publish BLE data.
-        for (int i = 1; i <= kMaxDevNum; ++i) {
-            std::string dev_name = kDeviceName + std::to_string(i);
-            DeviceType dev_type = DeviceType::Unknown;
-            BLEAddress dev_addr("00:00:00:00:00:00");
-            BLEAddress unknown_addr("00:00:00:00:00:00");
-            GetStoredDeviceTypeAddress(dev_name, &prefs, dev_type, dev_addr);
-            log_i("%s 0x%d %s", dev_name.c_str(),
-                  static_cast<uint8_t>(dev_type), dev_addr.toString().c_str());
-            if ((dev_type != DeviceType::Unknown) &&
-                (dev_addr != unknown_addr)) {
-                uint32_t start = millis();
-                std::unique_ptr<Device> dev = GetDevice(dev_type, dev_addr);
-                dev->Update(pClient, pScan);
-                dev->Push(WiFi, mqtt_client, kMQTTClientID);
-                Serial.printf("Elapsed time %d ms\n",
-                              static_cast<uint32_t>(millis() - start));
-            }
+    }
+    // Read BLE data of one device and publish it in the network window.
+    int i = next_index;
+    next_index = (next_index % slot_num) + 1;
+    Device* pDevice = stored_devices[i - 1].get();
+    if (pDevice != nullptr) {
+        log_i("%s%d 0x%d", kDeviceName.c_str(), i,
+              static_cast<uint8_t>(stored_device_types[i - 1]));
+        uint32_t start = millis();
+        pDevice->Update(*pTransport);
+        QueuePendingDevice(pDevice);
+        if (radio_scheduler.GetWindow() != RadioWindow::BLE) {
+            radio_scheduler.RecordOverrun();
+        }
+        Serial.printf("Elapsed time %d ms\n",
+                      static_cast<uint32_t>(millis() - start));
+    }
+    if (next_index == 1) {
+        SetMetric(Metric::CycleDuration,
+                  static_cast<uint32_t>(millis() - last));
+        CaptureDump(Serial);
+        if (CYCLE_STATISTICS) {
+            PrintCycleStatistics();
+        }
+    }
+}
+
+void PendingDevicePublish() {
+    // Each device is pending at most once, with its latest values offline.
+    if (pending_devices.empty() || !connectivity.IsOnline() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    uint32_t start = millis();
+    size_t pushed_num = 0;
+    // A device which is not pushed stays pending for the next window. The
+    // rest wait until the publisher has room for the configs and states of
+    // one more device, so nothing is dropped when many are updated at once.
+    auto it = pending_devices.begin();
+    while ((it != pending_devices.end()) &&
+           ((publisher.GetPendingNum() == 0) ||
+            (publisher.GetFreeSize() >= kDevicePushReserve))) {
+        if ((*it)->Push(WiFi, mqtt_client, kMQTTClientID)) {
+            it = pending_devices.erase(it);
+            ++pushed_num;
+        } else {
+            ++it;
+        }
+    }
+    if (CYCLE_STATISTICS && (pushed_num > 0)) {
+        Serial.printf("Queue %d devices in %d ms, %d pending\n", pushed_num,
+                      static_cast<uint32_t>(millis() - start),
+                      pending_devices.size());
+    }
+}
+
+void MQTTPublishProcess() {
+    if ((publisher.GetPendingNum() == 0) || !connectivity.IsOnline() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    uint32_t start = millis();
+    size_t delivered_num = publisher.Pump(radio_scheduler.GetRemainingTime());
+    if (CYCLE_STATISTICS && (delivered_num > 0)) {
+        Serial.printf("Deliver %d messages in %d ms, %d pending\n",
+                      delivered_num, static_cast<uint32_t>(millis() - start),
+                      publisher.GetPendingNum());
+    }
+    static bool is_first_published = false;
+    if (!is_first_published && (delivered_num > 0)) {
+        is_first_published = true;
+        ConnectivityStatistics connectivity_statistics =
+            connectivity.GetStatistics();
+        Serial.printf("Time to WiFi %d ms, to first publish %d ms\n",
+                      connectivity_statistics.first_connect_time, millis());
+    }
+    if (!CYCLE_STATISTICS || (publisher.GetPendingNum() > 0)) {
+        return;
+    }
+    PublishStatistics publish_statistics = publisher.GetStatistics();
+    Serial.printf(
+        "MQTT messages: delivered %d of %d, retry %d, dropped %d, "
+        "latency avg %d ms, max %d ms\n",
+        publish_statistics.delivered_num, publish_statistics.enqueued_num,
+        publish_statistics.retry_num, publish_statistics.dropped_num,
+        publish_statistics.delivered_num == 0
+            ? 0
+            : publish_statistics.total_latency /
+                  publish_statistics.delivered_num,
+        publish_statistics.max_latency);
+    RadioStatistics radio_statistics = GetRadioStatistics();
+    Serial.printf(
+        "Radio failures: BLE connect %d, WiFi %d, MQTT connect %d, "
+        "publish %d, overrun %d\n",
+        radio_statistics.ble_connect_failures,
+        radio_statistics.wifi_reconnect_failures,
+        radio_statistics.mqtt_connect_failures,
+        radio_statistics.mqtt_publish_failures, radio_statistics.overrun_num);
+}
+
+void PreviousTraceDump() {
+    size_t event_num = 0;
+    const TraceEvent* pEvents = GetPreviousTrace(event_num);
+    if (pEvents == nullptr) {
+        return;
+    }
+    Serial.printf("Trace of last boot with %d events\n", event_num);
+    for (size_t i = 0; i < event_num; ++i) {
+        const TraceEvent& event = pEvents[i];
+        Serial.printf("%10d ms %-12s %-11s 0x%04x\n", event.time,
+                      GetTraceStageName(event.stage),
+                      event.kind == TraceEventKind::Begin
+                          ? "begin"
+                          : (event.kind == TraceEventKind::End ? "end"
+                                                               : "over_budget"),
+                      event.tag);
+    }
+}
+
+void PreviousTracePublish() {
+    static bool is_published = false;
+    if (is_published || !connectivity.IsOnline() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    is_published = true;
+    size_t event_num = 0;
+    const TraceEvent* pEvents = GetPreviousTrace(event_num);
+    if (pEvents == nullptr) {
+        return;
+    }
+    // Split into messages of 12 events to fit the MQTT buffer.
+    const size_t chunk_size = 12;
+    std::string topic = std::string("bluetooth-gateway/trace/") + kMQTTClientID;
+    for (size_t start = 0; start < event_num; start += chunk_size) {
+        std::string payload =
+            "{\"reset_reason\":" + std::to_string(esp_reset_reason()) +
+            ",\"offset\":" + std::to_string(start) + ",\"events\":[";
+        for (size_t i = start; (i < event_num) && (i < start + chunk_size);
+             ++i) {
+            const TraceEvent& event = pEvents[i];
+            payload += (i == start ? "[" : ",[") + std::to_string(event.time) +
+                       ",\"" + GetTraceStageName(event.stage) + "\"," +
+                       std::to_string(static_cast<uint8_t>(event.kind)) +
+                       "," + std::to_string(event.tag) + "]";
+        }
+        payload += "]}";
+        PublishMessage(mqtt_client, topic.c_str(),
+                       reinterpret_cast<const uint8_t*>(payload.c_str()),
+                       payload.size());
+    }
+}
+
+void MQTTCallback(char* pTopic, uint8_t* pPayload, unsigned int length) {
+    HandleSightingMessage(pTopic, pPayload, length);
+    HandleHistoryMessage(pTopic, pPayload, length);
+    HandleConfigMessage(pTopic, pPayload, length);
+    HandleRulesMessage(pTopic, pPayload, length);
+}
+
+/**
+ * @brief Subscribe the topic filters of all modules.
+ * @return true If every filter is subscribed.
+ * @return false
+ */
+bool SubscribeMQTTTopics() {
+    bool is_subscribed = mqtt_client.subscribe(GetConfigTopicFilter());
+    is_subscribed = mqtt_client.subscribe(GetRulesTopicFilter()) &&
+                    is_subscribed;
+    if (HISTORY_SIZE > 0) {
+        is_subscribed = mqtt_client.subscribe(GetHistoryTopicFilter()) &&
+                        is_subscribed;
+    }
+    if (GATEWAY_COORDINATION) {
+        is_subscribed = mqtt_client.subscribe(GetSightingTopicFilter()) &&
+                        is_subscribed;
+    }
+    return is_subscribed;
+}
+
+/**
+ * @brief Keep the MQTT session and read the incoming messages.
+ * @details The session is clean, so the subscriptions are made again on
+ * each new connection, whichever process connected.
+ */
+void MQTTSessionProcess() {
+    static uint32_t subscribed_connection_num = 0;
+    if (!connectivity.IsOnline() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    if (!ConnectMQTT(mqtt_client, kMQTTClientID)) {
+        return;
+    }
+    if ((subscribed_connection_num != ack_client.GetConnectionNum()) &&
+        SubscribeMQTTTopics()) {
+        subscribed_connection_num = ack_client.GetConnectionNum();
+    }
+    mqtt_client.loop();
+}
+
+void GatewayCoordinationProcess() {
+    if (!GATEWAY_COORDINATION) {
+        return;
+    }
+    if (!connectivity.IsOnline() || !mqtt_client.connected() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    char topic[64];
+    char payload[96];
+    while (GetSightingAnnouncement(topic, sizeof(topic), payload,
+                                   sizeof(payload))) {
+        PublishMessage(mqtt_client, topic,
+                       reinterpret_cast<const uint8_t*>(payload),
+                       strlen(payload));
+    }
+}
+
+void MetricsHandle() {
+    // Counters kept by other modules are copied at scrape time.
+    ScanStatistics scan_statistics = GetScanStatistics();
+    SetMetric(Metric::Scans, scan_statistics.scan_num);
+    SetMetric(Metric::ScanCallbacks, scan_statistics.callback_num);
+    RadioStatistics radio_statistics = GetRadioStatistics();
+    SetMetric(Metric::BLEConnectFailures,
+              radio_statistics.ble_connect_failures);
+    SetMetric(Metric::MQTTConnectFailures,
+              radio_statistics.mqtt_connect_failures);
+    SetMetric(Metric::MQTTPublishFailures,
+              radio_statistics.mqtt_publish_failures);
+    ConnectivityStatistics connectivity_statistics =
+        connectivity.GetStatistics();
+    SetMetric(Metric::WiFiConnects, connectivity_statistics.connect_num);
+    SetMetric(Metric::WiFiDisconnects, connectivity_statistics.disconnect_num);
+    PublishStatistics publish_statistics = publisher.GetStatistics();
+    SetMetric(Metric::MQTTDelivered, publish_statistics.delivered_num);
+    SetMetric(Metric::MQTTDropped, publish_statistics.dropped_num);
+    TLSStatistics tls_statistics = tls_client.GetStatistics();
+    SetMetric(Metric::TLSHandshakes, tls_statistics.handshake_num);
+    SetMetric(Metric::TLSResumedHandshakes, tls_statistics.resumed_num);
+    SetMetric(Metric::TLSHandshakeDuration, tls_statistics.handshake_ms);
+    SetMetric(Metric::TLSSetupHeap, tls_statistics.heap_setup);
+    SetMetric(Metric::TLSHeapPeak, tls_statistics.heap_peak);
+    SetMetric(Metric::TLSMinFreeHeap, tls_statistics.heap_min_free);
+    SetMetric(Metric::TLSLargestFreeBlock, tls_statistics.heap_largest_block);
+    SetMetric(Metric::FreeHeap, esp_get_free_heap_size());
+    SetMetric(Metric::MinFreeHeap, esp_get_minimum_free_heap_size());
+    SetMetric(Metric::LargestFreeBlock,
+              heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    SetMetric(Metric::Uptime, millis() / 1000);
+    static char body[4096];
+    FormatMetrics(body, sizeof(body));
+    metrics_server.send(200, "text/plain; version=0.0.4", body);
+}
+
+void MetricsSetup() {
+    if (METRICS_PORT == 0) {
+        return;
+    }
+    metrics_server.on("/metrics", HTTP_GET, MetricsHandle);
+    metrics_server.begin();
+    Serial.printf("Metrics on port %d\n", METRICS_PORT);
+}
+
+void MetricsProcess() {
+    if ((METRICS_PORT == 0) || !connectivity.IsOnline()) {
+        return;
+    }
+    metrics_server.handleClient();
+}
+
+void HistoryProcess() {
+    if (HISTORY_SIZE == 0) {
+        return;
+    }
+    StoreHistory();
+    if (!connectivity.IsOnline() || !mqtt_client.connected() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    // Leave the rest of the queue to the sensor states.
+    char topic[80];
+    static char payload[MQTTPublisher::kMaxPayloadLength];
+    while ((publisher.GetFreeSize() >= MQTTPublisher::kQueueCapacity / 2) &&
+           GetHistoryResponse(topic, sizeof(topic), payload,
+                              sizeof(payload))) {
+        PublishMessage(mqtt_client, topic,
+                       reinterpret_cast<const uint8_t*>(payload),
+                       strlen(payload));
+    }
+}
+
+/**
+ * @brief Get the MQTT keepalive in seconds.
+ * @details The client is not serviced in the BLE window, so the keepalive
+ * covers the whole radio period.
+ */
+uint16_t GetMQTTKeepAlive() {
+    uint32_t period = (GetSetting(Setting::RadioPeriod) + 999) / 1000;
+    return std::max<uint32_t>(MQTT_KEEPALIVE, period);
+}
+
+/**
+ * @brief Get the longest cycle of reading every stored device.
+ * @details Each device may take a scan and an indication wait. They only
+ * start in the BLE window, and the rest of a window may be too short.
+ */
+uint32_t GetDeviceCyclePeriod() {
+    uint64_t ble_time = static_cast<uint64_t>(GetSetting(Setting::DeviceNum)) *
+                        (1000 * GetSetting(Setting::ScanDuration) +
+                         GetSetting(Setting::NotifyTimeout));
+    return GetSetting(Setting::DeviceInterval) +
+           ble_time * 100 / GetSetting(Setting::BLEDutyCycle) +
+           GetSetting(Setting::RadioPeriod);
+}
+
+/**
+ * @brief Apply the settings which are not read at each use.
+ */
+void SettingsApply() {
+    static uint16_t keep_alive = 0;
+    esp_task_wdt_init(GetSetting(Setting::WatchdogTimeout), true);
+    SetScanParameters(GetSetting(Setting::ScanInterval),
+                      GetSetting(Setting::ScanWindow));
+    radio_scheduler.SetDutyCycle(GetSetting(Setting::RadioPeriod),
+                                 GetSetting(Setting::BLEDutyCycle));
+    // A scan and a notify wait last up to their settings, plus a margin.
+    SetTraceBudget(TraceStage::Scan,
+                   1000 * GetSetting(Setting::ScanDuration) + 2000);
+    SetTraceBudget(TraceStage::NotifyWait,
+                   GetSetting(Setting::NotifyTimeout) + 1000);
+    mqtt_client.setBufferSize(GetSetting(Setting::MQTTBufferSize));
+    if (keep_alive != GetMQTTKeepAlive()) {
+        keep_alive = GetMQTTKeepAlive();
+        mqtt_client.setKeepAlive(keep_alive);
+        // The keepalive is sent on connect, so reconnect to renew it.
+        if (mqtt_client.connected()) {
+            mqtt_client.disconnect();
+        }
+    }
+    // A sensor missed in one cycle is still owned.
+    ownership.SetSightingTimeout(2 * GetDeviceCyclePeriod());
+    StoredDeviceSetup();
+    ScanAcceptListSetup();
+}
+
+void SettingsProcess() {
+    static uint32_t applied_version = GetSettingsVersion();
+    // Applied out of the MQTT callback, which uses the MQTT buffer.
+    if (applied_version != GetSettingsVersion()) {
+        applied_version = GetSettingsVersion();
+        SettingsApply();
+    }
+    if (!connectivity.IsOnline() || !mqtt_client.connected() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    char topic[80];
+    char payload[384];
+    if (GetConfigState(topic, sizeof(topic), payload, sizeof(payload))) {
+        PublishMessage(mqtt_client, topic,
+                       reinterpret_cast<const uint8_t*>(payload),
+                       strlen(payload));
+    }
+}
+
+void RulesProcess() {
+    if (!connectivity.IsOnline() || !mqtt_client.connected() ||
+        (radio_scheduler.GetWindow() != RadioWindow::Network)) {
+        return;
+    }
+    char topic[80];
+    char payload[64];
+    if (GetRulesState(topic, sizeof(topic), payload, sizeof(payload))) {
+        PublishMessage(mqtt_client, topic,
+                       reinterpret_cast<const uint8_t*>(payload),
+                       strlen(payload));
+    }
+}
+
+/**
+ * @brief Publish the alerts at once if the MQTT session is open.
+ * @details Otherwise they are queued in the publisher, which connects in
+ * the network window, so the BLE window is never held by a connection.
+ */
+void AlertProcess() {
+    if (GetPendingAlertNum() == 0) {
+        return;
+    }
+    char topic[80];
+    char payload[192];
+    while (GetAlert(topic, sizeof(topic), payload, sizeof(payload))) {
+        if (mqtt_client.connected() && mqtt_client.publish(topic, payload)) {
+            continue;
+        }
+        if (!PublishMessage(mqtt_client, topic,
+                            reinterpret_cast<const uint8_t*>(payload),
+                            strlen(payload))) {
+            IncrementMetric(Metric::AlertPublishFailures);
         }
     }
 }
@@ -92,33 +647,41 @@ void HeapDebug(const uint32_t& interval) {
     }
 }
 
-void SampleDeviceDebug() {
-    // BLEAddress addr("84:F7:03:39:EF:1A");  // Environment sensor 3.0.
-    BLEAddress addr("84:F7:03:3A:82:BA");  // Environment sensor.
-    // BLEAddress addr("84:F7:03:3B:6A:72");
-    EnvironmentSensor sensor(addr);
-    sensor.Update(pClient, pScan);
-    sensor.Push(WiFi, mqtt_client, kMQTTClientID);
-}
-
 void WifiSetup() {
-    char wifi_ssid[] = WIFI_SSID;
-    char wifi_password[] = WIFI_PASSWORD;
-    WiFi.begin(wifi_ssid, wifi_password);
-    uint32_t start = millis();
-    while (static_cast<uint32_t>(millis() - start) <= 10000U &&
-           !WiFi.isConnected()) {
-    }
-    if (WiFi.isConnected()) {
-        Serial.printf("WiFi connected. IP is %s\n",
-                      WiFi.localIP().toString().c_str());
-    } else {
-        Serial.println("WiFi connect fail");
+    static char wifi_ssid[] = WIFI_SSID;
+    static char wifi_password[] = WIFI_PASSWORD;
+    char static_ip[] = STATIC_IP;
+    char static_gateway[] = STATIC_GATEWAY;
+    char static_subnet[] = STATIC_SUBNET;
+    char static_dns[] = STATIC_DNS;
+    if (static_ip[0] != '\0') {
+        IPAddress ip_addr, gateway_addr, subnet_addr, dns_addr;
+        if (ip_addr.fromString(static_ip) &&
+            gateway_addr.fromString(static_gateway) &&
+            subnet_addr.fromString(static_subnet)) {
+            if (!dns_addr.fromString(static_dns)) {
+                dns_addr = gateway_addr;
+            }
+            connectivity.SetStaticIP(ip_addr, gateway_addr, subnet_addr,
+                                     dns_addr);
+            Serial.printf("WiFi static IP %s\n", static_ip);
+        }
     }
+    connectivity.Begin(wifi_ssid, wifi_password);
+    // SNTP keeps retrying in background until WiFi is connected.
+    configTime(0, 0, NTP_SERVER);
 }
 
 void MQTTSetup() {
-    mqtt_client.setBufferSize(512);
+    SetCBORStatePayload(STATE_PAYLOAD_CBOR);
+    SetMQTTPublisher(&publisher);
+    mqtt_client.setCallback(MQTTCallback);
+    if (MQTT_TLS && !tls_client.Begin(kMQTTCACert, TLS_SESSION_NVS)) {
+        Serial.println("MQTT TLS setup failed");
+    }
+    if (GATEWAY_COORDINATION) {
+        SetOwnershipElection(&ownership);
+    }
     char mqtt_ip[] = MQTT_IP;
     if (kMQTTDomain[0] != '\0') {
         mqtt_client.setServer(kMQTTDomain, kMQTTPort);
@@ -144,23 +707,44 @@ void WatchdogReset(const uint32_t interval) {
 }
 
 void setup() {
-    esp_task_wdt_init(WATCHDOG_TIMEOUT, true);
+    SettingsSetup(kMQTTClientID);
+    esp_task_wdt_init(GetSetting(Setting::WatchdogTimeout), true);
     esp_task_wdt_add(NULL);
     Serial.begin(115200);
+    Serial.printf("Boot, reset reason %d\n", esp_reset_reason());
+    TraceSetup();
+    PreviousTraceDump();
+#if !defined(BLE_NIMBLE)
     SerialBT.begin("ESP32 Bluetooth MQTT Gateway");
+#endif
     prefs.begin("devices");
-    BLEDevice::init("ESP32 BLE MQTT Gateway");
-    pClient = BLEDevice::createClient();
-    pClient->setClientCallbacks(new DefaultClientCallbacks());
-    pScan = BLEDevice::getScan();
+    pTransport = CreateBLETransport();
+    pTransport->Begin("ESP32 BLE MQTT Gateway");
+    SetCaptureEnabled(BLE_CAPTURE);
+    RulesSetup(kMQTTClientID);
+    if ((HISTORY_SIZE > 0) && HistorySetup(HISTORY_SIZE, kMQTTClientID)) {
+        Serial.printf("History in %d bytes of flash\n", HISTORY_SIZE);
+    }
+    SettingsApply();
     WifiSetup();
     MQTTSetup();
+    MetricsSetup();
 }
 
 void loop() {
     WatchdogReset(1000 * WATCHDOG_RESET_INTERVAL);
-    BTCommandProcess(1000);
-    StoredBLEDeviceProcess(1000);
-    // SampleDeviceDebug();
+    connectivity.Loop();
+    BTCommandProcess(GetSetting(Setting::CommandInterval));
+    StoredBLEDeviceProcess(GetSetting(Setting::DeviceInterval));
+    AlertProcess();
+    PendingDevicePublish();
+    PreviousTracePublish();
+    MQTTSessionProcess();
+    GatewayCoordinationProcess();
+    HistoryProcess();
+    SettingsProcess();
+    RulesProcess();
+    MQTTPublishProcess();
+    MetricsProcess();
     // HeapDebug(1000);
 }
\ No newline at end of file
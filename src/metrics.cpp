@@ -0,0 +1,155 @@
+/**
+ * @file metrics.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Fixed registry of counters and gauges in Prometheus format.
+ */
+#include "metrics.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+
+static const size_t kMaxDeviceLabelNum = 16;
+static const size_t kMaxDeviceLabelLength = 40;
+
+struct MetricInfo {
+    const char* name;
+    const char* type;
+    const char* help;
+};
+
+static const MetricInfo kMetricInfos[] = {
+    {"gateway_samples_total", "counter", "Values sampled from devices."},
+    {"gateway_scans_total", "counter", "BLE scans."},
+    {"gateway_scan_callbacks_total", "counter", "BLE advertising reports."},
+    {"gateway_ble_connect_failures_total", "counter", "Failed BLE connects."},
+    {"gateway_wifi_connects_total", "counter", "WiFi connects."},
+    {"gateway_wifi_disconnects_total", "counter", "WiFi disconnects."},
+    {"gateway_mqtt_connect_failures_total", "counter",
+     "Failed MQTT connects."},
+    {"gateway_mqtt_delivered_total", "counter", "Delivered MQTT messages."},
+    {"gateway_mqtt_publish_failures_total", "counter",
+     "Failed MQTT publishes."},
+    {"gateway_mqtt_dropped_total", "counter", "Dropped MQTT messages."},
+    {"gateway_alert_publish_failures_total", "counter",
+     "Alerts neither published nor queued."},
+    {"gateway_tls_handshakes_total", "counter", "MQTT TLS handshakes."},
+    {"gateway_tls_resumed_handshakes_total", "counter",
+     "MQTT TLS handshakes which resumed the session."},
+    {"gateway_tls_handshake_duration_milliseconds", "gauge",
+     "Duration of the last MQTT TLS handshake."},
+    {"gateway_tls_setup_heap_bytes", "gauge",
+     "Heap kept by the MQTT TLS context, mostly its record buffers."},
+    {"gateway_tls_heap_peak_bytes", "gauge",
+     "Heap taken during the last MQTT TLS handshake."},
+    {"gateway_tls_min_free_heap_bytes", "gauge",
+     "Minimum free heap since boot after the last MQTT TLS handshake."},
+    {"gateway_tls_largest_free_block_bytes", "gauge",
+     "Largest free heap block after the last MQTT TLS handshake."},
+    {"gateway_free_heap_bytes", "gauge", "Free heap."},
+    {"gateway_min_free_heap_bytes", "gauge", "Minimum free heap since boot."},
+    {"gateway_largest_free_block_bytes", "gauge",
+     "Largest free heap block, low under fragmentation."},
+    {"gateway_cycle_duration_milliseconds", "gauge",
+     "Duration of the last cycle over the registered devices."},
+    {"gateway_uptime_seconds", "gauge", "Time since boot."},
+};
+static const size_t kMetricNum = sizeof(kMetricInfos) / sizeof(kMetricInfos[0]);
+static_assert(kMetricNum == static_cast<size_t>(Metric::Uptime) + 1,
+              "kMetricInfos mismatch Metric.");
+
+static std::atomic<uint32_t> metric_values[kMetricNum];
+
+struct DeviceSamples {
+    char device[kMaxDeviceLabelLength];
+    std::atomic<uint32_t> num;
+};
+static DeviceSamples device_samples[kMaxDeviceLabelNum];
+// A label is filled before it is counted, so the scrape never reads a
+// partial one. Labels are only added by the loop task.
+static std::atomic<size_t> device_label_num(0);
+
+void IncrementMetric(const Metric& metric, uint32_t value) {
+    metric_values[static_cast<size_t>(metric)].fetch_add(
+        value, std::memory_order_relaxed);
+}
+
+void SetMetric(const Metric& metric, uint32_t value) {
+    metric_values[static_cast<size_t>(metric)].store(
+        value, std::memory_order_relaxed);
+}
+
+void AddDeviceSamples(const char* pDevice, uint32_t num) {
+    size_t label_num = device_label_num.load(std::memory_order_acquire);
+    for (size_t i = 0; i < label_num; ++i) {
+        if (strncmp(device_samples[i].device, pDevice,
+                    kMaxDeviceLabelLength - 1) == 0) {
+            device_samples[i].num.fetch_add(num, std::memory_order_relaxed);
+            return;
+        }
+    }
+    if (label_num == kMaxDeviceLabelNum) {
+        return;
+    }
+    DeviceSamples& samples = device_samples[label_num];
+    strncpy(samples.device, pDevice, kMaxDeviceLabelLength - 1);
+    samples.device[kMaxDeviceLabelLength - 1] = '\0';
+    samples.num.store(num, std::memory_order_relaxed);
+    device_label_num.store(label_num + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Append a line if it fits entirely.
+ */
+static bool AppendLine(char* pBuffer, size_t size, size_t& length,
+                       const char* pFormat, ...)
+    __attribute__((format(printf, 4, 5)));
+static bool AppendLine(char* pBuffer, size_t size, size_t& length,
+                       const char* pFormat, ...) {
+    va_list args;
+    va_start(args, pFormat);
+    int num = vsnprintf(pBuffer + length, size - length, pFormat, args);
+    va_end(args);
+    if ((num < 0) || (static_cast<size_t>(num) >= size - length)) {
+        pBuffer[length] = '\0';  // Drop the partial line.
+        return false;
+    }
+    length += num;
+    return true;
+}
+
+size_t FormatMetrics(char* pBuffer, size_t size) {
+    size_t length = 0;
+    if (size == 0) {
+        return 0;
+    }
+    pBuffer[0] = '\0';
+    for (size_t i = 0; i < kMetricNum; ++i) {
+        const MetricInfo& info = kMetricInfos[i];
+        if (!AppendLine(pBuffer, size, length,
+                        "# HELP %s %s\n# TYPE %s %s\n%s %u\n", info.name,
+                        info.help, info.name, info.type, info.name,
+                        metric_values[i].load(std::memory_order_relaxed))) {
+            return length;
+        }
+    }
+    if (!AppendLine(pBuffer, size, length,
+                    "# HELP gateway_device_samples_total Values sampled "
+                    "from each device.\n"
+                    "# TYPE gateway_device_samples_total counter\n")) {
+        return length;
+    }
+    size_t label_num = device_label_num.load(std::memory_order_acquire);
+    for (size_t i = 0; i < label_num; ++i) {
+        const DeviceSamples& samples = device_samples[i];
+        if (!AppendLine(pBuffer, size, length,
+                        "gateway_device_samples_total{device=\"%s\"} %u\n",
+                        samples.device,
+                        samples.num.load(std::memory_order_relaxed))) {
+            return length;
+        }
+    }
+    return length;
+}
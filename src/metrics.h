@@ -0,0 +1,75 @@
+/**
+ * @file metrics.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Fixed registry of counters and gauges in Prometheus format.
+ */
+#ifndef BLUETOOTHGATEWAY_METRICS_H_
+#define BLUETOOTHGATEWAY_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A enum for the metrics of the gateway.
+ * @details Add the name, type and help of a new metric to kMetricInfos.
+ */
+enum class Metric : uint8_t {
+    Samples,
+    Scans,
+    ScanCallbacks,
+    BLEConnectFailures,
+    WiFiConnects,
+    WiFiDisconnects,
+    MQTTConnectFailures,
+    MQTTDelivered,
+    MQTTPublishFailures,
+    MQTTDropped,
+    AlertPublishFailures,
+    TLSHandshakes,
+    TLSResumedHandshakes,
+    TLSHandshakeDuration,
+    TLSSetupHeap,
+    TLSHeapPeak,
+    TLSMinFreeHeap,
+    TLSLargestFreeBlock,
+    FreeHeap,
+    MinFreeHeap,
+    LargestFreeBlock,
+    CycleDuration,
+    Uptime,
+};
+
+/**
+ * @brief Add to a counter. It is atomic and safe in the BLE callbacks.
+ * @param [in] metric
+ * @param [in] value
+ */
+void IncrementMetric(const Metric& metric, uint32_t value = 1);
+
+/**
+ * @brief Set a gauge, or a counter kept by other statistics.
+ * @param [in] metric
+ * @param [in] value
+ */
+void SetMetric(const Metric& metric, uint32_t value);
+
+/**
+ * @brief Add the samples of a device labelled by its name.
+ * @details Call it from the loop task only, while FormatMetrics may run in
+ * another task. The samples of devices beyond the label slots are only
+ * counted in the total.
+ * @param [in] pDevice
+ * @param [in] num
+ */
+void AddDeviceSamples(const char* pDevice, uint32_t num);
+
+/**
+ * @brief Format all metrics in the Prometheus text exposition format.
+ * @param [out] pBuffer
+ * @param [in] size
+ * @return size_t The length without the null terminator. The output is
+ * truncated at a line boundary if the buffer is too small.
+ */
+size_t FormatMetrics(char* pBuffer, size_t size);
+
+#endif
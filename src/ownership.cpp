@@ -0,0 +1,270 @@
+/**
+ * @file ownership.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Elect one gateway to own each sensor by the sighting RSSI.
+ */
+#include "ownership.h"
+
+#include <Arduino.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const char kSightingTopicPrefix[] = "bluetooth-gateway/sighting/";
+static const char kSightingTopicFilter[] = "bluetooth-gateway/sighting/+";
+
+static OwnershipElection* pActiveElection = nullptr;
+
+OwnershipElection::OwnershipElection(const char* pGatewayID)
+    : sighting_timeout(kMinSightingTimeout) {
+    strncpy(gateway_id, pGatewayID, kMaxGatewayIDLength - 1);
+    gateway_id[kMaxGatewayIDLength - 1] = '\0';
+    memset(sensors, 0, sizeof(sensors));
+}
+
+const char* OwnershipElection::GetGatewayID() const { return gateway_id; }
+
+void OwnershipElection::SetSightingTimeout(uint32_t timeout) {
+    sighting_timeout =
+        (timeout < kMinSightingTimeout) ? kMinSightingTimeout : timeout;
+}
+
+uint32_t OwnershipElection::GetSightingTimeout() const {
+    return sighting_timeout;
+}
+
+bool OwnershipElection::IsFresh(uint32_t time, uint32_t now) const {
+    return static_cast<uint32_t>(now - time) < sighting_timeout;
+}
+
+/**
+ * @brief Find the state of the sensor or allocate one.
+ * @details If full, the least recently sighted sensor is replaced when
+ * is_evicting, otherwise nullptr is returned.
+ */
+OwnershipElection::SensorState* OwnershipElection::FindSensor(
+    const uint8_t* pAddress, uint32_t now, bool is_evicting) {
+    SensorState* pOldest = &sensors[0];
+    for (SensorState& sensor : sensors) {
+        if (sensor.is_used && (memcmp(sensor.address, pAddress, 6) == 0)) {
+            return &sensor;
+        }
+        if (!sensor.is_used) {
+            pOldest = &sensor;
+        } else if (pOldest->is_used &&
+                   (static_cast<uint32_t>(now - sensor.time) >
+                    static_cast<uint32_t>(now - pOldest->time))) {
+            pOldest = &sensor;
+        }
+    }
+    if (pOldest->is_used && !is_evicting) {
+        return nullptr;
+    }
+    memset(pOldest, 0, sizeof(SensorState));
+    memcpy(pOldest->address, pAddress, 6);
+    pOldest->is_used = true;
+    pOldest->is_announced = true;
+    pOldest->time = now - sighting_timeout;  // Not sighted locally.
+    return pOldest;
+}
+
+bool OwnershipElection::IsBetter(int rssi, const char* pGatewayID,
+                                 int other_rssi,
+                                 const char* pOtherGatewayID) const {
+    if (rssi != other_rssi) {
+        return rssi > other_rssi;
+    }
+    return strcmp(pGatewayID, pOtherGatewayID) < 0;
+}
+
+bool OwnershipElection::Decide(const SensorState& sensor, uint32_t now) const {
+    if (!IsFresh(sensor.time, now)) {
+        return false;
+    }
+    const Sighting* pOwner = nullptr;
+    bool is_best = true;
+    for (const Sighting& remote : sensor.remote) {
+        if ((remote.gateway_id[0] == '\0') || !IsFresh(remote.time, now)) {
+            continue;
+        }
+        if (IsBetter(remote.rssi, remote.gateway_id, sensor.rssi,
+                     gateway_id)) {
+            is_best = false;
+        }
+        if (remote.is_owner &&
+            ((pOwner == nullptr) ||
+             IsBetter(remote.rssi, remote.gateway_id, pOwner->rssi,
+                      pOwner->gateway_id))) {
+            pOwner = &remote;
+        }
+    }
+    if (sensor.is_owner) {
+        // Yield to a much stronger gateway or a better concurrent owner.
+        for (const Sighting& remote : sensor.remote) {
+            if ((remote.gateway_id[0] != '\0') && IsFresh(remote.time, now) &&
+                (remote.rssi > sensor.rssi + kHysteresis)) {
+                return false;
+            }
+        }
+        return (pOwner == nullptr) ||
+               IsBetter(sensor.rssi, gateway_id, pOwner->rssi,
+                        pOwner->gateway_id);
+    }
+    // Wait for the owner to yield so that no reading is published twice.
+    return (pOwner == nullptr) && is_best;
+}
+
+bool OwnershipElection::UpdateLocal(const uint8_t* pAddress, int rssi,
+                                    uint32_t now) {
+    SensorState* pSensor = FindSensor(pAddress, now, true);
+    pSensor->rssi = rssi;
+    pSensor->time = now;
+    pSensor->is_owner = Decide(*pSensor, now);
+    pSensor->is_announced = false;
+    return pSensor->is_owner;
+}
+
+void OwnershipElection::UpdateRemote(const uint8_t* pAddress,
+                                     const char* pGatewayID, int rssi,
+                                     bool is_owner, uint32_t now) {
+    if (strncmp(pGatewayID, gateway_id, kMaxGatewayIDLength - 1) == 0) {
+        return;  // Echo of this gateway.
+    }
+    // Sensors of other gateways do not evict the local ones.
+    SensorState* pSensor = FindSensor(pAddress, now, false);
+    if (pSensor == nullptr) {
+        return;
+    }
+    Sighting* pSighting = nullptr;
+    for (Sighting& remote : pSensor->remote) {
+        if (strncmp(remote.gateway_id, pGatewayID, kMaxGatewayIDLength - 1) ==
+            0) {
+            pSighting = &remote;
+            break;
+        }
+        if ((pSighting == nullptr) &&
+            ((remote.gateway_id[0] == '\0') || !IsFresh(remote.time, now))) {
+            pSighting = &remote;  // Reuse an empty or stale slot.
+        }
+    }
+    if (pSighting == nullptr) {
+        return;  // Too many gateways see this sensor.
+    }
+    strncpy(pSighting->gateway_id, pGatewayID, kMaxGatewayIDLength - 1);
+    pSighting->gateway_id[kMaxGatewayIDLength - 1] = '\0';
+    pSighting->rssi = rssi;
+    pSighting->is_owner = is_owner;
+    pSighting->time = now;
+}
+
+bool OwnershipElection::PopAnnouncement(uint8_t* pAddress, int& rssi,
+                                        bool& is_owner, uint32_t now) {
+    for (SensorState& sensor : sensors) {
+        if (!sensor.is_used) {
+            continue;
+        }
+        // Repeat a held claim before the other gateways take it as stale.
+        if (sensor.is_owner && IsFresh(sensor.time, now) &&
+            (static_cast<uint32_t>(now - sensor.announce_time) >=
+             sighting_timeout / 3)) {
+            sensor.is_announced = false;
+        }
+        if (!sensor.is_announced) {
+            sensor.is_announced = true;
+            sensor.announce_time = now;
+            memcpy(pAddress, sensor.address, 6);
+            rssi = sensor.rssi;
+            is_owner = sensor.is_owner;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SetOwnershipElection(OwnershipElection* pElection) {
+    pActiveElection = pElection;
+}
+
+bool ClaimSensor(const uint8_t* pAddress, int rssi) {
+    if (pActiveElection == nullptr) {
+        return true;
+    }
+    bool is_owner = pActiveElection->UpdateLocal(pAddress, rssi, millis());
+    log_i("Sensor %02x:%02x:%02x:%02x:%02x:%02x RSSI %d, %s.", pAddress[0],
+          pAddress[1], pAddress[2], pAddress[3], pAddress[4], pAddress[5],
+          rssi, is_owner ? "owned" : "owned by other gateway");
+    return is_owner;
+}
+
+const char* GetSightingTopicFilter() { return kSightingTopicFilter; }
+
+/**
+ * @brief Parse the 12 hex digits of the address in the topic.
+ */
+static bool ParseTopicAddress(const char* pTopic, uint8_t* pAddress) {
+    size_t prefix_length = sizeof(kSightingTopicPrefix) - 1;
+    if ((strncmp(pTopic, kSightingTopicPrefix, prefix_length) != 0) ||
+        (strlen(pTopic) != prefix_length + 12)) {
+        return false;
+    }
+    const char* pHex = pTopic + prefix_length;
+    for (size_t i = 0; i < 6; ++i) {
+        unsigned int byte = 0;
+        if (sscanf(pHex + 2 * i, "%2x", &byte) != 1) {
+            return false;
+        }
+        pAddress[i] = static_cast<uint8_t>(byte);
+    }
+    return true;
+}
+
+/**
+ * @details The payload is `{"gateway":"<id>","rssi":<rssi>,"owner":<0|1>}`.
+ */
+void HandleSightingMessage(const char* pTopic, const uint8_t* pPayload,
+                           size_t length) {
+    if (pActiveElection == nullptr) {
+        return;
+    }
+    uint8_t address[6];
+    if (!ParseTopicAddress(pTopic, address)) {
+        return;
+    }
+    char payload[96];
+    if (length >= sizeof(payload)) {
+        return;
+    }
+    memcpy(payload, pPayload, length);
+    payload[length] = '\0';
+    char gateway_id[OwnershipElection::kMaxGatewayIDLength];
+    int rssi = 0;
+    int is_owner = 0;
+    if (sscanf(payload, "{\"gateway\":\"%23[^\"]\",\"rssi\":%d,\"owner\":%d}",
+               gateway_id, &rssi, &is_owner) != 3) {
+        log_i("Invalid sighting payload %s.", payload);
+        return;
+    }
+    pActiveElection->UpdateRemote(address, gateway_id, rssi, is_owner != 0,
+                                  millis());
+}
+
+bool GetSightingAnnouncement(char* pTopic, size_t topic_size, char* pPayload,
+                             size_t payload_size) {
+    if (pActiveElection == nullptr) {
+        return false;
+    }
+    uint8_t address[6];
+    int rssi = 0;
+    bool is_owner = false;
+    if (!pActiveElection->PopAnnouncement(address, rssi, is_owner,
+                                          millis())) {
+        return false;
+    }
+    snprintf(pTopic, topic_size, "%s%02X%02X%02X%02X%02X%02X",
+             kSightingTopicPrefix, address[0], address[1], address[2],
+             address[3], address[4], address[5]);
+    snprintf(pPayload, payload_size,
+             "{\"gateway\":\"%s\",\"rssi\":%d,\"owner\":%d}",
+             pActiveElection->GetGatewayID(), rssi, is_owner ? 1 : 0);
+    return true;
+}
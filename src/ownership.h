@@ -0,0 +1,150 @@
+/**
+ * @file ownership.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Elect one gateway to own each sensor by the sighting RSSI.
+ */
+#ifndef BLUETOOTHGATEWAY_OWNERSHIP_H_
+#define BLUETOOTHGATEWAY_OWNERSHIP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "settings.h"
+
+/**
+ * @brief The RSSI election of sensors shared by several gateways.
+ * @details Every gateway announces its sighting RSSI of each sensor with a
+ * flag whether it owns the sensor. A gateway claims a sensor if no fresh
+ * sighting of other gateways claims it and this gateway ranks best. The
+ * rank is the higher RSSI and then the smaller gateway ID.
+ *
+ * The owner yields if another gateway is stronger by more than kHysteresis
+ * or another owner ranks better. A sighting is stale after the sighting
+ * timeout, which must outlast the cycle in which a gateway sights all of
+ * its sensors. An owner announces its claims again every third of the
+ * timeout, so a claim is not dropped while the sensor waits for its turn.
+ * The time is passed in so that it works on host.
+ */
+class OwnershipElection {
+   public:
+    // Every registered device fits, so none loses the remote sightings.
+    static const size_t kMaxSensorNum = kMaxDevNum;
+    static const size_t kMaxGatewayNum = 4;  // other gateways per sensor
+    static const size_t kMaxGatewayIDLength = 24;
+    static const int kHysteresis = 8;                   // dB
+    static const uint32_t kMinSightingTimeout = 90000;  // milliseconds
+    /**
+     * @param [in] pGatewayID The unique ID of this gateway.
+     */
+    OwnershipElection(const char* pGatewayID);
+    const char* GetGatewayID() const;
+    /**
+     * @brief Set the sighting timeout, at least kMinSightingTimeout.
+     * @param [in] timeout Milliseconds.
+     */
+    void SetSightingTimeout(uint32_t timeout);
+    uint32_t GetSightingTimeout() const;
+    /**
+     * @brief Record the sighting of this gateway and decide the ownership.
+     * @param [in] pAddress The 6 bytes address of the sensor.
+     * @param [in] rssi
+     * @param [in] now Milliseconds.
+     * @return true If this gateway owns the sensor.
+     * @return false
+     */
+    bool UpdateLocal(const uint8_t* pAddress, int rssi, uint32_t now);
+    /**
+     * @brief Record the sighting announced by another gateway.
+     * @param [in] pAddress The 6 bytes address of the sensor.
+     * @param [in] pGatewayID
+     * @param [in] rssi
+     * @param [in] is_owner Whether the gateway claims the sensor.
+     * @param [in] now Milliseconds.
+     */
+    void UpdateRemote(const uint8_t* pAddress, const char* pGatewayID,
+                      int rssi, bool is_owner, uint32_t now);
+    /**
+     * @brief Get the next sighting of this gateway not announced yet, or a
+     * claim due to be announced again.
+     * @param [out] pAddress The 6 bytes address of the sensor.
+     * @param [out] rssi
+     * @param [out] is_owner
+     * @param [in] now Milliseconds.
+     * @return true If a sighting is got.
+     * @return false
+     */
+    bool PopAnnouncement(uint8_t* pAddress, int& rssi, bool& is_owner,
+                         uint32_t now);
+
+   private:
+    struct Sighting {
+        char gateway_id[kMaxGatewayIDLength];
+        int rssi;
+        bool is_owner;
+        uint32_t time;
+    };
+static_assert(OwnershipElection::kMaxSensorNum >= kMaxDevNum,
+              "The ownership table is smaller than the device registry.");
+    struct SensorState {
+        uint8_t address[6];
+        bool is_used;
+        bool is_owner;
+        bool is_announced;
+        int rssi;
+        uint32_t time;
+        uint32_t announce_time;
+        Sighting remote[kMaxGatewayNum];
+    };
+    char gateway_id[kMaxGatewayIDLength];
+    uint32_t sighting_timeout;
+    SensorState sensors[kMaxSensorNum];
+    bool IsFresh(uint32_t time, uint32_t now) const;
+    SensorState* FindSensor(const uint8_t* pAddress, uint32_t now,
+                            bool is_evicting);
+    bool IsBetter(int rssi, const char* pGatewayID, int other_rssi,
+                  const char* pOtherGatewayID) const;
+    bool Decide(const SensorState& sensor, uint32_t now) const;
+};
+
+/**
+ * @brief Enable the election. nullptr disables it and every sensor is owned.
+ * @param [in] pElection
+ */
+void SetOwnershipElection(OwnershipElection* pElection);
+
+/**
+ * @brief Record the sighting of this gateway and check the ownership.
+ * @param [in] pAddress The 6 bytes address of the sensor.
+ * @param [in] rssi
+ * @return true If this gateway should read and publish the sensor.
+ * @return false
+ */
+bool ClaimSensor(const uint8_t* pAddress, int rssi);
+
+/**
+ * @brief Get the MQTT topic filter of the sighting announcements.
+ */
+const char* GetSightingTopicFilter();
+
+/**
+ * @brief Handle an MQTT message of the sighting topic.
+ * @param [in] pTopic
+ * @param [in] pPayload
+ * @param [in] length
+ */
+void HandleSightingMessage(const char* pTopic, const uint8_t* pPayload,
+                           size_t length);
+
+/**
+ * @brief Format the next sighting announcement of this gateway.
+ * @param [out] pTopic
+ * @param [in] topic_size
+ * @param [out] pPayload
+ * @param [in] payload_size
+ * @return true If an announcement is pending.
+ * @return false
+ */
+bool GetSightingAnnouncement(char* pTopic, size_t topic_size, char* pPayload,
+                             size_t payload_size);
+
+#endif
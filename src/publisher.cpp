@@ -0,0 +1,433 @@
+/**
+ * @file publisher.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Queue the MQTT messages and deliver them with QoS 1.
+ */
+#include "publisher.h"
+
+#include <Arduino.h>
+
+#include <string.h>
+
+#include "device.h"
+#include "scheduler.h"
+#include "trace.h"
+
+static const uint8_t kPublishQoS1 = 0x32;
+static const uint8_t kPublishDup = 0x08;
+static const uint8_t kPubAckType = 4;
+// PubSubClient numbers its subscriptions from 1, so the messages take the
+// upper half of the packet IDs.
+static const uint16_t kMinPacketID = 0x8000;
+
+static MQTTPublisher* pActivePublisher = nullptr;
+
+MQTTAckClient::MQTTAckClient(Client& client)
+    : client(client), connection_num(0) {
+    Reset();
+}
+
+/**
+ * @brief Forget the packets of the last connection.
+ */
+void MQTTAckClient::Reset() {
+    parse_state = ParseState::Header;
+    ack_head = 0;
+    ack_num = 0;
+}
+
+/**
+ * @brief Follow the MQTT packets in the bytes read by PubSubClient.
+ */
+void MQTTAckClient::Parse(uint8_t byte) {
+    switch (parse_state) {
+        case ParseState::Header:
+            packet_type = byte >> 4;
+            remaining_length = 0;
+            length_multiplier = 1;
+            parse_state = ParseState::Length;
+            break;
+        case ParseState::Length:
+            remaining_length += (byte & 0x7F) * length_multiplier;
+            length_multiplier *= 128;
+            if (byte & 0x80) {
+                break;
+            }
+            body_index = 0;
+            packet_id = 0;
+            if (remaining_length == 0) {
+                EndPacket();
+            } else {
+                parse_state = ParseState::Body;
+            }
+            break;
+        case ParseState::Body:
+            if (body_index < 2) {
+                packet_id = (packet_id << 8) | byte;
+            }
+            if (++body_index == remaining_length) {
+                EndPacket();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void MQTTAckClient::EndPacket() {
+    parse_state = ParseState::Header;
+    if ((packet_type != kPubAckType) || (remaining_length != 2)) {
+        return;
+    }
+    if (ack_num == kMaxAckNum) {
+        log_w("PUBACK %d ignored.", packet_id);  // Sent again on timeout.
+        return;
+    }
+    acks[(ack_head + ack_num) % kMaxAckNum] = packet_id;
+    ++ack_num;
+}
+
+bool MQTTAckClient::Publish(const char* pTopic, const uint8_t* pPayload,
+                            size_t length, uint16_t packet_id, bool is_dup) {
+    size_t topic_length = strlen(pTopic);
+    if (topic_length >= kMaxTopicLength) {
+        return false;
+    }
+    // Fixed header(2-5) + topic length(2) + topic + packet ID(2)
+    uint8_t head[5 + 2 + kMaxTopicLength + 2];
+    size_t head_length = 0;
+    head[head_length++] = kPublishQoS1 | (is_dup ? kPublishDup : 0);
+    size_t remaining_length = 2 + topic_length + 2 + length;
+    do {
+        uint8_t byte = remaining_length & 0x7F;
+        remaining_length >>= 7;
+        head[head_length++] = byte | ((remaining_length > 0) ? 0x80 : 0);
+    } while (remaining_length > 0);
+    head[head_length++] = topic_length >> 8;
+    head[head_length++] = topic_length;
+    memcpy(head + head_length, pTopic, topic_length);
+    head_length += topic_length;
+    head[head_length++] = packet_id >> 8;
+    head[head_length++] = packet_id;
+    return (client.write(head, head_length) == head_length) &&
+           (client.write(pPayload, length) == length);
+}
+
+bool MQTTAckClient::PopAck(uint16_t& packet_id) {
+    if (ack_num == 0) {
+        return false;
+    }
+    packet_id = acks[ack_head];
+    ack_head = (ack_head + 1) % kMaxAckNum;
+    --ack_num;
+    return true;
+}
+
+uint32_t MQTTAckClient::GetConnectionNum() const { return connection_num; }
+
+int MQTTAckClient::connect(IPAddress ip, uint16_t port) {
+    Reset();
+    int result = client.connect(ip, port);
+    connection_num += (result > 0) ? 1 : 0;
+    return result;
+}
+
+int MQTTAckClient::connect(const char* pHost, uint16_t port) {
+    Reset();
+    int result = client.connect(pHost, port);
+    connection_num += (result > 0) ? 1 : 0;
+    return result;
+}
+
+size_t MQTTAckClient::write(uint8_t byte) { return client.write(byte); }
+
+size_t MQTTAckClient::write(const uint8_t* pBuffer, size_t size) {
+    return client.write(pBuffer, size);
+}
+
+int MQTTAckClient::available() { return client.available(); }
+
+int MQTTAckClient::read() {
+    int byte = client.read();
+    if (byte >= 0) {
+        Parse(static_cast<uint8_t>(byte));
+    }
+    return byte;
+}
+
+int MQTTAckClient::read(uint8_t* pBuffer, size_t size) {
+    int length = client.read(pBuffer, size);
+    for (int i = 0; i < length; ++i) {
+        Parse(pBuffer[i]);
+    }
+    return length;
+}
+
+int MQTTAckClient::peek() { return client.peek(); }
+
+void MQTTAckClient::flush() { client.flush(); }
+
+void MQTTAckClient::stop() {
+    client.stop();
+    Reset();
+}
+
+uint8_t MQTTAckClient::connected() { return client.connected(); }
+
+MQTTAckClient::operator bool() { return static_cast<bool>(client); }
+
+MQTTPublisher::MQTTPublisher(PubSubClient& mqtt_client,
+                             MQTTAckClient& ack_client,
+                             const char* pMQTTClientID)
+    : mqtt_client(mqtt_client),
+      ack_client(ack_client),
+      pMQTTClientID(pMQTTClientID),
+      head(0),
+      tail(0),
+      end(0),
+      is_wrapped(false),
+      pending_num(0),
+      inflight_num(0),
+      next_packet_id(kMinPacketID),
+      connection_num(0),
+      statistics({0, 0, 0, 0, 0, 0}) {}
+
+MQTTPublisher::Message& MQTTPublisher::GetMessage(size_t offset) {
+    return *reinterpret_cast<Message*>(reinterpret_cast<uint8_t*>(pool) +
+                                       offset);
+}
+
+size_t MQTTPublisher::GetNextOffset(size_t offset) {
+    size_t next = offset + GetMessage(offset).size;
+    return (is_wrapped && (next == end)) ? 0 : next;
+}
+
+/**
+ * @brief Reserve a record at the tail of the ring.
+ * @details A record is never split. If it does not fit before the end of
+ * the pool, it starts over at the beginning.
+ * @return size_t The offset, or kQueueCapacity if full.
+ */
+size_t MQTTPublisher::Allocate(size_t size) {
+    size_t offset = kQueueCapacity;
+    if (is_wrapped) {
+        if (head - tail >= size) {
+            offset = tail;
+        }
+    } else if (kQueueCapacity - tail >= size) {
+        offset = tail;
+    } else if (head >= size) {
+        end = tail;
+        is_wrapped = true;
+        offset = 0;
+    }
+    if (offset != kQueueCapacity) {
+        tail = offset + size;
+    }
+    return offset;
+}
+
+size_t MQTTPublisher::GetFreeSize() const {
+    size_t space = is_wrapped ? head - tail
+                              : ((kQueueCapacity - tail > head)
+                                     ? kQueueCapacity - tail
+                                     : head);
+    size_t overhead = sizeof(Message) + kMaxTopicLength + 3;
+    return (space > overhead) ? space - overhead : 0;
+}
+
+bool MQTTPublisher::Enqueue(const char* pTopic, const uint8_t* pPayload,
+                            size_t length) {
+    size_t topic_length = strlen(pTopic);
+    if ((topic_length >= kMaxTopicLength) || (length > kMaxPayloadLength)) {
+        log_w("Message of %s too long to queue.", pTopic);
+        ++statistics.dropped_num;
+        return false;
+    }
+    // Keep the records aligned for the head.
+    size_t size = (sizeof(Message) + topic_length + 1 + length + 3) & ~3U;
+    size_t offset = Allocate(size);
+    if (offset == kQueueCapacity) {
+        log_w("Queue full, drop message of %s.", pTopic);
+        ++statistics.dropped_num;
+        return false;
+    }
+    Message& message = GetMessage(offset);
+    message.size = size;
+    message.packet_id = 0;
+    message.topic_length = topic_length;
+    message.payload_length = length;
+    message.enqueue_time = millis();
+    message.send_time = 0;
+    message.attempt_num = 0;
+    message.is_acked = false;
+    char* pMessageTopic = reinterpret_cast<char*>(&message + 1);
+    memcpy(pMessageTopic, pTopic, topic_length + 1);
+    memcpy(pMessageTopic + topic_length + 1, pPayload, length);
+    ++pending_num;
+    ++statistics.enqueued_num;
+    return true;
+}
+
+/**
+ * @brief Publish the message with a new packet ID or again with DUP.
+ */
+bool MQTTPublisher::Send(Message& message) {
+    if (message.packet_id == 0) {
+        message.packet_id = next_packet_id;
+        next_packet_id =
+            (next_packet_id == 0xFFFF) ? kMinPacketID : next_packet_id + 1;
+        ++inflight_num;
+    }
+    if (message.attempt_num > 0) {
+        ++statistics.retry_num;
+    }
+    ++message.attempt_num;
+    message.send_time = millis();
+    const char* pTopic = reinterpret_cast<const char*>(&message + 1);
+    const uint8_t* pPayload =
+        reinterpret_cast<const uint8_t*>(pTopic + message.topic_length + 1);
+    if (!ack_client.Publish(pTopic, pPayload, message.payload_length,
+                            message.packet_id, message.attempt_num > 1)) {
+        RecordRadioFailure(RadioFailure::MQTTPublish);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Mark the messages of the received PUBACKs as delivered.
+ */
+void MQTTPublisher::HandleAcks() {
+    uint16_t packet_id = 0;
+    while (ack_client.PopAck(packet_id)) {
+        size_t offset = head;
+        for (size_t i = 0; i < pending_num; ++i) {
+            Message& message = GetMessage(offset);
+            offset = GetNextOffset(offset);
+            if (message.is_acked || (message.packet_id != packet_id)) {
+                continue;
+            }
+            message.is_acked = true;
+            --inflight_num;
+            uint32_t latency =
+                static_cast<uint32_t>(millis() - message.enqueue_time);
+            statistics.total_latency += latency;
+            if (latency > statistics.max_latency) {
+                statistics.max_latency = latency;
+            }
+            ++statistics.delivered_num;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Free the delivered or dropped messages at the head.
+ */
+void MQTTPublisher::PopDone() {
+    while ((pending_num > 0) && GetMessage(head).is_acked) {
+        size_t next = head + GetMessage(head).size;
+        if (is_wrapped && (next == end)) {
+            next = 0;
+            is_wrapped = false;
+        }
+        head = next;
+        --pending_num;
+    }
+    if (pending_num == 0) {
+        head = 0;
+        tail = 0;
+        is_wrapped = false;
+    }
+}
+
+size_t MQTTPublisher::Pump(uint32_t budget) {
+    if (pending_num == 0) {
+        return 0;
+    }
+    if (!ConnectMQTT(mqtt_client, pMQTTClientID)) {
+        log_i("Fail to connect to MQTT server.");
+        RecordRadioFailure(RadioFailure::MQTTConnect);
+        return 0;
+    }
+    if (connection_num != ack_client.GetConnectionNum()) {
+        // The session is clean, so the messages in flight are sent again.
+        connection_num = ack_client.GetConnectionNum();
+        size_t offset = head;
+        for (size_t i = 0; i < pending_num; ++i) {
+            GetMessage(offset).packet_id = 0;
+            offset = GetNextOffset(offset);
+        }
+        inflight_num = 0;
+    }
+    ScopedTrace trace(TraceStage::Publish, 0);
+    uint32_t start = millis();
+    uint32_t delivered_num = statistics.delivered_num;
+    while ((pending_num > 0) && mqtt_client.connected() &&
+           (static_cast<uint32_t>(millis() - start) < budget)) {
+        // PubSubClient reads one packet in each loop.
+        for (size_t i = 0;
+             (i < kMaxInflightNum) && (ack_client.available() > 0); ++i) {
+            mqtt_client.loop();
+        }
+        HandleAcks();
+        bool is_sent = false;
+        size_t offset = head;
+        for (size_t i = 0; i < pending_num; ++i) {
+            Message& message = GetMessage(offset);
+            offset = GetNextOffset(offset);
+            if (message.is_acked) {
+                continue;
+            }
+            bool is_due =
+                (message.packet_id == 0)
+                    ? (inflight_num < kMaxInflightNum)
+                    : (static_cast<uint32_t>(millis() - message.send_time) >=
+                       kAckTimeout);
+            if (!is_due) {
+                continue;
+            }
+            if (message.attempt_num >= kMaxAttemptNum) {
+                log_w("Drop message of %s after %d attempts.",
+                      reinterpret_cast<const char*>(&message + 1),
+                      message.attempt_num);
+                message.is_acked = true;  // Freed as if acked.
+                inflight_num -= (message.packet_id != 0) ? 1 : 0;
+                ++statistics.dropped_num;
+                continue;
+            }
+            if (!Send(message)) {
+                break;  // Sent again on the next connection.
+            }
+            is_sent = true;
+        }
+        PopDone();
+        if (!is_sent) {
+            break;  // Wait for the acks in the next pump.
+        }
+    }
+    return statistics.delivered_num - delivered_num;
+}
+
+size_t MQTTPublisher::GetPendingNum() const { return pending_num; }
+
+PublishStatistics MQTTPublisher::GetStatistics() const { return statistics; }
+
+void SetMQTTPublisher(MQTTPublisher* pPublisher) {
+    pActivePublisher = pPublisher;
+}
+
+bool IsMQTTPublisherActive() { return pActivePublisher != nullptr; }
+
+bool PublishMessage(PubSubClient& mqtt_client, const char* pTopic,
+                    const uint8_t* pPayload, size_t length) {
+    if (pActivePublisher != nullptr) {
+        return pActivePublisher->Enqueue(pTopic, pPayload, length);
+    }
+    if (!mqtt_client.publish(pTopic, pPayload, length)) {
+        RecordRadioFailure(RadioFailure::MQTTPublish);
+        return false;
+    }
+    return true;
+}
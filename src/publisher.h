@@ -0,0 +1,197 @@
+/**
+ * @file publisher.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Queue the MQTT messages and deliver them with QoS 1.
+ */
+#ifndef BLUETOOTHGATEWAY_PUBLISHER_H_
+#define BLUETOOTHGATEWAY_PUBLISHER_H_
+
+#include <Client.h>
+#include <PubSubClient.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Counters of the MQTT publisher.
+ * @details The latency is from enqueue to the PUBACK.
+ */
+struct PublishStatistics {
+    uint32_t enqueued_num;
+    uint32_t delivered_num;
+    uint32_t retry_num;
+    uint32_t dropped_num;
+    uint32_t total_latency;  // milliseconds
+    uint32_t max_latency;    // milliseconds
+};
+
+/**
+ * @brief The network client of PubSubClient which adds QoS 1 publishing.
+ * @details PubSubClient only publishes with QoS 0 and ignores PUBACK. This
+ * client passes the traffic through and follows the packets which
+ * PubSubClient reads, so the PUBACKs of the QoS 1 messages written by
+ * Publish are kept for PopAck. The acks are lost with the connection.
+ */
+class MQTTAckClient : public Client {
+   public:
+    static const size_t kMaxAckNum = 16;
+    static const size_t kMaxTopicLength = 96;
+    MQTTAckClient(Client& client);
+    /**
+     * @brief Write a QoS 1 PUBLISH packet.
+     * @param [in] pTopic Shorter than kMaxTopicLength.
+     * @param [in] pPayload
+     * @param [in] length
+     * @param [in] packet_id Not 0.
+     * @param [in] is_dup Whether it is sent again.
+     * @return true If the whole packet is written.
+     * @return false
+     */
+    bool Publish(const char* pTopic, const uint8_t* pPayload, size_t length,
+                 uint16_t packet_id, bool is_dup);
+    /**
+     * @brief Get the packet ID of the next PUBACK.
+     * @return true If a PUBACK was received.
+     * @return false
+     */
+    bool PopAck(uint16_t& packet_id);
+    /**
+     * @brief A counter increased on each connect.
+     * @details The messages in flight are sent again on a new connection.
+     */
+    uint32_t GetConnectionNum() const;
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* pHost, uint16_t port) override;
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* pBuffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* pBuffer, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override;
+
+   private:
+    enum class ParseState : uint8_t {
+        Header,
+        Length,
+        Body,
+    };
+    Client& client;
+    uint32_t connection_num;
+    ParseState parse_state;
+    uint8_t packet_type;
+    uint32_t remaining_length;
+    uint32_t length_multiplier;
+    uint32_t body_index;
+    uint16_t packet_id;
+    uint16_t acks[kMaxAckNum];
+    size_t ack_head;
+    size_t ack_num;
+    void Reset();
+    void Parse(uint8_t byte);
+    void EndPacket();
+};
+
+/**
+ * @brief The outbound queue of MQTT messages.
+ * @details Messages are copied into a byte ring so that enqueuing never
+ * blocks on the socket. Each record takes only the length of its topic and
+ * payload. Pump publishes them with QoS 1 and keeps up to kMaxInflightNum
+ * of them in flight. A message leaves the queue on its PUBACK. It is sent
+ * again with the DUP flag after kAckTimeout or on a new connection, and
+ * dropped after kMaxAttemptNum. If the ring is full, the new message is
+ * dropped, so check GetFreeSize before queueing a batch.
+ */
+class MQTTPublisher {
+   public:
+    static const size_t kQueueCapacity = 12288;  // bytes
+    static const size_t kMaxTopicLength = MQTTAckClient::kMaxTopicLength;
+    static const size_t kMaxPayloadLength = 1024;
+    static const size_t kMaxInflightNum = 8;
+    static const uint32_t kAckTimeout = 5000;  // milliseconds
+    static const uint8_t kMaxAttemptNum = 3;
+    MQTTPublisher(PubSubClient& mqtt_client, MQTTAckClient& ack_client,
+                  const char* pMQTTClientID);
+    /**
+     * @brief Copy the message into the queue.
+     * @return true If queued.
+     * @return false If the message is too long or the queue is full.
+     */
+    bool Enqueue(const char* pTopic, const uint8_t* pPayload, size_t length);
+    /**
+     * @brief Send the queued messages and wait for their acks.
+     * @param [in] budget Return after this time in milliseconds.
+     * @return size_t The number of delivered messages.
+     */
+    size_t Pump(uint32_t budget);
+    size_t GetPendingNum() const;
+    /**
+     * @brief Get the payload length of the longest message which can be
+     * queued now.
+     */
+    size_t GetFreeSize() const;
+    PublishStatistics GetStatistics() const;
+
+   private:
+    /**
+     * @brief The head of a record, followed by the topic and payload.
+     * @details packet_id is 0 if the message is not in flight.
+     */
+    struct Message {
+        uint16_t size;  // bytes of the record
+        uint16_t packet_id;
+        uint16_t topic_length;
+        uint16_t payload_length;
+        uint32_t enqueue_time;
+        uint32_t send_time;
+        uint8_t attempt_num;
+        bool is_acked;
+    };
+    PubSubClient& mqtt_client;
+    MQTTAckClient& ack_client;
+    const char* pMQTTClientID;
+    uint32_t pool[kQueueCapacity / sizeof(uint32_t)];
+    size_t head;
+    size_t tail;
+    size_t end;  // end of the records before tail if wrapped
+    bool is_wrapped;
+    size_t pending_num;
+    size_t inflight_num;
+    uint16_t next_packet_id;
+    uint32_t connection_num;
+    PublishStatistics statistics;
+    Message& GetMessage(size_t offset);
+    size_t GetNextOffset(size_t offset);
+    size_t Allocate(size_t size);
+    bool Send(Message& message);
+    void HandleAcks();
+    void PopDone();
+};
+
+/**
+ * @brief Queue the following messages in the publisher.
+ * @details nullptr to publish synchronously.
+ * @param [in] pPublisher
+ */
+void SetMQTTPublisher(MQTTPublisher* pPublisher);
+
+/**
+ * @brief Whether the messages are queued by SetMQTTPublisher.
+ */
+bool IsMQTTPublisherActive();
+
+/**
+ * @brief Queue the message, or publish it at once if no publisher is set.
+ * @param [in] mqtt_client
+ * @param [in] pTopic
+ * @param [in] pPayload
+ * @param [in] length
+ * @return true If queued or published.
+ * @return false
+ */
+bool PublishMessage(PubSubClient& mqtt_client, const char* pTopic,
+                    const uint8_t* pPayload, size_t length);
+
+#endif
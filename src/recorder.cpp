@@ -0,0 +1,94 @@
+/**
+ * @file recorder.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Record the BLE traffic of the gateway in the capture format.
+ */
+#include "recorder.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include "capture.h"
+
+static const size_t kCaptureBufferSize = 4096;
+static const size_t kCaptureLineSize = 32;
+
+static uint8_t capture_buffer[kCaptureBufferSize];
+static CaptureWriter capture_writer(capture_buffer, kCaptureBufferSize);
+static bool is_capture_enabled = false;
+static uint32_t capture_dropped_num = 0;
+// The BLE callbacks run in the Bluetooth task.
+static portMUX_TYPE capture_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void SetCaptureEnabled(bool is_enabled) {
+    portENTER_CRITICAL(&capture_mux);
+    is_capture_enabled = is_enabled;
+    capture_writer.Clear();
+    capture_dropped_num = 0;
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+void CaptureAdvertisement(const uint8_t* pAddress, int rssi,
+                          const uint8_t* pPayload, size_t length) {
+    if (!is_capture_enabled) {
+        return;
+    }
+    uint32_t now = millis();
+    portENTER_CRITICAL(&capture_mux);
+    if (!capture_writer.WriteAdvertisement(now, pAddress, rssi, pPayload,
+                                           length)) {
+        ++capture_dropped_num;
+    }
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+void CaptureNotification(const uint8_t* pAddress, uint16_t uuid,
+                         const uint8_t* pData, size_t length) {
+    if (!is_capture_enabled) {
+        return;
+    }
+    uint32_t now = millis();
+    portENTER_CRITICAL(&capture_mux);
+    if (!capture_writer.WriteNotification(now, pAddress, uuid, pData,
+                                          length)) {
+        ++capture_dropped_num;
+    }
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+void CaptureConnection(const uint8_t* pAddress, bool is_connected) {
+    if (!is_capture_enabled) {
+        return;
+    }
+    uint32_t now = millis();
+    portENTER_CRITICAL(&capture_mux);
+    if (!capture_writer.WriteConnection(now, pAddress, is_connected)) {
+        ++capture_dropped_num;
+    }
+    portEXIT_CRITICAL(&capture_mux);
+}
+
+void CaptureDump(Print& output) {
+    if (!is_capture_enabled) {
+        return;
+    }
+    // Copy out so that printing does not block the Bluetooth task.
+    static uint8_t dump_buffer[kCaptureBufferSize];
+    portENTER_CRITICAL(&capture_mux);
+    size_t length = capture_writer.GetLength();
+    memcpy(dump_buffer, capture_writer.GetData(), length);
+    capture_writer.Clear();
+    uint32_t dropped_num = capture_dropped_num;
+    capture_dropped_num = 0;
+    portEXIT_CRITICAL(&capture_mux);
+    for (size_t offset = 0; offset < length; offset += kCaptureLineSize) {
+        output.print("CAP ");
+        for (size_t i = offset; (i < length) && (i < offset + kCaptureLineSize);
+             ++i) {
+            output.printf("%02x", dump_buffer[i]);
+        }
+        output.println();
+    }
+    if (dropped_num > 0) {
+        output.printf("CAP dropped %d\n", dropped_num);
+    }
+}
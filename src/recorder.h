@@ -0,0 +1,32 @@
+/**
+ * @file recorder.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Record the BLE traffic of the gateway in the capture format.
+ */
+#ifndef BLUETOOTHGATEWAY_RECORDER_H_
+#define BLUETOOTHGATEWAY_RECORDER_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Start or stop recording.
+ * @param [in] is_enabled
+ */
+void SetCaptureEnabled(bool is_enabled);
+
+void CaptureAdvertisement(const uint8_t* pAddress, int rssi,
+                          const uint8_t* pPayload, size_t length);
+void CaptureNotification(const uint8_t* pAddress, uint16_t uuid,
+                         const uint8_t* pData, size_t length);
+void CaptureConnection(const uint8_t* pAddress, bool is_connected);
+
+/**
+ * @brief Print the recorded capture and clear it.
+ * @details Each line is `CAP <hex>` of at most 32 bytes, so the capture can
+ * be extracted from the serial log. The records dropped since the last dump
+ * are printed as `CAP dropped <num>`.
+ * @param [in] output
+ */
+void CaptureDump(Print& output);
+
+#endif
@@ -0,0 +1,476 @@
+/**
+ * @file rules.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Evaluate alert rules on each sample and stage the alerts.
+ */
+#include "rules.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+static const size_t kMaxRuleNum = 256;
+static const size_t kAlertQueueSize = 8;
+static const size_t kMaxTopicLength = 80;
+static const size_t kMaxRuleLength = 48;
+
+/**
+ * @brief A enum for the rule operators.
+ */
+enum class RuleOperator : uint8_t {
+    Above,
+    Below,
+    RateAbove,  // change per minute
+};
+
+/**
+ * @brief A rule as configured, which is also the NVS format.
+ */
+struct RuleSpec {
+    uint16_t id;
+    uint16_t uuid;
+    uint8_t address[6];
+    RuleOperator op;
+    uint8_t reserved;
+    float threshold;
+    float hysteresis;
+};
+
+/**
+ * @brief A rule of the evaluated table with its state.
+ * @details The table is sorted by key, so the rules of a characteristic
+ * are adjacent.
+ */
+struct CompiledRule {
+    uint64_t key;
+    float raise;  // Raised past the threshold.
+    float clear;  // Cleared past the threshold and the hysteresis.
+    float last_value;
+    uint32_t last_uptime;
+    uint16_t id;
+    RuleOperator op;
+    bool is_active;
+    bool has_last;
+};
+
+struct Alert {
+    uint16_t id;
+    uint16_t uuid;
+    uint8_t address[6];
+    bool is_active;
+    float value;
+    uint32_t time;
+};
+
+static RuleSpec rule_specs[kMaxRuleNum];
+static size_t rule_num = 0;
+// Compiled in the table not in use and swapped, so the evaluation never
+// waits for the compilation.
+static CompiledRule rule_tables[2][kMaxRuleNum];
+static size_t table_rule_num = 0;
+static size_t active_table = 0;
+static Alert alerts[kAlertQueueSize];
+static size_t alert_head = 0;
+static size_t alert_num = 0;
+static RuleStatistics statistics = {0, 0, 0, 0};
+static Preferences rules_prefs;
+static char rules_topic[kMaxTopicLength];
+static char state_topic[kMaxTopicLength];
+static char alert_topic[kMaxTopicLength];
+static bool is_state_pending = false;
+static size_t rejected_position = 0;  // 1-based, 0 if none.
+// The rules are evaluated in the Bluetooth task.
+static portMUX_TYPE rules_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint64_t GetRuleKey(const uint8_t* pAddress, uint16_t uuid) {
+    uint64_t key = uuid;
+    for (size_t i = 0; i < 6; ++i) {
+        key = (key << 8) | pAddress[i];
+    }
+    return key;
+}
+
+static bool IsKeyLess(const CompiledRule& rule, uint64_t key) {
+    return rule.key < key;
+}
+
+static void CompileRules() {
+    size_t next_table = 1 - active_table;
+    CompiledRule* pTable = rule_tables[next_table];
+    for (size_t i = 0; i < rule_num; ++i) {
+        const RuleSpec& spec = rule_specs[i];
+        CompiledRule& rule = pTable[i];
+        rule.key = GetRuleKey(spec.address, spec.uuid);
+        rule.raise = spec.threshold;
+        rule.clear = (spec.op == RuleOperator::Below)
+                         ? spec.threshold + spec.hysteresis
+                         : spec.threshold - spec.hysteresis;
+        rule.last_value = 0;
+        rule.last_uptime = 0;
+        rule.id = spec.id;
+        rule.op = spec.op;
+        rule.is_active = false;
+        rule.has_last = false;
+    }
+    std::sort(pTable, pTable + rule_num,
+              [](const CompiledRule& a, const CompiledRule& b) {
+                  return a.key < b.key;
+              });
+    portENTER_CRITICAL(&rules_mux);
+    // A rule keeps its state while it watches the same characteristic the
+    // same way, so an active alert is not raised again by any change.
+    const CompiledRule* pActive = rule_tables[active_table];
+    const CompiledRule* pActiveEnd = pActive + table_rule_num;
+    for (size_t i = 0; i < rule_num; ++i) {
+        CompiledRule& rule = pTable[i];
+        const CompiledRule* pOld =
+            std::lower_bound(pActive, pActiveEnd, rule.key, IsKeyLess);
+        for (; (pOld != pActiveEnd) && (pOld->key == rule.key); ++pOld) {
+            if ((pOld->id == rule.id) && (pOld->op == rule.op)) {
+                rule.last_value = pOld->last_value;
+                rule.last_uptime = pOld->last_uptime;
+                rule.is_active = pOld->is_active;
+                rule.has_last = pOld->has_last;
+                break;
+            }
+        }
+    }
+    active_table = next_table;
+    table_rule_num = rule_num;
+    portEXIT_CRITICAL(&rules_mux);
+    log_i("%d rules compiled.", rule_num);
+}
+
+static void SaveRules() {
+    if (rule_num == 0) {
+        rules_prefs.remove("table");
+        return;
+    }
+    rules_prefs.putBytes("table", rule_specs, rule_num * sizeof(RuleSpec));
+}
+
+void RulesSetup(const char* pGatewayID) {
+    snprintf(rules_topic, sizeof(rules_topic), "bluetooth-gateway/rules/%s",
+             pGatewayID);
+    snprintf(state_topic, sizeof(state_topic),
+             "bluetooth-gateway/rules/%s/state", pGatewayID);
+    snprintf(alert_topic, sizeof(alert_topic), "bluetooth-gateway/alert/%s",
+             pGatewayID);
+    rules_prefs.begin("rules");
+    size_t length = rules_prefs.getBytesLength("table");
+    rule_num = 0;
+    if ((length % sizeof(RuleSpec) == 0) && (length <= sizeof(rule_specs))) {
+        rule_num = rules_prefs.getBytes("table", rule_specs, length) /
+                   sizeof(RuleSpec);
+    }
+    CompileRules();
+}
+
+/**
+ * @brief Stage an alert, overwriting the oldest if the queue is full.
+ * @details Call it in the critical section.
+ */
+static void StageAlert(const CompiledRule& rule, float value, uint32_t time) {
+    if (alert_num == kAlertQueueSize) {
+        alert_head = (alert_head + 1) % kAlertQueueSize;
+        --alert_num;
+        ++statistics.dropped_num;
+    }
+    Alert& alert = alerts[(alert_head + alert_num) % kAlertQueueSize];
+    alert.id = rule.id;
+    alert.uuid = rule.key >> 48;
+    for (size_t i = 0; i < 6; ++i) {
+        alert.address[i] = (rule.key >> (8 * (5 - i))) & 0xFF;
+    }
+    alert.is_active = rule.is_active;
+    alert.value = value;
+    alert.time = time;
+    ++alert_num;
+    ++statistics.alert_num;
+}
+
+void EvaluateRules(const uint8_t* pAddress, uint16_t uuid, float value,
+                   uint32_t uptime, uint32_t time) {
+    if (std::isnan(value)) {
+        return;
+    }
+    uint32_t start = micros();
+    uint64_t key = GetRuleKey(pAddress, uuid);
+    portENTER_CRITICAL(&rules_mux);
+    CompiledRule* pEnd = rule_tables[active_table] + table_rule_num;
+    CompiledRule* pRule = std::lower_bound(rule_tables[active_table], pEnd,
+                                           key, IsKeyLess);
+    for (; (pRule != pEnd) && (pRule->key == key); ++pRule) {
+        float measure = value;
+        if (pRule->op == RuleOperator::RateAbove) {
+            uint32_t elapsed = uptime - pRule->last_uptime;
+            bool has_rate = pRule->has_last && (elapsed > 0);
+            measure = has_rate
+                          ? std::fabs(value - pRule->last_value) * 60000.0F /
+                                elapsed
+                          : 0;
+            pRule->last_value = value;
+            pRule->last_uptime = uptime;
+            pRule->has_last = true;
+            if (!has_rate) {
+                continue;
+            }
+        }
+        bool is_below = pRule->op == RuleOperator::Below;
+        if (!pRule->is_active &&
+            (is_below ? measure < pRule->raise : measure > pRule->raise)) {
+            pRule->is_active = true;
+            StageAlert(*pRule, value, time);
+        } else if (pRule->is_active && (is_below ? measure > pRule->clear
+                                                 : measure < pRule->clear)) {
+            pRule->is_active = false;
+            StageAlert(*pRule, value, time);
+        }
+    }
+    ++statistics.evaluated_num;
+    statistics.evaluation_us += static_cast<uint32_t>(micros() - start);
+    portEXIT_CRITICAL(&rules_mux);
+}
+
+static int ParseHexDigit(char digit) {
+    if ((digit >= '0') && (digit <= '9')) {
+        return digit - '0';
+    }
+    if ((digit >= 'a') && (digit <= 'f')) {
+        return digit - 'a' + 10;
+    }
+    if ((digit >= 'A') && (digit <= 'F')) {
+        return digit - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool IsRuleEnd(char character) {
+    return (character == '\0') || (character == ';') || (character == '\n') ||
+           (character == '\r');
+}
+
+/**
+ * @brief Parse the id of a rule.
+ * @return const char* After the id, nullptr if invalid.
+ */
+static const char* ParseRuleID(const char* pText, uint16_t& id) {
+    char* pEnd = nullptr;
+    unsigned long value = strtoul(pText, &pEnd, 10);
+    if ((pEnd == pText) || (value == 0) || (value > 0xFFFF)) {
+        return nullptr;
+    }
+    id = value;
+    return pEnd;
+}
+
+/**
+ * @brief Parse a rule after its id.
+ * @return const char* After the rule, nullptr if invalid.
+ */
+static const char* ParseRuleBody(const char* pText, RuleSpec& spec) {
+    if (*pText++ != ':') {
+        return nullptr;
+    }
+    for (size_t i = 0; i < 6; ++i) {
+        int high = ParseHexDigit(*pText++);
+        int low = (high < 0) ? -1 : ParseHexDigit(*pText++);
+        if (low < 0) {
+            return nullptr;
+        }
+        spec.address[i] = (high << 4) | low;
+    }
+    if (*pText++ != ':') {
+        return nullptr;
+    }
+    char* pEnd = nullptr;
+    unsigned long uuid = strtoul(pText, &pEnd, 16);
+    if ((pEnd == pText) || (uuid > 0xFFFF) || (*pEnd != ':')) {
+        return nullptr;
+    }
+    spec.uuid = uuid;
+    pText = pEnd + 1;
+    switch (*pText++) {
+        case '>':
+            spec.op = RuleOperator::Above;
+            break;
+        case '<':
+            spec.op = RuleOperator::Below;
+            break;
+        case '~':
+            spec.op = RuleOperator::RateAbove;
+            break;
+        default:
+            return nullptr;
+    }
+    if (*pText++ != ':') {
+        return nullptr;
+    }
+    spec.threshold = strtof(pText, &pEnd);
+    if ((pEnd == pText) || !std::isfinite(spec.threshold)) {
+        return nullptr;
+    }
+    pText = pEnd;
+    spec.hysteresis = 0;
+    if (*pText == ':') {
+        ++pText;
+        spec.hysteresis = strtof(pText, &pEnd);
+        if ((pEnd == pText) || !(spec.hysteresis >= 0) ||
+            !std::isfinite(spec.hysteresis)) {
+            return nullptr;
+        }
+        pText = pEnd;
+    }
+    spec.reserved = 0;
+    return IsRuleEnd(*pText) ? pText : nullptr;
+}
+
+bool SetRule(const char* pText) {
+    RuleSpec spec;
+    pText = ParseRuleID(pText, spec.id);
+    if (pText == nullptr) {
+        return false;
+    }
+    size_t index = 0;
+    while ((index < rule_num) && (rule_specs[index].id != spec.id)) {
+        ++index;
+    }
+    if (IsRuleEnd(*pText)) {
+        if (index == rule_num) {
+            return false;
+        }
+        std::copy(rule_specs + index + 1, rule_specs + rule_num,
+                  rule_specs + index);
+        --rule_num;
+    } else {
+        if ((ParseRuleBody(pText, spec) == nullptr) ||
+            (index == kMaxRuleNum)) {
+            return false;
+        }
+        rule_specs[index] = spec;
+        rule_num = std::max(rule_num, index + 1);
+    }
+    SaveRules();
+    CompileRules();
+    return true;
+}
+
+const char* GetRulesTopicFilter() { return rules_topic; }
+
+void HandleRulesMessage(const char* pTopic, const uint8_t* pPayload,
+                        size_t length) {
+    if ((strcmp(pTopic, rules_topic) != 0) || (length == 0)) {
+        return;  // An empty message clears the retained rules.
+    }
+    // Parsed aside so that a rejected message keeps the rules.
+    static RuleSpec parsed_specs[kMaxRuleNum];
+    size_t parsed_num = 0;
+    size_t offset = 0;
+    is_state_pending = true;
+    while (offset < length) {
+        char text[kMaxRuleLength];
+        size_t text_length = 0;
+        while ((offset < length) && !IsRuleEnd(pPayload[offset])) {
+            if (text_length + 1 < sizeof(text)) {
+                text[text_length] = pPayload[offset];
+            }
+            ++text_length;
+            ++offset;
+        }
+        ++offset;  // Skip the separator.
+        if (text_length == 0) {
+            continue;
+        }
+        rejected_position = parsed_num + 1;
+        if ((text_length >= sizeof(text)) || (parsed_num == kMaxRuleNum)) {
+            log_w("Reject rule %d.", rejected_position);
+            return;
+        }
+        text[text_length] = '\0';
+        RuleSpec& spec = parsed_specs[parsed_num];
+        const char* pText = ParseRuleID(text, spec.id);
+        if ((pText == nullptr) || (ParseRuleBody(pText, spec) == nullptr)) {
+            log_w("Reject rule %d.", rejected_position);
+            return;
+        }
+        ++parsed_num;
+    }
+    rejected_position = 0;
+    // Written only on change since the retained rules are resent.
+    if ((parsed_num == rule_num) &&
+        (memcmp(parsed_specs, rule_specs, rule_num * sizeof(RuleSpec)) ==
+         0)) {
+        return;
+    }
+    std::copy(parsed_specs, parsed_specs + parsed_num, rule_specs);
+    rule_num = parsed_num;
+    SaveRules();
+    CompileRules();
+}
+
+bool GetRulesState(char* pTopic, size_t topic_size, char* pPayload,
+                   size_t payload_size) {
+    if (!is_state_pending) {
+        return false;
+    }
+    if (rejected_position == 0) {
+        snprintf(pPayload, payload_size, "{\"rules\":%u,\"error\":null}",
+                 static_cast<unsigned>(rule_num));
+    } else {
+        snprintf(pPayload, payload_size, "{\"rules\":%u,\"error\":%u}",
+                 static_cast<unsigned>(rule_num),
+                 static_cast<unsigned>(rejected_position));
+    }
+    snprintf(pTopic, topic_size, "%s", state_topic);
+    is_state_pending = false;
+    return true;
+}
+
+bool GetAlert(char* pTopic, size_t topic_size, char* pPayload,
+              size_t payload_size) {
+    Alert alert;
+    portENTER_CRITICAL(&rules_mux);
+    bool is_pending = alert_num > 0;
+    if (is_pending) {
+        alert = alerts[alert_head];
+        alert_head = (alert_head + 1) % kAlertQueueSize;
+        --alert_num;
+    }
+    portEXIT_CRITICAL(&rules_mux);
+    if (!is_pending) {
+        return false;
+    }
+    char time[12] = "null";
+    if (alert.time != 0) {
+        snprintf(time, sizeof(time), "%lu",
+                 static_cast<unsigned long>(alert.time));
+    }
+    snprintf(pPayload, payload_size,
+             "{\"rule\":%u,\"sensor\":\"%02X%02X%02X%02X%02X%02X\","
+             "\"uuid\":%u,\"value\":%.2f,\"state\":\"%s\",\"time\":%s}",
+             alert.id, alert.address[0], alert.address[1], alert.address[2],
+             alert.address[3], alert.address[4], alert.address[5],
+             alert.uuid, alert.value, alert.is_active ? "raised" : "cleared",
+             time);
+    snprintf(pTopic, topic_size, "%s", alert_topic);
+    return true;
+}
+
+size_t GetPendingAlertNum() {
+    portENTER_CRITICAL(&rules_mux);
+    size_t num = alert_num;
+    portEXIT_CRITICAL(&rules_mux);
+    return num;
+}
+
+RuleStatistics GetRuleStatistics() {
+    portENTER_CRITICAL(&rules_mux);
+    RuleStatistics result = statistics;
+    portEXIT_CRITICAL(&rules_mux);
+    return result;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file rules.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Evaluate alert rules on each sample and stage the alerts.
+ */
+#ifndef BLUETOOTHGATEWAY_RULES_H_
+#define BLUETOOTHGATEWAY_RULES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Counters of the rule engine.
+ * @details dropped_num counts the alerts overwritten before they were
+ * published.
+ */
+struct RuleStatistics {
+    uint32_t evaluated_num;
+    uint32_t alert_num;
+    uint32_t dropped_num;
+    uint32_t evaluation_us;
+};
+
+/**
+ * @brief Load the rules stored in NVS.
+ * @param [in] pGatewayID The MQTT client ID which names the topics.
+ */
+void RulesSetup(const char* pGatewayID);
+
+/**
+ * @brief Evaluate the rules of a characteristic on a sample.
+ * @details The rules are kept sorted by sensor and UUID, so the cost is a
+ * binary search plus the matching rules. It is safe in the BLE callbacks.
+ * @param [in] pAddress The 6 bytes address.
+ * @param [in] uuid The characteristic UUID.
+ * @param [in] value
+ * @param [in] uptime Milliseconds since boot.
+ * @param [in] time Seconds since the Unix epoch, 0 if unknown.
+ */
+void EvaluateRules(const uint8_t* pAddress, uint16_t uuid, float value,
+                   uint32_t uptime, uint32_t time);
+
+/**
+ * @brief Add, replace or remove a rule and store the rules.
+ * @details A rule is `<id>:<MAC without colon>:<UUID in hex>:<op>:<threshold>`
+ * optionally followed by `:<hysteresis>`. op is `>` to alert above the
+ * threshold, `<` below the threshold or `~` when the change per minute is
+ * above the threshold. The alert is cleared once the measure is back past
+ * the threshold by the hysteresis. A text of only the id removes the rule.
+ * @param [in] pText
+ * @return true If the rule is valid.
+ * @return false
+ */
+bool SetRule(const char* pText);
+
+/**
+ * @brief The topic of the rules, usually retained.
+ * @details The payload is the rules separated by `;` or new lines. It
+ * replaces all the rules only if every rule is valid.
+ */
+const char* GetRulesTopicFilter();
+
+void HandleRulesMessage(const char* pTopic, const uint8_t* pPayload,
+                        size_t length);
+
+/**
+ * @brief Get the result to publish after the rules are handled.
+ * @details The payload is `{"rules":n,"error":null}`, where the error is the
+ * position of the first rejected rule if any.
+ * @return true Once after each handled message.
+ * @return false
+ */
+bool GetRulesState(char* pTopic, size_t topic_size, char* pPayload,
+                   size_t payload_size);
+
+/**
+ * @brief Get the next alert to publish.
+ * @details The payload is
+ * `{"rule":id,"sensor":"...","uuid":n,"value":v,"state":"raised"|"cleared",
+ * "time":t}` where the time is null if the clock is not synchronized.
+ * @return true If an alert is pending.
+ * @return false
+ */
+bool GetAlert(char* pTopic, size_t topic_size, char* pPayload,
+              size_t payload_size);
+
+size_t GetPendingAlertNum();
+
+RuleStatistics GetRuleStatistics();
+
+#endif
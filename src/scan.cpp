@@ -0,0 +1,83 @@
+/**
+ * @file scan.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Scan the registered devices, optionally filtered by the controller.
+ */
+#include "scan.h"
+
+#include <Arduino.h>
+
+#include "recorder.h"
+#include "trace.h"
+
+// Scan interval and window in milliseconds.
+static uint16_t scan_interval = 100;
+static uint16_t scan_window = 100;
+
+static ScanStatistics scan_statistics = {0, 0, 0, 0};
+static bool is_accept_list_active = false;
+
+/**
+ * @brief Capture and count the reports forwarded to callbacks.
+ */
+class CountedScanCallbacks : public ScanReportCallbacks {
+   public:
+    CountedScanCallbacks(ScanReportCallbacks* pCallbacks)
+        : pCallbacks(pCallbacks) {}
+    bool onReport(const uint8_t* pAddress, int rssi, const uint8_t* pPayload,
+                  size_t length) override {
+        uint32_t start = micros();
+        CaptureAdvertisement(pAddress, rssi, pPayload, length);
+        bool is_stop = pCallbacks->onReport(pAddress, rssi, pPayload, length);
+        ++scan_statistics.callback_num;
+        scan_statistics.callback_us +=
+            static_cast<uint32_t>(micros() - start);
+        return is_stop;
+    }
+
+   private:
+    ScanReportCallbacks* pCallbacks;
+};
+
+bool SetScanAcceptList(BLETransport& transport, const DeviceAddress* pAddresses,
+                       size_t num) {
+    transport.ClearAcceptList();
+    is_accept_list_active = false;
+    if (num == 0) {
+        log_i("Scan accept list disabled.");
+        return false;
+    }
+    for (size_t i = 0; i < num; ++i) {
+        if (!transport.AddAcceptList(pAddresses[i].GetNative())) {
+            log_w("%d devices exceed accept list size, use software filter.",
+                  num);
+            transport.ClearAcceptList();
+            return false;
+        }
+    }
+    is_accept_list_active = true;
+    log_i("Scan accept list programmed with %d devices.", num);
+    return true;
+}
+
+bool IsScanAcceptListActive() { return is_accept_list_active; }
+
+void SetScanParameters(const uint16_t& interval, const uint16_t& window) {
+    scan_interval = interval;
+    scan_window = (window > interval) ? interval : window;
+    log_i("Scan interval %d ms, window %d ms.", scan_interval, scan_window);
+}
+
+void ScanDevices(BLETransport& transport, uint32_t duration,
+                 ScanReportCallbacks* pCallbacks) {
+    ScopedTrace trace(TraceStage::Scan, 0);
+    ++scan_statistics.scan_num;
+    if (is_accept_list_active) {
+        ++scan_statistics.filtered_scan_num;
+    }
+    CountedScanCallbacks counted_callbacks(pCallbacks);
+    transport.Scan(duration, scan_interval, scan_window, is_accept_list_active,
+                   &counted_callbacks);
+}
+
+ScanStatistics GetScanStatistics() { return scan_statistics; }
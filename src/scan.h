@@ -0,0 +1,62 @@
+/**
+ * @file scan.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Scan the registered devices, optionally filtered by the controller.
+ */
+#ifndef BLUETOOTHGATEWAY_SCAN_H_
+#define BLUETOOTHGATEWAY_SCAN_H_
+
+#include "address.h"
+#include "transport.h"
+
+/**
+ * @brief Counters of the scan callbacks.
+ */
+struct ScanStatistics {
+    uint32_t scan_num;
+    uint32_t filtered_scan_num;
+    uint32_t callback_num;
+    uint32_t callback_us;
+};
+
+/**
+ * @brief Program the filter accept list of the controller.
+ * @details The advertisements of other devices are dropped by the
+ * controller. If the addresses exceed the capacity of the accept list,
+ * the list is cleared and the scan falls back to software filter.
+ * @param [in] transport
+ * @param [in] pAddresses
+ * @param [in] num The number of addresses. 0 to disable the accept list.
+ * @return true If the accept list is active.
+ * @return false
+ */
+bool SetScanAcceptList(BLETransport& transport, const DeviceAddress* pAddresses,
+                       size_t num);
+
+/**
+ * @brief Whether the scan is filtered by the accept list.
+ */
+bool IsScanAcceptListActive();
+
+/**
+ * @brief Set the scan interval and window.
+ * @param [in] interval Scan interval in milliseconds.
+ * @param [in] window Scan window in milliseconds, at most the interval.
+ */
+void SetScanParameters(const uint16_t& interval, const uint16_t& window);
+
+/**
+ * @brief Scan and report the advertisements to callbacks.
+ * @param [in] transport
+ * @param [in] duration Scan duration in seconds.
+ * @param [in] pCallbacks
+ */
+void ScanDevices(BLETransport& transport, uint32_t duration,
+                 ScanReportCallbacks* pCallbacks);
+
+/**
+ * @brief Get the counters of the scan callbacks since boot.
+ */
+ScanStatistics GetScanStatistics();
+
+#endif
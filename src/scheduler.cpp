@@ -0,0 +1,90 @@
+/**
+ * @file scheduler.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Share the radio between BLE and WiFi by time windows.
+ */
+#include "scheduler.h"
+
+#include <Arduino.h>
+#include <esp_coexist.h>
+
+static RadioStatistics radio_statistics = {0, 0, 0, 0, 0, 0, 0};
+
+RadioScheduler::RadioScheduler(const uint32_t& period,
+                               const uint8_t& ble_duty)
+    : period_start(0), window(RadioWindow::Network), is_started(false) {
+    SetDutyCycle(period, ble_duty);
+}
+
+void RadioScheduler::SetDutyCycle(const uint32_t& period,
+                                  const uint8_t& ble_duty) {
+    this->period = (period == 0) ? 1 : period;
+    uint8_t duty = (ble_duty > 100) ? 100 : ble_duty;
+    ble_window = this->period * duty / 100;
+}
+
+RadioWindow RadioScheduler::GetWindow() {
+    uint32_t now = millis();
+    if (!is_started) {
+        // Boot in the network window of the first period.
+        period_start = now - ble_window;
+        is_started = true;
+        window = RadioWindow::Network;
+        EnterWindow();
+    }
+    uint32_t elapsed = static_cast<uint32_t>(now - period_start);
+    if (elapsed >= period) {
+        // Skip the periods missed by a long task.
+        period_start = now - elapsed % period;
+        elapsed = elapsed % period;
+    }
+    RadioWindow new_window =
+        (elapsed < ble_window) ? RadioWindow::BLE : RadioWindow::Network;
+    if (new_window != window) {
+        window = new_window;
+        EnterWindow();
+    }
+    return window;
+}
+
+uint32_t RadioScheduler::GetRemainingTime() {
+    RadioWindow current = GetWindow();
+    uint32_t elapsed = static_cast<uint32_t>(millis() - period_start);
+    uint32_t end = (current == RadioWindow::BLE) ? ble_window : period;
+    return (elapsed < end) ? end - elapsed : 0;
+}
+
+void RadioScheduler::RecordOverrun() { ++radio_statistics.overrun_num; }
+
+void RadioScheduler::EnterWindow() {
+    if (window == RadioWindow::BLE) {
+        ++radio_statistics.ble_window_num;
+        esp_coex_preference_set(ESP_COEX_PREFER_BT);
+        log_i("Enter BLE window.");
+    } else {
+        ++radio_statistics.network_window_num;
+        esp_coex_preference_set(ESP_COEX_PREFER_WIFI);
+        log_i("Enter network window.");
+    }
+}
+
+void RecordRadioFailure(const RadioFailure& failure) {
+    switch (failure) {
+        case RadioFailure::BLEConnect:
+            ++radio_statistics.ble_connect_failures;
+            break;
+        case RadioFailure::WiFiReconnect:
+            ++radio_statistics.wifi_reconnect_failures;
+            break;
+        case RadioFailure::MQTTConnect:
+            ++radio_statistics.mqtt_connect_failures;
+            break;
+        case RadioFailure::MQTTPublish:
+            ++radio_statistics.mqtt_publish_failures;
+            break;
+        default:
+            break;
+    }
+}
+
+RadioStatistics GetRadioStatistics() { return radio_statistics; }
@@ -0,0 +1,91 @@
+/**
+ * @file scheduler.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Share the radio between BLE and WiFi by time windows.
+ */
+#ifndef BLUETOOTHGATEWAY_SCHEDULER_H_
+#define BLUETOOTHGATEWAY_SCHEDULER_H_
+
+#include <stdint.h>
+
+/**
+ * @brief A enum for the time window of the radio.
+ * @details BLE scanning and connecting only start in BLE window.
+ * MQTT traffic is batched in Network window.
+ */
+enum class RadioWindow : uint8_t {
+    BLE,
+    Network,
+};
+
+/**
+ * @brief A enum for the failures probably caused by radio contention.
+ */
+enum class RadioFailure : uint8_t {
+    BLEConnect,
+    WiFiReconnect,
+    MQTTConnect,
+    MQTTPublish,
+};
+
+/**
+ * @brief Counters of the radio scheduler.
+ */
+struct RadioStatistics {
+    uint32_t ble_window_num;
+    uint32_t network_window_num;
+    uint32_t ble_connect_failures;
+    uint32_t wifi_reconnect_failures;
+    uint32_t mqtt_connect_failures;
+    uint32_t mqtt_publish_failures;
+    uint32_t overrun_num;
+};
+
+/**
+ * @brief Split each period to a BLE window and a network window.
+ * @details The coexistence preference of the radio follows the window. The
+ * first period starts at its network window, so the gateway connects and
+ * publishes right after boot instead of after a whole BLE window.
+ */
+class RadioScheduler {
+   public:
+    /**
+     * @param [in] period The period in milliseconds.
+     * @param [in] ble_duty The percentage of BLE window in a period.
+     */
+    RadioScheduler(const uint32_t& period, const uint8_t& ble_duty);
+    void SetDutyCycle(const uint32_t& period, const uint8_t& ble_duty);
+    /**
+     * @brief Get the current window and switch the radio preference.
+     */
+    RadioWindow GetWindow();
+    /**
+     * @brief Get the remaining time of the current window in milliseconds.
+     */
+    uint32_t GetRemainingTime();
+    /**
+     * @brief Record that a task was not finished in its window.
+     */
+    void RecordOverrun();
+
+   private:
+    uint32_t period;
+    uint32_t ble_window;
+    uint32_t period_start;
+    RadioWindow window;
+    bool is_started;
+    void EnterWindow();
+};
+
+/**
+ * @brief Count a failure probably caused by radio contention.
+ * @param [in] failure
+ */
+void RecordRadioFailure(const RadioFailure& failure);
+
+/**
+ * @brief Get the counters of the radio scheduler since boot.
+ */
+RadioStatistics GetRadioStatistics();
+
+#endif
@@ -1,6 +1,6 @@
 #include "serial_command.h"
 
-SerialBTReceiver::SerialBTReceiver(BluetoothSerial* pSerial, uint8_t* pBuffer,
+SerialBTReceiver::SerialBTReceiver(Stream* pSerial, uint8_t* pBuffer,
                                    const int& buffer_size)
     : pSerialBT(pSerial),
       pCommandBuffer(pBuffer),
@@ -51,7 +51,7 @@ void SerialBTReceiver::ClearBuffer(void) {
     }
 }
 
-bool SerialReceive(BluetoothSerial& serial_bt, uint8_t* pCommandBuffer,
+bool SerialReceive(Stream& serial_bt, uint8_t* pCommandBuffer,
                    const int& buffer_size) {
     SerialClearBuffer(serial_bt, pCommandBuffer, buffer_size);
     bool is_read_command = false;
@@ -84,7 +84,7 @@ bool SerialReceive(BluetoothSerial& serial_bt, uint8_t* pCommandBuffer,
     return success;
 }
 
-void SerialClearBuffer(BluetoothSerial& serial_bt, uint8_t* pCommandBuffer,
+void SerialClearBuffer(Stream& serial_bt, uint8_t* pCommandBuffer,
                        const int& buffer_size) {
     for (int i = 0; i < buffer_size; ++i) {
         pCommandBuffer[i] = 0;
@@ -6,7 +6,7 @@
 #ifndef BLUETOOTHGATEWAY_SERIAL_COMMAND_H_
 #define BLUETOOTHGATEWAY_SERIAL_COMMAND_H_
 
-#include <BluetoothSerial.h>
+#include <Stream.h>
 
 /**
  * @brief Receive command from bluetooth serial.
@@ -15,12 +15,12 @@ class [[deprecated(
     "Use function SerialReceive and SerialClearBuffer "
     "instead")]] SerialBTReceiver {
    private:
-    BluetoothSerial* pSerialBT;
+    Stream* pSerialBT;
     uint8_t* pCommandBuffer;
     int command_buffer_size;
 
    public:
-    SerialBTReceiver(BluetoothSerial * pSerial, uint8_t * pBuffer,
+    SerialBTReceiver(Stream * pSerial, uint8_t * pBuffer,
                      const int& buffer_size);
     bool Receive(void);
     void ClearBuffer(void);
@@ -34,7 +34,7 @@ class [[deprecated(
  * @return true If a command is received.
  * @return false If no command received.
  */
-bool SerialReceive(BluetoothSerial& serial_bt, uint8_t* pCommandBuffer,
+bool SerialReceive(Stream& serial_bt, uint8_t* pCommandBuffer,
                    const int& buffer_size);
 
 /**
@@ -43,7 +43,7 @@ bool SerialReceive(BluetoothSerial& serial_bt, uint8_t* pCommandBuffer,
  * @param [in] pCommandBuffer
  * @param [in] buffer_size
  */
-void SerialClearBuffer(BluetoothSerial& serial_bt, uint8_t* pCommandBuffer,
+void SerialClearBuffer(Stream& serial_bt, uint8_t* pCommandBuffer,
                        const int& buffer_size);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,287 @@
+/**
+ * @file settings.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tunable settings kept in NVS and updated from MQTT.
+ */
+#include "settings.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+static const size_t kMaxTopicLength = 80;
+static const size_t kMaxKeyLength = 16;
+
+struct SettingInfo {
+    const char* key;
+    uint32_t default_value;
+    uint32_t min;
+    uint32_t max;
+};
+
+static const SettingInfo kSettingInfos[] = {
+    {"command_ms", 1000, 100, 60000},
+    {"cycle_ms", 1000, 0, 3600000},
+    {"device_num", 5, 1, kMaxDevNum},
+    {"scan_s", 1, 1, 10},
+    {"scan_period_ms", 100, 10, 10000},
+    {"scan_window_ms", 50, 10, 10000},
+    {"notify_ms", 10000, 1000, 60000},
+    {"radio_ms", 30000, 5000, 600000},
+    {"ble_duty", 80, 10, 90},
+    {"watchdog_s", 300, 90, 3600},  // Over the reset interval of 60 s.
+    {"mqtt_buffer", 1024, 1024, 4096},  // The largest queued payload.
+};
+static const size_t kSettingNum =
+    sizeof(kSettingInfos) / sizeof(kSettingInfos[0]);
+static_assert(kSettingNum == static_cast<size_t>(Setting::MQTTBufferSize) + 1,
+              "kSettingInfos mismatch Setting.");
+
+static std::atomic<uint32_t> setting_values[kSettingNum];
+static std::atomic<uint32_t> settings_version(0);
+static Preferences settings_prefs;
+static char config_topic[kMaxTopicLength];
+static char state_topic[kMaxTopicLength];
+static bool is_state_pending = false;
+static char rejected_key[kMaxKeyLength];
+
+static bool IsInBounds(size_t index, uint32_t value) {
+    return (value >= kSettingInfos[index].min) &&
+           (value <= kSettingInfos[index].max);
+}
+
+static uint32_t GetValue(const uint32_t* pValues, Setting setting) {
+    return pValues[static_cast<size_t>(setting)];
+}
+
+/**
+ * @brief Check the constraints between the settings.
+ * @param [in] pValues The value of each setting.
+ * @return const char* The key to reject, or nullptr if consistent.
+ */
+static const char* CheckConsistency(const uint32_t* pValues) {
+    // A scan must fit in the BLE window of the radio period.
+    if (static_cast<uint64_t>(GetValue(pValues, Setting::RadioPeriod)) *
+            GetValue(pValues, Setting::BLEDutyCycle) / 100 <
+        1000ULL * GetValue(pValues, Setting::ScanDuration)) {
+        return "scan_s";
+    }
+    return nullptr;
+}
+
+void SettingsSetup(const char* pGatewayID) {
+    snprintf(config_topic, sizeof(config_topic),
+             "bluetooth-gateway/config/%s", pGatewayID);
+    snprintf(state_topic, sizeof(state_topic),
+             "bluetooth-gateway/config/%s/state", pGatewayID);
+    settings_prefs.begin("settings");
+    uint32_t values[kSettingNum];
+    for (size_t i = 0; i < kSettingNum; ++i) {
+        values[i] = settings_prefs.getUInt(kSettingInfos[i].key,
+                                           kSettingInfos[i].default_value);
+        if (!IsInBounds(i, values[i])) {
+            values[i] = kSettingInfos[i].default_value;
+        }
+    }
+    // The stored settings may predate a constraint.
+    if (CheckConsistency(values) != nullptr) {
+        for (size_t i = 0; i < kSettingNum; ++i) {
+            values[i] = kSettingInfos[i].default_value;
+        }
+    }
+    for (size_t i = 0; i < kSettingNum; ++i) {
+        setting_values[i].store(values[i], std::memory_order_relaxed);
+    }
+}
+
+uint32_t GetSetting(const Setting& setting) {
+    return setting_values[static_cast<size_t>(setting)].load(
+        std::memory_order_relaxed);
+}
+
+static void StoreSetting(size_t index, uint32_t value) {
+    if (setting_values[index].exchange(value) != value) {
+        // Write NVS only on change since the retained config is resent.
+        settings_prefs.putUInt(kSettingInfos[index].key, value);
+        ++settings_version;
+        log_i("Setting %s = %d.", kSettingInfos[index].key, value);
+    }
+}
+
+bool SetSetting(const Setting& setting, uint32_t value) {
+    size_t index = static_cast<size_t>(setting);
+    if (!IsInBounds(index, value)) {
+        return false;
+    }
+    uint32_t values[kSettingNum];
+    for (size_t i = 0; i < kSettingNum; ++i) {
+        values[i] = GetSetting(static_cast<Setting>(i));
+    }
+    values[index] = value;
+    if (CheckConsistency(values) != nullptr) {
+        return false;
+    }
+    StoreSetting(index, value);
+    return true;
+}
+
+uint32_t GetSettingsVersion() { return settings_version.load(); }
+
+const char* GetConfigTopicFilter() { return config_topic; }
+
+static size_t FindSetting(const char* pKey) {
+    for (size_t i = 0; i < kSettingNum; ++i) {
+        if (strcmp(kSettingInfos[i].key, pKey) == 0) {
+            return i;
+        }
+    }
+    return kSettingNum;
+}
+
+static const char* SkipSpace(const char* pText) {
+    while ((*pText == ' ') || (*pText == '\t') || (*pText == '\r') ||
+           (*pText == '\n')) {
+        ++pText;
+    }
+    return pText;
+}
+
+/**
+ * @brief Parse a flat JSON object of unsigned integers.
+ * @param [in] pText
+ * @param [out] pValues The parsed value of each setting.
+ * @param [out] pIsParsed Whether each setting is in the object.
+ * @return true If every key is known and in bounds.
+ * @return false The rejected key, or "invalid" if the syntax is wrong, is
+ * copied to rejected_key.
+ */
+static bool ParseConfig(const char* pText, uint32_t* pValues,
+                        bool* pIsParsed) {
+    snprintf(rejected_key, sizeof(rejected_key), "invalid");
+    pText = SkipSpace(pText);
+    if (*pText++ != '{') {
+        return false;
+    }
+    pText = SkipSpace(pText);
+    if (*pText == '}') {
+        return true;
+    }
+    while (true) {
+        char key[kMaxKeyLength];
+        size_t key_length = 0;
+        if (*pText++ != '"') {
+            return false;
+        }
+        while ((*pText != '"') && (*pText != '\0')) {
+            if (key_length + 1 < sizeof(key)) {
+                key[key_length++] = *pText;
+            }
+            ++pText;
+        }
+        key[key_length] = '\0';
+        snprintf(rejected_key, sizeof(rejected_key), "%s", key);
+        if (*pText++ != '"') {
+            return false;
+        }
+        pText = SkipSpace(pText);
+        if (*pText++ != ':') {
+            return false;
+        }
+        pText = SkipSpace(pText);
+        if ((*pText < '0') || (*pText > '9')) {
+            return false;
+        }
+        char* pEnd = nullptr;
+        errno = 0;
+        unsigned long value = strtoul(pText, &pEnd, 10);
+        pText = pEnd;
+        // unsigned long is 64 bits on host, so check before narrowing.
+        if ((errno == ERANGE) || (value > UINT32_MAX)) {
+            return false;
+        }
+        size_t index = FindSetting(key);
+        if ((index == kSettingNum) || !IsInBounds(index, value)) {
+            return false;
+        }
+        pValues[index] = value;
+        pIsParsed[index] = true;
+        pText = SkipSpace(pText);
+        if (*pText == '}') {
+            return true;
+        }
+        if (*pText++ != ',') {
+            return false;
+        }
+        pText = SkipSpace(pText);
+    }
+}
+
+void HandleConfigMessage(const char* pTopic, const uint8_t* pPayload,
+                         size_t length) {
+    if ((strcmp(pTopic, config_topic) != 0) || (length == 0)) {
+        return;  // An empty message clears the retained config.
+    }
+    char payload[512];
+    if (length >= sizeof(payload)) {
+        snprintf(rejected_key, sizeof(rejected_key), "invalid");
+        is_state_pending = true;
+        return;
+    }
+    memcpy(payload, pPayload, length);
+    payload[length] = '\0';
+    uint32_t values[kSettingNum];
+    bool is_parsed[kSettingNum] = {false};
+    for (size_t i = 0; i < kSettingNum; ++i) {
+        values[i] = GetSetting(static_cast<Setting>(i));
+    }
+    bool is_valid = ParseConfig(payload, values, is_parsed);
+    const char* pInconsistentKey =
+        is_valid ? CheckConsistency(values) : nullptr;
+    if (pInconsistentKey != nullptr) {
+        snprintf(rejected_key, sizeof(rejected_key), "%s", pInconsistentKey);
+        is_valid = false;
+    }
+    if (is_valid) {
+        rejected_key[0] = '\0';
+        for (size_t i = 0; i < kSettingNum; ++i) {
+            if (is_parsed[i]) {
+                StoreSetting(i, values[i]);
+            }
+        }
+    } else {
+        log_w("Reject config at %s.", rejected_key);
+    }
+    is_state_pending = true;
+}
+
+bool GetConfigState(char* pTopic, size_t topic_size, char* pPayload,
+                    size_t payload_size) {
+    if (!is_state_pending) {
+        return false;
+    }
+    size_t length = 0;
+    for (size_t i = 0; (i < kSettingNum) && (length < payload_size); ++i) {
+        length += snprintf(pPayload + length, payload_size - length,
+                           "%s\"%s\":%lu", i == 0 ? "{" : ",",
+                           kSettingInfos[i].key,
+                           static_cast<unsigned long>(GetSetting(
+                               static_cast<Setting>(i))));
+    }
+    if (length >= payload_size) {
+        return false;
+    }
+    if (rejected_key[0] == '\0') {
+        snprintf(pPayload + length, payload_size - length,
+                 ",\"error\":null}");
+    } else {
+        snprintf(pPayload + length, payload_size - length,
+                 ",\"error\":\"%s\"}", rejected_key);
+    }
+    snprintf(pTopic, topic_size, "%s", state_topic);
+    is_state_pending = false;
+    return true;
+}
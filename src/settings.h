@@ -0,0 +1,86 @@
+/**
+ * @file settings.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tunable settings kept in NVS and updated from MQTT.
+ */
+#ifndef BLUETOOTHGATEWAY_SETTINGS_H_
+#define BLUETOOTHGATEWAY_SETTINGS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A enum for the tunable settings.
+ * @details Add the key, default value and bounds of a new setting to
+ * kSettingInfos. The key is also the NVS key, at most 15 characters.
+ */
+enum class Setting : uint8_t {
+    CommandInterval,  // command_ms
+    DeviceInterval,   // cycle_ms
+    DeviceNum,        // device_num
+    ScanDuration,     // scan_s
+    ScanInterval,     // scan_period_ms
+    ScanWindow,       // scan_window_ms
+    NotifyTimeout,    // notify_ms
+    RadioPeriod,      // radio_ms
+    BLEDutyCycle,     // ble_duty
+    WatchdogTimeout,  // watchdog_s
+    MQTTBufferSize,   // mqtt_buffer
+};
+
+/**
+ * @brief The capacity of the device pool, the bound of device_num.
+ */
+const int kMaxDevNum = 16;
+
+/**
+ * @brief Load the settings stored in NVS.
+ * @details Call it once at boot before reading the settings.
+ * @param [in] pGatewayID The MQTT client ID which names the topics.
+ */
+void SettingsSetup(const char* pGatewayID);
+
+/**
+ * @brief Get a setting. It is safe in any task.
+ */
+uint32_t GetSetting(const Setting& setting);
+
+/**
+ * @brief Set and store a setting.
+ * @param [in] setting
+ * @param [in] value
+ * @return true If the value is in bounds and consistent with the others.
+ * @return false
+ */
+bool SetSetting(const Setting& setting, uint32_t value);
+
+/**
+ * @brief A counter increased whenever a setting changes.
+ * @details Components which cache a setting compare it to apply changes.
+ */
+uint32_t GetSettingsVersion();
+
+/**
+ * @brief The topic of the config, usually retained.
+ * @details The config is a flat JSON object of the keys to change, for
+ * example `{"scan_s":2,"notify_ms":5000}`. It is applied only if every key
+ * is known and in bounds, and a scan fits in the BLE window of the radio
+ * period.
+ */
+const char* GetConfigTopicFilter();
+
+void HandleConfigMessage(const char* pTopic, const uint8_t* pPayload,
+                         size_t length);
+
+/**
+ * @brief Get the settings to publish after a config is handled.
+ * @details The payload has all settings and `"error"` which is null or the
+ * first rejected key. A scan longer than the BLE window is rejected at
+ * `scan_s`.
+ * @return true Once after each handled config.
+ * @return false
+ */
+bool GetConfigState(char* pTopic, size_t topic_size, char* pPayload,
+                    size_t payload_size);
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * @file timeseries.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Compressed blocks of timestamped samples.
+ */
+#include "timeseries.h"
+
+#include <cstring>
+
+static const uint8_t kNoWindow = 0xFF;
+
+static uint32_t GetFloatBits(float value) {
+    uint32_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static uint8_t CountLeadingZeros(uint32_t bits) {
+    uint8_t num = 0;
+    for (uint32_t mask = 0x80000000U; (mask != 0) && !(bits & mask);
+         mask >>= 1) {
+        ++num;
+    }
+    return num;
+}
+
+static uint8_t CountTrailingZeros(uint32_t bits) {
+    uint8_t num = 0;
+    for (uint32_t mask = 1; (mask != 0) && !(bits & mask); mask <<= 1) {
+        ++num;
+    }
+    return num;
+}
+
+/**
+ * @brief Sign-extend the low num bits.
+ */
+static int32_t SignExtend(uint32_t bits, uint8_t num) {
+    uint32_t sign = 1U << (num - 1);
+    return static_cast<int32_t>((bits ^ sign) - sign);
+}
+
+TimeSeriesEncoder::TimeSeriesEncoder(uint8_t* pBuffer, size_t capacity)
+    : pBuffer(pBuffer), capacity(capacity) {
+    Clear();
+}
+
+void TimeSeriesEncoder::Clear() {
+    bit_length = 0;
+    sample_num = 0;
+    start_time = 0;
+    last_time = 0;
+    last_delta = 0;
+    last_bits = 0;
+    last_leading = kNoWindow;
+    last_trailing = 0;
+}
+
+/**
+ * @brief Write the low num bits, most significant first.
+ * @details The bits are set or cleared, so a rejected sample leaves no
+ * trace once it is overwritten.
+ */
+bool TimeSeriesEncoder::WriteBits(uint32_t bits, uint8_t num) {
+    if (bit_length + num > capacity * 8) {
+        return false;
+    }
+    for (int i = num - 1; i >= 0; --i) {
+        uint8_t mask = 0x80 >> (bit_length % 8);
+        if ((bits >> i) & 1) {
+            pBuffer[bit_length / 8] |= mask;
+        } else {
+            pBuffer[bit_length / 8] &= ~mask;
+        }
+        ++bit_length;
+    }
+    return true;
+}
+
+bool TimeSeriesEncoder::Append(uint32_t time, float value) {
+    if (sample_num == 0xFFFF) {
+        return false;
+    }
+    uint32_t bits = GetFloatBits(value);
+    size_t saved_bit_length = bit_length;
+    if (sample_num == 0) {
+        if (!WriteBits(time, 32) || !WriteBits(bits, 32)) {
+            bit_length = saved_bit_length;
+            return false;
+        }
+        start_time = time;
+        last_time = time;
+        last_delta = 0;
+        last_bits = bits;
+        ++sample_num;
+        return true;
+    }
+    if (time < last_time) {
+        return false;
+    }
+    uint32_t delta = time - last_time;
+    int64_t delta_of_delta = static_cast<int64_t>(delta) - last_delta;
+    bool is_written = true;
+    if (delta_of_delta == 0) {
+        is_written = WriteBits(0, 1);
+    } else if ((delta_of_delta >= -64) && (delta_of_delta <= 63)) {
+        is_written = WriteBits(0x2, 2) &&
+                     WriteBits(static_cast<uint32_t>(delta_of_delta), 7);
+    } else if ((delta_of_delta >= -256) && (delta_of_delta <= 255)) {
+        is_written = WriteBits(0x6, 3) &&
+                     WriteBits(static_cast<uint32_t>(delta_of_delta), 9);
+    } else if ((delta_of_delta >= -2048) && (delta_of_delta <= 2047)) {
+        is_written = WriteBits(0xE, 4) &&
+                     WriteBits(static_cast<uint32_t>(delta_of_delta), 12);
+    } else {
+        is_written = WriteBits(0xF, 4) && WriteBits(delta, 32);
+    }
+    uint32_t xor_bits = bits ^ last_bits;
+    uint8_t leading = last_leading;
+    uint8_t trailing = last_trailing;
+    if (xor_bits == 0) {
+        is_written = is_written && WriteBits(0, 1);
+    } else if (is_written) {
+        uint8_t xor_leading = CountLeadingZeros(xor_bits);
+        uint8_t xor_trailing = CountTrailingZeros(xor_bits);
+        if ((last_leading != kNoWindow) && (xor_leading >= last_leading) &&
+            (xor_trailing >= last_trailing)) {
+            is_written =
+                WriteBits(0x2, 2) &&
+                WriteBits(xor_bits >> last_trailing,
+                          32 - last_leading - last_trailing);
+        } else {
+            leading = xor_leading;
+            trailing = xor_trailing;
+            uint8_t meaningful_num = 32 - leading - trailing;
+            is_written = WriteBits(0x3, 2) && WriteBits(leading, 5) &&
+                         WriteBits(meaningful_num - 1, 5) &&
+                         WriteBits(xor_bits >> trailing, meaningful_num);
+        }
+    }
+    if (!is_written) {
+        bit_length = saved_bit_length;
+        return false;
+    }
+    last_time = time;
+    last_delta = delta;
+    last_bits = bits;
+    last_leading = leading;
+    last_trailing = trailing;
+    ++sample_num;
+    return true;
+}
+
+uint16_t TimeSeriesEncoder::GetSampleNum() const { return sample_num; }
+
+uint32_t TimeSeriesEncoder::GetStartTime() const { return start_time; }
+
+uint32_t TimeSeriesEncoder::GetEndTime() const { return last_time; }
+
+size_t TimeSeriesEncoder::GetLength() const { return (bit_length + 7) / 8; }
+
+TimeSeriesDecoder::TimeSeriesDecoder(const uint8_t* pData, size_t length,
+                                     uint16_t sample_num)
+    : pData(pData),
+      bit_length(length * 8),
+      bit_offset(0),
+      sample_num(sample_num),
+      read_num(0),
+      last_time(0),
+      last_delta(0),
+      last_bits(0),
+      last_leading(kNoWindow),
+      last_trailing(0) {}
+
+bool TimeSeriesDecoder::ReadBits(uint8_t num, uint32_t& bits) {
+    if (bit_offset + num > bit_length) {
+        return false;
+    }
+    bits = 0;
+    for (uint8_t i = 0; i < num; ++i) {
+        uint8_t mask = 0x80 >> (bit_offset % 8);
+        bits = (bits << 1) | ((pData[bit_offset / 8] & mask) ? 1 : 0);
+        ++bit_offset;
+    }
+    return true;
+}
+
+bool TimeSeriesDecoder::Next(uint32_t& time, float& value) {
+    if (read_num >= sample_num) {
+        return false;
+    }
+    uint32_t bits = 0;
+    if (read_num == 0) {
+        if (!ReadBits(32, last_time) || !ReadBits(32, last_bits)) {
+            return false;
+        }
+    } else {
+        // The prefix of the timestamp is at most 4 bits.
+        uint8_t prefix_num = 0;
+        while ((prefix_num < 4) && ReadBits(1, bits) && (bits == 1)) {
+            ++prefix_num;
+        }
+        static const uint8_t kDeltaOfDeltaBitNum[] = {0, 7, 9, 12};
+        int64_t delta = last_delta;
+        if (prefix_num == 4) {
+            if (!ReadBits(32, bits)) {
+                return false;
+            }
+            delta = bits;
+        } else if (prefix_num > 0) {
+            uint8_t num = kDeltaOfDeltaBitNum[prefix_num];
+            if (!ReadBits(num, bits)) {
+                return false;
+            }
+            delta += SignExtend(bits, num);
+        }
+        if ((delta < 0) || (delta > 0xFFFFFFFFLL - last_time)) {
+            return false;
+        }
+        last_delta = static_cast<uint32_t>(delta);
+        last_time += static_cast<uint32_t>(delta);
+        if (!ReadBits(1, bits)) {
+            return false;
+        }
+        if (bits == 1) {
+            if (!ReadBits(1, bits)) {
+                return false;
+            }
+            if (bits == 1) {
+                uint32_t leading = 0;
+                uint32_t meaningful_num = 0;
+                if (!ReadBits(5, leading) || !ReadBits(5, meaningful_num)) {
+                    return false;
+                }
+                ++meaningful_num;
+                if (leading + meaningful_num > 32) {
+                    return false;
+                }
+                last_leading = leading;
+                last_trailing = 32 - leading - meaningful_num;
+            } else if (last_leading == kNoWindow) {
+                return false;
+            }
+            uint32_t xor_bits = 0;
+            if (!ReadBits(32 - last_leading - last_trailing, xor_bits)) {
+                return false;
+            }
+            last_bits ^= xor_bits << last_trailing;
+        }
+    }
+    ++read_num;
+    time = last_time;
+    memcpy(&value, &last_bits, sizeof(value));
+    return true;
+}
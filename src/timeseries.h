@@ -0,0 +1,93 @@
+/**
+ * @file timeseries.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Compressed blocks of timestamped samples.
+ */
+#ifndef BLUETOOTHGATEWAY_TIMESERIES_H_
+#define BLUETOOTHGATEWAY_TIMESERIES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Append samples into a caller-provided block in a bit stream.
+ * @details The encoding follows Gorilla (Pelkonen et al., VLDB 2015).
+ * The first sample is stored raw in 64 bits. The following timestamps are
+ * delta-of-delta encoded in seconds:
+ * - `0` if the interval is unchanged.
+ * - `10` and 7 bits, `110` and 9 bits, `1110` and 12 bits for small changes.
+ * - `1111` and 32 bits otherwise.
+ *
+ * The values are XORed with the previous value:
+ * - `0` if unchanged.
+ * - `10` and the meaningful bits if they fit in the previous window.
+ * - `11`, 5 bits of leading zeros, 5 bits of length - 1 and the meaningful
+ * bits otherwise.
+ *
+ * A sample which does not fit is rejected as a whole.
+ */
+class TimeSeriesEncoder {
+   public:
+    TimeSeriesEncoder(uint8_t* pBuffer, size_t capacity);
+    /**
+     * @brief Append a sample.
+     * @param [in] time Seconds, not earlier than the last sample.
+     * @param [in] value
+     * @return true If appended.
+     * @return false If the block is full or the time goes backward.
+     */
+    bool Append(uint32_t time, float value);
+    /**
+     * @brief Start an empty block in the same buffer.
+     */
+    void Clear();
+    uint16_t GetSampleNum() const;
+    uint32_t GetStartTime() const;
+    uint32_t GetEndTime() const;
+    /**
+     * @brief The number of used bytes of the buffer.
+     */
+    size_t GetLength() const;
+
+   private:
+    uint8_t* pBuffer;
+    size_t capacity;
+    size_t bit_length;
+    uint16_t sample_num;
+    uint32_t start_time;
+    uint32_t last_time;
+    uint32_t last_delta;
+    uint32_t last_bits;
+    uint8_t last_leading;
+    uint8_t last_trailing;
+    bool WriteBits(uint32_t bits, uint8_t num);
+};
+
+/**
+ * @brief Read the samples of a block written by TimeSeriesEncoder.
+ */
+class TimeSeriesDecoder {
+   public:
+    TimeSeriesDecoder(const uint8_t* pData, size_t length, uint16_t sample_num);
+    /**
+     * @brief Read the next sample.
+     * @return true If read.
+     * @return false If all samples are read or the block is corrupted.
+     */
+    bool Next(uint32_t& time, float& value);
+
+   private:
+    const uint8_t* pData;
+    size_t bit_length;
+    size_t bit_offset;
+    uint16_t sample_num;
+    uint16_t read_num;
+    uint32_t last_time;
+    uint32_t last_delta;
+    uint32_t last_bits;
+    uint8_t last_leading;
+    uint8_t last_trailing;
+    bool ReadBits(uint8_t num, uint32_t& bits);
+};
+
+#endif
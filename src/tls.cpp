@@ -0,0 +1,327 @@
+/**
+ * @file tls.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief TLS client of MQTT which resumes the session on reconnect.
+ */
+#include "tls.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#include <mbedtls/error.h>
+
+#include <vector>
+
+static Preferences tls_prefs;
+#if defined(CONFIG_NVS_ENCRYPTION)
+static const bool kIsNVSEncrypted = true;
+#else
+static const bool kIsNVSEncrypted = false;
+#endif
+
+TLSClient::TLSClient()
+    : is_begun(false),
+      is_connected(false),
+      has_session(false),
+      is_session_stored(false),
+      peeked(-1),
+      statistics({0, 0, 0, 0, 0, 0, 0, 0, 0, 0}) {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_x509_crt_init(&ca_cert);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_net_init(&net);
+    mbedtls_ssl_session_init(&session);
+}
+
+TLSClient::~TLSClient() {
+    stop();
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_free(&ssl);
+    mbedtls_x509_crt_free(&ca_cert);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+}
+
+bool TLSClient::Begin(const char* pCACert, bool is_session_stored) {
+    this->is_session_stored = is_session_stored;
+    int result = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func,
+                                       &entropy, nullptr, 0);
+    if (result != 0) {
+        Fail(result);
+        return false;
+    }
+    result = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT,
+                                         MBEDTLS_SSL_TRANSPORT_STREAM,
+                                         MBEDTLS_SSL_PRESET_DEFAULT);
+    if (result != 0) {
+        Fail(result);
+        return false;
+    }
+    if ((pCACert != nullptr) && (pCACert[0] != '\0')) {
+        // The length of PEM includes the null terminator.
+        result = mbedtls_x509_crt_parse(
+            &ca_cert, reinterpret_cast<const unsigned char*>(pCACert),
+            strlen(pCACert) + 1);
+        if (result != 0) {
+            Fail(result);
+            return false;
+        }
+        mbedtls_ssl_conf_ca_chain(&conf, &ca_cert, nullptr);
+        mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else {
+        log_w("No CA, the MQTT server is not verified.");
+        mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_NONE);
+    }
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_read_timeout(&conf, kHandshakeTimeout);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf,
+                                     MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    // The buffers are allocated once here and kept across connections.
+    uint32_t free_heap = esp_get_free_heap_size();
+    result = mbedtls_ssl_setup(&ssl, &conf);
+    if (result != 0) {
+        Fail(result);
+        return false;
+    }
+    uint32_t free_heap_after = esp_get_free_heap_size();
+    statistics.heap_setup =
+        free_heap > free_heap_after ? free_heap - free_heap_after : 0;
+    is_begun = true;
+    tls_prefs.begin("tls");
+    if (!is_session_stored) {
+        // Do not leave the secret of an earlier build in NVS.
+        if (tls_prefs.getBytesLength("session") > 0) {
+            tls_prefs.remove("session");
+        }
+        return true;
+    }
+    if (!kIsNVSEncrypted) {
+        log_w("The TLS session is stored in NVS in plain text.");
+    }
+    LoadSession();
+    return true;
+}
+
+int TLSClient::connect(IPAddress ip, uint16_t port) {
+    return Handshake(ip.toString().c_str(), nullptr, port) ? 1 : 0;
+}
+
+int TLSClient::connect(const char* pHost, uint16_t port) {
+    return Handshake(pHost, pHost, port) ? 1 : 0;
+}
+
+bool TLSClient::Handshake(const char* pHost, const char* pName,
+                          uint16_t port) {
+    stop();
+    peeked = -1;
+    if (!is_begun) {
+        return false;
+    }
+    uint32_t free_heap = esp_get_free_heap_size();
+    uint32_t start = millis();
+    char port_text[6];
+    snprintf(port_text, sizeof(port_text), "%u", port);
+    int result =
+        mbedtls_net_connect(&net, pHost, port_text, MBEDTLS_NET_PROTO_TCP);
+    if (result != 0) {
+        Fail(result);
+        return false;
+    }
+    mbedtls_ssl_session_reset(&ssl);
+    mbedtls_ssl_set_hostname(&ssl, pName);
+    // Block with the read timeout until the handshake ends.
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv,
+                        mbedtls_net_recv_timeout);
+    if (has_session && (mbedtls_ssl_set_session(&ssl, &session) != 0)) {
+        has_session = false;
+    }
+    bool is_offered = has_session;
+    while ((result = mbedtls_ssl_handshake(&ssl)) != 0) {
+        if ((result != MBEDTLS_ERR_SSL_WANT_READ) &&
+            (result != MBEDTLS_ERR_SSL_WANT_WRITE)) {
+            mbedtls_net_free(&net);
+            has_session = false;  // Do not offer it again.
+            Fail(result);
+            return false;
+        }
+    }
+    statistics.handshake_ms = static_cast<uint32_t>(millis() - start);
+    // The master secret is only kept if the server resumed the session.
+    mbedtls_ssl_session new_session;
+    mbedtls_ssl_session_init(&new_session);
+    bool is_resumed = false;
+    if (mbedtls_ssl_get_session(&ssl, &new_session) == 0) {
+        is_resumed = is_offered &&
+                     (memcmp(new_session.master, session.master,
+                             sizeof(session.master)) == 0);
+        mbedtls_ssl_session_free(&session);
+        session = new_session;
+        has_session = true;
+        KeepSession(is_resumed);
+    } else {
+        mbedtls_ssl_session_free(&new_session);
+    }
+    // The client is polled by PubSubClient, so do not block after this.
+    mbedtls_net_set_nonblock(&net);
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv,
+                        nullptr);
+    is_connected = true;
+    ++statistics.handshake_num;
+    if (!is_resumed) {
+        statistics.full_handshake_ms = statistics.handshake_ms;
+    }
+    uint32_t free_heap_after = esp_get_free_heap_size();
+    statistics.heap_peak = free_heap - esp_get_minimum_free_heap_size();
+    statistics.heap_held =
+        free_heap > free_heap_after ? free_heap - free_heap_after : 0;
+    statistics.heap_min_free = esp_get_minimum_free_heap_size();
+    statistics.heap_largest_block =
+        heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    log_i("TLS handshake %s in %d ms with %s", is_resumed ? "resumed" : "full",
+          statistics.handshake_ms, mbedtls_ssl_get_ciphersuite(&ssl));
+    return true;
+}
+
+void TLSClient::KeepSession(bool is_resumed) {
+    if (is_resumed) {
+        ++statistics.resumed_num;
+        return;
+    }
+    if (is_session_stored) {
+        StoreSession();  // Only a new session is written to flash.
+    }
+}
+
+void TLSClient::LoadSession() {
+    size_t length = tls_prefs.getBytesLength("session");
+    if (length == 0) {
+        return;
+    }
+    std::vector<uint8_t> buffer(length);
+    tls_prefs.getBytes("session", buffer.data(), length);
+    if (mbedtls_ssl_session_load(&session, buffer.data(), length) != 0) {
+        log_w("Stored TLS session is invalid.");
+        mbedtls_ssl_session_free(&session);
+        mbedtls_ssl_session_init(&session);
+        tls_prefs.remove("session");
+        return;
+    }
+    has_session = true;
+    log_i("Stored TLS session loaded.");
+}
+
+void TLSClient::StoreSession() {
+    size_t length = 0;
+    if (mbedtls_ssl_session_save(&session, nullptr, 0, &length) !=
+        MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return;
+    }
+    std::vector<uint8_t> buffer(length);
+    if (mbedtls_ssl_session_save(&session, buffer.data(), length, &length) !=
+        0) {
+        return;
+    }
+    tls_prefs.putBytes("session", buffer.data(), length);
+}
+
+void TLSClient::Fail(int result) {
+    char error[64];
+    mbedtls_strerror(result, error, sizeof(error));
+    log_w("TLS error -0x%04x: %s", -result, error);
+    ++statistics.failure_num;
+}
+
+size_t TLSClient::write(uint8_t byte) { return write(&byte, 1); }
+
+size_t TLSClient::write(const uint8_t* pBuffer, size_t size) {
+    size_t written = 0;
+    uint32_t start = millis();
+    while (is_connected && (written < size)) {
+        int result = mbedtls_ssl_write(&ssl, pBuffer + written, size - written);
+        if (result > 0) {
+            written += result;
+            continue;
+        }
+        if (((result != MBEDTLS_ERR_SSL_WANT_READ) &&
+             (result != MBEDTLS_ERR_SSL_WANT_WRITE)) ||
+            (static_cast<uint32_t>(millis() - start) >= kWriteTimeout)) {
+            stop();
+            break;
+        }
+        delay(1);
+    }
+    return written;
+}
+
+int TLSClient::available() {
+    if (!is_connected) {
+        return 0;
+    }
+    // Read a record without consuming it, so the pending bytes are known.
+    int result = mbedtls_ssl_read(&ssl, nullptr, 0);
+    if ((result < 0) && (result != MBEDTLS_ERR_SSL_WANT_READ) &&
+        (result != MBEDTLS_ERR_SSL_WANT_WRITE)) {
+        stop();
+        return (peeked >= 0) ? 1 : 0;
+    }
+    return mbedtls_ssl_get_bytes_avail(&ssl) + ((peeked >= 0) ? 1 : 0);
+}
+
+int TLSClient::read() {
+    uint8_t byte;
+    return (read(&byte, 1) == 1) ? byte : -1;
+}
+
+int TLSClient::read(uint8_t* pBuffer, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t length = 0;
+    if (peeked >= 0) {
+        pBuffer[length++] = static_cast<uint8_t>(peeked);
+        peeked = -1;
+    }
+    if (!is_connected || (length == size)) {
+        return (length > 0) ? length : -1;
+    }
+    int result = mbedtls_ssl_read(&ssl, pBuffer + length, size - length);
+    if (result > 0) {
+        return length + result;
+    }
+    if ((result != MBEDTLS_ERR_SSL_WANT_READ) &&
+        (result != MBEDTLS_ERR_SSL_WANT_WRITE)) {
+        stop();  // Closed by the server or failed.
+    }
+    return (length > 0) ? length : -1;
+}
+
+int TLSClient::peek() {
+    if (peeked < 0) {
+        uint8_t byte;
+        if (read(&byte, 1) == 1) {
+            peeked = byte;
+        }
+    }
+    return peeked;
+}
+
+void TLSClient::stop() {
+    if (is_connected) {
+        is_connected = false;
+        // Without the close notify, the server may not resume the session.
+        mbedtls_ssl_close_notify(&ssl);
+        mbedtls_net_free(&net);
+    }
+}
+
+uint8_t TLSClient::connected() {
+    return (is_connected || (peeked >= 0)) ? 1 : 0;
+}
+
+TLSStatistics TLSClient::GetStatistics() const { return statistics; }
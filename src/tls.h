@@ -0,0 +1,105 @@
+/**
+ * @file tls.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief TLS client of MQTT which resumes the session on reconnect.
+ */
+#ifndef BLUETOOTHGATEWAY_TLS_H_
+#define BLUETOOTHGATEWAY_TLS_H_
+
+#include <Client.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+/**
+ * @brief Counters of the TLS handshakes.
+ * @details heap_setup is the heap kept by the SSL context from Begin, mostly
+ * its input and output record buffers. heap_peak is the free heap before the
+ * last handshake minus the lowest free heap since boot after it. It is exact
+ * if the handshake reached the lowest heap, as the first full handshake
+ * usually does, otherwise an upper bound. The headroom left is
+ * heap_min_free, the lowest free heap since boot, and heap_largest_block,
+ * the largest free block, both measured after the last handshake.
+ */
+struct TLSStatistics {
+    uint32_t handshake_num;
+    uint32_t resumed_num;
+    uint32_t failure_num;
+    uint32_t handshake_ms;        // the last handshake
+    uint32_t full_handshake_ms;   // the last handshake not resumed
+    uint32_t heap_setup;          // bytes
+    uint32_t heap_peak;           // bytes
+    uint32_t heap_held;           // bytes kept by the connection
+    uint32_t heap_min_free;       // bytes
+    uint32_t heap_largest_block;  // bytes
+};
+
+/**
+ * @brief A TLS client which resumes the last session.
+ * @details One configuration and SSL context are kept for all connections,
+ * so a reconnect reuses the buffers. The session of each handshake, with
+ * the ticket if the server issued one, is offered on the next connect and
+ * saves the certificate exchange and key agreement if the server accepts
+ * it. The close notify is sent on stop, otherwise the server may drop the
+ * session.
+ */
+class TLSClient : public Client {
+   public:
+    static const uint32_t kHandshakeTimeout = 10000;  // milliseconds
+    static const uint32_t kWriteTimeout = 5000;       // milliseconds
+    TLSClient();
+    ~TLSClient();
+    /**
+     * @brief Set up the context. Call it before connect.
+     * @param [in] pCACert The PEM of the CA, empty to skip verifying the
+     * server.
+     * @param [in] is_session_stored Keep the session in NVS across reboots.
+     * The session includes its master secret, which is stored in plain
+     * text unless NVS encryption is enabled. Otherwise a stored session
+     * is removed.
+     * @return true
+     * @return false If the CA or the random generator fails.
+     */
+    bool Begin(const char* pCACert, bool is_session_stored);
+    /**
+     * @brief Connect to an IP. The name of the certificate is not checked.
+     */
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* pHost, uint16_t port) override;
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* pBuffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* pBuffer, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+    TLSStatistics GetStatistics() const;
+
+   private:
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt ca_cert;
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context net;
+    mbedtls_ssl_session session;
+    bool is_begun;
+    bool is_connected;
+    bool has_session;
+    bool is_session_stored;
+    int peeked;
+    TLSStatistics statistics;
+
+    bool Handshake(const char* pHost, const char* pName, uint16_t port);
+    void KeepSession(bool is_resumed);
+    void LoadSession();
+    void StoreSession();
+    void Fail(int result);
+};
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file trace.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Trace the stages of the loop into a ring kept across resets.
+ */
+#include "trace.h"
+
+#include <Arduino.h>
+
+#include <string.h>
+
+static const uint32_t kTraceMagic = 0x54524345;
+static const size_t kTraceEventNum = 64;
+static const size_t kTraceStageNum = 7;
+
+/**
+ * @brief The ring in RTC memory, which survives the watchdog reset.
+ * @details Only the loop task traces, so no lock is needed.
+ */
+struct TraceRing {
+    uint32_t magic;
+    uint32_t head;
+    uint32_t num;
+    TraceEvent events[kTraceEventNum];
+};
+
+RTC_NOINIT_ATTR static TraceRing trace_ring;
+static TraceEvent previous_events[kTraceEventNum];
+static size_t previous_event_num = 0;
+static bool is_previous_kept = false;
+
+// Milliseconds of scan, connect, discovery, notify wait, MQTT connect,
+// publish and read. The scan and the notify wait follow the settings.
+static uint32_t stage_budgets[kTraceStageNum] = {3000, 10000, 5000, 11000,
+                                                 5000, 2000,  2000};
+static uint32_t stage_begin_times[kTraceStageNum] = {0};
+static TraceStatistics trace_statistics = {0, 0, 0};
+
+static const char* const kTraceStageNames[kTraceStageNum] = {
+    "scan",         "connect", "discovery", "notify_wait",
+    "mqtt_connect", "publish", "read"};
+
+void TraceSetup() {
+    previous_event_num = 0;
+    is_previous_kept = false;
+    if ((trace_ring.magic == kTraceMagic) &&
+        (trace_ring.num <= kTraceEventNum) &&
+        (trace_ring.head < kTraceEventNum)) {
+        size_t start = (trace_ring.head + kTraceEventNum - trace_ring.num) %
+                       kTraceEventNum;
+        for (size_t i = 0; i < trace_ring.num; ++i) {
+            previous_events[i] =
+                trace_ring.events[(start + i) % kTraceEventNum];
+        }
+        previous_event_num = trace_ring.num;
+        is_previous_kept = true;
+    }
+    trace_ring.magic = kTraceMagic;
+    trace_ring.head = 0;
+    trace_ring.num = 0;
+}
+
+void SetTraceBudget(const TraceStage& stage, uint32_t budget) {
+    stage_budgets[static_cast<size_t>(stage)] = budget;
+}
+
+static void AddTraceEvent(uint32_t time, const TraceStage& stage,
+                          const TraceEventKind& kind, uint16_t tag) {
+    TraceEvent& event = trace_ring.events[trace_ring.head];
+    event.time = time;
+    event.stage = stage;
+    event.kind = kind;
+    event.tag = tag;
+    trace_ring.head = (trace_ring.head + 1) % kTraceEventNum;
+    if (trace_ring.num < kTraceEventNum) {
+        ++trace_ring.num;
+    }
+    ++trace_statistics.event_num;
+}
+
+void TraceBegin(const TraceStage& stage, uint16_t tag) {
+    uint32_t start = micros();
+    uint32_t now = millis();
+    stage_begin_times[static_cast<size_t>(stage)] = now;
+    AddTraceEvent(now, stage, TraceEventKind::Begin, tag);
+    trace_statistics.cpu_us += static_cast<uint32_t>(micros() - start);
+}
+
+void TraceEnd(const TraceStage& stage, uint16_t tag) {
+    uint32_t start = micros();
+    uint32_t now = millis();
+    size_t index = static_cast<size_t>(stage);
+    uint32_t elapsed = static_cast<uint32_t>(now - stage_begin_times[index]);
+    if (elapsed > stage_budgets[index]) {
+        ++trace_statistics.over_budget_num;
+        AddTraceEvent(now, stage, TraceEventKind::OverBudget, tag);
+        log_w("Stage %s of 0x%04x takes %d ms over budget %d ms.",
+              kTraceStageNames[index], tag, elapsed, stage_budgets[index]);
+    } else {
+        AddTraceEvent(now, stage, TraceEventKind::End, tag);
+    }
+    trace_statistics.cpu_us += static_cast<uint32_t>(micros() - start);
+}
+
+ScopedTrace::ScopedTrace(const TraceStage& stage, uint16_t tag)
+    : stage(stage), tag(tag) {
+    TraceBegin(stage, tag);
+}
+ScopedTrace::~ScopedTrace() { TraceEnd(stage, tag); }
+
+uint16_t GetTraceTag(const uint8_t* pAddress) {
+    return (pAddress[4] << 8) | pAddress[5];
+}
+
+const char* GetTraceStageName(const TraceStage& stage) {
+    size_t index = static_cast<size_t>(stage);
+    return index < kTraceStageNum ? kTraceStageNames[index] : "unknown";
+}
+
+const TraceEvent* GetPreviousTrace(size_t& num) {
+    num = previous_event_num;
+    return is_previous_kept ? previous_events : nullptr;
+}
+
+TraceStatistics GetTraceStatistics() { return trace_statistics; }
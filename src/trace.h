@@ -0,0 +1,112 @@
+/**
+ * @file trace.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Trace the stages of the loop into a ring kept across resets.
+ */
+#ifndef BLUETOOTHGATEWAY_TRACE_H_
+#define BLUETOOTHGATEWAY_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief A enum for the traced stages.
+ */
+enum class TraceStage : uint8_t {
+    Scan,
+    Connect,
+    Discovery,
+    NotifyWait,
+    MQTTConnect,
+    Publish,
+    Read,
+};
+
+/**
+ * @brief A enum for the kind of trace events.
+ */
+enum class TraceEventKind : uint8_t {
+    Begin,
+    End,
+    OverBudget,  // End of a stage which exceeds its budget.
+};
+
+/**
+ * @brief A trace event of 8 bytes.
+ * @details The tag is the low 2 bytes of the device address, or 0.
+ */
+struct TraceEvent {
+    uint32_t time;  // milliseconds since boot
+    TraceStage stage;
+    TraceEventKind kind;
+    uint16_t tag;
+};
+
+/**
+ * @brief Counters of tracing.
+ * @details cpu_us is the time spent in tracing itself.
+ */
+struct TraceStatistics {
+    uint32_t event_num;
+    uint32_t over_budget_num;
+    uint32_t cpu_us;
+};
+
+/**
+ * @brief Keep the trace of the last boot and start a new trace.
+ * @details Call it once at boot.
+ */
+void TraceSetup();
+
+/**
+ * @brief Set the time budget of a stage.
+ * @param [in] stage
+ * @param [in] budget Milliseconds.
+ */
+void SetTraceBudget(const TraceStage& stage, uint32_t budget);
+
+void TraceBegin(const TraceStage& stage, uint16_t tag);
+
+/**
+ * @brief Record the end of a stage and flag it if over budget.
+ * @param [in] stage
+ * @param [in] tag
+ */
+void TraceEnd(const TraceStage& stage, uint16_t tag);
+
+/**
+ * @brief Trace a stage in a scope.
+ */
+class ScopedTrace {
+   public:
+    ScopedTrace(const TraceStage& stage, uint16_t tag);
+    ~ScopedTrace();
+
+   private:
+    TraceStage stage;
+    uint16_t tag;
+};
+
+/**
+ * @brief Get the trace tag of a 6 bytes address.
+ */
+uint16_t GetTraceTag(const uint8_t* pAddress);
+
+/**
+ * @brief Get the stage name.
+ */
+const char* GetTraceStageName(const TraceStage& stage);
+
+/**
+ * @brief Get the events of the last boot, oldest first.
+ * @param [out] num
+ * @return const TraceEvent* nullptr if no trace is kept.
+ */
+const TraceEvent* GetPreviousTrace(size_t& num);
+
+/**
+ * @brief Get the counters of tracing since boot.
+ */
+TraceStatistics GetTraceStatistics();
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file transport.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief The BLE host operations used by the devices and the scan.
+ */
+#ifndef BLUETOOTHGATEWAY_TRANSPORT_H_
+#define BLUETOOTHGATEWAY_TRANSPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+/**
+ * @brief Callback of a raw advertising report.
+ */
+class ScanReportCallbacks {
+   public:
+    virtual ~ScanReportCallbacks(){};
+    /**
+     * @brief Handle an advertising report.
+     * @param [in] pAddress The 6 bytes address.
+     * @param [in] rssi
+     * @param [in] pPayload The advertising data followed by scan response.
+     * @param [in] length
+     * @return true If the scan should stop.
+     * @return false
+     */
+    virtual bool onReport(const uint8_t* pAddress, int rssi,
+                          const uint8_t* pPayload, size_t length) = 0;
+};
+
+/**
+ * @brief Callback of a value indicated by the connected device.
+ * @param [in] index The index given to Subscribe.
+ * @param [in] pData
+ * @param [in] length
+ */
+typedef void (*IndicationCallback)(size_t index, const uint8_t* pData,
+                                   size_t length);
+
+// Characteristic properties as in the GATT characteristic declaration.
+const uint8_t kPropertyRead = 0x02;
+const uint8_t kPropertyIndicate = 0x20;
+
+/**
+ * @brief The BLE host stack, one connection at a time.
+ * @details Addresses are 6 bytes, most significant first as printed. The
+ * characteristics are those of the service found by DiscoverService.
+ */
+class BLETransport {
+   public:
+    virtual ~BLETransport(){};
+    /**
+     * @brief Start the host stack.
+     * @param [in] pName The device name.
+     */
+    virtual void Begin(const char* pName) = 0;
+    /**
+     * @brief Scan passively and report the advertisements to callbacks.
+     * @param [in] duration Scan duration in seconds.
+     * @param [in] interval Scan interval in milliseconds.
+     * @param [in] window Scan window in milliseconds.
+     * @param [in] is_filtered Only report the devices in the accept list.
+     * @param [in] pCallbacks
+     */
+    virtual void Scan(uint32_t duration, uint16_t interval, uint16_t window,
+                      bool is_filtered, ScanReportCallbacks* pCallbacks) = 0;
+    virtual void ClearAcceptList() = 0;
+    /**
+     * @brief Add a device to the filter accept list of the controller.
+     * @return false If the list is full.
+     */
+    virtual bool AddAcceptList(const uint8_t* pAddress) = 0;
+    virtual bool Connect(const uint8_t* pAddress) = 0;
+    /**
+     * @brief Request a short connection interval and a larger ATT MTU.
+     * @details The peripheral may reject the request and keep its
+     * parameters.
+     */
+    virtual void RequestFastConnection() = 0;
+    virtual void Disconnect() = 0;
+    /**
+     * @brief Find a primary service of the connected device.
+     * @return false If not found.
+     */
+    virtual bool DiscoverService(uint16_t uuid) = 0;
+    /**
+     * @brief Get the properties of a characteristic.
+     * @return uint8_t 0 if not found.
+     */
+    virtual uint8_t GetProperties(uint16_t uuid) = 0;
+    virtual bool Read(uint16_t uuid, std::string& value) = 0;
+    /**
+     * @brief Enable the indication of a characteristic.
+     * @details The callback runs in the host task until Disconnect and
+     * receives the index, so the caller dispatches without a lookup.
+     * @param [in] uuid
+     * @param [in] index Passed back to the callback.
+     * @param [in] callback
+     */
+    virtual bool Subscribe(uint16_t uuid, size_t index,
+                           IndicationCallback callback) = 0;
+};
+
+/**
+ * @brief Create the backend of the build, NimBLE if BLE_NIMBLE is defined
+ * and Bluedroid otherwise.
+ */
+std::unique_ptr<BLETransport> CreateBLETransport();
+
+#endif
@@ -0,0 +1,291 @@
+/**
+ * @file transport_bluedroid.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief The BLE transport on the Bluedroid host of the Arduino BLE library.
+ */
+#if !defined(BLE_NIMBLE)
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <esp_gap_ble_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <vector>
+
+#include "recorder.h"
+#include "transport.h"
+
+#if !defined(CONFIG_BT_ENABLED) || !defined(CONFIG_BLUEDROID_ENABLED)
+#error Bluetooth is not enabled! Please run `make menuconfig` to and enable it
+#endif
+
+static const size_t kMaxSubscriptionNum = 24;
+
+static SemaphoreHandle_t filtered_scan_end = nullptr;
+static ScanReportCallbacks* pFilteredCallbacks = nullptr;
+// Set by FilteredScan and cleared in the host task when the scan has ended,
+// after which the callbacks are not used any more.
+static volatile bool is_filtered_scanning = false;
+static volatile bool is_filtered_stopping = false;
+
+// The handles of the subscribed characteristics and the indexes passed back
+// to the callback.
+static uint16_t subscribed_handles[kMaxSubscriptionNum];
+static size_t subscribed_indexes[kMaxSubscriptionNum];
+static size_t subscription_num = 0;
+static IndicationCallback indication_callback = nullptr;
+
+/**
+ * @brief Capture the connections of the client.
+ */
+class DefaultClientCallbacks : public BLEClientCallbacks {
+   public:
+    void onConnect(BLEClient* pClient) {
+        BLEAddress address = pClient->getPeerAddress();
+        log_i("Connect to %s", address.toString().c_str());
+        CaptureConnection(*address.getNative(), true);
+    }
+    void onDisconnect(BLEClient* pClient) {
+        BLEAddress address = pClient->getPeerAddress();
+        log_i("Disconnect to %s", address.toString().c_str());
+        CaptureConnection(*address.getNative(), false);
+    }
+};
+
+/**
+ * @brief Forward the advertised device of BLEScan to ScanReportCallbacks.
+ */
+class DefaultAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
+   public:
+    DefaultAdvertisedDeviceCallbacks(ScanReportCallbacks* pCallbacks,
+                                     BLEScan* pScan)
+        : pCallbacks(pCallbacks), pScan(pScan) {}
+    void onResult(BLEAdvertisedDevice advertised_device) {
+        if (pCallbacks->onReport(*advertised_device.getAddress().getNative(),
+                                 advertised_device.getRSSI(),
+                                 advertised_device.getPayload(),
+                                 advertised_device.getPayloadLength())) {
+            pScan->stop();
+        }
+    }
+
+   private:
+    ScanReportCallbacks* pCallbacks;
+    BLEScan* pScan;
+};
+
+/**
+ * @brief Handle the scan events of the filtered scan.
+ * @details Only the devices in the accept list are reported by the
+ * controller.
+ */
+static void FilteredScanGapHandler(esp_gap_ble_cb_event_t event,
+                                   esp_ble_gap_cb_param_t* param) {
+    if (!is_filtered_scanning) {
+        return;
+    }
+    if ((event == ESP_GAP_BLE_SCAN_RESULT_EVT) &&
+        (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT)) {
+        if (is_filtered_stopping) {
+            return;
+        }
+        if (pFilteredCallbacks->onReport(
+                param->scan_rst.bda, param->scan_rst.rssi,
+                param->scan_rst.ble_adv,
+                param->scan_rst.adv_data_len + param->scan_rst.scan_rsp_len)) {
+            // Ended by the stop complete event, so that it does not end
+            // the next scan.
+            is_filtered_stopping = true;
+            esp_ble_gap_stop_scanning();
+        }
+        return;
+    }
+    if (((event == ESP_GAP_BLE_SCAN_RESULT_EVT) &&
+         (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT)) ||
+        (event == ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT)) {
+        is_filtered_scanning = false;
+        xSemaphoreGive(filtered_scan_end);
+    }
+}
+
+static void NotificationCallback(BLERemoteCharacteristic* pRemoteC,
+                                 uint8_t* pData, size_t length,
+                                 bool isNotify) {
+    uint16_t handle = pRemoteC->getHandle();
+    for (size_t i = 0; i < subscription_num; ++i) {
+        if (subscribed_handles[i] == handle) {
+            indication_callback(subscribed_indexes[i], pData, length);
+            return;
+        }
+    }
+    log_i("Remote characteristic handle 0x%04x not registered.", handle);
+}
+
+/**
+ * @brief The transport of the Arduino BLE library.
+ * @details BLEScan does not expose the filter policy, so the filtered scan
+ * is started by GAP API directly and the results are received by the
+ * custom GAP handler.
+ */
+class BluedroidTransport : public BLETransport {
+   public:
+    BluedroidTransport()
+        : pClient(nullptr), pScan(nullptr), pService(nullptr) {}
+    void Begin(const char* pName) override {
+        BLEDevice::init(pName);
+        pClient = BLEDevice::createClient();
+        pClient->setClientCallbacks(new DefaultClientCallbacks());
+        pScan = BLEDevice::getScan();
+        filtered_scan_end = xSemaphoreCreateBinary();
+        BLEDevice::setCustomGapHandler(FilteredScanGapHandler);
+    }
+    void Scan(uint32_t duration, uint16_t interval, uint16_t window,
+              bool is_filtered, ScanReportCallbacks* pCallbacks) override {
+        if (is_filtered) {
+            FilteredScan(duration, interval, window, pCallbacks);
+            return;
+        }
+        DefaultAdvertisedDeviceCallbacks scan_callback(pCallbacks, pScan);
+        pScan->setInterval(interval);
+        pScan->setWindow(window);
+        pScan->setAdvertisedDeviceCallbacks(&scan_callback);
+        pScan->start(duration, false);
+        pScan->setAdvertisedDeviceCallbacks(
+            nullptr);  // Avoid point to local variables after exit.
+    }
+    void ClearAcceptList() override {
+        for (BLEAddress& address : accept_list) {
+            BLEDevice::whiteListRemove(address);
+        }
+        accept_list.clear();
+    }
+    bool AddAcceptList(const uint8_t* pAddress) override {
+        uint16_t capacity = 0;
+        if ((esp_ble_gap_get_whitelist_size(&capacity) != ESP_OK) ||
+            (accept_list.size() >= capacity)) {
+            return false;
+        }
+        esp_bd_addr_t native;
+        memcpy(native, pAddress, sizeof(native));
+        accept_list.push_back(BLEAddress(native));
+        BLEDevice::whiteListAdd(accept_list.back());
+        return true;
+    }
+    bool Connect(const uint8_t* pAddress) override {
+        pService = nullptr;
+        subscription_num = 0;
+        memcpy(peer_address, pAddress, sizeof(peer_address));
+        return pClient->connect(BLEAddress(peer_address));
+    }
+    void RequestFastConnection() override {
+        esp_ble_conn_update_params_t params;
+        memcpy(params.bda, peer_address, sizeof(esp_bd_addr_t));
+        params.min_int = 0x06;  // 7.5 ms in units of 1.25 ms
+        params.max_int = 0x0C;  // 15 ms
+        params.latency = 0;     // connection events
+        params.timeout = 400;   // 4 s in units of 10 ms
+        if (esp_ble_gap_update_conn_params(&params) != ESP_OK) {
+            log_i("Fail to request connection parameters.");
+        }
+        pClient->setMTU(185);
+    }
+    void Disconnect() override {
+        pClient->disconnect();
+        pService = nullptr;
+        subscription_num = 0;
+    }
+    bool DiscoverService(uint16_t uuid) override {
+        pService = pClient->getService(BLEUUID(uuid));
+        return pService != nullptr;
+    }
+    uint8_t GetProperties(uint16_t uuid) override {
+        BLERemoteCharacteristic* pRemoteC = GetCharacteristic(uuid);
+        if (pRemoteC == nullptr) {
+            return 0;
+        }
+        return (pRemoteC->canRead() ? kPropertyRead : 0) |
+               (pRemoteC->canIndicate() ? kPropertyIndicate : 0);
+    }
+    bool Read(uint16_t uuid, std::string& value) override {
+        BLERemoteCharacteristic* pRemoteC = GetCharacteristic(uuid);
+        if (pRemoteC == nullptr) {
+            return false;
+        }
+        value = pRemoteC->readValue();
+        return true;
+    }
+    bool Subscribe(uint16_t uuid, size_t index,
+                   IndicationCallback callback) override {
+        BLERemoteCharacteristic* pRemoteC = GetCharacteristic(uuid);
+        if ((pRemoteC == nullptr) ||
+            (subscription_num >= kMaxSubscriptionNum)) {
+            return false;
+        }
+        indication_callback = callback;
+        subscribed_handles[subscription_num] = pRemoteC->getHandle();
+        subscribed_indexes[subscription_num] = index;
+        ++subscription_num;
+        pRemoteC->registerForNotify(NotificationCallback,
+                                    false);  // Enable indication.
+        return true;
+    }
+
+   private:
+    BLEClient* pClient;
+    BLEScan* pScan;
+    BLERemoteService* pService;
+    esp_bd_addr_t peer_address;
+    std::vector<BLEAddress> accept_list;
+
+    BLERemoteCharacteristic* GetCharacteristic(uint16_t uuid) {
+        if (pService == nullptr) {
+            return nullptr;
+        }
+        return pService->getCharacteristic(BLEUUID(uuid));
+    }
+
+    void FilteredScan(uint32_t duration, uint16_t interval, uint16_t window,
+                      ScanReportCallbacks* pCallbacks) {
+        // Scan interval and window are in units of 0.625 ms.
+        esp_ble_scan_params_t scan_params = {
+            BLE_SCAN_TYPE_PASSIVE,
+            BLE_ADDR_TYPE_PUBLIC,
+            BLE_SCAN_FILTER_ALLOW_ONLY_WLST,
+            static_cast<uint16_t>(interval / 0.625),
+            static_cast<uint16_t>(window / 0.625),
+            BLE_SCAN_DUPLICATE_DISABLE};
+        if (esp_ble_gap_set_scan_params(&scan_params) != ESP_OK) {
+            log_w("Fail to set filtered scan parameters.");
+            return;
+        }
+        xSemaphoreTake(filtered_scan_end, 0);  // Clear the stale signal.
+        pFilteredCallbacks = pCallbacks;
+        is_filtered_stopping = false;
+        is_filtered_scanning = true;
+        if (esp_ble_gap_start_scanning(duration) != ESP_OK) {
+            log_w("Fail to start filtered scan.");
+            is_filtered_scanning = false;
+            pFilteredCallbacks = nullptr;
+            return;
+        }
+        if (xSemaphoreTake(filtered_scan_end,
+                           pdMS_TO_TICKS(1000 * duration + 1000)) != pdTRUE) {
+            // The host task may be in a report until the stop completes.
+            is_filtered_stopping = true;
+            esp_ble_gap_stop_scanning();
+            if (xSemaphoreTake(filtered_scan_end, pdMS_TO_TICKS(1000)) !=
+                pdTRUE) {
+                log_w("Filtered scan does not stop.");
+                is_filtered_scanning = false;
+            }
+        }
+        pFilteredCallbacks = nullptr;
+    }
+};
+
+std::unique_ptr<BLETransport> CreateBLETransport() {
+    return std::unique_ptr<BLETransport>(new BluedroidTransport());
+}
+
+#endif
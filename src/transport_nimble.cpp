@@ -0,0 +1,211 @@
+/**
+ * @file transport_nimble.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief The BLE transport on the NimBLE host of NimBLE-Arduino.
+ */
+#if defined(BLE_NIMBLE)
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+
+#include <algorithm>
+
+#include "recorder.h"
+#include "transport.h"
+
+#if !defined(CONFIG_BT_ENABLED)
+#error Bluetooth is not enabled! Please run `make menuconfig` to and enable it
+#endif
+
+static const size_t kMaxSubscriptionNum = 24;
+
+static uint16_t subscribed_handles[kMaxSubscriptionNum];
+static size_t subscribed_indexes[kMaxSubscriptionNum];
+static size_t subscription_num = 0;
+static IndicationCallback indication_callback = nullptr;
+
+/**
+ * @brief Convert the address to the order of the transport interface.
+ * @details NimBLE keeps the address least significant first.
+ */
+static void GetAddress(const NimBLEAddress& address, uint8_t* pAddress) {
+    const uint8_t* pNative = address.getNative();
+    std::reverse_copy(pNative, pNative + 6, pAddress);
+}
+
+static NimBLEAddress GetNimBLEAddress(const uint8_t* pAddress) {
+    char mac[18];
+    snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x", pAddress[0],
+             pAddress[1], pAddress[2], pAddress[3], pAddress[4], pAddress[5]);
+    return NimBLEAddress(std::string(mac));
+}
+
+/**
+ * @brief Capture the connections of the client.
+ */
+class DefaultClientCallbacks : public NimBLEClientCallbacks {
+   public:
+    void onConnect(NimBLEClient* pClient) override {
+        uint8_t address[6];
+        GetAddress(pClient->getPeerAddress(), address);
+        CaptureConnection(address, true);
+    }
+    void onDisconnect(NimBLEClient* pClient) override {
+        uint8_t address[6];
+        GetAddress(pClient->getPeerAddress(), address);
+        CaptureConnection(address, false);
+    }
+};
+
+/**
+ * @brief Forward the advertised device of NimBLEScan to ScanReportCallbacks.
+ */
+class DefaultAdvertisedDeviceCallbacks
+    : public NimBLEAdvertisedDeviceCallbacks {
+   public:
+    DefaultAdvertisedDeviceCallbacks(ScanReportCallbacks* pCallbacks,
+                                     NimBLEScan* pScan)
+        : pCallbacks(pCallbacks), pScan(pScan) {}
+    void onResult(NimBLEAdvertisedDevice* pAdvertisedDevice) override {
+        uint8_t address[6];
+        GetAddress(pAdvertisedDevice->getAddress(), address);
+        if (pCallbacks->onReport(address, pAdvertisedDevice->getRSSI(),
+                                 pAdvertisedDevice->getPayload(),
+                                 pAdvertisedDevice->getPayloadLength())) {
+            pScan->stop();
+        }
+    }
+
+   private:
+    ScanReportCallbacks* pCallbacks;
+    NimBLEScan* pScan;
+};
+
+static void NotificationCallback(NimBLERemoteCharacteristic* pRemoteC,
+                                 uint8_t* pData, size_t length,
+                                 bool isNotify) {
+    uint16_t handle = pRemoteC->getHandle();
+    for (size_t i = 0; i < subscription_num; ++i) {
+        if (subscribed_handles[i] == handle) {
+            indication_callback(subscribed_indexes[i], pData, length);
+            return;
+        }
+    }
+    log_i("Remote characteristic handle 0x%04x not registered.", handle);
+}
+
+/**
+ * @brief The transport of NimBLE-Arduino.
+ * @details NimBLEScan takes the filter policy, so the filtered scan needs no
+ * custom GAP handler as Bluedroid does.
+ */
+class NimBLETransport : public BLETransport {
+   public:
+    NimBLETransport() : pClient(nullptr), pScan(nullptr), pService(nullptr) {}
+    void Begin(const char* pName) override {
+        NimBLEDevice::init(pName);
+        NimBLEDevice::setMTU(185);
+        pClient = NimBLEDevice::createClient();
+        pClient->setClientCallbacks(new DefaultClientCallbacks());
+        pScan = NimBLEDevice::getScan();
+        pScan->setActiveScan(false);
+        pScan->setMaxResults(0);  // Reported by callbacks, not kept.
+    }
+    void Scan(uint32_t duration, uint16_t interval, uint16_t window,
+              bool is_filtered, ScanReportCallbacks* pCallbacks) override {
+        DefaultAdvertisedDeviceCallbacks scan_callback(pCallbacks, pScan);
+        pScan->setInterval(interval);
+        pScan->setWindow(window);
+        pScan->setFilterPolicy(is_filtered ? BLE_HCI_SCAN_FILT_USE_WL
+                                           : BLE_HCI_SCAN_FILT_NO_WL);
+        pScan->setAdvertisedDeviceCallbacks(&scan_callback);
+        pScan->start(duration, false);
+        pScan->setAdvertisedDeviceCallbacks(
+            nullptr);  // Avoid point to local variables after exit.
+    }
+    void ClearAcceptList() override {
+        // A failed removal leaves the count unchanged, so bound the loop.
+        size_t count = NimBLEDevice::getWhiteListCount();
+        for (size_t i = 0; i < count; ++i) {
+            if (!NimBLEDevice::whiteListRemove(
+                    NimBLEDevice::getWhiteListAddress(0))) {
+                log_w("Fail to clear the accept list.");
+                return;
+            }
+        }
+    }
+    bool AddAcceptList(const uint8_t* pAddress) override {
+        return NimBLEDevice::whiteListAdd(GetNimBLEAddress(pAddress));
+    }
+    bool Connect(const uint8_t* pAddress) override {
+        pService = nullptr;
+        subscription_num = 0;
+        return pClient->connect(GetNimBLEAddress(pAddress));
+    }
+    void RequestFastConnection() override {
+        // 7.5 ms to 15 ms in units of 1.25 ms, 4 s timeout in units of
+        // 10 ms.
+        pClient->updateConnParams(0x06, 0x0C, 0, 400);
+    }
+    void Disconnect() override {
+        pClient->disconnect();
+        pService = nullptr;
+        subscription_num = 0;
+    }
+    bool DiscoverService(uint16_t uuid) override {
+        pService = pClient->getService(NimBLEUUID(uuid));
+        return pService != nullptr;
+    }
+    uint8_t GetProperties(uint16_t uuid) override {
+        NimBLERemoteCharacteristic* pRemoteC = GetCharacteristic(uuid);
+        if (pRemoteC == nullptr) {
+            return 0;
+        }
+        return (pRemoteC->canRead() ? kPropertyRead : 0) |
+               (pRemoteC->canIndicate() ? kPropertyIndicate : 0);
+    }
+    bool Read(uint16_t uuid, std::string& value) override {
+        NimBLERemoteCharacteristic* pRemoteC = GetCharacteristic(uuid);
+        if (pRemoteC == nullptr) {
+            return false;
+        }
+        value = pRemoteC->readValue();
+        return true;
+    }
+    bool Subscribe(uint16_t uuid, size_t index,
+                   IndicationCallback callback) override {
+        NimBLERemoteCharacteristic* pRemoteC = GetCharacteristic(uuid);
+        if ((pRemoteC == nullptr) ||
+            (subscription_num >= kMaxSubscriptionNum)) {
+            return false;
+        }
+        indication_callback = callback;
+        subscribed_handles[subscription_num] = pRemoteC->getHandle();
+        subscribed_indexes[subscription_num] = index;
+        ++subscription_num;
+        // Enable indication, which is confirmed by the host.
+        if (!pRemoteC->subscribe(false, NotificationCallback, true)) {
+            --subscription_num;
+            return false;
+        }
+        return true;
+    }
+
+   private:
+    NimBLEClient* pClient;
+    NimBLEScan* pScan;
+    NimBLERemoteService* pService;
+
+    NimBLERemoteCharacteristic* GetCharacteristic(uint16_t uuid) {
+        if (pService == nullptr) {
+            return nullptr;
+        }
+        return pService->getCharacteristic(NimBLEUUID(uuid));
+    }
+};
+
+std::unique_ptr<BLETransport> CreateBLETransport() {
+    return std::unique_ptr<BLETransport>(new NimBLETransport());
+}
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ * @file Arduino.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the Arduino core used by the portable modules.
+ * @details The clock only moves when a test sets FakeMillis or delays.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_ARDUINO_H_
+#define BLUETOOTHGATEWAY_FAKE_ARDUINO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+inline uint32_t& FakeMillis() {
+    static uint32_t now = 0;
+    return now;
+}
+
+inline uint32_t millis() { return FakeMillis(); }
+
+inline uint32_t micros() { return 1000 * FakeMillis(); }
+
+/**
+ * @brief Wait by moving the clock.
+ */
+inline void delay(uint32_t ms) { FakeMillis() += ms; }
+
+#if defined(__ELF__)
+// Kept in one section, so a test can fill it as after power on.
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_noinit")))
+extern char __start_rtc_noinit[] __attribute__((weak));
+extern char __stop_rtc_noinit[] __attribute__((weak));
+
+/**
+ * @brief Fill the RTC memory kept across resets, as a power on does.
+ */
+inline void FakeRTCPowerOn(uint8_t fill) {
+    if (__start_rtc_noinit != nullptr) {
+        memset(__start_rtc_noinit, fill,
+               __stop_rtc_noinit - __start_rtc_noinit);
+    }
+}
+#else
+#define RTC_NOINIT_ATTR
+
+inline void FakeRTCPowerOn(uint8_t fill) {}
+#endif
+
+/**
+ * @brief The string of the Arduino core.
+ */
+class String {
+   public:
+    String(const char* pText = "") : text(pText) {}
+    const char* c_str() const { return text.c_str(); }
+    size_t length() const { return text.size(); }
+    bool isEmpty() const { return text.empty(); }
+    bool operator==(const char* pText) const { return text == pText; }
+    String operator+(const String& other) const {
+        return String((text + other.text).c_str());
+    }
+
+   private:
+    std::string text;
+};
+
+class IPAddress {
+   public:
+    IPAddress() : address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : address(a | (b << 8) | (c << 16) | (static_cast<uint32_t>(d) << 24)) {
+    }
+    operator uint32_t() const { return address; }
+
+   private:
+    uint32_t address;
+};
+
+/**
+ * @brief The print of the Arduino core into a string.
+ */
+class Print {
+   public:
+    size_t print(const char* pText) { return Write(pText); }
+    size_t println() { return Write("\n"); }
+    template <typename... Args>
+    size_t printf(const char* pFormat, Args... args) {
+        char line[256];
+        snprintf(line, sizeof(line), pFormat, args...);
+        return Write(line);
+    }
+    const std::string& GetOutput() const { return output; }
+
+   private:
+    std::string output;
+    size_t Write(const char* pText) {
+        output += pText;
+        return strlen(pText);
+    }
+};
+
+// The arguments are evaluated as on the device, so they are used.
+template <typename... Args>
+inline void FakeLog(const char* pFormat, Args... args) {}
+
+#define log_e(...) FakeLog(__VA_ARGS__)
+#define log_w(...) FakeLog(__VA_ARGS__)
+#define log_i(...) FakeLog(__VA_ARGS__)
+#define log_d(...) FakeLog(__VA_ARGS__)
+
+#endif
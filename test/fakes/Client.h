@@ -0,0 +1,28 @@
+/**
+ * @file Client.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the network client interface of the Arduino core.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_CLIENT_H_
+#define BLUETOOTHGATEWAY_FAKE_CLIENT_H_
+
+#include <Arduino.h>
+
+class Client {
+   public:
+    virtual ~Client() {}
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char* pHost, uint16_t port) = 0;
+    virtual size_t write(uint8_t byte) = 0;
+    virtual size_t write(const uint8_t* pBuffer, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t* pBuffer, size_t size) = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+    virtual operator bool() = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file Preferences.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the NVS preferences.
+ * @details The values of all namespaces are kept in memory as bytes until
+ * FakePreferencesClear.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_PREFERENCES_H_
+#define BLUETOOTHGATEWAY_FAKE_PREFERENCES_H_
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+inline std::map<std::string, std::string>& FakePreferencesValues() {
+    static std::map<std::string, std::string> values;
+    return values;
+}
+
+inline void FakePreferencesClear() { FakePreferencesValues().clear(); }
+
+class Preferences {
+   public:
+    bool begin(const char* pName, bool is_read_only = false) {
+        name = pName;
+        return true;
+    }
+    bool remove(const char* pKey) {
+        return FakePreferencesValues().erase(GetKey(pKey)) > 0;
+    }
+    uint8_t getUChar(const char* pKey, uint8_t default_value = 0) {
+        return Get(pKey, default_value);
+    }
+    size_t putUChar(const char* pKey, uint8_t value) {
+        return putBytes(pKey, &value, sizeof(value));
+    }
+    uint32_t getUInt(const char* pKey, uint32_t default_value = 0) {
+        return Get(pKey, default_value);
+    }
+    size_t putUInt(const char* pKey, uint32_t value) {
+        return putBytes(pKey, &value, sizeof(value));
+    }
+    String getString(const char* pKey, String default_value = String()) {
+        auto it = FakePreferencesValues().find(GetKey(pKey));
+        return (it == FakePreferencesValues().end())
+                   ? default_value
+                   : String(it->second.c_str());
+    }
+    size_t putString(const char* pKey, const char* pValue) {
+        return putBytes(pKey, pValue, strlen(pValue));
+    }
+    size_t putBytes(const char* pKey, const void* pValue, size_t length) {
+        const char* pBytes = static_cast<const char*>(pValue);
+        FakePreferencesValues()[GetKey(pKey)] =
+            std::string(pBytes, pBytes + length);
+        return length;
+    }
+    size_t getBytesLength(const char* pKey) {
+        auto it = FakePreferencesValues().find(GetKey(pKey));
+        return (it == FakePreferencesValues().end()) ? 0 : it->second.size();
+    }
+    size_t getBytes(const char* pKey, void* pBuffer, size_t size) {
+        size_t length = getBytesLength(pKey);
+        if ((length == 0) || (length > size)) {
+            return 0;
+        }
+        memcpy(pBuffer, FakePreferencesValues()[GetKey(pKey)].data(), length);
+        return length;
+    }
+
+   private:
+    std::string name;
+    std::string GetKey(const char* pKey) const { return name + "." + pKey; }
+    template <typename T>
+    T Get(const char* pKey, T default_value) {
+        T value = default_value;
+        if (getBytesLength(pKey) == sizeof(value)) {
+            getBytes(pKey, &value, sizeof(value));
+        }
+        return value;
+    }
+};
+
+#endif
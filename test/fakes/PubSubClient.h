@@ -0,0 +1,86 @@
+/**
+ * @file PubSubClient.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of PubSubClient which records the published messages.
+ * @details The messages published with QoS 0 are recorded instead of being
+ * written to the network client. The network client is only connected,
+ * and loop reads one packet from it as PubSubClient does.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_PUBSUBCLIENT_H_
+#define BLUETOOTHGATEWAY_FAKE_PUBSUBCLIENT_H_
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <string>
+#include <vector>
+
+#define MQTT_KEEPALIVE 15
+
+struct FakeMQTTMessage {
+    std::string topic;
+    std::string payload;
+};
+
+class PubSubClient {
+   public:
+    PubSubClient() : pClient(nullptr) {}
+    explicit PubSubClient(Client& client) : pClient(&client) {}
+    bool connect(const char* pID) {
+        is_connected = is_reachable &&
+                       ((pClient == nullptr) || (pClient->connect("", 0) > 0));
+        connect_num += is_connected ? 1 : 0;
+        return is_connected;
+    }
+    bool connect(const char* pID, const char* pUser, const char* pPassword) {
+        return connect(pID);
+    }
+    void disconnect() { is_connected = false; }
+    bool connected() { return is_connected; }
+    bool publish(const char* pTopic, const char* pPayload) {
+        return publish(pTopic, reinterpret_cast<const uint8_t*>(pPayload),
+                       strlen(pPayload));
+    }
+    bool publish(const char* pTopic, const uint8_t* pPayload,
+                 unsigned int length) {
+        if (!is_connected) {
+            return false;
+        }
+        messages.push_back({pTopic, std::string(pPayload, pPayload + length)});
+        return true;
+    }
+    bool subscribe(const char* pTopic) {
+        subscriptions.push_back(pTopic);
+        return is_connected;
+    }
+    bool loop() {
+        if (!is_connected || (pClient == nullptr) ||
+            (pClient->available() == 0)) {
+            return is_connected;
+        }
+        pClient->read();
+        size_t length = 0;
+        size_t multiplier = 1;
+        int byte = 0;
+        do {
+            byte = pClient->read();
+            length += (byte & 0x7F) * multiplier;
+            multiplier *= 128;
+        } while ((byte >= 0) && (byte & 0x80));
+        for (size_t i = 0; i < length; ++i) {
+            pClient->read();
+        }
+        return is_connected;
+    }
+
+    bool is_reachable = true;
+    bool is_connected = false;
+    size_t connect_num = 0;
+    std::vector<FakeMQTTMessage> messages;
+    std::vector<std::string> subscriptions;
+
+   private:
+    Client* pClient;
+};
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file Stream.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the input stream of the Arduino core.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_STREAM_H_
+#define BLUETOOTHGATEWAY_FAKE_STREAM_H_
+
+#include <Arduino.h>
+
+class Stream : public Print {
+   public:
+    virtual ~Stream() {}
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+};
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file WiFi.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the WiFi station, connected unless a test says not.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_WIFI_H_
+#define BLUETOOTHGATEWAY_FAKE_WIFI_H_
+
+#include <Arduino.h>
+
+class WiFiClass {
+   public:
+    bool isConnected() { return is_connected; }
+
+    bool is_connected = true;
+};
+
+#endif
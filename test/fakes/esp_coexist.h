@@ -0,0 +1,21 @@
+/**
+ * @file esp_coexist.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the coexistence preference of the radio.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_ESP_COEXIST_H_
+#define BLUETOOTHGATEWAY_FAKE_ESP_COEXIST_H_
+
+typedef int esp_err_t;
+
+typedef enum {
+    ESP_COEX_PREFER_WIFI,
+    ESP_COEX_PREFER_BT,
+    ESP_COEX_PREFER_BALANCE,
+} esp_coex_prefer_t;
+
+inline esp_err_t esp_coex_preference_set(esp_coex_prefer_t preference) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ * @file esp_partition.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the partition API over a NOR flash in RAM.
+ * @details Erasing sets the bytes to 0xFF and writing can only clear bits,
+ * as on the chip. FakeFlash resizes and erases the whole partition.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_ESP_PARTITION_H_
+#define BLUETOOTHGATEWAY_FAKE_ESP_PARTITION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+typedef enum {
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+} esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+} esp_partition_t;
+
+struct FakeFlashState {
+    esp_partition_t partition;
+    std::vector<uint8_t> data;
+    uint32_t erase_num;
+    uint32_t write_num;
+};
+
+inline FakeFlashState& GetFakeFlash() {
+    static FakeFlashState state = {
+        {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0, 0},
+        std::vector<uint8_t>(),
+        0,
+        0};
+    return state;
+}
+
+/**
+ * @brief Erase the fake partition with the size, 0 to remove it.
+ */
+inline void FakeFlash(uint32_t size) {
+    FakeFlashState& state = GetFakeFlash();
+    state.partition.size = size;
+    state.data.assign(size, 0xFF);
+    state.erase_num = 0;
+    state.write_num = 0;
+}
+
+inline const esp_partition_t* esp_partition_find_first(
+    esp_partition_type_t type, esp_partition_subtype_t subtype,
+    const char* label) {
+    FakeFlashState& state = GetFakeFlash();
+    return (state.partition.size > 0) && (type == state.partition.type) &&
+                   (subtype == state.partition.subtype)
+               ? &state.partition
+               : nullptr;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t* partition,
+                                    size_t src_offset, void* dst,
+                                    size_t size) {
+    FakeFlashState& state = GetFakeFlash();
+    if (src_offset + size > state.data.size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, state.data.data() + src_offset, size);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t* partition,
+                                     size_t dst_offset, const void* src,
+                                     size_t size) {
+    FakeFlashState& state = GetFakeFlash();
+    if (dst_offset + size > state.data.size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t* pSource = static_cast<const uint8_t*>(src);
+    for (size_t i = 0; i < size; ++i) {
+        state.data[dst_offset + i] &= pSource[i];
+    }
+    ++state.write_num;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                           size_t offset, size_t size) {
+    FakeFlashState& state = GetFakeFlash();
+    if ((offset % 4096 != 0) || (size % 4096 != 0) ||
+        (offset + size > state.data.size())) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(state.data.data() + offset, 0xFF, size);
+    ++state.erase_num;
+    return ESP_OK;
+}
+
+#endif
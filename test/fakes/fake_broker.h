@@ -0,0 +1,124 @@
+/**
+ * @file fake_broker.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of a network client connected to a local MQTT broker.
+ * @details The broker answers each QoS 1 PUBLISH written to it with a
+ * PUBACK to read back, and keeps the published messages. Every
+ * ack_loss_period-th PUBACK is lost, so the sender has to send again, and
+ * each PUBLISH takes publish_latency of the fake clock. Its memory is not
+ * counted as the heap of the gateway.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_BROKER_H_
+#define BLUETOOTHGATEWAY_FAKE_BROKER_H_
+
+#include <Client.h>
+#include <PubSubClient.h>
+#include <fake_heap.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+class FakeBrokerClient : public Client {
+   public:
+    int connect(IPAddress ip, uint16_t port) override {
+        return connect("", port);
+    }
+    int connect(const char* pHost, uint16_t port) override {
+        is_connected = is_reachable;
+        ScopedFakeHeapPause pause;
+        inbound.clear();
+        outbound.clear();
+        return is_connected ? 1 : 0;
+    }
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
+    size_t write(const uint8_t* pBuffer, size_t size) override {
+        if (!is_connected) {
+            return 0;
+        }
+        ScopedFakeHeapPause pause;
+        inbound.append(reinterpret_cast<const char*>(pBuffer), size);
+        while (ParsePacket()) {
+        }
+        return size;
+    }
+    int available() override { return outbound.size(); }
+    int read() override {
+        if (outbound.empty()) {
+            return -1;
+        }
+        uint8_t byte = outbound.front();
+        outbound.pop_front();
+        return byte;
+    }
+    int read(uint8_t* pBuffer, size_t size) override {
+        size_t length = 0;
+        while ((length < size) && !outbound.empty()) {
+            pBuffer[length++] = read();
+        }
+        return length;
+    }
+    int peek() override { return outbound.empty() ? -1 : outbound.front(); }
+    void flush() override {}
+    void stop() override { is_connected = false; }
+    uint8_t connected() override { return is_connected ? 1 : 0; }
+    operator bool() override { return is_connected; }
+
+    bool is_reachable = true;
+    size_t ack_loss_period = 0;
+    uint32_t publish_latency = 0;  // milliseconds
+    size_t publish_num = 0;
+    size_t duplicate_num = 0;
+    std::vector<FakeMQTTMessage> messages;
+
+   private:
+    bool is_connected = false;
+    std::string inbound;
+    std::deque<uint8_t> outbound;
+
+    /**
+     * @brief Handle the first complete packet written.
+     */
+    bool ParsePacket() {
+        size_t index = 1;
+        size_t length = 0;
+        size_t multiplier = 1;
+        while (true) {
+            if (index >= inbound.size()) {
+                return false;
+            }
+            uint8_t byte = inbound[index++];
+            length += (byte & 0x7F) * multiplier;
+            multiplier *= 128;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        if (inbound.size() < index + length) {
+            return false;
+        }
+        uint8_t header = inbound[0];
+        if ((header & 0xF6) == 0x32) {  // PUBLISH with QoS 1
+            size_t topic_length = (static_cast<uint8_t>(inbound[index]) << 8) |
+                                  static_cast<uint8_t>(inbound[index + 1]);
+            size_t id_index = index + 2 + topic_length;
+            delay(publish_latency);
+            ++publish_num;
+            duplicate_num += (header & 0x08) ? 1 : 0;
+            messages.push_back(
+                {inbound.substr(index + 2, topic_length),
+                 inbound.substr(id_index + 2, index + length - id_index - 2)});
+            if ((ack_loss_period == 0) ||
+                (publish_num % ack_loss_period != 0)) {
+                const uint8_t ack[4] = {
+                    0x40, 0x02, static_cast<uint8_t>(inbound[id_index]),
+                    static_cast<uint8_t>(inbound[id_index + 1])};
+                outbound.insert(outbound.end(), ack, ack + sizeof(ack));
+            }
+        }
+        inbound.erase(0, index + length);
+        return true;
+    }
+};
+
+#endif
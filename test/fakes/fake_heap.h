@@ -0,0 +1,106 @@
+/**
+ * @file fake_heap.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Count the heap use of a host test by replacing operator new.
+ * @details Include it in one file of a test only, since it defines the
+ * global operator new and delete. The allocations in a ScopedFakeHeapPause
+ * are not counted, such as those of a fake broker.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_HEAP_H_
+#define BLUETOOTHGATEWAY_FAKE_HEAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <new>
+
+struct FakeHeapStatistics {
+    size_t allocation_num;
+    size_t allocated_size;  // bytes of all allocations
+    size_t used_size;       // bytes in use
+    size_t peak_size;       // most bytes in use
+};
+
+inline FakeHeapStatistics& GetFakeHeapStatistics() {
+    static FakeHeapStatistics statistics = {0, 0, 0, 0};
+    return statistics;
+}
+
+inline int& FakeHeapPauseDepth() {
+    static int depth = 0;
+    return depth;
+}
+
+class ScopedFakeHeapPause {
+   public:
+    ScopedFakeHeapPause() { ++FakeHeapPauseDepth(); }
+    ~ScopedFakeHeapPause() { --FakeHeapPauseDepth(); }
+};
+
+/**
+ * @brief Restart the peak from the bytes in use.
+ */
+inline void ResetFakeHeapPeak() {
+    GetFakeHeapStatistics().peak_size = GetFakeHeapStatistics().used_size;
+}
+
+// The counted size is kept in front of each block.
+static const size_t kFakeHeapHeaderSize = alignof(max_align_t);
+
+void* operator new(size_t size) {
+    uint8_t* pBlock =
+        static_cast<uint8_t*>(malloc(size + kFakeHeapHeaderSize));
+    if (pBlock == nullptr) {
+        throw std::bad_alloc();
+    }
+    if (FakeHeapPauseDepth() > 0) {
+        *reinterpret_cast<size_t*>(pBlock) = 0;
+        return pBlock + kFakeHeapHeaderSize;
+    }
+    *reinterpret_cast<size_t*>(pBlock) = size;
+    FakeHeapStatistics& statistics = GetFakeHeapStatistics();
+    ++statistics.allocation_num;
+    statistics.allocated_size += size;
+    statistics.used_size += size;
+    if (statistics.used_size > statistics.peak_size) {
+        statistics.peak_size = statistics.used_size;
+    }
+    return pBlock + kFakeHeapHeaderSize;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+// Not inlined, so the compiler does not pair malloc with operator delete.
+__attribute__((noinline)) void operator delete(void* pMemory) noexcept {
+    if (pMemory == nullptr) {
+        return;
+    }
+    uint8_t* pBlock = static_cast<uint8_t*>(pMemory) - kFakeHeapHeaderSize;
+    GetFakeHeapStatistics().used_size -= *reinterpret_cast<size_t*>(pBlock);
+    free(pBlock);
+}
+
+void operator delete[](void* pMemory) noexcept { operator delete(pMemory); }
+
+void operator delete(void* pMemory, size_t size) noexcept {
+    operator delete(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t size) noexcept {
+    operator delete(pMemory);
+}
+
+#endif
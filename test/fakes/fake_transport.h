@@ -0,0 +1,153 @@
+/**
+ * @file fake_transport.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the BLE host stack with scripted devices.
+ * @details A scan reports the advertisements in order, dropping those
+ * outside the accept list if filtered, like the controller. The GATT
+ * values are those of the connected device, which indicates the value of
+ * a characteristic indication_num times as soon as it is subscribed.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_TRANSPORT_H_
+#define BLUETOOTHGATEWAY_FAKE_TRANSPORT_H_
+
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "transport.h"
+
+struct FakeAdvertisement {
+    uint8_t address[6];
+    int rssi;
+    std::vector<uint8_t> payload;
+};
+
+struct FakeCharacteristic {
+    uint8_t properties;
+    std::string value;
+};
+
+struct FakePeripheral {
+    uint8_t address[6];
+    uint16_t service_uuid;
+    std::map<uint16_t, FakeCharacteristic> characteristics;
+};
+
+class FakeTransport : public BLETransport {
+   public:
+    explicit FakeTransport(size_t accept_list_capacity = 8)
+        : accept_list_capacity(accept_list_capacity) {}
+    void Begin(const char* pName) override {}
+    void Scan(uint32_t duration, uint16_t interval, uint16_t window,
+              bool is_filtered, ScanReportCallbacks* pCallbacks) override {
+        ++scan_num;
+        last_is_filtered = is_filtered;
+        for (const FakeAdvertisement& advertisement : advertisements) {
+            if (is_filtered && !IsAccepted(advertisement.address)) {
+                continue;
+            }
+            ++report_num;
+            if (pCallbacks->onReport(advertisement.address,
+                                     advertisement.rssi,
+                                     advertisement.payload.data(),
+                                     advertisement.payload.size())) {
+                return;
+            }
+        }
+    }
+    void ClearAcceptList() override { accept_list.clear(); }
+    bool AddAcceptList(const uint8_t* pAddress) override {
+        if (accept_list.size() >= accept_list_capacity) {
+            return false;
+        }
+        accept_list.push_back(std::string(pAddress, pAddress + 6));
+        return true;
+    }
+    bool Connect(const uint8_t* pAddress) override {
+        ++connect_num;
+        pConnected = nullptr;
+        pService = nullptr;
+        for (FakePeripheral& peripheral : peripherals) {
+            if (memcmp(peripheral.address, pAddress, 6) == 0) {
+                pConnected = &peripheral;
+            }
+        }
+        return pConnected != nullptr;
+    }
+    void RequestFastConnection() override {}
+    void Disconnect() override {
+        pConnected = nullptr;
+        pService = nullptr;
+    }
+    bool DiscoverService(uint16_t uuid) override {
+        pService = ((pConnected != nullptr) &&
+                    (pConnected->service_uuid == uuid))
+                       ? pConnected
+                       : nullptr;
+        return pService != nullptr;
+    }
+    uint8_t GetProperties(uint16_t uuid) override {
+        FakeCharacteristic* pCharacteristic = Find(uuid);
+        return (pCharacteristic == nullptr) ? 0
+                                            : pCharacteristic->properties;
+    }
+    bool Read(uint16_t uuid, std::string& value) override {
+        FakeCharacteristic* pCharacteristic = Find(uuid);
+        if (pCharacteristic == nullptr) {
+            return false;
+        }
+        value = pCharacteristic->value;
+        return true;
+    }
+    bool Subscribe(uint16_t uuid, size_t index,
+                   IndicationCallback callback) override {
+        if (Find(uuid) == nullptr) {
+            return false;
+        }
+        const std::string& value = Find(uuid)->value;
+        for (size_t i = 0; i < indication_num; ++i) {
+            callback(index, reinterpret_cast<const uint8_t*>(value.data()),
+                     value.size());
+        }
+        ++subscription_num;
+        return true;
+    }
+    size_t GetAcceptListSize() const { return accept_list.size(); }
+
+    std::vector<FakeAdvertisement> advertisements;
+    std::vector<FakePeripheral> peripherals;
+    size_t scan_num = 0;
+    size_t report_num = 0;
+    size_t connect_num = 0;
+    size_t subscription_num = 0;
+    size_t indication_num = 1;
+    bool last_is_filtered = false;
+
+   private:
+    size_t accept_list_capacity;
+    std::vector<std::string> accept_list;
+    FakePeripheral* pConnected = nullptr;
+    FakePeripheral* pService = nullptr;
+
+    bool IsAccepted(const uint8_t* pAddress) const {
+        std::string address(pAddress, pAddress + 6);
+        for (const std::string& accepted : accept_list) {
+            if (accepted == address) {
+                return true;
+            }
+        }
+        return false;
+    }
+    FakeCharacteristic* Find(uint16_t uuid) {
+        if (pService == nullptr) {
+            return nullptr;
+        }
+        auto it = pService->characteristics.find(uuid);
+        return (it == pService->characteristics.end()) ? nullptr
+                                                       : &it->second;
+    }
+};
+
+#endif
@@ -0,0 +1,16 @@
+/**
+ * @file FreeRTOS.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Host fake of the FreeRTOS critical sections.
+ * @details The tests run in one thread, so the sections do nothing.
+ */
+#ifndef BLUETOOTHGATEWAY_FAKE_FREERTOS_H_
+#define BLUETOOTHGATEWAY_FAKE_FREERTOS_H_
+
+typedef int portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(pMux) ((void)(pMux))
+#define portEXIT_CRITICAL(pMux) ((void)(pMux))
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @file secrets.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief The secrets of the host tests, which connect without credentials.
+ */
+#ifndef BLUETOOTHGATEWAY_SECRETS_H_
+#define BLUETOOTHGATEWAY_SECRETS_H_
+
+#define WIFI_SSID ""
+#define WIFI_PASSWORD ""
+#define MQTT_IP ""
+#define MQTT_DOMAIN ""
+#define MQTT_USER ""
+#define MQTT_PASSWORD ""
+#define MQTT_CLIENT_ID "gw"
+
+#endif
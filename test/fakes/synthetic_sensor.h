@@ -0,0 +1,101 @@
+/**
+ * @file synthetic_sensor.h
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief A virtual sensor for load tests on host.
+ */
+#ifndef BLUETOOTHGATEWAY_SYNTHETIC_SENSOR_H_
+#define BLUETOOTHGATEWAY_SYNTHETIC_SENSOR_H_
+
+#include <Arduino.h>
+
+#include <algorithm>
+
+#include "characteristic.h"
+#include "device.h"
+
+/**
+ * @brief The behaviour of a synthetic sensor.
+ */
+struct SyntheticSensorProfile {
+    uint32_t latency;         // milliseconds of each update
+    uint8_t dropout_percent;  // chance of a missed update
+    float drift;              // maximum change of the values per update
+};
+
+constexpr const CharacteristicDescriptor*
+    kSyntheticSensorCharacteristics[] = {&kTemperatureCharacteristic,
+                                         &kHumidityCharacteristic,
+                                         &kBatteryLevelCharacteristic};
+
+constexpr DeviceDescriptor kSyntheticSensorDescriptor = {
+    "synthetic_sensor", 0, kSyntheticSensorCharacteristics,
+    sizeof(kSyntheticSensorCharacteristics) /
+        sizeof(kSyntheticSensorCharacteristics[0]),
+    GattAcquisition::Indication};
+static_assert(kSyntheticSensorDescriptor.characteristic_num <=
+                  SensorDevice::kMaxCharacteristicNum,
+              "Too many characteristics of kSyntheticSensorDescriptor.");
+
+/**
+ * @brief A sensor without radio.
+ * @details The values drift randomly from a seed of the address, so the
+ * same fleet is generated in each run. Update waits the latency on the fake
+ * clock as a GATT read does.
+ */
+class SyntheticSensor : public SensorDevice {
+   public:
+    SyntheticSensor(const DeviceAddress& address,
+                    const SyntheticSensorProfile& profile)
+        : SensorDevice(address, kSyntheticSensorDescriptor),
+          profile(profile) {
+        const uint8_t* pAddress = this->address.GetNative();
+        random_state = (pAddress[2] << 24) | (pAddress[3] << 16) |
+                       (pAddress[4] << 8) | pAddress[5];
+        random_state = (random_state == 0) ? 1 : random_state;
+        values[0] = 20.0F + NextRandom() % 10;  // temperature
+        values[1] = 40.0F + NextRandom() % 30;  // humidity
+        values[2] = 100.0F;                     // battery
+    }
+
+    void Update(BLETransport& transport) override {
+        delay(profile.latency);
+        if (NextRandom() % 100 < profile.dropout_percent) {
+            return;
+        }
+        for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+            // Uniform in [-drift, drift].
+            int permille = static_cast<int>(NextRandom() % 2001) - 1000;
+            float value = values[i] + permille / 1000.0F * profile.drift;
+            if (i > 0) {
+                value = std::min(100.0F, std::max(0.0F, value));  // Percent.
+            }
+            SetValue(i, value);
+            is_provided[i] = true;
+        }
+    }
+
+    bool IsUpdated() const {
+        for (size_t i = 0; i < descriptor.characteristic_num; ++i) {
+            if (is_updated[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+   private:
+    SyntheticSensorProfile profile;
+    uint32_t random_state;
+
+    /**
+     * @brief Xorshift32 pseudo random number.
+     */
+    uint32_t NextRandom() {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return random_state;
+    }
+};
+
+#endif
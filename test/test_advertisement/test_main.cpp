@@ -0,0 +1,276 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the advertisement decoders.
+ */
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+#include "advertisement.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+const size_t kMaxSampleNum = 8;
+
+void test_atc1441(void) {
+    // MAC + 23.0 °C + 50 % + 85 % + 3000 mV + frame counter
+    const uint8_t data[] = {0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56, 0x00,
+                            0xE6, 0x32, 0x55, 0x0B, 0xB8, 0x01};
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(4, DecodeATC(data, sizeof(data), samples,
+                                   kMaxSampleNum));
+    TEST_ASSERT_TRUE(samples[0].pCharacteristic ==
+                     &kTemperatureCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 23.0, samples[0].value);
+    TEST_ASSERT_TRUE(samples[1].pCharacteristic == &kHumidityCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 50.0, samples[1].value);
+    TEST_ASSERT_TRUE(samples[2].pCharacteristic ==
+                     &kBatteryLevelCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 85.0, samples[2].value);
+    TEST_ASSERT_TRUE(samples[3].pCharacteristic == &kVoltageCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 3.0, samples[3].value);
+}
+
+void test_atc1441_negative_temperature(void) {
+    const uint8_t data[] = {0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56, 0xFF,
+                            0x9C, 0x32, 0x55, 0x0B, 0xB8, 0x01};
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(4, DecodeATC(data, sizeof(data), samples,
+                                   kMaxSampleNum));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, -10.0, samples[0].value);
+}
+
+void test_pvvx(void) {
+    // MAC + 23.00 °C + 50.00 % + 2950 mV + 80 % + frame counter + flags
+    const uint8_t data[] = {0x56, 0x34, 0x12, 0x38, 0xC1, 0xA4, 0xFC, 0x08,
+                            0x88, 0x13, 0x86, 0x0B, 0x50, 0x01, 0x04};
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(4, DecodeATC(data, sizeof(data), samples,
+                                   kMaxSampleNum));
+    TEST_ASSERT_TRUE(samples[0].pCharacteristic ==
+                     &kTemperatureCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 23.0, samples[0].value);
+    TEST_ASSERT_TRUE(samples[1].pCharacteristic == &kHumidityCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 50.0, samples[1].value);
+    TEST_ASSERT_TRUE(samples[2].pCharacteristic == &kVoltageCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 2.95, samples[2].value);
+    TEST_ASSERT_TRUE(samples[3].pCharacteristic ==
+                     &kBatteryLevelCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 80.0, samples[3].value);
+}
+
+void test_atc_other_length(void) {
+    const uint8_t data[14] = {0};
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(0, DecodeATC(data, sizeof(data), samples,
+                                   kMaxSampleNum));
+    TEST_ASSERT_EQUAL(0, DecodeATC(data, 0, samples, kMaxSampleNum));
+}
+
+void test_bthome(void) {
+    // The example of bthome.io with a battery level: 25.06 °C + 50.55 %
+    // + 97 %.
+    const uint8_t data[] = {0x40, 0x02, 0xCA, 0x09, 0x03,
+                            0xBF, 0x13, 0x01, 0x61};
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(3, DecodeBTHome(data, sizeof(data), samples,
+                                      kMaxSampleNum));
+    TEST_ASSERT_TRUE(samples[0].pCharacteristic ==
+                     &kTemperatureCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 25.06, samples[0].value);
+    TEST_ASSERT_TRUE(samples[1].pCharacteristic == &kHumidityCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 50.55, samples[1].value);
+    TEST_ASSERT_TRUE(samples[2].pCharacteristic ==
+                     &kBatteryLevelCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 97.0, samples[2].value);
+}
+
+void test_bthome_objects(void) {
+    // Packet id 0x00, energy 0x0A (skipped), text 0x53 "ABC" (skipped),
+    // pressure 1008.00 hPa, CO2 1250 ppm, temperature 0x45 -2.5 °C and
+    // rainfall 12.3 mm.
+    const uint8_t data[] = {0x40, 0x00, 0x07, 0x0A, 0x01, 0x02, 0x03,
+                            0x53, 0x03, 0x41, 0x42, 0x43, 0x04, 0xC0,
+                            0x89, 0x01, 0x12, 0xE2, 0x04, 0x45, 0xE7,
+                            0xFF, 0x5F, 0x7B, 0x00};
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(4, DecodeBTHome(data, sizeof(data), samples,
+                                      kMaxSampleNum));
+    TEST_ASSERT_TRUE(samples[0].pCharacteristic == &kPressureCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-2, 1008.0, samples[0].value);
+    TEST_ASSERT_TRUE(samples[1].pCharacteristic ==
+                     &kCO2ConcentrationCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 1250.0, samples[1].value);
+    TEST_ASSERT_TRUE(samples[2].pCharacteristic ==
+                     &kTemperatureCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, -2.5, samples[2].value);
+    TEST_ASSERT_TRUE(samples[3].pCharacteristic == &kRainfallCharacteristic);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 12.3, samples[3].value);
+}
+
+void test_bthome_rejected(void) {
+    AdvertisementSample samples[kMaxSampleNum];
+    const uint8_t encrypted[] = {0x41, 0x02, 0xCA, 0x09};
+    TEST_ASSERT_EQUAL(0, DecodeBTHome(encrypted, sizeof(encrypted), samples,
+                                      kMaxSampleNum));
+    const uint8_t version1[] = {0x20, 0x02, 0xCA, 0x09};
+    TEST_ASSERT_EQUAL(0, DecodeBTHome(version1, sizeof(version1), samples,
+                                      kMaxSampleNum));
+    TEST_ASSERT_EQUAL(0, DecodeBTHome(encrypted, 0, samples, kMaxSampleNum));
+}
+
+void test_bthome_stops(void) {
+    AdvertisementSample samples[kMaxSampleNum];
+    // The unknown object 0xF0 hides the size of the rest.
+    const uint8_t unknown[] = {0x40, 0x02, 0xCA, 0x09,
+                               0xF0, 0x01, 0x01, 0x61};
+    TEST_ASSERT_EQUAL(1, DecodeBTHome(unknown, sizeof(unknown), samples,
+                                      kMaxSampleNum));
+    // The humidity is truncated.
+    const uint8_t truncated[] = {0x40, 0x02, 0xCA, 0x09, 0x03, 0xBF};
+    TEST_ASSERT_EQUAL(1, DecodeBTHome(truncated, sizeof(truncated), samples,
+                                      kMaxSampleNum));
+    // The length of the text runs past the end.
+    const uint8_t text[] = {0x40, 0x53, 0x09, 0x41, 0x01, 0x61};
+    TEST_ASSERT_EQUAL(0, DecodeBTHome(text, sizeof(text), samples,
+                                      kMaxSampleNum));
+}
+
+void test_find_format(void) {
+    const AdvertisementFormat* pFormat =
+        FindAdvertisementFormat(AdvertisementDataType::ServiceData, 0xFCD2);
+    TEST_ASSERT_NOT_NULL(pFormat);
+    TEST_ASSERT_EQUAL_STRING("bthome", pFormat->name);
+    pFormat =
+        FindAdvertisementFormat(AdvertisementDataType::ServiceData, 0x181A);
+    TEST_ASSERT_NOT_NULL(pFormat);
+    TEST_ASSERT_EQUAL_STRING("atc", pFormat->name);
+    TEST_ASSERT_NULL(FindAdvertisementFormat(
+        AdvertisementDataType::ManufacturerData, 0xFCD2));
+    TEST_ASSERT_NULL(
+        FindAdvertisementFormat(AdvertisementDataType::ServiceData, 0x180F));
+}
+
+/**
+ * @brief Flags, an unsupported manufacturer data, BTHome service data and
+ * a complete local name.
+ */
+const uint8_t kBTHomePayload[] = {
+    0x02, 0x01, 0x06, 0x05, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0x0C, 0x16,
+    0xD2, 0xFC, 0x40, 0x02, 0xCA, 0x09, 0x03, 0xBF, 0x13, 0x01, 0x61,
+    0x05, 0x09, 0x42, 0x54, 0x48, 0x31};
+
+/**
+ * @brief Flags and pvvx service data.
+ */
+const uint8_t kPvvxPayload[] = {
+    0x02, 0x01, 0x06, 0x12, 0x16, 0x1A, 0x18, 0x56, 0x34, 0x12,
+    0x38, 0xC1, 0xA4, 0xFC, 0x08, 0x88, 0x13, 0x86, 0x0B, 0x50,
+    0x01, 0x04};
+
+/**
+ * @brief An iBeacon, which carries no sensor data.
+ */
+const uint8_t kBeaconPayload[] = {
+    0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2,
+    0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0,
+    0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5};
+
+void test_payload(void) {
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(3, DecodeAdvertisingPayload(kBTHomePayload,
+                                                  sizeof(kBTHomePayload),
+                                                  samples, kMaxSampleNum));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 25.06, samples[0].value);
+    TEST_ASSERT_EQUAL(4, DecodeAdvertisingPayload(kPvvxPayload,
+                                                  sizeof(kPvvxPayload),
+                                                  samples, kMaxSampleNum));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 23.0, samples[0].value);
+    TEST_ASSERT_EQUAL(0, DecodeAdvertisingPayload(kBeaconPayload,
+                                                  sizeof(kBeaconPayload),
+                                                  samples, kMaxSampleNum));
+}
+
+void test_payload_capacity(void) {
+    AdvertisementSample samples[kMaxSampleNum];
+    TEST_ASSERT_EQUAL(2, DecodeAdvertisingPayload(kBTHomePayload,
+                                                  sizeof(kBTHomePayload),
+                                                  samples, 2));
+    TEST_ASSERT_EQUAL(0, DecodeAdvertisingPayload(kPvvxPayload,
+                                                  sizeof(kPvvxPayload),
+                                                  samples, 0));
+}
+
+void test_payload_malformed(void) {
+    AdvertisementSample samples[kMaxSampleNum];
+    // The service data runs past the end of the payload.
+    TEST_ASSERT_EQUAL(0, DecodeAdvertisingPayload(kBTHomePayload, 20,
+                                                  samples, kMaxSampleNum));
+    // A zero length ends the payload.
+    const uint8_t padded[] = {0x02, 0x01, 0x06, 0x00, 0x00, 0x00};
+    TEST_ASSERT_EQUAL(0, DecodeAdvertisingPayload(padded, sizeof(padded),
+                                                  samples, kMaxSampleNum));
+    // The service data has no UUID.
+    const uint8_t no_uuid[] = {0x02, 0x16, 0xD2};
+    TEST_ASSERT_EQUAL(0, DecodeAdvertisingPayload(no_uuid, sizeof(no_uuid),
+                                                  samples, kMaxSampleNum));
+}
+
+/**
+ * @brief Decode a recorded stream where most advertisements carry no sensor
+ * data, as in a busy scan.
+ */
+void test_benchmark_payload_stream(void) {
+    struct Payload {
+        const uint8_t* pData;
+        size_t length;
+    };
+    const Payload stream[] = {
+        {kBeaconPayload, sizeof(kBeaconPayload)},
+        {kBTHomePayload, sizeof(kBTHomePayload)},
+        {kBeaconPayload, sizeof(kBeaconPayload)},
+        {kPvvxPayload, sizeof(kPvvxPayload)},
+    };
+    const size_t stream_length = sizeof(stream) / sizeof(stream[0]);
+    const size_t repeat_num = 500000;
+    AdvertisementSample samples[kMaxSampleNum];
+    size_t sample_num = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat_num; ++i) {
+        for (const Payload& payload : stream) {
+            sample_num += DecodeAdvertisingPayload(
+                payload.pData, payload.length, samples, kMaxSampleNum);
+        }
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    TEST_ASSERT_EQUAL(7 * repeat_num, sample_num);
+    char message[96];
+    snprintf(message, sizeof(message),
+             "%.1f ns per advertisement, %.1f ns per sample",
+             elapsed / (stream_length * repeat_num), elapsed / sample_num);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_atc1441);
+    RUN_TEST(test_atc1441_negative_temperature);
+    RUN_TEST(test_pvvx);
+    RUN_TEST(test_atc_other_length);
+    RUN_TEST(test_bthome);
+    RUN_TEST(test_bthome_objects);
+    RUN_TEST(test_bthome_rejected);
+    RUN_TEST(test_bthome_stops);
+    RUN_TEST(test_find_format);
+    RUN_TEST(test_payload);
+    RUN_TEST(test_payload_capacity);
+    RUN_TEST(test_payload_malformed);
+    RUN_TEST(test_benchmark_payload_stream);
+    return UNITY_END();
+}
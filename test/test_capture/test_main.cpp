@@ -0,0 +1,266 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the capture format, its replay and the decoding pipeline.
+ */
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "capture.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+const uint8_t kSensor[6] = {0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56};
+const uint8_t kOther[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+/**
+ * @brief Flags and pvvx service data with four samples.
+ */
+const uint8_t kPvvxPayload[] = {
+    0x02, 0x01, 0x06, 0x12, 0x16, 0x1A, 0x18, 0x56, 0x34, 0x12,
+    0x38, 0xC1, 0xA4, 0xFC, 0x08, 0x88, 0x13, 0x86, 0x0B, 0x50,
+    0x01, 0x04};
+
+/**
+ * @brief 23.45 °C of the Temperature characteristic.
+ */
+const uint8_t kTemperatureValue[] = {0x29, 0x09};
+
+/**
+ * @brief Keep the replayed records.
+ */
+class RecordingCallbacks : public CaptureReplayCallbacks {
+   public:
+    std::vector<std::string> records;
+    void onAdvertisement(uint32_t time, const uint8_t* pAddress, int rssi,
+                         const uint8_t* pPayload, size_t length) override {
+        char record[64];
+        snprintf(record, sizeof(record), "adv %u %02x %d %u", time,
+                 pAddress[5], rssi, static_cast<unsigned>(length));
+        records.push_back(record);
+        TEST_ASSERT_EQUAL_MEMORY(kPvvxPayload, pPayload, length);
+    }
+    void onNotification(uint32_t time, const uint8_t* pAddress, uint16_t uuid,
+                        const uint8_t* pData, size_t length) override {
+        char record[64];
+        snprintf(record, sizeof(record), "notify %u %02x %04x %u", time,
+                 pAddress[5], uuid, static_cast<unsigned>(length));
+        records.push_back(record);
+        TEST_ASSERT_EQUAL_MEMORY(kTemperatureValue, pData, length);
+    }
+    void onConnection(uint32_t time, const uint8_t* pAddress,
+                      bool is_connected) override {
+        char record[64];
+        snprintf(record, sizeof(record), "%s %u %02x",
+                 is_connected ? "connect" : "disconnect", time, pAddress[5]);
+        records.push_back(record);
+    }
+};
+
+/**
+ * @brief Write the traffic of one device update.
+ */
+static void WriteUpdate(CaptureWriter& writer, uint32_t time) {
+    writer.WriteAdvertisement(time, kSensor, -67, kPvvxPayload,
+                              sizeof(kPvvxPayload));
+    writer.WriteConnection(time + 100, kSensor, true);
+    writer.WriteNotification(time + 250, kSensor, 0x2A6E, kTemperatureValue,
+                             sizeof(kTemperatureValue));
+    writer.WriteConnection(time + 300, kSensor, false);
+}
+
+/**
+ * @brief Extract the capture from the `CAP <hex>` lines of a serial log.
+ */
+static std::vector<uint8_t> ParseCaptureLog(const char* pLog) {
+    std::vector<uint8_t> data;
+    const char* pLine = pLog;
+    while (*pLine != '\0') {
+        const char* pEnd = strchr(pLine, '\n');
+        size_t line_length = pEnd == nullptr ? strlen(pLine) : pEnd - pLine;
+        if ((line_length > 4) && (strncmp(pLine, "CAP ", 4) == 0) &&
+            (strncmp(pLine, "CAP dropped", 11) != 0)) {
+            for (size_t i = 4; i + 1 < line_length; i += 2) {
+                unsigned int byte = 0;
+                sscanf(pLine + i, "%2x", &byte);
+                data.push_back(static_cast<uint8_t>(byte));
+            }
+        }
+        pLine += line_length + (pEnd == nullptr ? 0 : 1);
+    }
+    return data;
+}
+
+void test_round_trip(void) {
+    uint8_t buffer[256];
+    CaptureWriter writer(buffer, sizeof(buffer));
+    WriteUpdate(writer, 0x01020304);
+    // 11 bytes of header in each record.
+    TEST_ASSERT_EQUAL(11 + 2 + sizeof(kPvvxPayload) + 11 + 11 + 4 + 2 + 11,
+                      writer.GetLength());
+    RecordingCallbacks callbacks;
+    TEST_ASSERT_EQUAL(4, ReplayCapture(writer.GetData(), writer.GetLength(),
+                                       &callbacks));
+    TEST_ASSERT_EQUAL(4, callbacks.records.size());
+    TEST_ASSERT_EQUAL_STRING("adv 16909060 56 -67 22",
+                             callbacks.records[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("connect 16909160 56",
+                             callbacks.records[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("notify 16909310 56 2a6e 2",
+                             callbacks.records[2].c_str());
+    TEST_ASSERT_EQUAL_STRING("disconnect 16909360 56",
+                             callbacks.records[3].c_str());
+}
+
+void test_little_endian_layout(void) {
+    uint8_t buffer[32];
+    CaptureWriter writer(buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(writer.WriteNotification(0x0A0B0C0D, kSensor, 0x2A6E,
+                                              kTemperatureValue,
+                                              sizeof(kTemperatureValue)));
+    const uint8_t expected[] = {0x02, 0x0D, 0x0C, 0x0B, 0x0A, 0xA4,
+                                0xC1, 0x38, 0x12, 0x34, 0x56, 0x6E,
+                                0x2A, 0x02, 0x00, 0x29, 0x09};
+    TEST_ASSERT_EQUAL(sizeof(expected), writer.GetLength());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+void test_full_buffer_drops_record(void) {
+    uint8_t buffer[40];
+    CaptureWriter writer(buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(writer.WriteConnection(0, kSensor, true));
+    // 35 bytes do not fit in the other 29 bytes.
+    TEST_ASSERT_FALSE(writer.WriteAdvertisement(1, kSensor, -60, kPvvxPayload,
+                                                sizeof(kPvvxPayload)));
+    TEST_ASSERT_EQUAL(11, writer.GetLength());
+    TEST_ASSERT_TRUE(writer.WriteConnection(2, kSensor, false));
+    TEST_ASSERT_EQUAL(22, writer.GetLength());
+    uint8_t payload[256] = {0};
+    uint8_t large[512];
+    CaptureWriter large_writer(large, sizeof(large));
+    TEST_ASSERT_FALSE(large_writer.WriteAdvertisement(0, kSensor, -60,
+                                                      payload, 256));
+    writer.Clear();
+    TEST_ASSERT_EQUAL(0, writer.GetLength());
+}
+
+void test_replay_stops_at_malformed(void) {
+    uint8_t buffer[256];
+    CaptureWriter writer(buffer, sizeof(buffer));
+    WriteUpdate(writer, 1000);
+    size_t length = writer.GetLength();
+    RecordingCallbacks truncated;
+    // The last disconnect and one byte of the notification are cut.
+    TEST_ASSERT_EQUAL(2, ReplayCapture(buffer, length - 12, &truncated));
+    RecordingCallbacks unknown;
+    buffer[11 + 2 + sizeof(kPvvxPayload)] = 0x7F;
+    TEST_ASSERT_EQUAL(1, ReplayCapture(buffer, length, &unknown));
+    RecordingCallbacks empty;
+    TEST_ASSERT_EQUAL(0, ReplayCapture(buffer, 10, &empty));
+    TEST_ASSERT_EQUAL(0, empty.records.size());
+}
+
+void test_pipeline_decodes(void) {
+    uint8_t buffer[256];
+    CaptureWriter writer(buffer, sizeof(buffer));
+    WriteUpdate(writer, 0);
+    // An unknown characteristic and a value of the wrong length.
+    writer.WriteNotification(400, kSensor, 0x1234, kTemperatureValue,
+                             sizeof(kTemperatureValue));
+    writer.WriteNotification(500, kSensor, 0x2A6E, kTemperatureValue, 1);
+    CapturePipeline pipeline(nullptr, 0);
+    TEST_ASSERT_EQUAL(6, ReplayCapture(writer.GetData(), writer.GetLength(),
+                                       &pipeline));
+    // Connections are not counted as records of the pipeline.
+    TEST_ASSERT_EQUAL(4, pipeline.GetRecordNum());
+    TEST_ASSERT_EQUAL(0, pipeline.GetFilteredNum());
+    TEST_ASSERT_EQUAL(4 + 1, pipeline.GetSampleNum());
+}
+
+void test_pipeline_accept_list(void) {
+    uint8_t buffer[256];
+    CaptureWriter writer(buffer, sizeof(buffer));
+    writer.WriteAdvertisement(0, kSensor, -60, kPvvxPayload,
+                              sizeof(kPvvxPayload));
+    writer.WriteAdvertisement(10, kOther, -60, kPvvxPayload,
+                              sizeof(kPvvxPayload));
+    writer.WriteAdvertisement(20, kOther, -60, kPvvxPayload,
+                              sizeof(kPvvxPayload));
+    const uint8_t accept_list[][6] = {
+        {0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56}};
+    CapturePipeline pipeline(accept_list, 1);
+    ReplayCapture(writer.GetData(), writer.GetLength(), &pipeline);
+    TEST_ASSERT_EQUAL(3, pipeline.GetRecordNum());
+    TEST_ASSERT_EQUAL(2, pipeline.GetFilteredNum());
+    TEST_ASSERT_EQUAL(4, pipeline.GetSampleNum());
+}
+
+void test_replay_serial_log(void) {
+    // The CaptureDump lines of one update in a serial log.
+    const char log[] =
+        "Elapsed time 532 ms\n"
+        "CAP 01e8030000a4c138123456bd1602010612161a1856341238c1a4fc08881386"
+        "0b\n"
+        "CAP 500104034c040000a4c138123456\n"
+        "CAP dropped 3\n";
+    std::vector<uint8_t> data = ParseCaptureLog(log);
+    TEST_ASSERT_EQUAL(11 + 2 + sizeof(kPvvxPayload) + 11, data.size());
+    RecordingCallbacks callbacks;
+    TEST_ASSERT_EQUAL(2, ReplayCapture(data.data(), data.size(), &callbacks));
+    TEST_ASSERT_EQUAL_STRING("adv 1000 56 -67 22",
+                             callbacks.records[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("connect 1100 56", callbacks.records[1].c_str());
+}
+
+/**
+ * @brief Replay a capture of a fleet through the pipeline at maximum speed.
+ */
+void test_benchmark_replay(void) {
+    const size_t update_num = 100;
+    std::vector<uint8_t> buffer(update_num * 128);
+    CaptureWriter writer(buffer.data(), buffer.size());
+    for (size_t i = 0; i < update_num; ++i) {
+        WriteUpdate(writer, 1000 * i);
+    }
+    const size_t repeat_num = 2000;
+    size_t record_num = 0;
+    uint32_t sample_num = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat_num; ++i) {
+        CapturePipeline pipeline(nullptr, 0);
+        record_num +=
+            ReplayCapture(writer.GetData(), writer.GetLength(), &pipeline);
+        sample_num += pipeline.GetSampleNum();
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    TEST_ASSERT_EQUAL(4 * update_num * repeat_num, record_num);
+    TEST_ASSERT_EQUAL(5 * update_num * repeat_num, sample_num);
+    char message[96];
+    snprintf(message, sizeof(message),
+             "%.1f ns per record, %.1f MB/s of capture",
+             elapsed / record_num,
+             writer.GetLength() * repeat_num * 1e3 / elapsed);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_little_endian_layout);
+    RUN_TEST(test_full_buffer_drops_record);
+    RUN_TEST(test_replay_stops_at_malformed);
+    RUN_TEST(test_pipeline_decodes);
+    RUN_TEST(test_pipeline_accept_list);
+    RUN_TEST(test_replay_serial_log);
+    RUN_TEST(test_benchmark_replay);
+    return UNITY_END();
+}
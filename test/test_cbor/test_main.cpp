@@ -0,0 +1,253 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the CBOR encoder against the examples of RFC 8949.
+ */
+#include <unity.h>
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include "cbor.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/**
+ * @brief Check the encoded bytes against the hex of RFC 8949 Appendix A.
+ */
+static void AssertEncoded(const char* pHex, const CborWriter& writer,
+                          const uint8_t* pBuffer) {
+    size_t length = strlen(pHex) / 2;
+    uint8_t expected[32];
+    for (size_t i = 0; i < length; ++i) {
+        unsigned int byte = 0;
+        sscanf(pHex + 2 * i, "%2x", &byte);
+        expected[i] = static_cast<uint8_t>(byte);
+    }
+    TEST_ASSERT_TRUE(writer.IsValid());
+    TEST_ASSERT_EQUAL(length, writer.GetLength());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, pBuffer, length);
+}
+
+void test_unsigned_integers(void) {
+    const struct {
+        uint64_t value;
+        const char* pHex;
+    } vectors[] = {
+        {0, "00"},
+        {23, "17"},
+        {24, "1818"},
+        {100, "1864"},
+        {1000, "1903e8"},
+        {1000000, "1a000f4240"},
+        {1000000000000ULL, "1b000000e8d4a51000"},
+        {18446744073709551615ULL, "1bffffffffffffffff"},
+    };
+    for (const auto& vector : vectors) {
+        uint8_t buffer[16];
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.WriteUInt(vector.value);
+        AssertEncoded(vector.pHex, writer, buffer);
+    }
+}
+
+void test_signed_integers(void) {
+    const struct {
+        int32_t value;
+        const char* pHex;
+    } vectors[] = {
+        {10, "0a"},
+        {-1, "20"},
+        {-10, "29"},
+        {-100, "3863"},
+        {-1000, "3903e7"},
+        {INT32_MIN, "3a7fffffff"},
+    };
+    for (const auto& vector : vectors) {
+        uint8_t buffer[16];
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.WriteInt(vector.value);
+        AssertEncoded(vector.pHex, writer, buffer);
+    }
+}
+
+void test_floats(void) {
+    const struct {
+        float value;
+        const char* pHex;
+    } vectors[] = {
+        {1.1F, "fa3f8ccccd"},
+        {100000.0F, "1a000186a0"},  // Integral, so an integer.
+        {-4.0F, "23"},
+        {-4.1F, "fac0833333"},
+        {3.4028234663852886e+38F, "fa7f7fffff"},
+        {std::numeric_limits<float>::infinity(), "fa7f800000"},
+        {-std::numeric_limits<float>::infinity(), "faff800000"},
+        {NAN, "f6"},  // Unknown values are null.
+    };
+    for (const auto& vector : vectors) {
+        uint8_t buffer[16];
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.WriteFloat(vector.value);
+        AssertEncoded(vector.pHex, writer, buffer);
+    }
+}
+
+void test_text(void) {
+    const struct {
+        const char* pText;
+        const char* pHex;
+    } vectors[] = {
+        {"", "60"},
+        {"a", "6161"},
+        {"IETF", "6449455446"},
+        {"\"\\", "62225c"},
+        {"\xc3\xbc", "62c3bc"},
+        {"\xe6\xb0\xb4", "63e6b0b4"},
+    };
+    for (const auto& vector : vectors) {
+        uint8_t buffer[16];
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.WriteText(vector.pText);
+        AssertEncoded(vector.pHex, writer, buffer);
+    }
+}
+
+void test_containers(void) {
+    uint8_t buffer[32];
+    CborWriter empty(buffer, sizeof(buffer));
+    empty.WriteArray(0);
+    empty.WriteMap(0);
+    empty.WriteNull();
+    AssertEncoded("80a0f6", empty, buffer);
+    // {"a": 1, "b": [2, 3]}
+    CborWriter map(buffer, sizeof(buffer));
+    map.WriteMap(2);
+    map.WriteText("a");
+    map.WriteUInt(1);
+    map.WriteText("b");
+    map.WriteArray(2);
+    map.WriteUInt(2);
+    map.WriteUInt(3);
+    AssertEncoded("a26161016162820203", map, buffer);
+    // An array of 25 items has a one byte argument.
+    CborWriter array(buffer, sizeof(buffer));
+    array.WriteArray(25);
+    AssertEncoded("9819", array, buffer);
+}
+
+void test_overflow(void) {
+    uint8_t buffer[8] = {0};
+    CborWriter writer(buffer, 4);
+    writer.WriteText("IETF");
+    TEST_ASSERT_FALSE(writer.IsValid());
+    size_t length = writer.GetLength();
+    TEST_ASSERT_LESS_OR_EQUAL(4, length);
+    // Later writes which fit are ignored too.
+    writer.WriteNull();
+    TEST_ASSERT_EQUAL(length, writer.GetLength());
+    TEST_ASSERT_EQUAL_HEX8(0x00, buffer[4]);
+    CborWriter exact(buffer, 5);
+    exact.WriteText("IETF");
+    TEST_ASSERT_TRUE(exact.IsValid());
+    TEST_ASSERT_EQUAL(5, exact.GetLength());
+}
+
+/**
+ * @brief Format a value as the JSON state does.
+ */
+static std::string FormatJSONValue(float value) {
+    return std::isnan(value) ? "\"unknown\""
+                             : std::to_string(round(10 * value) / 10.0);
+}
+
+/**
+ * @brief Encode the state of the environment sensor as JSON and CBOR the
+ * way SensorDevice::Push does and compare the size and time.
+ */
+void test_benchmark_state_payload(void) {
+    const char* names[] = {"temperature", "humidity", "illuminance"};
+    const float values[] = {23.46F, 59.04F, 400.0F};
+    const uint64_t epoch = 1700000000123ULL;
+    const uint32_t uptime = 86400000;
+    const uint32_t ages[] = {0, 12, 25};
+    const uint32_t sequences[] = {40001, 40002, 40003};
+    const size_t repeat_num = 100000;
+    size_t json_length = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat_num; ++i) {
+        std::string payload = "{";
+        for (size_t j = 0; j < 3; ++j) {
+            payload += (j == 0 ? "\"" : ",\"") + std::string(names[j]) +
+                       "\":" + FormatJSONValue(values[j]);
+        }
+        payload += ",\"sampled_at\":[" + std::to_string(epoch) + "," +
+                   std::to_string(uptime) + "],\"samples\":{";
+        for (size_t j = 0; j < 3; ++j) {
+            payload += (j == 0 ? "\"" : ",\"") + std::string(names[j]) +
+                       "\":[" + std::to_string(ages[j]) + "," +
+                       std::to_string(sequences[j]) + "]";
+        }
+        payload += "}}";
+        json_length += payload.size();
+    }
+    double json_ns = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    size_t cbor_length = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat_num; ++i) {
+        uint8_t payload[256];
+        CborWriter writer(payload, sizeof(payload));
+        writer.WriteMap(5);
+        for (size_t j = 0; j < 3; ++j) {
+            writer.WriteText(names[j]);
+            writer.WriteFloat(round(10 * values[j]) / 10.0);
+        }
+        writer.WriteText("sampled_at");
+        writer.WriteArray(2);
+        writer.WriteUInt(epoch);
+        writer.WriteUInt(uptime);
+        writer.WriteText("samples");
+        writer.WriteMap(3);
+        for (size_t j = 0; j < 3; ++j) {
+            writer.WriteText(names[j]);
+            writer.WriteArray(2);
+            writer.WriteUInt(ages[j]);
+            writer.WriteUInt(sequences[j]);
+        }
+        TEST_ASSERT_TRUE(writer.IsValid());
+        cbor_length += writer.GetLength();
+    }
+    double cbor_ns = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    json_length /= repeat_num;
+    cbor_length /= repeat_num;
+    TEST_ASSERT_LESS_THAN(json_length, cbor_length);
+    char message[128];
+    snprintf(message, sizeof(message),
+             "JSON %u bytes in %.0f ns, CBOR %u bytes in %.0f ns",
+             static_cast<unsigned>(json_length), json_ns / repeat_num,
+             static_cast<unsigned>(cbor_length), cbor_ns / repeat_num);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_unsigned_integers);
+    RUN_TEST(test_signed_integers);
+    RUN_TEST(test_floats);
+    RUN_TEST(test_text);
+    RUN_TEST(test_containers);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_benchmark_state_payload);
+    return UNITY_END();
+}
@@ -0,0 +1,211 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the characteristic descriptor tables.
+ */
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "characteristic.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_table_sorted_by_uuid(void) {
+    const CharacteristicDescriptor* const* pTable =
+        kEnvironmentalSensingCharacteristics;
+    for (size_t i = 1; i < kEnvironmentalSensingCharacteristicNum; ++i) {
+        TEST_ASSERT_LESS_THAN(pTable[i]->uuid, pTable[i - 1]->uuid);
+    }
+}
+
+void test_find_every_characteristic(void) {
+    for (size_t i = 0; i < kEnvironmentalSensingCharacteristicNum; ++i) {
+        const CharacteristicDescriptor* pDescriptor =
+            kEnvironmentalSensingCharacteristics[i];
+        TEST_ASSERT_TRUE(FindCharacteristic(pDescriptor->uuid) == pDescriptor);
+        TEST_ASSERT_NOT_NULL(pDescriptor->decode);
+        TEST_ASSERT_NOT_NULL(pDescriptor->name);
+    }
+    TEST_ASSERT_NULL(FindCharacteristic(0x2A19));  // Not an ESS one.
+    TEST_ASSERT_NULL(FindCharacteristic(0x0000));
+    TEST_ASSERT_NULL(FindCharacteristic(0xFFFF));
+}
+
+void test_decode_environment_sensor(void) {
+    // The values of the self-made environment sensor.
+    const uint8_t temperature[] = {0x2A, 0x09};     // 23.46 °C
+    const uint8_t humidity[] = {0x10, 0x17};        // 59.04 %
+    const uint8_t illuminance[] = {0x40, 0x9C, 0};  // 400.00 lx
+    float value = NAN;
+    TEST_ASSERT_TRUE(DecodeCharacteristic(kTemperatureCharacteristic,
+                                          temperature, 2, value));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 23.46, value);
+    TEST_ASSERT_TRUE(
+        DecodeCharacteristic(kHumidityCharacteristic, humidity, 2, value));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 59.04, value);
+    TEST_ASSERT_TRUE(DecodeCharacteristic(kIlluminanceCharacteristic,
+                                          illuminance, 3, value));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 400.0, value);
+    TEST_ASSERT_EQUAL_STRING("°C", kTemperatureCharacteristic.unit);
+    TEST_ASSERT_EQUAL_STRING("humidity", kHumidityCharacteristic.device_class);
+}
+
+void test_decode_too_short(void) {
+    const uint8_t data[] = {0x01, 0x02};
+    float value = 1.0F;
+    TEST_ASSERT_FALSE(
+        DecodeCharacteristic(kTemperatureCharacteristic, data, 1, value));
+    TEST_ASSERT_FALSE(
+        DecodeCharacteristic(kIlluminanceCharacteristic, data, 2, value));
+    TEST_ASSERT_EQUAL_FLOAT(1.0F, value);  // Untouched.
+}
+
+/**
+ * @brief A raw value and its decoded value, NAN if rejected.
+ */
+struct GoldenVector {
+    const CharacteristicDescriptor* pDescriptor;
+    uint8_t data[4];
+    size_t length;
+    float value;
+};
+
+// Encoded by hand from the GATT Specification Supplement.
+static const GoldenVector kGoldenVectors[] = {
+    {&kElevationCharacteristic, {0x39, 0x30, 0x00}, 3, 123.45F},
+    {&kElevationCharacteristic, {0xC7, 0xCF, 0xFF}, 3, -123.45F},
+    {&kPressureCharacteristic, {0xA0, 0x86, 0x01, 0x00}, 4, 100.0F},
+    {&kPressureCharacteristic, {0xFF, 0xFF, 0xFF, 0xFF}, 4, NAN},
+    {&kTemperatureCharacteristic, {0x2A, 0x09}, 2, 23.46F},
+    {&kTemperatureCharacteristic, {0x0C, 0xFE}, 2, -5.0F},
+    {&kTemperatureCharacteristic, {0x00, 0x80}, 2, NAN},
+    {&kHumidityCharacteristic, {0x10, 0x27}, 2, 100.0F},
+    {&kHumidityCharacteristic, {0xFF, 0xFF}, 2, NAN},
+    {&kTrueWindSpeedCharacteristic, {0xF4, 0x01}, 2, 5.0F},
+    {&kTrueWindDirectionCharacteristic, {0x28, 0x8C}, 2, 358.8F},
+    {&kApparentWindSpeedCharacteristic, {0x0A, 0x00}, 2, 0.1F},
+    {&kApparentWindDirectionCharacteristic, {0x10, 0x27}, 2, 100.0F},
+    {&kGustFactorCharacteristic, {0x0F}, 1, 1.5F},
+    {&kPollenConcentrationCharacteristic, {0x40, 0x42, 0x0F}, 3, 1000000.0F},
+    {&kUVIndexCharacteristic, {0x0B}, 1, 11.0F},
+    {&kIrradianceCharacteristic, {0x10, 0x27}, 2, 1000.0F},
+    {&kRainfallCharacteristic, {0x0C, 0x00}, 2, 12.0F},
+    {&kWindChillCharacteristic, {0xEC}, 1, -20.0F},
+    {&kHeatIndexCharacteristic, {0x2D}, 1, 45.0F},
+    {&kDewPointCharacteristic, {0xFD}, 1, -3.0F},
+    {&kDewPointCharacteristic, {0x7F}, 1, 127.0F},
+    {&kIlluminanceCharacteristic, {0x40, 0x9C, 0x00}, 3, 400.0F},
+    {&kIlluminanceCharacteristic, {0xFF, 0xFF, 0xFF}, 3, NAN},
+    {&kCO2ConcentrationCharacteristic, {0x20, 0x03}, 2, 800.0F},
+    {&kCO2ConcentrationCharacteristic, {0xFE, 0xFF}, 2, 65534.0F},
+    {&kCO2ConcentrationCharacteristic, {0xFF, 0xFF}, 2, NAN},
+    {&kVOCConcentrationCharacteristic, {0xF4, 0x01}, 2, 500.0F},
+    {&kVOCConcentrationCharacteristic, {0xFF, 0xFF}, 2, NAN},
+    {&kBatteryLevelCharacteristic, {0x64}, 1, 100.0F},
+    {&kVoltageCharacteristic, {0xD3, 0x00}, 2, 3.296875F},
+    {&kVoltageCharacteristic, {0xFF, 0xFF}, 2, NAN},
+};
+
+void test_golden_vectors(void) {
+    char message[96];
+    for (const GoldenVector& vector : kGoldenVectors) {
+        float value = NAN;
+        bool is_decoded = DecodeCharacteristic(
+            *vector.pDescriptor, vector.data, vector.length, value);
+        snprintf(message, sizeof(message), "%s %02x%02x%02x%02x",
+                 vector.pDescriptor->name, vector.data[0], vector.data[1],
+                 vector.data[2], vector.data[3]);
+        TEST_ASSERT_TRUE_MESSAGE(is_decoded == !std::isnan(vector.value),
+                                 message);
+        if (is_decoded) {
+            TEST_ASSERT_FLOAT_WITHIN(std::fabs(vector.value) * 1e-6F + 1e-4F,
+                                     vector.value, value);
+        }
+    }
+}
+
+void test_every_characteristic_has_vector(void) {
+    for (size_t i = 0; i < kEnvironmentalSensingCharacteristicNum; ++i) {
+        bool is_covered = false;
+        for (const GoldenVector& vector : kGoldenVectors) {
+            is_covered |=
+                vector.pDescriptor == kEnvironmentalSensingCharacteristics[i];
+        }
+        TEST_ASSERT_TRUE_MESSAGE(is_covered,
+                                 kEnvironmentalSensingCharacteristics[i]->name);
+    }
+}
+
+void test_decode_batch(void) {
+    const uint8_t temperature[] = {0x2A, 0x09};
+    const uint8_t unknown_humidity[] = {0xFF, 0xFF};
+    const uint8_t pressure[] = {0xA0, 0x86, 0x01, 0x00};
+    const uint8_t battery[] = {0x64};
+    const RawCharacteristicValue raw_values[] = {
+        {0x2A6E, temperature, 2},
+        {0x2A6E, temperature, 2},
+        {0x2A6F, unknown_humidity, 2},
+        {0x2A6D, pressure, 4},
+        {0x2A19, battery, 1},  // Not an ESS characteristic.
+        {0x2A6E, temperature, 1},
+    };
+    float values[6];
+    TEST_ASSERT_EQUAL(3, DecodeCharacteristics(raw_values, 6, values));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 23.46, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 23.46, values[1]);
+    TEST_ASSERT_FLOAT_IS_NAN(values[2]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 100.0, values[3]);
+    TEST_ASSERT_FLOAT_IS_NAN(values[4]);
+    TEST_ASSERT_FLOAT_IS_NAN(values[5]);
+}
+
+/**
+ * @brief Decode batches of a multi-characteristic sensor.
+ */
+void test_benchmark_batch_decode(void) {
+    const size_t batch_size = 8;
+    const size_t batch_num = 200000;
+    const uint8_t data[][4] = {{0x2A, 0x09}, {0x10, 0x17},
+                               {0xA0, 0x86, 0x01, 0x00}, {0x20, 0x03},
+                               {0xF4, 0x01}, {0x40, 0x9C, 0x00},
+                               {0xFD}, {0x0B}};
+    const uint16_t uuids[] = {0x2A6E, 0x2A6F, 0x2A6D, 0x2B8C,
+                              0x2BE7, 0x2AFB, 0x2A7B, 0x2A76};
+    const size_t lengths[] = {2, 2, 4, 2, 2, 3, 1, 1};
+    RawCharacteristicValue raw_values[batch_size];
+    for (size_t i = 0; i < batch_size; ++i) {
+        raw_values[i] = {uuids[i], data[i], lengths[i]};
+    }
+    float values[batch_size];
+    size_t decoded_num = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < batch_num; ++i) {
+        decoded_num += DecodeCharacteristics(raw_values, batch_size, values);
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    TEST_ASSERT_EQUAL(batch_size * batch_num, decoded_num);
+    char message[96];
+    snprintf(message, sizeof(message), "%.1f ns per value in batches of %u",
+             elapsed / decoded_num, static_cast<unsigned>(batch_size));
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_table_sorted_by_uuid);
+    RUN_TEST(test_find_every_characteristic);
+    RUN_TEST(test_decode_environment_sensor);
+    RUN_TEST(test_decode_too_short);
+    RUN_TEST(test_golden_vectors);
+    RUN_TEST(test_every_characteristic_has_vector);
+    RUN_TEST(test_decode_batch);
+    RUN_TEST(test_benchmark_batch_decode);
+    return UNITY_END();
+}
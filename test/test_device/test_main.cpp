@@ -0,0 +1,295 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the GATT devices on a fake transport and MQTT client.
+ */
+#include <Preferences.h>
+#include <WiFi.h>
+#include <fake_transport.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "device.h"
+#include "settings.h"
+
+const uint8_t kAddress[6] = {0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56};
+const char kStateTopic[] =
+    "homeassistant/sensor/environment_sensor-a4c138123456/state";
+
+static FakeTransport* pTransport = nullptr;
+
+void setUp(void) {
+    FakePreferencesClear();
+    SettingsSetup("gw");
+    pTransport = new FakeTransport();
+    FakeAdvertisement advertisement = {
+        {0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56}, -70, {0x02, 0x01, 0x06}};
+    pTransport->advertisements.push_back(advertisement);
+    // 21.5 °C and 50 % in little endian.
+    FakePeripheral peripheral = {{0xA4, 0xC1, 0x38, 0x12, 0x34, 0x56},
+                                 0x181A,
+                                 {{0x2A6E, {kPropertyIndicate, "\x66\x08"}},
+                                  {0x2A6F, {kPropertyIndicate, "\x88\x13"}}}};
+    pTransport->peripherals.push_back(peripheral);
+}
+
+void tearDown(void) { delete pTransport; }
+
+static const FakeMQTTMessage* FindMessage(const PubSubClient& mqtt_client,
+                                          const std::string& topic) {
+    for (const FakeMQTTMessage& message : mqtt_client.messages) {
+        if (message.topic == topic) {
+            return &message;
+        }
+    }
+    return nullptr;
+}
+
+void test_indication_update_and_push(void) {
+    std::unique_ptr<Device> device =
+        GetDevice(DeviceType::BluetoothEnvironmentSensor,
+                  DeviceAddress(kAddress));
+    TEST_ASSERT_NOT_NULL(device.get());
+    device->Update(*pTransport);
+    TEST_ASSERT_EQUAL(1, pTransport->connect_num);
+    TEST_ASSERT_EQUAL(2, pTransport->subscription_num);
+    WiFiClass wifi;
+    PubSubClient mqtt_client;
+    TEST_ASSERT_TRUE(device->Push(wifi, mqtt_client, "gw"));
+    // The configs of the provided characteristics and the state.
+    TEST_ASSERT_EQUAL(3, mqtt_client.messages.size());
+    TEST_ASSERT_NOT_NULL(FindMessage(
+        mqtt_client, "homeassistant/sensor/environment_sensor-a4c138123456/"
+                     "temperature/config"));
+    const FakeMQTTMessage* pState = FindMessage(mqtt_client, kStateTopic);
+    TEST_ASSERT_NOT_NULL(pState);
+    TEST_ASSERT_EQUAL(0, pState->payload.find("{\"temperature\":21.5"));
+    TEST_ASSERT_TRUE(pState->payload.find("\"humidity\":50.0") !=
+                     std::string::npos);
+    TEST_ASSERT_TRUE(pState->payload.find("illuminance") ==
+                     std::string::npos);
+    // Nothing new to push.
+    TEST_ASSERT_TRUE(device->Push(wifi, mqtt_client, "gw"));
+    TEST_ASSERT_EQUAL(3, mqtt_client.messages.size());
+}
+
+void test_device_reused_across_updates(void) {
+    std::unique_ptr<Device> device =
+        GetDevice(DeviceType::BluetoothEnvironmentSensor,
+                  DeviceAddress(kAddress));
+    WiFiClass wifi;
+    PubSubClient mqtt_client;
+    device->Update(*pTransport);
+    TEST_ASSERT_TRUE(device->Push(wifi, mqtt_client, "gw"));
+    pTransport->peripherals[0].characteristics[0x2A6E].value = "\xD0\x07";
+    device->Update(*pTransport);
+    TEST_ASSERT_TRUE(device->Push(wifi, mqtt_client, "gw"));
+    TEST_ASSERT_EQUAL(0, mqtt_client.messages.back().payload.find(
+                             "{\"temperature\":20.0"));
+}
+
+void test_offline_keeps_values(void) {
+    std::unique_ptr<Device> device =
+        GetDevice(DeviceType::BluetoothEnvironmentSensor,
+                  DeviceAddress(kAddress));
+    device->Update(*pTransport);
+    WiFiClass wifi;
+    wifi.is_connected = false;
+    PubSubClient mqtt_client;
+    TEST_ASSERT_FALSE(device->Push(wifi, mqtt_client, "gw"));
+    wifi.is_connected = true;
+    mqtt_client.is_reachable = false;
+    TEST_ASSERT_FALSE(device->Push(wifi, mqtt_client, "gw"));
+    mqtt_client.is_reachable = true;
+    TEST_ASSERT_TRUE(device->Push(wifi, mqtt_client, "gw"));
+    TEST_ASSERT_NOT_NULL(FindMessage(mqtt_client, kStateTopic));
+}
+
+void test_direct_read(void) {
+    for (auto& characteristic : pTransport->peripherals[0].characteristics) {
+        characteristic.second.properties = kPropertyRead;
+    }
+    std::unique_ptr<Device> device =
+        GetDevice(DeviceType::BluetoothEnvironmentalSensing,
+                  DeviceAddress(kAddress));
+    device->Update(*pTransport);
+    TEST_ASSERT_EQUAL(0, pTransport->subscription_num);
+    WiFiClass wifi;
+    PubSubClient mqtt_client;
+    TEST_ASSERT_TRUE(device->Push(wifi, mqtt_client, "gw"));
+    const FakeMQTTMessage* pState = FindMessage(
+        mqtt_client,
+        "homeassistant/sensor/environmental_sensing-a4c138123456/state");
+    TEST_ASSERT_NOT_NULL(pState);
+    TEST_ASSERT_EQUAL(0, pState->payload.find("{\"temperature\":21.5"));
+    TEST_ASSERT_TRUE(pState->payload.find(",\"humidity\":50.0") !=
+                     std::string::npos);
+}
+
+void test_not_found(void) {
+    pTransport->advertisements.clear();
+    std::unique_ptr<Device> device =
+        GetDevice(DeviceType::BluetoothEnvironmentSensor,
+                  DeviceAddress(kAddress));
+    device->Update(*pTransport);
+    TEST_ASSERT_EQUAL(0, pTransport->connect_num);
+    WiFiClass wifi;
+    PubSubClient mqtt_client;
+    TEST_ASSERT_TRUE(device->Push(wifi, mqtt_client, "gw"));
+    TEST_ASSERT_EQUAL(0, mqtt_client.messages.size());
+    TEST_ASSERT_NULL(
+        GetDevice(DeviceType::Unknown, DeviceAddress(kAddress)).get());
+}
+
+/**
+ * @brief Flags and BTHome service data of 25.06 °C, 50.55 % and a text.
+ */
+const std::vector<uint8_t> kBTHomePayload = {
+    0x02, 0x01, 0x06, 0x0C, 0x16, 0xD2, 0xFC, 0x40, 0x02, 0xCA,
+    0x09, 0x03, 0xBF, 0x13, 0x01, 0x61};
+/**
+ * @brief Flags and ATC1441 service data of 23.0 °C.
+ */
+const std::vector<uint8_t> kATCPayload = {
+    0x02, 0x01, 0x06, 0x10, 0x16, 0x1A, 0x18, 0xA4, 0xC1, 0x38, 0x00,
+    0x00, 0x02, 0x00, 0xE6, 0x32, 0x55, 0x0B, 0xB8, 0x01};
+/**
+ * @brief Flags and pvvx service data of 23.00 °C.
+ */
+const std::vector<uint8_t> kPvvxPayload = {
+    0x02, 0x01, 0x06, 0x12, 0x16, 0x1A, 0x18, 0x03, 0x00, 0x00,
+    0x38, 0xC1, 0xA4, 0xFC, 0x08, 0x88, 0x13, 0x86, 0x0B, 0x50,
+    0x01, 0x04};
+
+void test_advertisement_sensors_share_scan(void) {
+    const uint8_t addresses[3][6] = {{0xA4, 0xC1, 0x38, 0x00, 0x00, 0x01},
+                                     {0xA4, 0xC1, 0x38, 0x00, 0x00, 0x02},
+                                     {0xA4, 0xC1, 0x38, 0x00, 0x00, 0x03}};
+    const uint8_t other[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+    pTransport->advertisements.clear();
+    pTransport->advertisements.push_back(
+        {{0xA4, 0xC1, 0x38, 0x00, 0x00, 0x01}, -60, kBTHomePayload});
+    pTransport->advertisements.push_back(
+        {{0x11, 0x22, 0x33, 0x44, 0x55, 0x66}, -50, kATCPayload});
+    pTransport->advertisements.push_back(
+        {{0xA4, 0xC1, 0x38, 0x00, 0x00, 0x02}, -65, kATCPayload});
+    pTransport->advertisements.push_back(
+        {{0xA4, 0xC1, 0x38, 0x00, 0x00, 0x03}, -70, kPvvxPayload});
+    // Not reported, since every sensor is decoded before.
+    pTransport->advertisements.push_back(
+        {{0xA4, 0xC1, 0x38, 0x00, 0x00, 0x01}, -60, kBTHomePayload});
+    std::unique_ptr<Device> devices[3];
+    for (size_t i = 0; i < 3; ++i) {
+        devices[i] = GetDevice(DeviceType::BluetoothAdvertisementSensor,
+                               DeviceAddress(addresses[i]));
+        TEST_ASSERT_NOT_NULL(devices[i].get());
+    }
+    // A removed sensor no longer keeps the shared scan running.
+    std::unique_ptr<Device> absent = GetDevice(
+        DeviceType::BluetoothAdvertisementSensor, DeviceAddress(other));
+    absent.reset();
+    for (size_t i = 0; i < 3; ++i) {
+        devices[i]->Update(*pTransport);
+    }
+    TEST_ASSERT_EQUAL(1, pTransport->scan_num);
+    TEST_ASSERT_EQUAL(4, pTransport->report_num);
+    WiFiClass wifi;
+    PubSubClient mqtt_client;
+    const char* suffixes[3] = {"a4c138000001", "a4c138000002",
+                               "a4c138000003"};
+    const char* temperatures[3] = {"{\"temperature\":25.1",
+                                   "{\"temperature\":23.0",
+                                   "{\"temperature\":23.0"};
+    for (size_t i = 0; i < 3; ++i) {
+        TEST_ASSERT_TRUE(devices[i]->Push(wifi, mqtt_client, "gw"));
+        const FakeMQTTMessage& state = mqtt_client.messages.back();
+        TEST_ASSERT_TRUE(state.topic.find(suffixes[i]) != std::string::npos);
+        TEST_ASSERT_EQUAL(0, state.payload.find(temperatures[i]));
+    }
+    // The next cycle scans again.
+    devices[0]->Update(*pTransport);
+    devices[1]->Update(*pTransport);
+    TEST_ASSERT_EQUAL(2, pTransport->scan_num);
+}
+
+static float decoded_values[SensorDevice::kMaxCharacteristicNum];
+
+/**
+ * @brief Dispatch by the index and decode like GattSensor::OnIndication, but
+ * without stamping the value.
+ */
+static void DecodeIndication(size_t index, const uint8_t* pData,
+                             size_t length) {
+    if (index >= kEnvironmentSensorDescriptor.characteristic_num) {
+        return;
+    }
+    DecodeCharacteristic(*(kEnvironmentSensorDescriptor.characteristics[index]),
+                         pData, length, decoded_values[index]);
+}
+
+static double GetElapsedNanoseconds(
+    std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+/**
+ * @brief The full indication path from the transport callback to the
+ * stamped value, against the dispatch and decoding alone.
+ */
+void test_benchmark_dispatch(void) {
+    const size_t indication_num = 200000;
+    pTransport->indication_num = indication_num;
+    std::unique_ptr<Device> device =
+        GetDevice(DeviceType::BluetoothEnvironmentSensor,
+                  DeviceAddress(kAddress));
+    auto start = std::chrono::steady_clock::now();
+    device->Update(*pTransport);
+    double indication_ns = GetElapsedNanoseconds(start);
+    TEST_ASSERT_EQUAL(2, pTransport->subscription_num);
+    // The same transport dispatch without SetValue.
+    TEST_ASSERT_TRUE(pTransport->Connect(kAddress));
+    TEST_ASSERT_TRUE(pTransport->DiscoverService(0x181A));
+    start = std::chrono::steady_clock::now();
+    pTransport->Subscribe(0x2A6E, 0, DecodeIndication);
+    pTransport->Subscribe(0x2A6F, 1, DecodeIndication);
+    double dispatch_ns = GetElapsedNanoseconds(start);
+    TEST_ASSERT_EQUAL_FLOAT(21.5, decoded_values[0]);
+    TEST_ASSERT_EQUAL_FLOAT(50.0, decoded_values[1]);
+    const uint8_t raw[2] = {0x66, 0x08};
+    float value = 0;
+    double sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < 2 * indication_num; ++i) {
+        DecodeCharacteristic(kTemperatureCharacteristic, raw, sizeof(raw),
+                             value);
+        sum += value;
+    }
+    double decode_ns = GetElapsedNanoseconds(start);
+    TEST_ASSERT_FLOAT_WITHIN(1, 21.5 * 2 * indication_num, sum);
+    char message[160];
+    snprintf(message, sizeof(message),
+             "indication %.1f ns, dispatch and decode %.1f ns, decode "
+             "%.1f ns",
+             indication_ns / (2 * indication_num),
+             dispatch_ns / (2 * indication_num),
+             decode_ns / (2 * indication_num));
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_indication_update_and_push);
+    RUN_TEST(test_device_reused_across_updates);
+    RUN_TEST(test_offline_keeps_values);
+    RUN_TEST(test_direct_read);
+    RUN_TEST(test_not_found);
+    RUN_TEST(test_advertisement_sensors_share_scan);
+    RUN_TEST(test_benchmark_dispatch);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Heap churn of the devices over a simulated day.
+ * @details The devices created for each cycle, as GetDevice was used before,
+ * are compared with the devices kept across cycles, as in main.cpp. Each
+ * cycle updates every device on a fake transport and queues its state in
+ * the publisher, which delivers it to a fake broker.
+ */
+#include <Preferences.h>
+#include <WiFi.h>
+#include <fake_broker.h>
+#include <fake_transport.h>
+#include <unity.h>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "device.h"
+#include "publisher.h"
+#include "settings.h"
+
+const size_t kDeviceNum = 8;
+const uint32_t kPeriod = 30000;  // milliseconds
+const size_t kCycleNum = 24 * 3600 * 1000 / kPeriod;
+
+struct ChurnReport {
+    double allocation_num;  // per cycle
+    double allocated_size;  // bytes per cycle
+    long first_used_size;  // bytes in use after the first cycle
+    long last_used_size;   // bytes in use after the last cycle
+    long peak_size;        // bytes
+    uint32_t delivered_num;
+};
+
+static DeviceAddress GetAddress(size_t index) {
+    const uint8_t address[DeviceAddress::kLength] = {
+        0xA4, 0xC1, 0x38, 0x12, 0x34, static_cast<uint8_t>(index)};
+    return DeviceAddress(address);
+}
+
+static ChurnReport RunDay(bool is_pooled) {
+    ChurnReport report = {};
+    FakeMillis() = 0;
+    FakeTransport transport;
+    for (size_t i = 0; i < kDeviceNum; ++i) {
+        DeviceAddress address = GetAddress(i);
+        FakeAdvertisement advertisement = {{}, -70, {0x02, 0x01, 0x06}};
+        FakePeripheral peripheral = {
+            {},
+            0x181A,
+            {{0x2A6E, {kPropertyIndicate, "\x66\x08"}},
+             {0x2A6F, {kPropertyIndicate, "\x88\x13"}}}};
+        for (size_t j = 0; j < DeviceAddress::kLength; ++j) {
+            advertisement.address[j] = address.GetNative()[j];
+            peripheral.address[j] = address.GetNative()[j];
+        }
+        transport.advertisements.push_back(advertisement);
+        transport.peripherals.push_back(peripheral);
+    }
+    FakeBrokerClient broker;
+    MQTTAckClient ack_client(broker);
+    PubSubClient mqtt_client(ack_client);
+    std::unique_ptr<MQTTPublisher> publisher(
+        new MQTTPublisher(mqtt_client, ack_client, "gw"));
+    SetMQTTPublisher(publisher.get());
+    WiFiClass wifi;
+    std::vector<std::unique_ptr<Device>> devices(kDeviceNum);
+    FakeHeapStatistics start_heap = GetFakeHeapStatistics();
+    ResetFakeHeapPeak();
+    for (size_t cycle = 0; cycle < kCycleNum; ++cycle) {
+        for (size_t i = 0; i < kDeviceNum; ++i) {
+            if (!is_pooled || !devices[i]) {
+                devices[i] =
+                    GetDevice(DeviceType::BluetoothEnvironmentSensor,
+                              GetAddress(i));
+            }
+            devices[i]->Update(transport);
+            TEST_ASSERT_TRUE(devices[i]->Push(wifi, mqtt_client, "gw"));
+            if (!is_pooled) {
+                devices[i].reset();
+            }
+        }
+        publisher->Pump(kPeriod);
+        TEST_ASSERT_EQUAL(0, publisher->GetPendingNum());
+        if (cycle == 0) {
+            report.first_used_size =
+                static_cast<long>(GetFakeHeapStatistics().used_size) -
+                static_cast<long>(start_heap.used_size);
+        }
+        delay(kPeriod);
+    }
+    FakeHeapStatistics end_heap = GetFakeHeapStatistics();
+    report.allocation_num =
+        static_cast<double>(end_heap.allocation_num -
+                            start_heap.allocation_num) /
+        kCycleNum;
+    report.allocated_size =
+        static_cast<double>(end_heap.allocated_size -
+                            start_heap.allocated_size) /
+        kCycleNum;
+    report.last_used_size = static_cast<long>(end_heap.used_size) -
+                            static_cast<long>(start_heap.used_size);
+    report.peak_size = static_cast<long>(end_heap.peak_size) -
+                       static_cast<long>(start_heap.used_size);
+    report.delivered_num = publisher->GetStatistics().delivered_num;
+    SetMQTTPublisher(nullptr);
+    return report;
+}
+
+static void PrintReport(const char* pName, const ChurnReport& report) {
+    char message[256];
+    snprintf(message, sizeof(message),
+             "%s: %.1f allocations and %.0f B per cycle, %ld B in use "
+             "after the first cycle, %ld B after a day, peak %ld B",
+             pName, report.allocation_num, report.allocated_size,
+             report.first_used_size, report.last_used_size,
+             report.peak_size);
+    TEST_MESSAGE(message);
+}
+
+void setUp(void) {
+    FakePreferencesClear();
+    SettingsSetup("gw");
+}
+
+void tearDown(void) {}
+
+void test_day_of_churn(void) {
+    ChurnReport per_cycle = RunDay(false);
+    ChurnReport pooled = RunDay(true);
+    PrintReport("created per cycle", per_cycle);
+    PrintReport("kept across cycles", pooled);
+    TEST_ASSERT_EQUAL(kCycleNum * kDeviceNum * 3, pooled.delivered_num);
+    TEST_ASSERT_EQUAL(pooled.delivered_num, per_cycle.delivered_num);
+    TEST_ASSERT_LESS_THAN(per_cycle.allocation_num, pooled.allocation_num);
+    TEST_ASSERT_LESS_THAN(per_cycle.allocated_size, pooled.allocated_size);
+    // Nothing accumulates over the day.
+    TEST_ASSERT_LESS_OR_EQUAL(per_cycle.first_used_size,
+                              per_cycle.last_used_size);
+    TEST_ASSERT_LESS_OR_EQUAL(pooled.first_used_size, pooled.last_used_size);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_day_of_churn);
+    return UNITY_END();
+}
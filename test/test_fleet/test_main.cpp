@@ -0,0 +1,255 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Simulation of a synthetic fleet against a fake broker.
+ * @details The loop mirrors main.cpp on the fake clock: one sensor is
+ * updated at a time in the BLE window, and the updated devices are pushed
+ * with backpressure and delivered with QoS 1 in the network window.
+ */
+#include <Preferences.h>
+#include <WiFi.h>
+#include <fake_broker.h>
+#include <fake_transport.h>
+#include <synthetic_sensor.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "device.h"
+#include "publisher.h"
+#include "scheduler.h"
+#include "settings.h"
+
+// Bytes of the configs and states of one device, as in main.cpp.
+const size_t kDevicePushReserve = 4096;
+
+struct FleetConfig {
+    size_t sensor_num;
+    SyntheticSensorProfile profile;
+    uint32_t period;      // milliseconds of the radio period
+    uint8_t ble_duty;     // percent
+    uint32_t duration;    // milliseconds of the simulation
+    uint32_t publish_latency;  // milliseconds of each PUBLISH
+    size_t ack_loss_period;
+};
+
+struct FleetReport {
+    size_t cycle_num;
+    uint32_t average_cycle_time;  // milliseconds
+    uint32_t max_staleness;       // milliseconds
+    uint32_t average_staleness;   // milliseconds of the last cycle
+    size_t max_pending_num;
+    size_t updated_sensor_num;
+    size_t state_topic_num;
+    size_t duplicate_num;
+    size_t used_size;  // bytes in use at the end
+    size_t peak_size;  // bytes
+    PublishStatistics statistics;
+};
+
+static FleetReport RunFleet(const FleetConfig& config) {
+    FleetReport report = {};
+    FakeMillis() = 0;
+    FakeHeapStatistics start_heap = GetFakeHeapStatistics();
+    ResetFakeHeapPeak();
+    {
+        FakeTransport transport;
+        FakeBrokerClient broker;
+        broker.publish_latency = config.publish_latency;
+        broker.ack_loss_period = config.ack_loss_period;
+        MQTTAckClient ack_client(broker);
+        PubSubClient mqtt_client(ack_client);
+        std::unique_ptr<MQTTPublisher> publisher(
+            new MQTTPublisher(mqtt_client, ack_client, "gw"));
+        SetMQTTPublisher(publisher.get());
+        RadioScheduler scheduler(config.period, config.ble_duty);
+        WiFiClass wifi;
+
+        std::vector<std::unique_ptr<SyntheticSensor>> sensors;
+        for (size_t i = 0; i < config.sensor_num; ++i) {
+            char mac[18];
+            snprintf(mac, sizeof(mac), "02:00:00:00:%02x:%02x",
+                     static_cast<int>((i >> 8) & 0xFF),
+                     static_cast<int>(i & 0xFF));
+            sensors.emplace_back(new SyntheticSensor(
+                DeviceAddress(std::string(mac)), config.profile));
+        }
+        std::vector<uint32_t> last_updates(config.sensor_num, 0);
+        std::vector<bool> is_updated(config.sensor_num, false);
+        std::vector<Device*> pending_devices;
+        pending_devices.reserve(config.sensor_num);
+        size_t next_index = 0;
+        uint32_t cycle_start = 0;
+        uint64_t total_cycle_time = 0;
+
+        while (millis() < config.duration) {
+            bool is_busy = false;
+            if (scheduler.GetWindow() == RadioWindow::BLE) {
+                if (scheduler.GetRemainingTime() >=
+                    config.profile.latency + 100) {
+                    is_busy = true;
+                    SyntheticSensor* pSensor = sensors[next_index].get();
+                    pSensor->Update(transport);
+                    if (pSensor->IsUpdated()) {
+                        last_updates[next_index] = millis();
+                        is_updated[next_index] = true;
+                        if (std::find(pending_devices.begin(),
+                                      pending_devices.end(),
+                                      pSensor) == pending_devices.end()) {
+                            pending_devices.push_back(pSensor);
+                        }
+                    }
+                    next_index = (next_index + 1) % config.sensor_num;
+                    if (next_index == 0) {
+                        uint32_t now = millis();
+                        uint64_t total_staleness = 0;
+                        for (uint32_t last_update : last_updates) {
+                            uint32_t staleness = now - last_update;
+                            report.max_staleness =
+                                std::max(report.max_staleness, staleness);
+                            total_staleness += staleness;
+                        }
+                        report.average_staleness =
+                            total_staleness / config.sensor_num;
+                        total_cycle_time += now - cycle_start;
+                        ++report.cycle_num;
+                        cycle_start = now;
+                    }
+                }
+            } else {
+                auto it = pending_devices.begin();
+                while ((it != pending_devices.end()) &&
+                       ((publisher->GetPendingNum() == 0) ||
+                        (publisher->GetFreeSize() >= kDevicePushReserve))) {
+                    TEST_ASSERT_TRUE((*it)->Push(wifi, mqtt_client, "gw"));
+                    it = pending_devices.erase(it);
+                }
+                if (publisher->GetPendingNum() > 0) {
+                    is_busy = publisher->Pump(scheduler.GetRemainingTime()) >
+                              0;
+                }
+            }
+            report.max_pending_num =
+                std::max(report.max_pending_num, pending_devices.size());
+            if (!is_busy) {
+                // Idle until the window ends or an ack times out.
+                // Copied, since the in-class constant has no definition.
+                uint32_t ack_timeout = MQTTPublisher::kAckTimeout;
+                delay(std::max<uint32_t>(
+                    1, std::min(scheduler.GetRemainingTime(), ack_timeout)));
+            }
+        }
+        report.used_size = GetFakeHeapStatistics().used_size -
+                           start_heap.used_size;
+        report.peak_size = GetFakeHeapStatistics().peak_size -
+                           start_heap.used_size;
+        report.average_cycle_time =
+            (report.cycle_num > 0) ? total_cycle_time / report.cycle_num : 0;
+        report.updated_sensor_num =
+            std::count(is_updated.begin(), is_updated.end(), true);
+        std::set<std::string> state_topics;
+        for (const FakeMQTTMessage& message : broker.messages) {
+            if (message.topic.find("/state") != std::string::npos) {
+                state_topics.insert(message.topic);
+            }
+        }
+        report.state_topic_num = state_topics.size();
+        report.duplicate_num = broker.duplicate_num;
+        report.statistics = publisher->GetStatistics();
+        SetMQTTPublisher(nullptr);
+    }
+    return report;
+}
+
+static void PrintReport(const FleetConfig& config,
+                        const FleetReport& report) {
+    char message[320];
+    snprintf(message, sizeof(message),
+             "%d sensors: cycle %d ms, staleness avg %d ms, max %d ms, "
+             "pending devices max %d, delivered %d of %d, retry %d, "
+             "dropped %d, latency avg %d ms, max %d ms, heap %d B at end, "
+             "peak %d B (%d B per sensor)",
+             static_cast<int>(config.sensor_num),
+             static_cast<int>(report.average_cycle_time),
+             static_cast<int>(report.average_staleness),
+             static_cast<int>(report.max_staleness),
+             static_cast<int>(report.max_pending_num),
+             static_cast<int>(report.statistics.delivered_num),
+             static_cast<int>(report.statistics.enqueued_num),
+             static_cast<int>(report.statistics.retry_num),
+             static_cast<int>(report.statistics.dropped_num),
+             static_cast<int>(
+                 report.statistics.delivered_num > 0
+                     ? report.statistics.total_latency /
+                           report.statistics.delivered_num
+                     : 0),
+             static_cast<int>(report.statistics.max_latency),
+             static_cast<int>(report.used_size),
+             static_cast<int>(report.peak_size),
+             static_cast<int>(report.peak_size / config.sensor_num));
+    TEST_MESSAGE(message);
+}
+
+void setUp(void) {
+    FakePreferencesClear();
+    SettingsSetup("gw");
+}
+
+void tearDown(void) {}
+
+/**
+ * @brief Check that every sensor is delivered and nothing is dropped.
+ */
+static FleetReport AssertFleet(const FleetConfig& config) {
+    FleetReport report = RunFleet(config);
+    PrintReport(config, report);
+    TEST_ASSERT_GREATER_THAN(1, report.cycle_num);
+    TEST_ASSERT_EQUAL(config.sensor_num, report.updated_sensor_num);
+    TEST_ASSERT_EQUAL(config.sensor_num, report.state_topic_num);
+    TEST_ASSERT_EQUAL(0, report.statistics.dropped_num);
+    TEST_ASSERT_GREATER_THAN(0, report.statistics.delivered_num);
+    TEST_ASSERT_LESS_OR_EQUAL(config.sensor_num, report.max_pending_num);
+    // A missed update leaves a sensor stale for another cycle.
+    TEST_ASSERT_LESS_OR_EQUAL(report.average_cycle_time,
+                              report.average_staleness);
+    return report;
+}
+
+void test_fleet_50(void) {
+    FleetConfig config = {50, {200, 5, 0.5F}, 30000, 80, 600000, 20, 0};
+    AssertFleet(config);
+}
+
+void test_fleet_200(void) {
+    FleetConfig config = {200, {200, 5, 0.5F}, 30000, 80, 1800000, 20, 0};
+    AssertFleet(config);
+}
+
+void test_fleet_1000(void) {
+    FleetConfig config = {1000, {200, 5, 0.5F}, 30000, 80, 3600000, 20, 0};
+    FleetReport report = AssertFleet(config);
+    // The sensors and the queue of pending devices, about 600 B per sensor
+    // on a 64-bit host.
+    TEST_ASSERT_LESS_THAN(1024 * config.sensor_num, report.peak_size);
+}
+
+void test_fleet_lost_acks(void) {
+    FleetConfig config = {50, {200, 5, 0.5F}, 30000, 80, 600000, 20, 10};
+    FleetReport report = AssertFleet(config);
+    TEST_ASSERT_GREATER_THAN(0, report.statistics.retry_num);
+    TEST_ASSERT_GREATER_THAN(0, report.duplicate_num);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fleet_50);
+    RUN_TEST(test_fleet_200);
+    RUN_TEST(test_fleet_1000);
+    RUN_TEST(test_fleet_lost_acks);
+    return UNITY_END();
+}
@@ -0,0 +1,319 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the flash history on a fake partition.
+ */
+#include <esp_partition.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "history.h"
+
+const char kRequestTopic[] = "bluetooth-gateway/history/gw/request";
+const uint8_t kSensor[6] = {0x84, 0xF7, 0x03, 0x3A, 0x82, 0xBA};
+const uint16_t kTemperatureUUID = 0x2A6E;
+const uint32_t kStartTime = 1700000000;
+
+struct Sample {
+    uint32_t time;
+    float value;
+};
+
+void setUp(void) {
+    FakeFlash(64 * 1024);
+    SetHistorySeriesNum(16);
+    HistorySetup(64 * 1024, "gw");
+}
+
+void tearDown(void) {}
+
+static void Record(const uint8_t* pAddress, uint16_t uuid, uint32_t time,
+                   float value) {
+    RecordHistory(pAddress, uuid, time, value);
+    StoreHistory();
+}
+
+static void Request(const char* pPayload) {
+    HandleHistoryMessage(kRequestTopic,
+                         reinterpret_cast<const uint8_t*>(pPayload),
+                         strlen(pPayload));
+}
+
+/**
+ * @brief Read all chunks of the response as the loop does.
+ * @details A call without a chunk only scanned part of the flash, so it is
+ * called again a few times.
+ * @return The samples, or none if no request is pending.
+ */
+static std::vector<Sample> CollectResponse() {
+    std::vector<Sample> samples;
+    char topic[80];
+    char payload[1024];
+    size_t idle_num = 0;
+    for (size_t call_num = 0; (call_num < 10000) && (idle_num < 8);
+         ++call_num) {
+        if (!GetHistoryResponse(topic, sizeof(topic), payload,
+                                sizeof(payload))) {
+            ++idle_num;
+            continue;
+        }
+        idle_num = 0;
+        TEST_ASSERT_EQUAL_STRING("bluetooth-gateway/history/gw/response",
+                                 topic);
+        unsigned long offset = 0;
+        TEST_ASSERT_EQUAL(1, sscanf(strstr(payload, "\"offset\":"),
+                                    "\"offset\":%lu", &offset));
+        TEST_ASSERT_EQUAL(samples.size(), offset);
+        const char* pSample = strstr(payload, "\"samples\":[") + 11;
+        unsigned long time = 0;
+        float value = 0;
+        while (sscanf(pSample, "[%lu,%f]", &time, &value) == 2) {
+            samples.push_back({static_cast<uint32_t>(time), value});
+            pSample = strchr(pSample, ']') + 1;
+            pSample += (*pSample == ',') ? 1 : 0;
+        }
+        if (strstr(payload, "\"last\":1}") != nullptr) {
+            break;
+        }
+    }
+    return samples;
+}
+
+void test_round_trip(void) {
+    uint8_t other[6] = {0xA4, 0xC1, 0x38, 0x00, 0x00, 0x01};
+    for (uint32_t i = 0; i < 300; ++i) {
+        Record(kSensor, kTemperatureUUID, kStartTime + 30 * i, 20 + 0.1F * i);
+        Record(kSensor, 0x2A6F, kStartTime + 30 * i, 50.0F);
+        Record(other, kTemperatureUUID, kStartTime + 30 * i, -5.0F);
+    }
+    // Blocks in flash and the open block in RAM.
+    TEST_ASSERT_GREATER_THAN(0, GetHistoryStatistics().written_block_num);
+    Request("{\"sensor\":\"84F7033A82BA\",\"uuid\":10862,\"from\":0,"
+            "\"to\":4000000000}");
+    std::vector<Sample> samples = CollectResponse();
+    TEST_ASSERT_EQUAL(300, samples.size());
+    for (uint32_t i = 0; i < 300; ++i) {
+        TEST_ASSERT_EQUAL(kStartTime + 30 * i, samples[i].time);
+        TEST_ASSERT_FLOAT_WITHIN(1e-3, 20 + 0.1F * i, samples[i].value);
+    }
+    // The response is finished.
+    char topic[80];
+    char payload[256];
+    TEST_ASSERT_FALSE(
+        GetHistoryResponse(topic, sizeof(topic), payload, sizeof(payload)));
+}
+
+void test_time_range(void) {
+    for (uint32_t i = 0; i < 200; ++i) {
+        Record(kSensor, kTemperatureUUID, kStartTime + 60 * i, 1.0F * i);
+    }
+    char request[128];
+    snprintf(request, sizeof(request),
+             "{\"sensor\":\"84F7033A82BA\",\"uuid\":10862,\"from\":%u,"
+             "\"to\":%u}",
+             kStartTime + 60 * 50, kStartTime + 60 * 59);
+    Request(request);
+    std::vector<Sample> samples = CollectResponse();
+    TEST_ASSERT_EQUAL(10, samples.size());
+    TEST_ASSERT_EQUAL(kStartTime + 60 * 50, samples.front().time);
+    TEST_ASSERT_EQUAL(kStartTime + 60 * 59, samples.back().time);
+}
+
+void test_tolerant_request(void) {
+    for (uint32_t i = 0; i < 10; ++i) {
+        Record(kSensor, kTemperatureUUID, kStartTime + 30 * i, 21.0F);
+    }
+    const char* requests[] = {
+        "{\"sensor\":\"84F7033A82BA\",\"uuid\":10862}",
+        " { \"uuid\" : 10862 ,\n \"sensor\" : \"84:f7:03:3a:82:ba\" } ",
+        "{\"from\":0,\"uuid\":\"0x2A6E\",\"sensor\":\"84-F7-03-3A-82-BA\","
+        "\"id\":\"dashboard\",\"to\":4000000000,\"limit\":100}",
+    };
+    for (const char* pRequest : requests) {
+        Request(pRequest);
+        TEST_ASSERT_EQUAL_MESSAGE(10, CollectResponse().size(), pRequest);
+    }
+}
+
+void test_invalid_request(void) {
+    Record(kSensor, kTemperatureUUID, kStartTime, 21.0F);
+    const char* requests[] = {
+        "{\"sensor\":\"84F7033A82BA\"}",
+        "{\"uuid\":10862}",
+        "{\"sensor\":\"84F7033A82\",\"uuid\":10862}",
+        "{\"sensor\":\"84F7033A82BAFF\",\"uuid\":10862}",
+        "{\"sensor\":\"84F7033A82BG\",\"uuid\":10862}",
+        "{\"sensor\":\"84F7033A82BA\",\"uuid\":70000}",
+        "{\"sensor\":\"84F7033A82BA\",\"uuid\":-1}",
+        "{\"sensor\":\"84F7033A82BA\",\"uuid\":10862,\"to\":{\"t\":1}}",
+        "{\"sensor\":\"84F7033A82BA\",\"uuid\":10862",
+        "[\"84F7033A82BA\",10862]",
+        "",
+    };
+    for (const char* pRequest : requests) {
+        Request(pRequest);
+        TEST_ASSERT_EQUAL_MESSAGE(0, CollectResponse().size(), pRequest);
+    }
+}
+
+/**
+ * @brief Eight series share four open blocks.
+ */
+void test_more_series_than_slots(void) {
+    SetHistorySeriesNum(4);
+    uint8_t address[6];
+    memcpy(address, kSensor, 6);
+    const uint32_t round_num = 2000;
+    for (uint32_t i = 0; i < round_num; ++i) {
+        for (uint8_t j = 0; j < 8; ++j) {
+            address[5] = j;
+            Record(address, kTemperatureUUID, kStartTime + 30 * i,
+                   20.0F + 0.1F * ((i / 20 + j) % 7));
+        }
+    }
+    HistoryStatistics statistics = GetHistoryStatistics();
+    TEST_ASSERT_EQUAL(8 * round_num,
+                      statistics.recorded_num + statistics.dropped_num);
+    TEST_ASSERT_GREATER_THAN(0, statistics.dropped_num);
+    // Only blocks at least half full are evicted, not one per sample.
+    TEST_ASSERT_GREATER_THAN(60 * statistics.written_block_num,
+                             statistics.recorded_num);
+    // With a series for each, nothing is dropped.
+    FakeFlash(64 * 1024);
+    SetHistorySeriesNum(8);
+    HistorySetup(64 * 1024, "gw");
+    for (uint32_t i = 0; i < round_num; ++i) {
+        for (uint8_t j = 0; j < 8; ++j) {
+            address[5] = j;
+            Record(address, kTemperatureUUID, kStartTime + 30 * i,
+                   20.0F + 0.1F * ((i / 20 + j) % 7));
+        }
+    }
+    statistics = GetHistoryStatistics();
+    TEST_ASSERT_EQUAL(0, statistics.dropped_num);
+    TEST_ASSERT_EQUAL(8 * round_num, statistics.recorded_num);
+    TEST_ASSERT_GREATER_THAN(100 * statistics.written_block_num,
+                             statistics.recorded_num);
+}
+
+void test_resize_keeps_samples(void) {
+    for (uint32_t i = 0; i < 20; ++i) {
+        Record(kSensor, kTemperatureUUID, kStartTime + 30 * i, 21.0F);
+    }
+    TEST_ASSERT_EQUAL(0, GetHistoryStatistics().written_block_num);
+    SetHistorySeriesNum(32);
+    TEST_ASSERT_EQUAL(1, GetHistoryStatistics().written_block_num);
+    Request("{\"sensor\":\"84F7033A82BA\",\"uuid\":10862}");
+    TEST_ASSERT_EQUAL(20, CollectResponse().size());
+}
+
+void test_hourly_flush(void) {
+    for (uint32_t i = 0; i <= 6; ++i) {
+        Record(kSensor, kTemperatureUUID, kStartTime + 600 * i, 21.0F);
+    }
+    TEST_ASSERT_EQUAL(1, GetHistoryStatistics().written_block_num);
+}
+
+void test_reopen_continues(void) {
+    for (uint32_t i = 0; i < 1000; ++i) {
+        Record(kSensor, kTemperatureUUID, kStartTime + 30 * i, 0.5F * i);
+    }
+    uint32_t written_num = GetHistoryStatistics().written_block_num;
+    TEST_ASSERT_GREATER_THAN(1, written_num);
+    // After a reset the open block in RAM is lost.
+    HistorySetup(64 * 1024, "gw");
+    TEST_ASSERT_EQUAL(written_num, GetHistoryStatistics().stored_block_num);
+    Request("{\"sensor\":\"84F7033A82BA\",\"uuid\":10862}");
+    std::vector<Sample> samples = CollectResponse();
+    TEST_ASSERT_GREATER_THAN(0, samples.size());
+    TEST_ASSERT_LESS_THAN(1000, samples.size());
+    TEST_ASSERT_EQUAL(kStartTime, samples.front().time);
+    // New blocks follow the stored ones.
+    uint32_t time = samples.back().time + 30;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        Record(kSensor, kTemperatureUUID, time + 30 * i, 0.5F * i);
+    }
+    Request("{\"sensor\":\"84F7033A82BA\",\"uuid\":10862}");
+    std::vector<Sample> more_samples = CollectResponse();
+    TEST_ASSERT_EQUAL(samples.size() + 1000, more_samples.size());
+    for (size_t i = 1; i < more_samples.size(); ++i) {
+        TEST_ASSERT_LESS_THAN(more_samples[i].time, more_samples[i - 1].time);
+    }
+}
+
+void test_wrap_erases_oldest(void) {
+    FakeFlash(64 * 1024);
+    HistorySetup(8 * 1024, "gw");  // 32 blocks
+    for (uint32_t i = 0; i < 10000; ++i) {
+        Record(kSensor, kTemperatureUUID, kStartTime + 30 * i,
+               20.0F + 0.1F * (i % 13));
+    }
+    HistoryStatistics statistics = GetHistoryStatistics();
+    TEST_ASSERT_GREATER_THAN(32, statistics.written_block_num);
+    TEST_ASSERT_LESS_OR_EQUAL(32, statistics.stored_block_num);
+    Request("{\"sensor\":\"84F7033A82BA\",\"uuid\":10862}");
+    std::vector<Sample> samples = CollectResponse();
+    TEST_ASSERT_GREATER_THAN(0, samples.size());
+    TEST_ASSERT_LESS_THAN(10000, samples.size());
+    // The newest samples are kept in order.
+    TEST_ASSERT_EQUAL(kStartTime + 30 * 9999, samples.back().time);
+    for (size_t i = 1; i < samples.size(); ++i) {
+        TEST_ASSERT_EQUAL(samples[i - 1].time + 30, samples[i].time);
+    }
+}
+
+/**
+ * @brief A week of a thermometer with 0.1 °C resolution sampled every 30 s.
+ */
+void test_benchmark_week(void) {
+    const uint32_t sample_num = 7 * 24 * 120;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < sample_num; ++i) {
+        float value =
+            std::round(10 * (21.0 + 3.0 * std::sin(i * 2 * M_PI / 2880))) /
+            10.0F;
+        RecordHistory(kSensor, kTemperatureUUID, kStartTime + 30 * i, value);
+        StoreHistory();
+    }
+    double store_ns = std::chrono::duration<double, std::nano>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    HistoryStatistics statistics = GetHistoryStatistics();
+    TEST_ASSERT_EQUAL(sample_num, statistics.recorded_num);
+    start = std::chrono::steady_clock::now();
+    Request("{\"sensor\":\"84F7033A82BA\",\"uuid\":10862}");
+    std::vector<Sample> samples = CollectResponse();
+    double query_ns = std::chrono::duration<double, std::nano>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    TEST_ASSERT_EQUAL(sample_num, samples.size());
+    char message[160];
+    snprintf(message, sizeof(message),
+             "%u samples in %u blocks, %.2f B/sample of flash, store %.0f ns, "
+             "query %.0f ns per sample",
+             sample_num, statistics.written_block_num,
+             256.0 * statistics.written_block_num / sample_num,
+             store_ns / sample_num, query_ns / sample_num);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_time_range);
+    RUN_TEST(test_tolerant_request);
+    RUN_TEST(test_invalid_request);
+    RUN_TEST(test_more_series_than_slots);
+    RUN_TEST(test_resize_keeps_samples);
+    RUN_TEST(test_hourly_flush);
+    RUN_TEST(test_reopen_continues);
+    RUN_TEST(test_wrap_erases_oldest);
+    RUN_TEST(test_benchmark_week);
+    return UNITY_END();
+}
@@ -0,0 +1,101 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the metrics registry and its Prometheus format.
+ */
+#include <unity.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "metrics.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static std::string Format() {
+    static char buffer[8192];
+    size_t length = FormatMetrics(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(buffer), length);
+    return std::string(buffer, length);
+}
+
+void test_counters_and_gauges(void) {
+    IncrementMetric(Metric::Samples);
+    IncrementMetric(Metric::Samples, 4);
+    SetMetric(Metric::FreeHeap, 123456);
+    IncrementMetric(Metric::AlertPublishFailures);
+    std::string metrics = Format();
+    TEST_ASSERT_TRUE(metrics.find("# TYPE gateway_samples_total counter\n"
+                                  "gateway_samples_total 5\n") !=
+                     std::string::npos);
+    TEST_ASSERT_TRUE(
+        metrics.find("# TYPE gateway_alert_publish_failures_total counter\n"
+                     "gateway_alert_publish_failures_total 1\n") !=
+        std::string::npos);
+    TEST_ASSERT_TRUE(metrics.find("# TYPE gateway_free_heap_bytes gauge\n"
+                                  "gateway_free_heap_bytes 123456\n") !=
+                     std::string::npos);
+}
+
+void test_device_labels(void) {
+    AddDeviceSamples("sensor-A4C138123456", 3);
+    AddDeviceSamples("sensor-84F7033A82BA", 1);
+    AddDeviceSamples("sensor-A4C138123456", 2);
+    std::string metrics = Format();
+    TEST_ASSERT_TRUE(
+        metrics.find("gateway_device_samples_total{device=\""
+                     "sensor-A4C138123456\"} 5\n"
+                     "gateway_device_samples_total{device=\""
+                     "sensor-84F7033A82BA\"} 1\n") != std::string::npos);
+}
+
+void test_long_label_truncated(void) {
+    AddDeviceSamples("a-very-long-device-name-which-exceeds-the-label", 1);
+    std::string metrics = Format();
+    TEST_ASSERT_TRUE(metrics.find("{device=\"a-very-long-device-name-which-"
+                                  "exceeds-t\"} 1\n") != std::string::npos);
+}
+
+void test_label_slots_full(void) {
+    char device[16];
+    for (int i = 0; i < 32; ++i) {
+        snprintf(device, sizeof(device), "extra-%02d", i);
+        AddDeviceSamples(device, 1);
+    }
+    std::string metrics = Format();
+    size_t label_num = 0;
+    for (size_t offset = metrics.find("{device=");
+         offset != std::string::npos;
+         offset = metrics.find("{device=", offset + 1)) {
+        ++label_num;
+    }
+    // 3 devices of the previous tests and 13 of this one.
+    TEST_ASSERT_EQUAL(16, label_num);
+    TEST_ASSERT_TRUE(metrics.find("extra-12") != std::string::npos);
+    TEST_ASSERT_TRUE(metrics.find("extra-13") == std::string::npos);
+}
+
+void test_truncated_at_line(void) {
+    char buffer[300];
+    size_t length = FormatMetrics(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(buffer), length);
+    TEST_ASSERT_LESS_THAN(sizeof(buffer), length);
+    TEST_ASSERT_EQUAL('\n', buffer[length - 1]);
+    // The first metric does not fit.
+    TEST_ASSERT_EQUAL(0, FormatMetrics(buffer, 64));
+    TEST_ASSERT_EQUAL_STRING("", buffer);
+    TEST_ASSERT_EQUAL(0, FormatMetrics(buffer, 0));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_counters_and_gauges);
+    RUN_TEST(test_device_labels);
+    RUN_TEST(test_long_label_truncated);
+    RUN_TEST(test_label_slots_full);
+    RUN_TEST(test_truncated_at_line);
+    return UNITY_END();
+}
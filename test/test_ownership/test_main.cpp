@@ -0,0 +1,251 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the RSSI election of shared sensors.
+ */
+#include <Arduino.h>
+#include <unity.h>
+
+#include <cstring>
+
+#include "ownership.h"
+
+const uint8_t kSensor[6] = {0xA4, 0xC1, 0x38, 0x00, 0x00, 0x01};
+
+void setUp(void) { FakeMillis() = 0; }
+
+void tearDown(void) { SetOwnershipElection(nullptr); }
+
+void test_claim_alone(void) {
+    OwnershipElection election("gw-a");
+    TEST_ASSERT_TRUE(election.UpdateLocal(kSensor, -70, 1000));
+}
+
+void test_wait_for_stronger(void) {
+    OwnershipElection election("gw-a");
+    election.UpdateRemote(kSensor, "gw-b", -60, false, 1000);
+    TEST_ASSERT_FALSE(election.UpdateLocal(kSensor, -70, 2000));
+    // The same RSSI is ranked by the gateway ID.
+    OwnershipElection other("gw-c");
+    other.UpdateRemote(kSensor, "gw-b", -70, false, 1000);
+    TEST_ASSERT_FALSE(other.UpdateLocal(kSensor, -70, 2000));
+}
+
+void test_hysteresis(void) {
+    OwnershipElection election("gw-a");
+    TEST_ASSERT_TRUE(election.UpdateLocal(kSensor, -70, 1000));
+    election.UpdateRemote(kSensor, "gw-b", -62, false, 2000);
+    TEST_ASSERT_TRUE(election.UpdateLocal(kSensor, -70, 3000));
+    election.UpdateRemote(kSensor, "gw-b", -61, false, 4000);
+    TEST_ASSERT_FALSE(election.UpdateLocal(kSensor, -70, 5000));
+}
+
+void test_no_double_claim(void) {
+    OwnershipElection election("gw-a");
+    // gw-b owns the sensor though this gateway is stronger now.
+    election.UpdateRemote(kSensor, "gw-b", -75, true, 1000);
+    TEST_ASSERT_FALSE(election.UpdateLocal(kSensor, -70, 2000));
+}
+
+void test_stale_owner_ignored(void) {
+    OwnershipElection election("gw-a");
+    election.UpdateRemote(kSensor, "gw-b", -60, true, 0);
+    uint32_t timeout = election.GetSightingTimeout();
+    TEST_ASSERT_FALSE(election.UpdateLocal(kSensor, -70, timeout - 1));
+    TEST_ASSERT_TRUE(election.UpdateLocal(kSensor, -70, timeout));
+}
+
+void test_timeout_bounds(void) {
+    OwnershipElection election("gw-a");
+    TEST_ASSERT_EQUAL(OwnershipElection::kMinSightingTimeout,
+                      election.GetSightingTimeout());
+    election.SetSightingTimeout(1000);
+    TEST_ASSERT_EQUAL(OwnershipElection::kMinSightingTimeout,
+                      election.GetSightingTimeout());
+    election.SetSightingTimeout(500000);
+    TEST_ASSERT_EQUAL(500000, election.GetSightingTimeout());
+}
+
+/**
+ * @brief Sixteen sensors at a 24 s BLE window take several minutes per
+ * cycle, much longer than the minimum timeout.
+ */
+void test_long_cycle_keeps_claim(void) {
+    const uint32_t cycle = 251000;
+    OwnershipElection owner("gw-a");
+    OwnershipElection other("gw-b");
+    owner.SetSightingTimeout(2 * cycle);
+    other.SetSightingTimeout(2 * cycle);
+    uint8_t address[6];
+    int rssi = 0;
+    bool is_owner = false;
+    for (uint32_t now = 0; now < 10 * cycle; now += cycle) {
+        TEST_ASSERT_TRUE(owner.UpdateLocal(kSensor, -60, now));
+        while (owner.PopAnnouncement(address, rssi, is_owner, now)) {
+            other.UpdateRemote(address, "gw-a", rssi, is_owner, now);
+        }
+        // gw-b is stronger within the hysteresis and sights the sensor
+        // just before the next sighting of gw-a.
+        TEST_ASSERT_FALSE(other.UpdateLocal(kSensor, -55, now + cycle - 1));
+        while (other.PopAnnouncement(address, rssi, is_owner,
+                                     now + cycle - 1)) {
+            owner.UpdateRemote(address, "gw-b", rssi, is_owner,
+                               now + cycle - 1);
+        }
+    }
+}
+
+void test_announce_claim_again(void) {
+    OwnershipElection election("gw-a");
+    election.SetSightingTimeout(300000);
+    uint8_t address[6];
+    int rssi = 0;
+    bool is_owner = false;
+    TEST_ASSERT_TRUE(election.UpdateLocal(kSensor, -70, 1000));
+    TEST_ASSERT_TRUE(election.PopAnnouncement(address, rssi, is_owner, 1000));
+    TEST_ASSERT_EQUAL_MEMORY(kSensor, address, 6);
+    TEST_ASSERT_EQUAL(-70, rssi);
+    TEST_ASSERT_TRUE(is_owner);
+    TEST_ASSERT_FALSE(
+        election.PopAnnouncement(address, rssi, is_owner, 100999));
+    // A third of the timeout after the last announcement.
+    TEST_ASSERT_TRUE(
+        election.PopAnnouncement(address, rssi, is_owner, 101000));
+    TEST_ASSERT_TRUE(is_owner);
+    TEST_ASSERT_FALSE(
+        election.PopAnnouncement(address, rssi, is_owner, 101000));
+    // Not repeated after the local sighting is stale.
+    TEST_ASSERT_FALSE(
+        election.PopAnnouncement(address, rssi, is_owner, 301000));
+}
+
+void test_no_repeat_without_claim(void) {
+    OwnershipElection election("gw-a");
+    uint8_t address[6];
+    int rssi = 0;
+    bool is_owner = true;
+    election.UpdateRemote(kSensor, "gw-b", -50, true, 0);
+    TEST_ASSERT_FALSE(election.UpdateLocal(kSensor, -70, 1000));
+    TEST_ASSERT_TRUE(election.PopAnnouncement(address, rssi, is_owner, 1000));
+    TEST_ASSERT_FALSE(is_owner);
+    TEST_ASSERT_FALSE(
+        election.PopAnnouncement(address, rssi, is_owner, 80000));
+}
+
+void test_remote_does_not_evict(void) {
+    OwnershipElection election("gw-a");
+    uint8_t address[6];
+    memcpy(address, kSensor, 6);
+    for (size_t i = 0; i < OwnershipElection::kMaxSensorNum; ++i) {
+        address[5] = i;
+        election.UpdateLocal(address, -70, 1000 + i);
+    }
+    address[5] = 0x80;
+    election.UpdateRemote(address, "gw-b", -40, true, 2000);
+    // Every local sensor is still tracked and owned.
+    for (size_t i = 0; i < OwnershipElection::kMaxSensorNum; ++i) {
+        address[5] = i;
+        TEST_ASSERT_TRUE(election.UpdateLocal(address, -70, 3000));
+    }
+}
+
+/**
+ * @brief Two gateways sharing a full registry settle to one owner each.
+ */
+void test_full_registry_shared(void) {
+    const uint32_t cycle = 30000;
+    OwnershipElection gateway_a("gw-a");
+    OwnershipElection gateway_b("gw-b");
+    uint8_t address[6];
+    int rssi = 0;
+    bool is_owner = false;
+    for (size_t round = 0; round < 6; ++round) {
+        uint32_t now = round * cycle;
+        bool is_owned_a[kMaxDevNum];
+        bool is_owned_b[kMaxDevNum];
+        memcpy(address, kSensor, 6);
+        for (size_t i = 0; i < kMaxDevNum; ++i) {
+            address[5] = i;
+            // Each gateway is stronger for half of the sensors.
+            is_owned_a[i] =
+                gateway_a.UpdateLocal(address, (i % 2) ? -60 : -75, now + i);
+        }
+        while (gateway_a.PopAnnouncement(address, rssi, is_owner, now)) {
+            gateway_b.UpdateRemote(address, "gw-a", rssi, is_owner, now);
+        }
+        memcpy(address, kSensor, 6);
+        now += cycle / 2;
+        for (size_t i = 0; i < kMaxDevNum; ++i) {
+            address[5] = i;
+            is_owned_b[i] =
+                gateway_b.UpdateLocal(address, (i % 2) ? -75 : -60, now + i);
+        }
+        while (gateway_b.PopAnnouncement(address, rssi, is_owner, now)) {
+            gateway_a.UpdateRemote(address, "gw-b", rssi, is_owner, now);
+        }
+        if (round < 2) {
+            continue;  // The first claims are settling.
+        }
+        for (size_t i = 0; i < kMaxDevNum; ++i) {
+            TEST_ASSERT_TRUE(is_owned_a[i] != is_owned_b[i]);
+        }
+    }
+}
+
+void test_message_round_trip(void) {
+    OwnershipElection election("gw-a");
+    SetOwnershipElection(&election);
+    const char topic[] = "bluetooth-gateway/sighting/A4C138000001";
+    const char payload[] = "{\"gateway\":\"gw-b\",\"rssi\":-55,\"owner\":1}";
+    FakeMillis() = 1000;
+    HandleSightingMessage(topic, reinterpret_cast<const uint8_t*>(payload),
+                          strlen(payload));
+    FakeMillis() = 2000;
+    TEST_ASSERT_FALSE(ClaimSensor(kSensor, -70));
+    char announced_topic[64];
+    char announced_payload[96];
+    TEST_ASSERT_TRUE(GetSightingAnnouncement(
+        announced_topic, sizeof(announced_topic), announced_payload,
+        sizeof(announced_payload)));
+    TEST_ASSERT_EQUAL_STRING(topic, announced_topic);
+    TEST_ASSERT_EQUAL_STRING("{\"gateway\":\"gw-a\",\"rssi\":-70,\"owner\":0}",
+                             announced_payload);
+    TEST_ASSERT_FALSE(GetSightingAnnouncement(
+        announced_topic, sizeof(announced_topic), announced_payload,
+        sizeof(announced_payload)));
+}
+
+void test_invalid_messages(void) {
+    OwnershipElection election("gw-a");
+    SetOwnershipElection(&election);
+    const char payload[] = "{\"gateway\":\"gw-b\",\"rssi\":-55,\"owner\":1}";
+    HandleSightingMessage("bluetooth-gateway/sighting/A4C1380000",
+                          reinterpret_cast<const uint8_t*>(payload),
+                          strlen(payload));
+    const char invalid[] = "{\"gateway\":\"gw-b\",\"rssi\":\"high\"}";
+    HandleSightingMessage("bluetooth-gateway/sighting/A4C138000001",
+                          reinterpret_cast<const uint8_t*>(invalid),
+                          strlen(invalid));
+    TEST_ASSERT_TRUE(ClaimSensor(kSensor, -70));
+    // Every sensor is owned without an election.
+    SetOwnershipElection(nullptr);
+    TEST_ASSERT_TRUE(ClaimSensor(kSensor, -90));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_claim_alone);
+    RUN_TEST(test_wait_for_stronger);
+    RUN_TEST(test_hysteresis);
+    RUN_TEST(test_no_double_claim);
+    RUN_TEST(test_stale_owner_ignored);
+    RUN_TEST(test_timeout_bounds);
+    RUN_TEST(test_long_cycle_keeps_claim);
+    RUN_TEST(test_announce_claim_again);
+    RUN_TEST(test_no_repeat_without_claim);
+    RUN_TEST(test_remote_does_not_evict);
+    RUN_TEST(test_full_registry_shared);
+    RUN_TEST(test_message_round_trip);
+    RUN_TEST(test_invalid_messages);
+    return UNITY_END();
+}
@@ -0,0 +1,173 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the MQTT publisher against a fake broker.
+ */
+#include <Arduino.h>
+#include <fake_broker.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "publisher.h"
+
+// The head of a record takes 20 bytes and the topic "t" 2 bytes, so each
+// message of kPayloadLength takes 1024 bytes and 12 of them fill the ring.
+const size_t kPayloadLength = 1002;
+const size_t kRecordNum = 12;
+
+static FakeBrokerClient* pBroker = nullptr;
+static MQTTAckClient* pAckClient = nullptr;
+static PubSubClient* pMQTTClient = nullptr;
+static MQTTPublisher* pPublisher = nullptr;
+
+void setUp(void) {
+    FakeMillis() = 0;
+    pBroker = new FakeBrokerClient();
+    pAckClient = new MQTTAckClient(*pBroker);
+    pMQTTClient = new PubSubClient(*pAckClient);
+    pPublisher = new MQTTPublisher(*pMQTTClient, *pAckClient, "gw");
+}
+
+void tearDown(void) {
+    delete pPublisher;
+    delete pMQTTClient;
+    delete pAckClient;
+    delete pBroker;
+}
+
+/**
+ * @brief Queue a message whose payload is filled with its index.
+ */
+static bool EnqueueIndexed(uint8_t index) {
+    std::vector<uint8_t> payload(kPayloadLength, index);
+    return pPublisher->Enqueue("t", payload.data(), payload.size());
+}
+
+void test_deliver_in_order(void) {
+    for (uint8_t i = 0; i < 3; ++i) {
+        TEST_ASSERT_TRUE(EnqueueIndexed(i));
+    }
+    TEST_ASSERT_EQUAL(3, pPublisher->GetPendingNum());
+    TEST_ASSERT_EQUAL(3, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(0, pPublisher->GetPendingNum());
+    TEST_ASSERT_EQUAL(3, pBroker->messages.size());
+    for (uint8_t i = 0; i < 3; ++i) {
+        TEST_ASSERT_EQUAL_STRING("t", pBroker->messages[i].topic.c_str());
+        TEST_ASSERT_EQUAL(kPayloadLength, pBroker->messages[i].payload.size());
+        TEST_ASSERT_EQUAL(i, pBroker->messages[i].payload[0]);
+    }
+    TEST_ASSERT_EQUAL(0, pBroker->duplicate_num);
+}
+
+void test_ring_wrap(void) {
+    // The ack of the 10th message is lost, so it stays at the head.
+    pBroker->ack_loss_period = 10;
+    for (uint8_t i = 0; i < 10; ++i) {
+        TEST_ASSERT_TRUE(EnqueueIndexed(i));
+    }
+    TEST_ASSERT_EQUAL(9, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(1, pPublisher->GetPendingNum());
+    // Two records fit before the end of the pool and the rest wrap around
+    // up to the head.
+    for (uint8_t i = 10; i < 9 + kRecordNum; ++i) {
+        TEST_ASSERT_TRUE(EnqueueIndexed(i));
+    }
+    TEST_ASSERT_EQUAL(kRecordNum, pPublisher->GetPendingNum());
+    TEST_ASSERT_FALSE(EnqueueIndexed(9 + kRecordNum));
+    pBroker->ack_loss_period = 0;
+    delay(MQTTPublisher::kAckTimeout);
+    TEST_ASSERT_EQUAL(kRecordNum, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(0, pPublisher->GetPendingNum());
+    TEST_ASSERT_EQUAL(10 + kRecordNum, pBroker->messages.size());
+    for (uint8_t i = 9; i < 9 + kRecordNum; ++i) {
+        TEST_ASSERT_EQUAL(i, pBroker->messages[i + 1].payload[0]);
+        TEST_ASSERT_EQUAL(kPayloadLength,
+                          pBroker->messages[i + 1].payload.size());
+    }
+    TEST_ASSERT_EQUAL(1, pBroker->duplicate_num);
+    // The ring is empty, so a full ring fits again.
+    for (uint8_t i = 0; i < kRecordNum; ++i) {
+        TEST_ASSERT_TRUE(EnqueueIndexed(i));
+    }
+}
+
+void test_ack_timeout_retry(void) {
+    pBroker->ack_loss_period = 1;
+    TEST_ASSERT_TRUE(EnqueueIndexed(0));
+    TEST_ASSERT_EQUAL(0, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(1, pBroker->publish_num);
+    // Not sent again before the timeout.
+    delay(MQTTPublisher::kAckTimeout - 1);
+    TEST_ASSERT_EQUAL(0, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(1, pBroker->publish_num);
+    pBroker->ack_loss_period = 0;
+    delay(1);
+    TEST_ASSERT_EQUAL(1, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(2, pBroker->publish_num);
+    TEST_ASSERT_EQUAL(1, pBroker->duplicate_num);
+    TEST_ASSERT_EQUAL(0, pPublisher->GetPendingNum());
+    PublishStatistics statistics = pPublisher->GetStatistics();
+    TEST_ASSERT_EQUAL(1, statistics.delivered_num);
+    TEST_ASSERT_EQUAL(1, statistics.retry_num);
+    TEST_ASSERT_EQUAL(0, statistics.dropped_num);
+    TEST_ASSERT_EQUAL(MQTTPublisher::kAckTimeout, statistics.max_latency);
+}
+
+void test_drop_after_third_attempt(void) {
+    pBroker->ack_loss_period = 1;
+    TEST_ASSERT_TRUE(EnqueueIndexed(0));
+    TEST_ASSERT_TRUE(EnqueueIndexed(1));
+    for (size_t i = 0; i < MQTTPublisher::kMaxAttemptNum; ++i) {
+        TEST_ASSERT_EQUAL(0, pPublisher->Pump(1000));
+        TEST_ASSERT_EQUAL(2, pPublisher->GetPendingNum());
+        delay(MQTTPublisher::kAckTimeout);
+    }
+    TEST_ASSERT_EQUAL(2 * MQTTPublisher::kMaxAttemptNum, pBroker->publish_num);
+    TEST_ASSERT_EQUAL(0, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(2 * MQTTPublisher::kMaxAttemptNum, pBroker->publish_num);
+    TEST_ASSERT_EQUAL(2 * (MQTTPublisher::kMaxAttemptNum - 1),
+                      pBroker->duplicate_num);
+    TEST_ASSERT_EQUAL(0, pPublisher->GetPendingNum());
+    PublishStatistics statistics = pPublisher->GetStatistics();
+    TEST_ASSERT_EQUAL(0, statistics.delivered_num);
+    TEST_ASSERT_EQUAL(2, statistics.dropped_num);
+    TEST_ASSERT_EQUAL(2 * (MQTTPublisher::kMaxAttemptNum - 1),
+                      statistics.retry_num);
+    // The in-flight slots of the dropped messages are free again.
+    pBroker->ack_loss_period = 0;
+    TEST_ASSERT_TRUE(EnqueueIndexed(2));
+    TEST_ASSERT_EQUAL(1, pPublisher->Pump(1000));
+}
+
+void test_full_queue_rejected(void) {
+    for (uint8_t i = 0; i < kRecordNum; ++i) {
+        TEST_ASSERT_TRUE(EnqueueIndexed(i));
+    }
+    TEST_ASSERT_EQUAL(0, pPublisher->GetFreeSize());
+    TEST_ASSERT_FALSE(EnqueueIndexed(kRecordNum));
+    const uint8_t byte = 0;
+    TEST_ASSERT_FALSE(pPublisher->Enqueue("t", &byte, sizeof(byte)));
+    TEST_ASSERT_EQUAL(kRecordNum, pPublisher->GetPendingNum());
+    PublishStatistics statistics = pPublisher->GetStatistics();
+    TEST_ASSERT_EQUAL(kRecordNum, statistics.enqueued_num);
+    TEST_ASSERT_EQUAL(2, statistics.dropped_num);
+    TEST_ASSERT_EQUAL(kRecordNum, pPublisher->Pump(1000));
+    TEST_ASSERT_EQUAL(kRecordNum, pBroker->messages.size());
+    // Too long even for the empty queue.
+    std::vector<uint8_t> payload(MQTTPublisher::kMaxPayloadLength + 1, 0);
+    TEST_ASSERT_FALSE(
+        pPublisher->Enqueue("t", payload.data(), payload.size()));
+    TEST_ASSERT_EQUAL(3, pPublisher->GetStatistics().dropped_num);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_deliver_in_order);
+    RUN_TEST(test_ring_wrap);
+    RUN_TEST(test_ack_timeout_retry);
+    RUN_TEST(test_drop_after_third_attempt);
+    RUN_TEST(test_full_queue_rejected);
+    return UNITY_END();
+}
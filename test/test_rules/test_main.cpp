@@ -0,0 +1,248 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the rule parser and the alert path.
+ */
+#include <Preferences.h>
+#include <PubSubClient.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "rules.h"
+
+const uint8_t kAddress[6] = {0x84, 0xF7, 0x03, 0x3A, 0x82, 0xBA};
+const uint16_t kTemperatureUUID = 0x2A6E;
+const char kRulesTopic[] = "bluetooth-gateway/rules/gw";
+
+static std::string GetAlertPayload() {
+    char topic[80];
+    char payload[192];
+    if (!GetAlert(topic, sizeof(topic), payload, sizeof(payload))) {
+        return "";
+    }
+    TEST_ASSERT_EQUAL_STRING("bluetooth-gateway/alert/gw", topic);
+    return payload;
+}
+
+static std::string HandleRules(const char* pRules) {
+    HandleRulesMessage(kRulesTopic, reinterpret_cast<const uint8_t*>(pRules),
+                       strlen(pRules));
+    char topic[80];
+    char payload[64];
+    TEST_ASSERT_TRUE(
+        GetRulesState(topic, sizeof(topic), payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_STRING("bluetooth-gateway/rules/gw/state", topic);
+    return payload;
+}
+
+void setUp(void) {
+    FakePreferencesClear();
+    RulesSetup("gw");
+    while (GetPendingAlertNum() > 0) {
+        GetAlertPayload();
+    }
+}
+
+void tearDown(void) {}
+
+void test_raise_and_clear(void) {
+    TEST_ASSERT_TRUE(SetRule("1:84F7033A82BA:2A6E:>:8:0.5"));
+    EvaluateRules(kAddress, kTemperatureUUID, 7.9F, 1000, 0);
+    TEST_ASSERT_EQUAL(0, GetPendingAlertNum());
+    EvaluateRules(kAddress, kTemperatureUUID, 8.21F, 2000, 1700000000);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"rule\":1,\"sensor\":\"84F7033A82BA\",\"uuid\":10862,"
+        "\"value\":8.21,\"state\":\"raised\",\"time\":1700000000}",
+        GetAlertPayload().c_str());
+    // Within the hysteresis.
+    EvaluateRules(kAddress, kTemperatureUUID, 7.6F, 3000, 0);
+    EvaluateRules(kAddress, kTemperatureUUID, 9.0F, 4000, 0);
+    TEST_ASSERT_EQUAL(0, GetPendingAlertNum());
+    EvaluateRules(kAddress, kTemperatureUUID, 7.4F, 5000, 0);
+    TEST_ASSERT_EQUAL(0, GetAlertPayload().find(
+                             "{\"rule\":1,\"sensor\":\"84F7033A82BA\","
+                             "\"uuid\":10862,\"value\":7.40,"
+                             "\"state\":\"cleared\",\"time\":null}"));
+    // Other characteristics and sensors are not matched.
+    const uint8_t other[6] = {0x84, 0xF7, 0x03, 0x3A, 0x82, 0xBB};
+    EvaluateRules(other, kTemperatureUUID, 20.0F, 6000, 0);
+    EvaluateRules(kAddress, 0x2A6F, 20.0F, 6000, 0);
+    TEST_ASSERT_EQUAL(0, GetPendingAlertNum());
+}
+
+void test_below_and_rate(void) {
+    TEST_ASSERT_TRUE(SetRule("2:84f7033a82ba:2a6e:<:0"));
+    TEST_ASSERT_TRUE(SetRule("3:84F7033A82BA:2A6E:~:2:1"));
+    EvaluateRules(kAddress, kTemperatureUUID, 5.0F, 0, 0);
+    // 1 °C in 20 s is 3 °C per minute.
+    EvaluateRules(kAddress, kTemperatureUUID, 6.0F, 20000, 0);
+    TEST_ASSERT_TRUE(GetAlertPayload().find("\"rule\":3") !=
+                     std::string::npos);
+    // Below 1 °C per minute clears the rate, in any order with the other.
+    EvaluateRules(kAddress, kTemperatureUUID, -0.5F, 600000, 0);
+    std::string alerts = GetAlertPayload() + GetAlertPayload();
+    TEST_ASSERT_TRUE(alerts.find("\"rule\":2,\"sensor\":\"84F7033A82BA\","
+                                 "\"uuid\":10862,\"value\":-0.50,"
+                                 "\"state\":\"raised\"") != std::string::npos);
+    TEST_ASSERT_TRUE(alerts.find("\"rule\":3,\"sensor\":\"84F7033A82BA\","
+                                 "\"uuid\":10862,\"value\":-0.50,"
+                                 "\"state\":\"cleared\"") !=
+                     std::string::npos);
+    // Unknown values are skipped.
+    EvaluateRules(kAddress, kTemperatureUUID, NAN, 210000, 0);
+    TEST_ASSERT_EQUAL(0, GetPendingAlertNum());
+}
+
+void test_invalid_rules(void) {
+    const char* invalid_rules[] = {
+        "",
+        "0:84F7033A82BA:2A6E:>:8",
+        "65536:84F7033A82BA:2A6E:>:8",
+        "1:84F7033A82B:2A6E:>:8",
+        "1:84F7033A82BG:2A6E:>:8",
+        "1:84F7033A82BA:12345:>:8",
+        "1:84F7033A82BA:2A6E:=:8",
+        "1:84F7033A82BA:2A6E:>:",
+        "1:84F7033A82BA:2A6E:>:inf",
+        "1:84F7033A82BA:2A6E:>:8:-1",
+        "1:84F7033A82BA:2A6E:>:8:0.5x",
+        "1",  // Removes nothing.
+    };
+    for (const char* pRule : invalid_rules) {
+        TEST_ASSERT_FALSE_MESSAGE(SetRule(pRule), pRule);
+    }
+    TEST_ASSERT_TRUE(SetRule("1:84F7033A82BA:2A6E:>:8"));
+    TEST_ASSERT_TRUE(SetRule("1"));
+    EvaluateRules(kAddress, kTemperatureUUID, 20.0F, 0, 0);
+    TEST_ASSERT_EQUAL(0, GetPendingAlertNum());
+}
+
+void test_rules_message(void) {
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"rules\":3,\"error\":null}",
+        HandleRules("1:84F7033A82BA:2A6E:>:8;2:84F7033A82BA:2A6F:<:30\r\n"
+                    "\n3:84F7033A82BB:2A6E:>:10;")
+            .c_str());
+    // A message with an invalid rule keeps the rules.
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"rules\":3,\"error\":2}",
+        HandleRules("1:84F7033A82BA:2A6E:>:8;4:84F7033A82BA:2A6E:?:1")
+            .c_str());
+    EvaluateRules(kAddress, 0x2A6F, 20.0F, 0, 0);
+    TEST_ASSERT_TRUE(GetAlertPayload().find("\"rule\":2") !=
+                     std::string::npos);
+    // The rules are stored.
+    RulesSetup("gw");
+    EvaluateRules(kAddress, kTemperatureUUID, 20.0F, 0, 0);
+    TEST_ASSERT_TRUE(GetAlertPayload().find("\"rule\":1") !=
+                     std::string::npos);
+    // Other topics are ignored.
+    const char rules[] = "5:84F7033A82BA:2A6E:>:8";
+    HandleRulesMessage("bluetooth-gateway/rules/other",
+                       reinterpret_cast<const uint8_t*>(rules),
+                       strlen(rules));
+    char topic[80];
+    char payload[64];
+    TEST_ASSERT_FALSE(
+        GetRulesState(topic, sizeof(topic), payload, sizeof(payload)));
+}
+
+void test_state_kept_across_changes(void) {
+    HandleRules("1:84F7033A82BA:2A6E:>:8:0.5;2:84F7033A82BA:2A6E:~:5");
+    EvaluateRules(kAddress, kTemperatureUUID, 10.0F, 0, 0);
+    TEST_ASSERT_TRUE(GetAlertPayload().find("raised") != std::string::npos);
+    // A new rule and a new threshold keep the raised alert and the rate.
+    HandleRules(
+        "1:84F7033A82BA:2A6E:>:9:0.5;2:84F7033A82BA:2A6E:~:5;"
+        "3:84F7033A82BA:2A6F:>:90");
+    EvaluateRules(kAddress, kTemperatureUUID, 10.5F, 60000, 0);
+    TEST_ASSERT_EQUAL(0, GetPendingAlertNum());
+    EvaluateRules(kAddress, kTemperatureUUID, 8.0F, 120000, 0);
+    TEST_ASSERT_TRUE(GetAlertPayload().find("cleared") != std::string::npos);
+    EvaluateRules(kAddress, kTemperatureUUID, 10.0F, 180000, 0);
+    TEST_ASSERT_TRUE(GetAlertPayload().find("raised") != std::string::npos);
+    // A rule changed to another operator starts again.
+    TEST_ASSERT_TRUE(SetRule("1:84F7033A82BA:2A6E:<:20"));
+    EvaluateRules(kAddress, kTemperatureUUID, 10.0F, 240000, 0);
+    TEST_ASSERT_TRUE(GetAlertPayload().find("raised") != std::string::npos);
+}
+
+/**
+ * @brief 240 rules of 80 sensors, evaluated and published on each sample.
+ */
+void test_benchmark_alert_path(void) {
+    const size_t sensor_num = 80;
+    const uint16_t uuids[3] = {0x2A6E, 0x2A6F, 0x2A19};
+    std::string rules;
+    uint8_t addresses[sensor_num][6];
+    for (size_t i = 0; i < sensor_num; ++i) {
+        const uint8_t address[6] = {0x02, 0x00, 0x00, 0x00,
+                                    static_cast<uint8_t>(i >> 8),
+                                    static_cast<uint8_t>(i)};
+        memcpy(addresses[i], address, sizeof(address));
+        for (size_t j = 0; j < 3; ++j) {
+            char rule[48];
+            snprintf(rule, sizeof(rule), "%u:0200000000%02X:%X:>:50:1;",
+                     static_cast<unsigned>(3 * i + j + 1),
+                     static_cast<unsigned>(i), uuids[j]);
+            rules += rule;
+        }
+    }
+    TEST_ASSERT_EQUAL_STRING("{\"rules\":240,\"error\":null}",
+                             HandleRules(rules.c_str()).c_str());
+    PubSubClient mqtt_client;
+    mqtt_client.connect("gw");
+    const size_t sample_num = 1000000;
+    size_t alert_num = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sample_num; ++i) {
+        // Every 100th sample crosses the threshold one way or the other.
+        float value = (i % 100 == 0) ? ((i / 100) % 2 ? 40.0F : 60.0F) : 45;
+        EvaluateRules(addresses[i % sensor_num], uuids[i % 3], value, i, 0);
+        char topic[80];
+        char payload[192];
+        while (GetAlert(topic, sizeof(topic), payload, sizeof(payload))) {
+            mqtt_client.publish(topic, payload);
+            ++alert_num;
+        }
+        if (mqtt_client.messages.size() > 1000) {
+            mqtt_client.messages.clear();
+        }
+    }
+    double total_ns = std::chrono::duration<double, std::nano>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    TEST_ASSERT_GREATER_THAN(0, alert_num);
+    TEST_ASSERT_EQUAL(0, GetRuleStatistics().dropped_num);
+    // The values stay within the hysteresis of the last alerts.
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sample_num; ++i) {
+        EvaluateRules(addresses[i % sensor_num], uuids[i % 3], 49.5F, i, 0);
+    }
+    double evaluate_ns = std::chrono::duration<double, std::nano>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    TEST_ASSERT_EQUAL(0, GetPendingAlertNum());
+    char message[160];
+    snprintf(message, sizeof(message),
+             "240 rules: evaluate %.1f ns per sample, %.1f ns per sample "
+             "with %d alerts published",
+             evaluate_ns / sample_num, total_ns / sample_num,
+             static_cast<int>(alert_num));
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_raise_and_clear);
+    RUN_TEST(test_below_and_rate);
+    RUN_TEST(test_invalid_rules);
+    RUN_TEST(test_rules_message);
+    RUN_TEST(test_state_kept_across_changes);
+    RUN_TEST(test_benchmark_alert_path);
+    return UNITY_END();
+}
@@ -0,0 +1,148 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the device address and the scan on a fake transport.
+ */
+#include <fake_transport.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "address.h"
+#include "recorder.h"
+#include "scan.h"
+
+/**
+ * @brief Record the reported addresses and stop at a target.
+ */
+class RecordingCallbacks : public ScanReportCallbacks {
+   public:
+    explicit RecordingCallbacks(const DeviceAddress& target = DeviceAddress())
+        : target(target) {}
+    bool onReport(const uint8_t* pAddress, int rssi, const uint8_t* pPayload,
+                  size_t length) override {
+        DeviceAddress address(pAddress);
+        reported.push_back(address.ToString());
+        return address == target;
+    }
+
+    std::vector<std::string> reported;
+
+   private:
+    DeviceAddress target;
+};
+
+static FakeAdvertisement Advertisement(uint8_t last_byte) {
+    FakeAdvertisement advertisement = {
+        {0xA4, 0xC1, 0x38, 0x00, 0x00, last_byte}, -60, {0x02, 0x01, 0x06}};
+    return advertisement;
+}
+
+static DeviceAddress Address(uint8_t last_byte) {
+    return DeviceAddress(Advertisement(last_byte).address);
+}
+
+void setUp(void) { SetCaptureEnabled(false); }
+
+void tearDown(void) {}
+
+void test_address_string(void) {
+    DeviceAddress address(std::string("84:F7:03:3a:82:ba"));
+    const uint8_t expected[6] = {0x84, 0xF7, 0x03, 0x3A, 0x82, 0xBA};
+    TEST_ASSERT_EQUAL_MEMORY(expected, address.GetNative(), 6);
+    TEST_ASSERT_EQUAL_STRING("84:f7:03:3a:82:ba", address.ToString().c_str());
+    TEST_ASSERT_TRUE(address == DeviceAddress(expected));
+    TEST_ASSERT_TRUE(address != DeviceAddress());
+    TEST_ASSERT_FALSE(address.IsZero());
+    TEST_ASSERT_TRUE(DeviceAddress().IsZero());
+    TEST_ASSERT_EQUAL_STRING("00:00:00:00:00:00",
+                             DeviceAddress().ToString().c_str());
+    const char* invalid[] = {"", "84:F7:03:3A:82", "84:F7:03:3A:82:BA:00",
+                             "84-F7-03-3A-82-BA", "84:F7:03:3A:82:BG",
+                             "unknown"};
+    for (const char* pInvalid : invalid) {
+        TEST_ASSERT_TRUE(DeviceAddress(std::string(pInvalid)).IsZero());
+    }
+}
+
+void test_filtered_scan(void) {
+    FakeTransport transport;
+    for (uint8_t i = 0; i < 5; ++i) {
+        transport.advertisements.push_back(Advertisement(i));
+    }
+    DeviceAddress addresses[] = {Address(1), Address(3)};
+    TEST_ASSERT_TRUE(SetScanAcceptList(transport, addresses, 2));
+    TEST_ASSERT_TRUE(IsScanAcceptListActive());
+    TEST_ASSERT_EQUAL(2, transport.GetAcceptListSize());
+    ScanStatistics statistics = GetScanStatistics();
+    RecordingCallbacks callbacks;
+    ScanDevices(transport, 1, &callbacks);
+    TEST_ASSERT_TRUE(transport.last_is_filtered);
+    TEST_ASSERT_EQUAL(2, callbacks.reported.size());
+    TEST_ASSERT_EQUAL_STRING("a4:c1:38:00:00:01",
+                             callbacks.reported[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("a4:c1:38:00:00:03",
+                             callbacks.reported[1].c_str());
+    ScanStatistics updated = GetScanStatistics();
+    TEST_ASSERT_EQUAL(statistics.scan_num + 1, updated.scan_num);
+    TEST_ASSERT_EQUAL(statistics.filtered_scan_num + 1,
+                      updated.filtered_scan_num);
+    TEST_ASSERT_EQUAL(statistics.callback_num + 2, updated.callback_num);
+}
+
+void test_accept_list_overflow(void) {
+    FakeTransport transport(2);
+    for (uint8_t i = 0; i < 5; ++i) {
+        transport.advertisements.push_back(Advertisement(i));
+    }
+    DeviceAddress addresses[] = {Address(0), Address(1), Address(2)};
+    // More devices than the controller holds fall back to software filter.
+    TEST_ASSERT_FALSE(SetScanAcceptList(transport, addresses, 3));
+    TEST_ASSERT_FALSE(IsScanAcceptListActive());
+    TEST_ASSERT_EQUAL(0, transport.GetAcceptListSize());
+    RecordingCallbacks callbacks;
+    ScanDevices(transport, 1, &callbacks);
+    TEST_ASSERT_FALSE(transport.last_is_filtered);
+    TEST_ASSERT_EQUAL(5, callbacks.reported.size());
+    // Disabled with no device.
+    TEST_ASSERT_TRUE(SetScanAcceptList(transport, addresses, 2));
+    TEST_ASSERT_FALSE(SetScanAcceptList(transport, addresses, 0));
+    TEST_ASSERT_EQUAL(0, transport.GetAcceptListSize());
+}
+
+void test_scan_stops_at_target(void) {
+    FakeTransport transport;
+    for (uint8_t i = 0; i < 5; ++i) {
+        transport.advertisements.push_back(Advertisement(i));
+    }
+    SetScanAcceptList(transport, nullptr, 0);
+    RecordingCallbacks callbacks(Address(2));
+    ScanDevices(transport, 1, &callbacks);
+    TEST_ASSERT_EQUAL(3, callbacks.reported.size());
+    TEST_ASSERT_EQUAL(3, transport.report_num);
+}
+
+void test_scan_captured(void) {
+    FakeTransport transport;
+    transport.advertisements.push_back(Advertisement(7));
+    SetScanAcceptList(transport, nullptr, 0);
+    SetCaptureEnabled(true);
+    RecordingCallbacks callbacks;
+    ScanDevices(transport, 1, &callbacks);
+    Print output;
+    CaptureDump(output);
+    TEST_ASSERT_EQUAL(0, output.GetOutput().find("CAP "));
+    TEST_ASSERT_TRUE(output.GetOutput().find("a4c138000007") !=
+                     std::string::npos);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_address_string);
+    RUN_TEST(test_filtered_scan);
+    RUN_TEST(test_accept_list_overflow);
+    RUN_TEST(test_scan_stops_at_target);
+    RUN_TEST(test_scan_captured);
+    return UNITY_END();
+}
@@ -0,0 +1,71 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the radio windows.
+ */
+#include <Arduino.h>
+#include <unity.h>
+
+#include "scheduler.h"
+
+void setUp(void) { FakeMillis() = 5000; }
+
+void tearDown(void) {}
+
+void test_boot_in_network_window(void) {
+    RadioScheduler scheduler(30000, 80);
+    TEST_ASSERT_EQUAL(static_cast<int>(RadioWindow::Network),
+                      static_cast<int>(scheduler.GetWindow()));
+    TEST_ASSERT_EQUAL(6000, scheduler.GetRemainingTime());
+    delay(5999);
+    TEST_ASSERT_EQUAL(static_cast<int>(RadioWindow::Network),
+                      static_cast<int>(scheduler.GetWindow()));
+    delay(1);
+    TEST_ASSERT_EQUAL(static_cast<int>(RadioWindow::BLE),
+                      static_cast<int>(scheduler.GetWindow()));
+    TEST_ASSERT_EQUAL(24000, scheduler.GetRemainingTime());
+}
+
+void test_windows_alternate(void) {
+    RadioScheduler scheduler(30000, 80);
+    scheduler.GetWindow();
+    RadioStatistics start = GetRadioStatistics();
+    for (int i = 0; i < 3; ++i) {
+        delay(scheduler.GetRemainingTime());
+        TEST_ASSERT_EQUAL(static_cast<int>(RadioWindow::BLE),
+                          static_cast<int>(scheduler.GetWindow()));
+        delay(scheduler.GetRemainingTime());
+        TEST_ASSERT_EQUAL(static_cast<int>(RadioWindow::Network),
+                          static_cast<int>(scheduler.GetWindow()));
+        TEST_ASSERT_EQUAL(6000, scheduler.GetRemainingTime());
+    }
+    RadioStatistics end = GetRadioStatistics();
+    TEST_ASSERT_EQUAL(3, end.ble_window_num - start.ble_window_num);
+    TEST_ASSERT_EQUAL(3, end.network_window_num - start.network_window_num);
+}
+
+void test_missed_periods_skipped(void) {
+    RadioScheduler scheduler(30000, 80);
+    scheduler.GetWindow();
+    // A long task misses two periods and ends 1 s into a BLE window.
+    delay(6000 + 2 * 30000 + 1000);
+    TEST_ASSERT_EQUAL(static_cast<int>(RadioWindow::BLE),
+                      static_cast<int>(scheduler.GetWindow()));
+    TEST_ASSERT_EQUAL(23000, scheduler.GetRemainingTime());
+}
+
+void test_full_ble_duty(void) {
+    RadioScheduler scheduler(30000, 100);
+    TEST_ASSERT_EQUAL(static_cast<int>(RadioWindow::BLE),
+                      static_cast<int>(scheduler.GetWindow()));
+    TEST_ASSERT_EQUAL(30000, scheduler.GetRemainingTime());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_in_network_window);
+    RUN_TEST(test_windows_alternate);
+    RUN_TEST(test_missed_periods_skipped);
+    RUN_TEST(test_full_ble_duty);
+    return UNITY_END();
+}
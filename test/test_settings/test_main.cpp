@@ -0,0 +1,130 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the settings and the config messages.
+ */
+#include <Preferences.h>
+#include <unity.h>
+
+#include <cstring>
+#include <string>
+
+#include "settings.h"
+
+const char kConfigTopic[] = "bluetooth-gateway/config/gw";
+
+void setUp(void) {
+    FakePreferencesClear();
+    SettingsSetup("gw");
+}
+
+void tearDown(void) {}
+
+static void Config(const char* pPayload) {
+    HandleConfigMessage(kConfigTopic,
+                        reinterpret_cast<const uint8_t*>(pPayload),
+                        strlen(pPayload));
+}
+
+static std::string GetState() {
+    char topic[80];
+    char payload[384];
+    TEST_ASSERT_TRUE(
+        GetConfigState(topic, sizeof(topic), payload, sizeof(payload)));
+    TEST_ASSERT_EQUAL_STRING("bluetooth-gateway/config/gw/state", topic);
+    return payload;
+}
+
+void test_config_applied(void) {
+    uint32_t version = GetSettingsVersion();
+    Config("{\"scan_s\":2, \"notify_ms\":5000,\"ble_duty\":70}");
+    TEST_ASSERT_EQUAL(2, GetSetting(Setting::ScanDuration));
+    TEST_ASSERT_EQUAL(5000, GetSetting(Setting::NotifyTimeout));
+    TEST_ASSERT_EQUAL(70, GetSetting(Setting::BLEDutyCycle));
+    TEST_ASSERT_NOT_EQUAL(version, GetSettingsVersion());
+    std::string state = GetState();
+    TEST_ASSERT_TRUE(state.find("\"scan_s\":2,") != std::string::npos);
+    TEST_ASSERT_TRUE(state.find("\"error\":null}") != std::string::npos);
+    // Stored for the next boot.
+    SettingsSetup("gw");
+    TEST_ASSERT_EQUAL(2, GetSetting(Setting::ScanDuration));
+}
+
+void test_config_rejected_as_whole(void) {
+    Config("{\"scan_s\":2,\"notify_ms\":1}");
+    TEST_ASSERT_EQUAL(1, GetSetting(Setting::ScanDuration));
+    TEST_ASSERT_TRUE(GetState().find("\"error\":\"notify_ms\"}") !=
+                     std::string::npos);
+    Config("{\"scan_s\":2,\"unknown\":1}");
+    TEST_ASSERT_TRUE(GetState().find("\"error\":\"unknown\"}") !=
+                     std::string::npos);
+    // Out of the range of uint32_t, not wrapped into the bounds.
+    Config("{\"scan_s\":4294967297}");
+    TEST_ASSERT_EQUAL(1, GetSetting(Setting::ScanDuration));
+    TEST_ASSERT_TRUE(GetState().find("\"error\":\"scan_s\"}") !=
+                     std::string::npos);
+    Config("{\"scan_s\":99999999999999999999999}");
+    TEST_ASSERT_EQUAL(1, GetSetting(Setting::ScanDuration));
+    TEST_ASSERT_TRUE(GetState().find("\"error\":\"scan_s\"}") !=
+                     std::string::npos);
+    Config("{\"scan_s\":\"2\"}");
+    TEST_ASSERT_EQUAL(1, GetSetting(Setting::ScanDuration));
+    TEST_ASSERT_TRUE(GetState().find("\"error\":\"scan_s\"}") !=
+                     std::string::npos);
+}
+
+void test_mqtt_buffer_fits_payload(void) {
+    Config("{\"mqtt_buffer\":512}");
+    TEST_ASSERT_EQUAL(1024, GetSetting(Setting::MQTTBufferSize));
+    TEST_ASSERT_TRUE(GetState().find("\"error\":\"mqtt_buffer\"}") !=
+                     std::string::npos);
+    Config("{\"mqtt_buffer\":2048}");
+    TEST_ASSERT_EQUAL(2048, GetSetting(Setting::MQTTBufferSize));
+}
+
+/**
+ * @brief A scan must fit in the BLE window of the radio period.
+ */
+void test_scan_longer_than_ble_window(void) {
+    // 5000 ms * 10 % is shorter than a scan of 1 s.
+    Config("{\"radio_ms\":5000,\"ble_duty\":10}");
+    TEST_ASSERT_EQUAL(30000, GetSetting(Setting::RadioPeriod));
+    TEST_ASSERT_EQUAL(80, GetSetting(Setting::BLEDutyCycle));
+    TEST_ASSERT_TRUE(GetState().find("\"error\":\"scan_s\"}") !=
+                     std::string::npos);
+    // Checked with the current values of the keys not in the config.
+    Config("{\"radio_ms\":10000}");
+    TEST_ASSERT_EQUAL(10000, GetSetting(Setting::RadioPeriod));
+    Config("{\"scan_s\":9}");
+    TEST_ASSERT_EQUAL(1, GetSetting(Setting::ScanDuration));
+    GetState();
+    // Valid as a whole though not key by key.
+    Config("{\"scan_s\":9,\"radio_ms\":20000}");
+    TEST_ASSERT_EQUAL(9, GetSetting(Setting::ScanDuration));
+    TEST_ASSERT_EQUAL(20000, GetSetting(Setting::RadioPeriod));
+    TEST_ASSERT_TRUE(GetState().find("\"error\":null}") != std::string::npos);
+    TEST_ASSERT_FALSE(SetSetting(Setting::BLEDutyCycle, 10));
+    TEST_ASSERT_TRUE(SetSetting(Setting::BLEDutyCycle, 50));
+}
+
+void test_inconsistent_stored_settings_reset(void) {
+    Preferences prefs;
+    prefs.begin("settings");
+    prefs.putUInt("radio_ms", 5000);
+    prefs.putUInt("ble_duty", 10);
+    prefs.putUInt("notify_ms", 5000);
+    SettingsSetup("gw");
+    TEST_ASSERT_EQUAL(30000, GetSetting(Setting::RadioPeriod));
+    TEST_ASSERT_EQUAL(80, GetSetting(Setting::BLEDutyCycle));
+    TEST_ASSERT_EQUAL(10000, GetSetting(Setting::NotifyTimeout));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_config_applied);
+    RUN_TEST(test_config_rejected_as_whole);
+    RUN_TEST(test_mqtt_buffer_fits_payload);
+    RUN_TEST(test_scan_longer_than_ble_window);
+    RUN_TEST(test_inconsistent_stored_settings_reset);
+    return UNITY_END();
+}
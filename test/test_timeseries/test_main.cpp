@@ -0,0 +1,223 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the Gorilla encoding of the sample blocks.
+ */
+#include <unity.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "timeseries.h"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+struct Sample {
+    uint32_t time;
+    float value;
+};
+
+/**
+ * @brief Encode the samples and check that they are decoded bit for bit.
+ * @return size_t The encoded length.
+ */
+static size_t AssertRoundTrip(const std::vector<Sample>& samples) {
+    std::vector<uint8_t> buffer(16 * samples.size() + 16);
+    TimeSeriesEncoder encoder(buffer.data(), buffer.size());
+    for (const Sample& sample : samples) {
+        TEST_ASSERT_TRUE(encoder.Append(sample.time, sample.value));
+    }
+    TEST_ASSERT_EQUAL(samples.size(), encoder.GetSampleNum());
+    TEST_ASSERT_EQUAL(samples.front().time, encoder.GetStartTime());
+    TEST_ASSERT_EQUAL(samples.back().time, encoder.GetEndTime());
+    TimeSeriesDecoder decoder(buffer.data(), encoder.GetLength(),
+                              encoder.GetSampleNum());
+    for (const Sample& sample : samples) {
+        uint32_t time = 0;
+        float value = 0;
+        TEST_ASSERT_TRUE(decoder.Next(time, value));
+        TEST_ASSERT_EQUAL(sample.time, time);
+        TEST_ASSERT_EQUAL_MEMORY(&sample.value, &value, sizeof(value));
+    }
+    uint32_t time = 0;
+    float value = 0;
+    TEST_ASSERT_FALSE(decoder.Next(time, value));
+    return encoder.GetLength();
+}
+
+void test_regular_interval(void) {
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < 100; ++i) {
+        samples.push_back({1700000000 + 30 * i, 21.5F});
+    }
+    // 64 bits of the first sample, 9 bits of the first interval and 1 bit
+    // of the value, then 2 bits of each repeated sample.
+    TEST_ASSERT_EQUAL((64 + 10 + 2 * 98 + 7) / 8, AssertRoundTrip(samples));
+}
+
+void test_delta_of_delta_ranges(void) {
+    // Changes of the interval in each range of the timestamp encoding.
+    const int32_t changes[] = {0,    1,    -1,    63,    -64,     64,
+                               -65,  255,  -256,  256,   -257,    2047,
+                               -2048, 2048, -2049, 100000, -100000, 0};
+    std::vector<Sample> samples;
+    uint32_t time = 1700000000;
+    int64_t delta = 200000;
+    samples.push_back({time, 0.0F});
+    for (int32_t change : changes) {
+        delta += change;
+        time += static_cast<uint32_t>(delta);
+        samples.push_back({time, 0.0F});
+    }
+    samples.push_back({time, 0.0F});  // The same time again.
+    AssertRoundTrip(samples);
+}
+
+void test_values(void) {
+    const float values[] = {21.5F,
+                            21.6F,
+                            21.6F,
+                            -40.0F,
+                            0.0F,
+                            -0.0F,
+                            1e-30F,
+                            3.4e38F,
+                            std::numeric_limits<float>::infinity(),
+                            std::numeric_limits<float>::quiet_NaN(),
+                            21.7F,
+                            21.8F};
+    std::vector<Sample> samples;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        samples.push_back({static_cast<uint32_t>(60 * i), values[i]});
+    }
+    AssertRoundTrip(samples);
+}
+
+void test_time_backward_rejected(void) {
+    uint8_t buffer[64];
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(encoder.Append(1000, 1.0F));
+    TEST_ASSERT_TRUE(encoder.Append(1030, 2.0F));
+    TEST_ASSERT_FALSE(encoder.Append(1029, 3.0F));
+    TEST_ASSERT_EQUAL(2, encoder.GetSampleNum());
+    TEST_ASSERT_EQUAL(1030, encoder.GetEndTime());
+}
+
+void test_full_block_rejects_whole_sample(void) {
+    uint8_t buffer[16];
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    float value = 1.0F;
+    uint32_t time = 0;
+    while (encoder.Append(time, value)) {
+        time += 17 + time % 7;
+        value = value * 1.37F + 0.11F;
+    }
+    uint16_t sample_num = encoder.GetSampleNum();
+    size_t length = encoder.GetLength();
+    TEST_ASSERT_GREATER_THAN(1, sample_num);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(buffer), length);
+    // The rejected sample leaves no bits behind.
+    TimeSeriesDecoder decoder(buffer, sizeof(buffer), sample_num);
+    uint32_t decoded_time = 0;
+    float decoded_value = 0;
+    size_t decoded_num = 0;
+    while (decoder.Next(decoded_time, decoded_value)) {
+        ++decoded_num;
+    }
+    TEST_ASSERT_EQUAL(sample_num, decoded_num);
+    encoder.Clear();
+    TEST_ASSERT_EQUAL(0, encoder.GetSampleNum());
+    TEST_ASSERT_EQUAL(0, encoder.GetLength());
+    TEST_ASSERT_TRUE(encoder.Append(5, 2.0F));
+}
+
+void test_corrupted_block(void) {
+    uint8_t buffer[32];
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    encoder.Append(1000, 1.0F);
+    encoder.Append(1010, 2.0F);
+    uint32_t time = 0;
+    float value = 0;
+    // More samples claimed than encoded, and a truncated first sample.
+    TimeSeriesDecoder truncated(buffer, encoder.GetLength(), 100);
+    size_t decoded_num = 0;
+    while (truncated.Next(time, value)) {
+        ++decoded_num;
+    }
+    TEST_ASSERT_LESS_THAN(100, decoded_num);
+    TimeSeriesDecoder short_block(buffer, 7, 1);
+    TEST_ASSERT_FALSE(short_block.Next(time, value));
+    // A value in the previous window before any window exists.
+    uint8_t invalid[16] = {0};
+    invalid[8] = 0x40;  // Timestamp `0`, value `10`.
+    TimeSeriesDecoder no_window(invalid, sizeof(invalid), 2);
+    TEST_ASSERT_TRUE(no_window.Next(time, value));
+    TEST_ASSERT_FALSE(no_window.Next(time, value));
+}
+
+/**
+ * @brief A day of a thermometer with 0.1 °C resolution sampled every 30 s.
+ */
+void test_benchmark_temperature(void) {
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < 2880; ++i) {
+        float value =
+            std::round(10 * (21.0 + 3.0 * std::sin(i * 2 * M_PI / 2880))) /
+            10.0F;
+        uint32_t jitter = (i % 5 == 0) ? 1 : 0;
+        samples.push_back({1700000000 + 30 * i + jitter, value});
+    }
+    std::vector<uint8_t> buffer(16 * samples.size());
+    const size_t repeat_num = 200;
+    size_t length = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat_num; ++i) {
+        TimeSeriesEncoder encoder(buffer.data(), buffer.size());
+        for (const Sample& sample : samples) {
+            encoder.Append(sample.time, sample.value);
+        }
+        length = encoder.GetLength();
+    }
+    double encode_ns = std::chrono::duration<double, std::nano>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    start = std::chrono::steady_clock::now();
+    size_t decoded_num = 0;
+    for (size_t i = 0; i < repeat_num; ++i) {
+        TimeSeriesDecoder decoder(buffer.data(), length, samples.size());
+        uint32_t time = 0;
+        float value = 0;
+        while (decoder.Next(time, value)) {
+            ++decoded_num;
+        }
+    }
+    double decode_ns = std::chrono::duration<double, std::nano>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    TEST_ASSERT_EQUAL(samples.size() * repeat_num, decoded_num);
+    double sample_num = samples.size() * repeat_num;
+    char message[128];
+    snprintf(message, sizeof(message),
+             "%.2f B/sample, append %.1f ns, decode %.1f ns per sample",
+             static_cast<double>(length) / samples.size(),
+             encode_ns / sample_num, decode_ns / sample_num);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_regular_interval);
+    RUN_TEST(test_delta_of_delta_ranges);
+    RUN_TEST(test_values);
+    RUN_TEST(test_time_backward_rejected);
+    RUN_TEST(test_full_block_rejects_whole_sample);
+    RUN_TEST(test_corrupted_block);
+    RUN_TEST(test_benchmark_temperature);
+    return UNITY_END();
+}
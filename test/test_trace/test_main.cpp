@@ -0,0 +1,112 @@
+/**
+ * @file test_main.cpp
+ * @author hktkzyx (hktkzyx@yeah.net)
+ * @brief Tests of the trace ring kept across resets.
+ */
+#include <Arduino.h>
+#include <unity.h>
+
+#include "trace.h"
+
+void setUp(void) {
+    FakeMillis() = 0;
+    TraceSetup();
+}
+
+void tearDown(void) {}
+
+void test_restore_after_reset(void) {
+    TraceBegin(TraceStage::Scan, 0);
+    delay(100);
+    TraceEnd(TraceStage::Scan, 0);
+    TraceBegin(TraceStage::Connect, 0x3456);
+    // The watchdog resets in the middle of a stage.
+    TraceSetup();
+    size_t num = 0;
+    const TraceEvent* pEvents = GetPreviousTrace(num);
+    TEST_ASSERT_NOT_NULL(pEvents);
+    TEST_ASSERT_EQUAL(3, num);
+    TEST_ASSERT_EQUAL(static_cast<int>(TraceStage::Scan),
+                      static_cast<int>(pEvents[0].stage));
+    TEST_ASSERT_EQUAL(static_cast<int>(TraceEventKind::End),
+                      static_cast<int>(pEvents[1].kind));
+    TEST_ASSERT_EQUAL(100, pEvents[1].time);
+    TEST_ASSERT_EQUAL(static_cast<int>(TraceStage::Connect),
+                      static_cast<int>(pEvents[2].stage));
+    TEST_ASSERT_EQUAL(0x3456, pEvents[2].tag);
+    // The trace of this boot is empty but kept.
+    TraceSetup();
+    TEST_ASSERT_NOT_NULL(GetPreviousTrace(num));
+    TEST_ASSERT_EQUAL(0, num);
+}
+
+void test_wrap_around(void) {
+    for (uint16_t i = 0; i < 100; ++i) {
+        FakeMillis() = i;
+        TraceBegin(TraceStage::Publish, i);
+        TraceEnd(TraceStage::Publish, i);
+    }
+    TraceSetup();
+    size_t num = 0;
+    const TraceEvent* pEvents = GetPreviousTrace(num);
+    TEST_ASSERT_NOT_NULL(pEvents);
+    TEST_ASSERT_EQUAL(64, num);
+    // The last 32 stages, oldest first.
+    for (size_t i = 0; i < num; ++i) {
+        TEST_ASSERT_EQUAL(68 + i / 2, pEvents[i].tag);
+        TEST_ASSERT_EQUAL(68 + i / 2, pEvents[i].time);
+        TEST_ASSERT_EQUAL(
+            static_cast<int>(i % 2 ? TraceEventKind::End
+                                   : TraceEventKind::Begin),
+            static_cast<int>(pEvents[i].kind));
+    }
+}
+
+void test_corrupt_header(void) {
+    TraceBegin(TraceStage::Scan, 0);
+    // The RTC memory holds garbage after power on.
+    const uint8_t fills[] = {0x00, 0xA5, 0xFF};
+    for (uint8_t fill : fills) {
+        FakeRTCPowerOn(fill);
+        TraceSetup();
+        size_t num = 1;
+        TEST_ASSERT_NULL(GetPreviousTrace(num));
+        TEST_ASSERT_EQUAL(0, num);
+    }
+    // The new trace is valid after the garbage.
+    TraceBegin(TraceStage::Scan, 0);
+    TraceSetup();
+    size_t num = 0;
+    TEST_ASSERT_NOT_NULL(GetPreviousTrace(num));
+    TEST_ASSERT_EQUAL(1, num);
+}
+
+void test_over_budget(void) {
+    TraceStatistics start = GetTraceStatistics();
+    SetTraceBudget(TraceStage::NotifyWait, 30000);
+    TraceBegin(TraceStage::NotifyWait, 1);
+    delay(30000);
+    TraceEnd(TraceStage::NotifyWait, 1);
+    TraceBegin(TraceStage::NotifyWait, 2);
+    delay(30001);
+    TraceEnd(TraceStage::NotifyWait, 2);
+    TEST_ASSERT_EQUAL(1, GetTraceStatistics().over_budget_num -
+                             start.over_budget_num);
+    TraceSetup();
+    size_t num = 0;
+    const TraceEvent* pEvents = GetPreviousTrace(num);
+    TEST_ASSERT_EQUAL(4, num);
+    TEST_ASSERT_EQUAL(static_cast<int>(TraceEventKind::End),
+                      static_cast<int>(pEvents[1].kind));
+    TEST_ASSERT_EQUAL(static_cast<int>(TraceEventKind::OverBudget),
+                      static_cast<int>(pEvents[3].kind));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_restore_after_reset);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_corrupt_header);
+    RUN_TEST(test_over_budget);
+    return UNITY_END();
+}